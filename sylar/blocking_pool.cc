@@ -0,0 +1,151 @@
+/**
+ * @file blocking_pool.cc
+ * @brief 阻塞调用卸载线程池实现
+ * @version 0.1
+ * @date 2026-10-16
+ */
+#include "blocking_pool.h"
+#include "config.h"
+#include "fiber.h"
+#include "iomanager.h"
+#include "hook.h"
+#include "util.h"
+
+namespace sylar {
+
+static ConfigVar<uint32_t>::ptr g_blocking_pool_threads =
+    Config::Lookup<uint32_t>("blocking_pool.threads", 4, "blocking call offload thread count");
+
+static ConfigVar<uint32_t>::ptr g_blocking_pool_max_queue =
+    Config::Lookup<uint32_t>("blocking_pool.max_queue", 1024,
+                             "max queued blocking calls, calls beyond it run on the calling thread");
+
+BlockingPool::BlockingPool()
+{
+}
+
+BlockingPool::~BlockingPool()
+{
+    {
+        MutexType::Lock lock(m_mutex);
+        m_stopping = true;
+    }
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_sem.notify();
+    }
+    for (auto &i : m_threads)
+    {
+        i->join();
+    }
+}
+
+void BlockingPool::run(std::function<void()> cb)
+{
+    // 只有IOManager的任务协程可以让出等待，其它情况(比如调度线程的idle协程、普通线程)直接执行
+    IOManager *iom = IOManager::GetThis();
+    if (!iom || !is_hook_enable() || Fiber::GetThis().get() == Scheduler::GetMainFiber())
+    {
+        cb();
+        return;
+    }
+
+    Task task;
+    task.cb        = &cb;
+    task.iom       = iom;
+    task.fiber     = Fiber::GetThis();
+    task.enqueueUs = GetCurrentUS();
+    // 任务放进队列之后池线程随时可能执行完并注销等待，要先登记
+    iom->addExternalWait();
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopping || m_tasks.size() >= g_blocking_pool_max_queue->getValue())
+        {
+            lock.unlock();
+            iom->doneExternalWait();
+            ++m_rejectCount;
+            cb();
+            return;
+        }
+        if (m_threads.empty())
+        {
+            uint32_t count = std::max(g_blocking_pool_threads->getValue(), 1u);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                m_threads.push_back(std::make_shared<Thread>(std::bind(&BlockingPool::work, this),
+                                                             "blocking_pool_" + std::to_string(i)));
+            }
+        }
+        m_tasks.push_back(&task);
+        UpdateMax(m_maxDepth, m_tasks.size());
+    }
+    // 协程让出之前就可能被池线程放回调度器，调度器会等它让出之后再恢复
+    m_sem.notify();
+    Fiber::GetThis()->yield();
+    if (task.exception)
+    {
+        std::rethrow_exception(task.exception);
+    }
+}
+
+size_t BlockingPool::getQueueDepth()
+{
+    MutexType::Lock lock(m_mutex);
+    return m_tasks.size();
+}
+
+void BlockingPool::work()
+{
+    while (true)
+    {
+        m_sem.wait();
+        Task *task = nullptr;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_tasks.empty())
+            {
+                if (m_stopping)
+                {
+                    return;
+                }
+                continue;
+            }
+            task = m_tasks.front();
+            m_tasks.pop_front();
+        }
+
+        uint64_t begin = GetCurrentUS();
+        uint64_t wait  = begin - task->enqueueUs;
+        try {
+            (*task->cb)();
+        } catch (...) {
+            // 异常交给发起的协程重新抛出
+            task->exception = std::current_exception();
+        }
+        ++m_taskCount;
+        m_totalWaitUs += wait;
+        UpdateMax(m_maxWaitUs, wait);
+        m_totalRunUs += GetCurrentUS() - begin;
+
+        // 协程放回调度器之后task所在的栈随时可能被释放，先取出需要的字段
+        IOManager *iom    = task->iom;
+        Fiber::ptr fiber  = std::move(task->fiber);
+        iom->schedule(fiber);
+        iom->doneExternalWait();
+    }
+}
+
+void BlockingPool::UpdateMax(std::atomic<uint64_t> &max, uint64_t value)
+{
+    uint64_t old = max;
+    while (value > old && !max.compare_exchange_weak(old, value))
+    {
+    }
+}
+
+void async_blocking(std::function<void()> cb)
+{
+    BlockingPoolMgr::GetInstance()->run(std::move(cb));
+}
+
+}
@@ -0,0 +1,115 @@
+/**
+ * @file blocking_pool.h
+ * @brief 阻塞调用卸载线程池
+ * @details 普通文件的读写、open、stat、fsync、getaddrinfo这类调用没有就绪通知，在IO协程里直接调用会阻塞整个调度线程。
+ *          这些调用交给一个固定大小的辅助线程池执行，发起的协程让出，执行完成后再由池线程把协程放回调度器
+ * @version 0.1
+ * @date 2026-10-16
+ */
+#ifndef __SYLAR_BLOCKING_POOL_H__
+#define __SYLAR_BLOCKING_POOL_H__
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "thread.h"
+#include "singleton.h"
+
+namespace sylar {
+
+class Fiber;
+class IOManager;
+
+/**
+ * @brief 阻塞调用线程池
+ * @details 线程数和队列长度由配置blocking_pool.threads和blocking_pool.max_queue决定，第一次提交任务时创建线程。
+ *          队列满、或者当前不在IO协程里时任务直接在调用线程上执行
+ */
+class BlockingPool : Noncopyable {
+public:
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 构造函数
+     */
+    BlockingPool();
+
+    /**
+     * @brief 析构函数，等待池线程执行完队列中的任务后退出
+     */
+    ~BlockingPool();
+
+    /**
+     * @brief 在池线程上执行cb，当前协程让出直到执行完成
+     * @details 不在IOManager的任务协程里时直接在当前线程执行，cb抛出的异常在当前协程里重新抛出
+     */
+    void run(std::function<void()> cb);
+
+    /// 当前排队的任务数
+    size_t getQueueDepth();
+    /// 排队任务数的最大值
+    size_t getMaxQueueDepth() const { return m_maxDepth; }
+    /// 在池线程上执行过的任务数
+    uint64_t getTaskCount() const { return m_taskCount; }
+    /// 队列已满而在调用线程上执行的任务数
+    uint64_t getRejectCount() const { return m_rejectCount; }
+    /// 任务排队时间总和，微秒
+    uint64_t getTotalWaitUs() const { return m_totalWaitUs; }
+    /// 任务排队时间最大值，微秒
+    uint64_t getMaxWaitUs() const { return m_maxWaitUs; }
+    /// 任务执行时间总和，微秒
+    uint64_t getTotalRunUs() const { return m_totalRunUs; }
+
+private:
+    /**
+     * @brief 排队的任务，放在发起协程的栈上，协程恢复前一直有效
+     */
+    struct Task {
+        std::function<void()> *cb;
+        IOManager *iom;
+        std::shared_ptr<Fiber> fiber;
+        uint64_t enqueueUs;
+        std::exception_ptr exception;
+    };
+
+    /**
+     * @brief 池线程主循环
+     */
+    void work();
+
+    /**
+     * @brief 把value记入最大值
+     */
+    static void UpdateMax(std::atomic<uint64_t> &max, uint64_t value);
+
+private:
+    MutexType m_mutex;
+    /// 有任务或需要退出时通知池线程
+    Semaphore m_sem;
+    std::deque<Task *> m_tasks;
+    std::vector<Thread::ptr> m_threads;
+    bool m_stopping = false;
+
+    std::atomic<uint64_t> m_maxDepth    = {0};
+    std::atomic<uint64_t> m_taskCount   = {0};
+    std::atomic<uint64_t> m_rejectCount = {0};
+    std::atomic<uint64_t> m_totalWaitUs = {0};
+    std::atomic<uint64_t> m_maxWaitUs   = {0};
+    std::atomic<uint64_t> m_totalRunUs  = {0};
+};
+
+/// 阻塞调用线程池单例
+typedef Singleton<BlockingPool> BlockingPoolMgr;
+
+/**
+ * @brief 在阻塞调用线程池上执行cb，当前协程让出直到执行完成
+ * @details cb里的调用不经过hook，errno等线程局部的状态要在cb里自己取出来
+ */
+void async_blocking(std::function<void()> cb);
+
+}
+
+#endif
@@ -1,10 +1,16 @@
 #include "bytearray.h"
+#include <atomic>
 #include <fstream>
 #include <sstream>
 #include <string.h>
 #include <iomanip>
 #include <cmath>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
+#include "config.h"
 #include "endian.h"
 #include "log.h"
 
@@ -12,8 +18,150 @@ namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+/// 每个线程最多缓存的内存块字节数，0表示不缓存
+static ConfigVar<uint64_t>::ptr g_bytearray_pool_max_bytes =
+    Config::Lookup<uint64_t>("bytearray.pool.max_bytes", 4 * 1024 * 1024, "max cached bytearray node bytes per thread");
+
+static std::atomic<uint64_t> s_pool_max_bytes{4 * 1024 * 1024};
+
+/// 缓存池命中次数
+static std::atomic<uint64_t> s_pool_hits{0};
+/// 缓存池未命中次数
+static std::atomic<uint64_t> s_pool_misses{0};
+/// 缓存池已满释放的次数
+static std::atomic<uint64_t> s_pool_drops{0};
+/// 所有线程缓存的字节数
+static std::atomic<uint64_t> s_pool_cached{0};
+
+namespace {
+struct _ByteArrayPoolIniter 
+{
+    _ByteArrayPoolIniter() 
+    {
+        s_pool_max_bytes = g_bytearray_pool_max_bytes->getValue();
+        g_bytearray_pool_max_bytes->addListener(
+            [](const uint64_t &ov, const uint64_t &nv) 
+            {
+                s_pool_max_bytes = nv;
+            });
+    }
+};
+static _ByteArrayPoolIniter _bytearray_pool_init;
+} // namespace
+
+/// 每个线程缓存的内存块大小种类数，一个程序里用到的base_size通常只有几种
+static const size_t NODE_POOL_BUCKETS = 8;
+
+/**
+ * @brief 线程内的空闲内存块缓存
+ * @details 按内存块大小分组，空闲内存块的前几个字节用来保存下一个空闲块的地址。
+ *          ByteArray可能在别的线程释放，内存块就归还到释放所在线程的缓存中
+ */
+struct NodePool 
+{
+    struct Bucket 
+    {
+        /// 内存块大小，0表示未使用
+        size_t size;
+        /// 空闲链表头
+        char *head;
+    };
+
+    Bucket buckets[NODE_POOL_BUCKETS];
+    /// 缓存的总字节数
+    uint64_t bytes;
+
+    /**
+     * @brief 返回size大小的内存块对应的分组，分组用完或者内存块放不下链表指针时返回nullptr
+     */
+    Bucket *get(size_t size) 
+    {
+        if (size < sizeof(char *)) 
+        {
+            return nullptr;
+        }
+        for (size_t i = 0; i < NODE_POOL_BUCKETS; ++i) 
+        {
+            if (buckets[i].size == size) 
+            {
+                return &buckets[i];
+            }
+            if (buckets[i].size == 0) 
+            {
+                buckets[i].size = size;
+                return &buckets[i];
+            }
+        }
+        return nullptr;
+    }
+
+    ~NodePool();
+};
+
+/// 线程局部变量，标记本线程的缓存已析构，之后释放的内存块直接delete
+static thread_local bool t_node_pool_destroyed = false;
+
+/// 线程局部变量，本线程的内存块缓存
+static thread_local NodePool t_node_pool = {};
+
+NodePool::~NodePool() 
+{
+    t_node_pool_destroyed = true;
+    for (auto &i : buckets) 
+    {
+        while (i.head) 
+        {
+            char *next = *(char **)i.head;
+            delete[] i.head;
+            i.head = next;
+        }
+    }
+    s_pool_cached -= bytes;
+}
+
+static char *AllocChunk(size_t size) 
+{
+    NodePool::Bucket *bucket = t_node_pool_destroyed ? nullptr : t_node_pool.get(size);
+    if (bucket && bucket->head) 
+    {
+        char *ptr = bucket->head;
+        bucket->head = *(char **)ptr;
+        t_node_pool.bytes -= size;
+        s_pool_cached.fetch_sub(size, std::memory_order_relaxed);
+        s_pool_hits.fetch_add(1, std::memory_order_relaxed);
+        return ptr;
+    }
+    s_pool_misses.fetch_add(1, std::memory_order_relaxed);
+    return new char[size];
+}
+
+static void FreeChunk(char *ptr, size_t size) 
+{
+    NodePool::Bucket *bucket = t_node_pool_destroyed ? nullptr : t_node_pool.get(size);
+    if (bucket && t_node_pool.bytes + size <= s_pool_max_bytes.load(std::memory_order_relaxed)) 
+    {
+        *(char **)ptr = bucket->head;
+        bucket->head = ptr;
+        t_node_pool.bytes += size;
+        s_pool_cached.fetch_add(size, std::memory_order_relaxed);
+        return;
+    }
+    s_pool_drops.fetch_add(1, std::memory_order_relaxed);
+    delete[] ptr;
+}
+
+ByteArray::PoolStats ByteArray::GetPoolStats() 
+{
+    PoolStats stats;
+    stats.hits         = s_pool_hits;
+    stats.misses       = s_pool_misses;
+    stats.drops        = s_pool_drops;
+    stats.cached_bytes = s_pool_cached;
+    return stats;
+}
+
 ByteArray::Node::Node(size_t s)
-    :ptr(new char[s])
+    :ptr(AllocChunk(s))
     ,next(nullptr)
     ,size(s) {
 }
@@ -28,12 +176,13 @@ ByteArray::Node::~Node()
 {
     if(ptr) 
     {
-        delete[] ptr;
+        FreeChunk(ptr, size);
     }
 }
 
 ByteArray::ByteArray(size_t base_size)
     :m_baseSize(base_size)
+    ,m_baseMask(base_size > 1 && (base_size & (base_size - 1)) == 0 ? base_size - 1 : 0)
     ,m_position(0)
     ,m_capacity(base_size)
     ,m_size(0)
@@ -71,71 +220,6 @@ void ByteArray::setIsLittleEndian(bool val)
     }
 }
 
-void ByteArray::writeFint8  (int8_t value) 
-{
-    // 因为就写一个字节的数据所以不需要考虑字节序
-    write(&value, sizeof(value));
-}
-
-void ByteArray::writeFuint8 (uint8_t value) 
-{
-    write(&value, sizeof(value));
-}
-void ByteArray::writeFint16 (int16_t value) 
-{
-    // 不等于我机器上的字节序，需要转一下再写
-    if(m_endian != SYLAR_BYTE_ORDER) 
-    {
-        value = byteswap(value);
-    }
-    write(&value, sizeof(value));
-}
-
-void ByteArray::writeFuint16(uint16_t value) 
-{
-    if(m_endian != SYLAR_BYTE_ORDER) 
-    {
-        value = byteswap(value);
-    }
-    write(&value, sizeof(value));
-}
-
-void ByteArray::writeFint32 (int32_t value) 
-{
-    if(m_endian != SYLAR_BYTE_ORDER) 
-    {
-        value = byteswap(value);
-    }
-    write(&value, sizeof(value));
-}
-
-void ByteArray::writeFuint32(uint32_t value) 
-{
-    if(m_endian != SYLAR_BYTE_ORDER) 
-    {
-        value = byteswap(value);
-    }
-    write(&value, sizeof(value));
-}
-
-void ByteArray::writeFint64 (int64_t value) 
-{
-    if(m_endian != SYLAR_BYTE_ORDER) 
-    {
-        value = byteswap(value);
-    }
-    write(&value, sizeof(value));
-}
-
-void ByteArray::writeFuint64(uint64_t value) 
-{
-    if(m_endian != SYLAR_BYTE_ORDER) 
-    {
-        value = byteswap(value);
-    }
-    write(&value, sizeof(value));
-}
-
 // 将int32_t类型的数据用zigzag算法编码：1 -> 2, -1 -> 1, -1000 -> 1999
 static uint32_t EncodeZigzag32(const int32_t& v) 
 {
@@ -262,60 +346,6 @@ void ByteArray::writeStringWithoutLength(const std::string& value)
     write(value.c_str(), value.size());
 }
 
-int8_t   ByteArray::readFint8() 
-{
-    int8_t v;
-    read(&v, sizeof(v));
-    return v;
-}
-
-uint8_t  ByteArray::readFuint8() 
-{
-    uint8_t v;
-    read(&v, sizeof(v));
-    return v;
-}
-
-#define XX(type) \
-    type v; \
-    read(&v, sizeof(v)); \
-    if(m_endian == SYLAR_BYTE_ORDER) { \
-        return v; \
-    } else { \
-        return byteswap(v); \
-    }
-
-int16_t  ByteArray::readFint16() 
-{
-    XX(int16_t);
-}
-uint16_t ByteArray::readFuint16() 
-{
-    XX(uint16_t);
-}
-
-int32_t  ByteArray::readFint32() 
-{
-    XX(int32_t);
-}
-
-uint32_t ByteArray::readFuint32() 
-{
-    XX(uint32_t);
-}
-
-int64_t  ByteArray::readFint64() 
-{
-    XX(int64_t);
-}
-
-uint64_t ByteArray::readFuint64() 
-{
-    XX(uint64_t);
-}
-
-#undef XX
-
 int32_t  ByteArray::readInt32() 
 {
     return DecodeZigzag32(readUint32());
@@ -364,6 +394,223 @@ uint64_t ByteArray::readUint64()
     return result;
 }
 
+// 批量Varint编解码，数组元素和Varint无符号值之间的转换
+static inline uint32_t ToVarint(uint32_t v) { return v; }
+static inline uint32_t ToVarint(int32_t v)  { return EncodeZigzag32(v); }
+static inline uint64_t ToVarint(uint64_t v) { return v; }
+static inline uint64_t ToVarint(int64_t v)  { return EncodeZigzag64(v); }
+
+static inline void FromVarint(uint32_t v, uint32_t& out) { out = v; }
+static inline void FromVarint(uint32_t v, int32_t& out)  { out = DecodeZigzag32(v); }
+static inline void FromVarint(uint64_t v, uint64_t& out) { out = v; }
+static inline void FromVarint(uint64_t v, int64_t& out)  { out = DecodeZigzag64(v); }
+
+/**
+ * @brief 把16个单字节编码(都小于0x80)展开成16个元素
+ */
+template<class T>
+static inline void StoreSingleBytes(const uint8_t* p, T* out) 
+{
+    for(int i = 0; i < 16; ++i) 
+    {
+        FromVarint((decltype(ToVarint(T())))p[i], out[i]);
+    }
+}
+
+#ifdef __SSE2__
+template<>
+inline void StoreSingleBytes(const uint8_t* p, uint32_t* out) 
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    _mm_storeu_si128((__m128i*)out,        _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*)(out + 4),  _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*)(out + 8),  _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i*)(out + 12), _mm_unpackhi_epi16(hi, zero));
+}
+
+template<>
+inline void StoreSingleBytes(const uint8_t* p, uint64_t* out) 
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    __m128i words[4] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                        _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+    for(int i = 0; i < 4; ++i) 
+    {
+        _mm_storeu_si128((__m128i*)(out + i * 4),     _mm_unpacklo_epi32(words[i], zero));
+        _mm_storeu_si128((__m128i*)(out + i * 4 + 2), _mm_unpackhi_epi32(words[i], zero));
+    }
+}
+#endif
+
+template<class T>
+void ByteArray::writeVarintArray(const T* values, size_t count) 
+{
+    // 每个元素最多占用的字节数，每批最多编码的元素个数
+    static const size_t MAX_LEN = (sizeof(T) * 8 + 6) / 7;
+    static const size_t BATCH = 64;
+    uint8_t tmp[BATCH * MAX_LEN];
+
+    while(count > 0) 
+    {
+        size_t n = std::min(count, BATCH);
+        size_t npos = m_position % m_baseSize;
+        // 当前内存块放得下这一批时直接编码到内存块中
+        bool direct = m_cur && m_cur->size - npos >= n * MAX_LEN;
+        uint8_t* begin = direct ? (uint8_t*)m_cur->ptr + npos : tmp;
+        uint8_t* p = begin;
+        for(size_t i = 0; i < n; ++i) 
+        {
+            auto v = ToVarint(values[i]);
+            while(v >= 0x80) 
+            {
+                *p++ = (v & 0x7F) | 0x80;
+                v >>= 7;
+            }
+            *p++ = v;
+        }
+        size_t len = p - begin;
+        if(direct) 
+        {
+            if(m_cur->size == npos + len) 
+            {
+                m_cur = m_cur->next;
+            }
+            m_position += len;
+            if(m_position > m_size) 
+            {
+                m_size = m_position;
+            }
+        } 
+        else 
+        {
+            write(tmp, len);
+        }
+        values += n;
+        count -= n;
+    }
+}
+
+template<class T>
+void ByteArray::readVarintArray(T* values, size_t count) 
+{
+    typedef decltype(ToVarint(T())) U;
+    static const size_t MAX_LEN = (sizeof(T) * 8 + 6) / 7;
+
+    size_t i = 0;
+    while(i < count) 
+    {
+        if(getReadSize() == 0) 
+        {
+            throw std::out_of_range("not enough len");
+        }
+        size_t npos = m_position % m_baseSize;
+        const uint8_t* begin = (const uint8_t*)m_cur->ptr + npos;
+        const uint8_t* end = begin + std::min(m_cur->size - npos, getReadSize());
+        const uint8_t* p = begin;
+        while(i < count) 
+        {
+            // 连续16个单字节编码一次展开
+            if(count - i >= 16 && end - p >= 16) 
+            {
+#ifdef __SSE2__
+                bool single = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p)) == 0;
+#else
+                bool single = true;
+                for(int k = 0; k < 16; ++k) 
+                {
+                    single = single && p[k] < 0x80;
+                }
+#endif
+                if(single) 
+                {
+                    StoreSingleBytes(p, values + i);
+                    p += 16;
+                    i += 16;
+                    continue;
+                }
+            }
+            // 剩余的数据可能不够一个完整的编码，交给逐个读取处理
+            if(end - p < (ptrdiff_t)MAX_LEN) 
+            {
+                break;
+            }
+            U result = 0;
+            for(size_t k = 0, shift = 0; k < MAX_LEN; ++k, shift += 7) 
+            {
+                uint8_t b = *p++;
+                result |= ((U)(b & 0x7f)) << shift;
+                if(b < 0x80) 
+                {
+                    break;
+                }
+            }
+            FromVarint(result, values[i++]);
+        }
+
+        size_t len = p - begin;
+        if(len > 0) 
+        {
+            if(m_cur->size == npos + len) 
+            {
+                m_cur = m_cur->next;
+            }
+            m_position += len;
+        }
+        if(i < count && (size_t)(end - p) < MAX_LEN) 
+        {
+            // 跨越内存块边界或者在数据末尾的元素
+            U result = sizeof(T) == 4 ? (U)readUint32() : (U)readUint64();
+            FromVarint(result, values[i++]);
+        }
+    }
+}
+
+void ByteArray::writeInt32Array (const int32_t* values, size_t count) 
+{
+    writeVarintArray(values, count);
+}
+
+void ByteArray::writeUint32Array(const uint32_t* values, size_t count) 
+{
+    writeVarintArray(values, count);
+}
+
+void ByteArray::writeInt64Array (const int64_t* values, size_t count) 
+{
+    writeVarintArray(values, count);
+}
+
+void ByteArray::writeUint64Array(const uint64_t* values, size_t count) 
+{
+    writeVarintArray(values, count);
+}
+
+void ByteArray::readInt32Array (int32_t* values, size_t count) 
+{
+    readVarintArray(values, count);
+}
+
+void ByteArray::readUint32Array(uint32_t* values, size_t count) 
+{
+    readVarintArray(values, count);
+}
+
+void ByteArray::readInt64Array (int64_t* values, size_t count) 
+{
+    readVarintArray(values, count);
+}
+
+void ByteArray::readUint64Array(uint64_t* values, size_t count) 
+{
+    readVarintArray(values, count);
+}
+
 float    ByteArray::readFloat() 
 {
     uint32_t v = readFuint32();
@@ -772,7 +1019,12 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len) co
 uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers
                                 ,uint64_t len, uint64_t position) const 
 {
-    len = len > getReadSize() ? getReadSize() : len;
+    // 从position开始可读的数据是[position, m_size)，和m_position无关
+    if(position >= m_size) 
+    {
+        return 0;
+    }
+    len = len > (m_size - position) ? (m_size - position) : len;
     if(len == 0) 
     {
         return 0;
@@ -12,10 +12,13 @@
 #include <memory>
 #include <string>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <vector>
 
+#include "endian.h"
+
 namespace sylar {
 
 /**
@@ -54,6 +57,27 @@ public:
         size_t size;
     };
 
+    /**
+     * @brief 内存块缓存池统计
+     * @details 每个线程按内存块大小缓存释放的内存块，同样大小的ByteArray共用，
+     *          缓存的总字节数由bytearray.pool.max_bytes限制
+     */
+    struct PoolStats {
+        /// 从线程缓存池中取到内存块的次数
+        uint64_t hits = 0;
+        /// 缓存池中没有，需要new的次数
+        uint64_t misses = 0;
+        /// 缓存池已满，直接delete的次数
+        uint64_t drops = 0;
+        /// 所有线程缓存池中的字节数
+        uint64_t cached_bytes = 0;
+    };
+
+    /**
+     * @brief 获取内存块缓存池统计
+     */
+    static PoolStats GetPoolStats();
+
     /**
      * @brief 使用指定长度的内存块构造ByteArray
      * @param[in] base_size 内存块大小
@@ -149,6 +173,19 @@ public:
      */
     void writeUint64 (uint64_t value);
 
+    /**
+     * @brief 批量写入Varint编码的数组，编码结果和逐个调用writeInt32/writeUint32/writeInt64/writeUint64相同
+     * @details 当前内存块剩余空间足够时直接编码到内存块中，否则分批编码到栈上的缓存再写入
+     * @param[in] values 数组地址
+     * @param[in] count 元素个数
+     * @post m_position += 实际占用内存
+     *       如果m_position > m_size 则 m_size = m_position
+     */
+    void writeInt32Array (const int32_t* values, size_t count);
+    void writeUint32Array(const uint32_t* values, size_t count);
+    void writeInt64Array (const int64_t* values, size_t count);
+    void writeUint64Array(const uint64_t* values, size_t count);
+
     /**
      * @brief 写入float类型的数据（转成int32_t写的）
      * @post m_position += sizeof(value)
@@ -294,6 +331,20 @@ public:
      */
     uint64_t readUint64();
 
+    /**
+     * @brief 批量读取Varint编码的数组，可以读取逐个写入的数据
+     * @details 在当前内存块内连续解码，支持SSE2时16个连续的单字节编码一次解码；
+     *          跨越内存块边界的元素逐个读取
+     * @param[out] values 数组地址
+     * @param[in] count 元素个数
+     * @post m_position += 实际占用内存
+     * @exception 如果数据不足count个 抛出 std::out_of_range
+     */
+    void readInt32Array (int32_t* values, size_t count);
+    void readUint32Array(uint32_t* values, size_t count);
+    void readInt64Array (int64_t* values, size_t count);
+    void readUint64Array(uint64_t* values, size_t count);
+
     /**
      * @brief 读取float类型的数据
      * @pre getReadSize() >= sizeof(float)
@@ -439,7 +490,7 @@ public:
     /**
      * @brief 获取可读取的缓存,保存成iovec数组,从position位置开始
      * @param[out] buffers 保存可读取数据的iovec数组
-     * @param[in] len 读取数据的长度,如果len > getReadSize() 则 len = getReadSize()
+     * @param[in] len 读取数据的长度,如果len > getSize() - position 则 len = getSize() - position
      * @param[in] position 读取数据的位置
      * @return 返回实际数据的长度
      */
@@ -465,6 +516,68 @@ private:
      */
     void addCapacity(size_t size);
 
+    /**
+     * @brief 返回position在所在内存块中的偏移，内存块大小是2的幂时用掩码代替取模
+     */
+    size_t getNodeOffset(size_t position) const 
+    {
+        return m_baseMask ? (position & m_baseMask) : position % m_baseSize;
+    }
+
+    /**
+     * @brief 写入定长数据，value已经是目标字节序
+     * @details 数据完整落在当前内存块内时直接拷贝，跨越内存块边界时交给write处理
+     */
+    template<class T>
+    void writeFixed(T value) 
+    {
+        size_t npos = getNodeOffset(m_position);
+        // 严格大于，写完后m_cur不需要移动到下一个内存块
+        if(m_cur && m_cur->size - npos > sizeof(T)) 
+        {
+            memcpy(m_cur->ptr + npos, &value, sizeof(T));
+            m_position += sizeof(T);
+            if(m_position > m_size) 
+            {
+                m_size = m_position;
+            }
+            return;
+        }
+        write(&value, sizeof(T));
+    }
+
+    /**
+     * @brief 读取定长数据，返回值未做字节序转换
+     * @details 数据完整落在当前内存块内时直接拷贝，跨越内存块边界时交给read处理
+     * @exception 如果getReadSize() < sizeof(T) 抛出 std::out_of_range
+     */
+    template<class T>
+    T readFixed() 
+    {
+        T v;
+        size_t npos = getNodeOffset(m_position);
+        if(getReadSize() >= sizeof(T) && m_cur->size - npos > sizeof(T)) 
+        {
+            memcpy(&v, m_cur->ptr + npos, sizeof(T));
+            m_position += sizeof(T);
+            return v;
+        }
+        read(&v, sizeof(T));
+        return v;
+    }
+
+    /**
+     * @brief 批量写入Varint数组的实现，T为数组元素类型
+     */
+    template<class T>
+    void writeVarintArray(const T* values, size_t count);
+
+    /**
+     * @brief 批量读取Varint数组的实现，T为数组元素类型
+     */
+    template<class T>
+    void readVarintArray(T* values, size_t count);
+
     /**
      * @brief 获取当前的可写入容量
      */
@@ -478,6 +591,8 @@ private:
 private:
     /// 内存块的大小
     size_t m_baseSize;
+    /// 内存块大小是2的幂时为m_baseSize - 1，否则为0
+    size_t m_baseMask;
     /// 当前操作位置
     size_t m_position;
     /// 当前的总容量
@@ -492,6 +607,62 @@ private:
     Node* m_cur;
 };
 
+inline void ByteArray::writeFint8  (int8_t value) 
+{
+    // 因为就写一个字节的数据所以不需要考虑字节序
+    writeFixed(value);
+}
+
+inline void ByteArray::writeFuint8 (uint8_t value) 
+{
+    writeFixed(value);
+}
+
+// 不等于机器上的字节序，需要转一下再写
+#define XX(name, type) \
+    inline void ByteArray::name(type value) { \
+        if(m_endian != SYLAR_BYTE_ORDER) { \
+            value = byteswap(value); \
+        } \
+        writeFixed(value); \
+    }
+
+XX(writeFint16,  int16_t)
+XX(writeFuint16, uint16_t)
+XX(writeFint32,  int32_t)
+XX(writeFuint32, uint32_t)
+XX(writeFint64,  int64_t)
+XX(writeFuint64, uint64_t)
+#undef XX
+
+inline int8_t   ByteArray::readFint8() 
+{
+    return readFixed<int8_t>();
+}
+
+inline uint8_t  ByteArray::readFuint8() 
+{
+    return readFixed<uint8_t>();
+}
+
+#define XX(name, type) \
+    inline type ByteArray::name() { \
+        type v = readFixed<type>(); \
+        if(m_endian == SYLAR_BYTE_ORDER) { \
+            return v; \
+        } else { \
+            return byteswap(v); \
+        } \
+    }
+
+XX(readFint16,  int16_t)
+XX(readFuint16, uint16_t)
+XX(readFint32,  int32_t)
+XX(readFuint32, uint32_t)
+XX(readFint64,  int64_t)
+XX(readFuint64, uint64_t)
+#undef XX
+
 }
 
 #endif
@@ -12,8 +12,9 @@
 #define SYLAR_LITTLE_ENDIAN 1
 #define SYLAR_BIG_ENDIAN 2
 
-#include <byteswap.h>
+#include <endian.h>
 #include <stdint.h>
+#include <type_traits>
 
 namespace sylar {
 
@@ -25,7 +26,7 @@ typename std::enable_if<sizeof(T) == sizeof(uint64_t), T>::type
 byteswap(T value) 
 {
     // 返回一个值，其中64位的参数中的所有字节都已交换
-    return (T)bswap_64((uint64_t)value);
+    return (T)__builtin_bswap64((uint64_t)value);
 }
 
 /**
@@ -35,7 +36,7 @@ template <class T>
 typename std::enable_if<sizeof(T) == sizeof(uint32_t), T>::type
 byteswap(T value) 
 {
-    return (T)bswap_32((uint32_t)value);
+    return (T)__builtin_bswap32((uint32_t)value);
 }
 
 /**
@@ -45,7 +46,7 @@ template <class T>
 typename std::enable_if<sizeof(T) == sizeof(uint16_t), T>::type
 byteswap(T value) 
 {
-    return (T)bswap_16((uint16_t)value);
+    return (T)__builtin_bswap16((uint16_t)value);
 }
 
 #if BYTE_ORDER == BIG_ENDIAN
@@ -12,6 +12,7 @@
 #include "mutex.h"
 #include <map>
 #include <vector>
+#include <string>
 
 namespace sylar {
 
@@ -11,9 +11,13 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <atomic>
 
 namespace sylar {
 
+/// 已经分配出去的最大代数
+static std::atomic<uint64_t> s_fd_generation{0};
+
 // 对一个socketfd进行构造
 FdCtx::FdCtx(int fd)
     :m_isInit(false)          //是否初始化
@@ -24,6 +28,7 @@ FdCtx::FdCtx(int fd)
     ,m_fd(fd)                 //文件描述符
     ,m_recvTimeout(-1)        //读超时时间毫秒数
     ,m_sendTimeout(-1)        //写超时时间毫秒数
+    ,m_generation(++s_fd_generation) //代数
 {      
     init();                   //初始化函数
 }
@@ -48,6 +48,12 @@ public:
      */
     bool isClose() const { return m_isClosed;}
 
+    /**
+     * @brief 标记为已关闭
+     * @details 在close时先于取消事件设置，被唤醒的协程据此知道fd已经关闭，不会再次等待
+     */
+    void setClose() { m_isClosed = true;}
+
     /**
      * @brief 设置用户主动设置非阻塞
      * @param[in] v 是否阻塞
@@ -83,6 +89,13 @@ public:
      * @return 超时时间毫秒
      */
     uint64_t getTimeout(int type);
+
+    /**
+     * @brief 获取代数
+     * @details FdManager每次新建FdCtx都分配一个新的代数，fd被关闭或删除后同号的新fd一定是不同的代数，
+     *          IOManager据此判断常驻在epoll上的注册是不是还属于这个fd
+     */
+    uint64_t getGeneration() const { return m_generation;}
 private:
     /**
      * @brief 初始化
@@ -105,6 +118,8 @@ private:
     uint64_t m_recvTimeout;
     /// 写超时时间毫秒
     uint64_t m_sendTimeout;
+    /// 代数，从1开始
+    uint64_t m_generation;
 };
 
 /**
@@ -128,6 +143,7 @@ public:
 
     /**
      * @brief 删除文件句柄类
+     * @details 之后再get(fd, true)会新建FdCtx并分配新的代数
      * @param[in] fd 文件句柄
      */
     void del(int fd);
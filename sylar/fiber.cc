@@ -6,6 +6,12 @@
  */
 
 #include <atomic>
+#include <new>
+#include <vector>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "fiber.h"
 #include "config.h"
 #include "log.h"
@@ -33,19 +39,180 @@ static thread_local Fiber::ptr t_thread_fiber = nullptr;
 static ConfigVar<uint32_t>::ptr g_fiber_stack_size =
     Config::Lookup<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
 
+/// 协程栈分配器类型，malloc或mmap，mmap分配的栈带保护页并在线程内缓存复用
+static ConfigVar<std::string>::ptr g_fiber_stack_allocator =
+    Config::Lookup<std::string>("fiber.stack_allocator", "mmap", "fiber stack allocator, malloc or mmap");
+
+/// 每个线程最多缓存的协程栈个数
+static ConfigVar<uint32_t>::ptr g_fiber_stack_pool_max_count =
+    Config::Lookup<uint32_t>("fiber.stack_pool.max_count", 64, "max cached fiber stacks per thread");
+
+/// 每个线程最多缓存的协程栈字节数
+static ConfigVar<uint64_t>::ptr g_fiber_stack_pool_max_bytes =
+    Config::Lookup<uint64_t>("fiber.stack_pool.max_bytes", 16 * 1024 * 1024, "max cached fiber stack bytes per thread");
+
+/// 栈缓存池命中次数
+static std::atomic<uint64_t> s_stack_hits{0};
+
+/// 栈缓存池未命中次数
+static std::atomic<uint64_t> s_stack_misses{0};
+
+/// 当前常驻的栈内存字节数
+static std::atomic<uint64_t> s_stack_resident{0};
+
 /**
  * @brief malloc栈内存分配器
  */
-class MallocStackAllocator {
+class MallocStackAllocator : public StackAllocator {
 public:
     //分配size大小的栈内存，并返回首地址（指针）
-    static void *Alloc(size_t size) { return malloc(size); }
+    void *alloc(size_t size) override 
+    {
+        ++s_stack_misses;
+        void *vp = malloc(size);
+        if (!vp) 
+        {
+            throw std::bad_alloc();
+        }
+        s_stack_resident += size;
+        return vp;
+    }
     //释放那块内存
-    static void Dealloc(void *vp, size_t size) { return free(vp); }
+    void dealloc(void *vp, size_t size) override 
+    {
+        s_stack_resident -= size;
+        free(vp);
+    }
+};
+
+/**
+ * @brief 线程内的空闲栈缓存
+ * @details 线程退出时释放缓存中的栈。协程可能在别的线程析构，栈就归还到析构所在线程的缓存中
+ */
+struct StackPool {
+    /// 空闲栈，first为映射总长度，second为映射首地址
+    std::vector<std::pair<size_t, void *>> stacks;
+    /// 缓存的总字节数
+    uint64_t bytes = 0;
+
+    ~StackPool();
+};
+
+/// 线程局部变量，标记本线程的栈缓存已析构，之后释放的栈直接munmap
+static thread_local bool t_stack_pool_destroyed = false;
+
+/// 线程局部变量，本线程的栈缓存
+static thread_local StackPool t_stack_pool;
+
+StackPool::~StackPool() 
+{
+    t_stack_pool_destroyed = true;
+    for (auto &i : stacks) 
+    {
+        munmap(i.second, i.first);
+        s_stack_resident -= i.first;
+    }
+}
+
+/**
+ * @brief mmap栈内存分配器
+ * @details 在栈的低地址端多映射一个不可访问的保护页，栈溢出时直接触发SIGSEGV，而不是悄悄踩坏堆内存。
+ * 释放的栈放回线程内的缓存，下次分配相同大小的栈时直接复用，省掉mmap/munmap/mprotect的系统调用
+ */
+class MmapStackAllocator : public StackAllocator {
+public:
+    void *alloc(size_t size) override 
+    {
+        size_t len = MapLength(size);
+        if (!t_stack_pool_destroyed) 
+        {
+            auto &stacks = t_stack_pool.stacks;
+            for (auto it = stacks.rbegin(); it != stacks.rend(); ++it) 
+            {
+                if (it->first == len) 
+                {
+                    void *base = it->second;
+                    stacks.erase(std::next(it).base());
+                    t_stack_pool.bytes -= len;
+                    ++s_stack_hits;
+                    return (char *)base + PageSize();
+                }
+            }
+        }
+
+        ++s_stack_misses;
+        void *base = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) 
+        {
+            SYLAR_LOG_ERROR(g_logger) << "mmap fiber stack errno=" << errno << " " << strerror(errno);
+            throw std::bad_alloc();
+        }
+        // 低地址端的保护页，设置失败时不能交出一个没有保护页的栈
+        if (mprotect(base, PageSize(), PROT_NONE)) 
+        {
+            SYLAR_LOG_ERROR(g_logger) << "mprotect fiber stack guard page errno=" << errno
+                                      << " " << strerror(errno);
+            munmap(base, len);
+            throw std::bad_alloc();
+        }
+        s_stack_resident += len;
+        return (char *)base + PageSize();
+    }
+
+    void dealloc(void *vp, size_t size) override 
+    {
+        size_t len = MapLength(size);
+        void *base = (char *)vp - PageSize();
+        if (!t_stack_pool_destroyed 
+            && t_stack_pool.stacks.size() < g_fiber_stack_pool_max_count->getValue() 
+            && t_stack_pool.bytes + len <= g_fiber_stack_pool_max_bytes->getValue()) 
+        {
+            t_stack_pool.stacks.push_back(std::make_pair(len, base));
+            t_stack_pool.bytes += len;
+            return;
+        }
+        munmap(base, len);
+        s_stack_resident -= len;
+    }
+
+private:
+    static size_t PageSize() 
+    {
+        static size_t s_page_size = sysconf(_SC_PAGESIZE);
+        return s_page_size;
+    }
+
+    /// 栈大小按页对齐后再加上一个保护页
+    static size_t MapLength(size_t size) 
+    {
+        size_t page = PageSize();
+        return (size + page - 1) / page * page + page;
+    }
 };
 
-//指定别名 （协程栈内存分配器）
-using StackAllocator = MallocStackAllocator;
+static MallocStackAllocator s_malloc_stack_allocator;
+static MmapStackAllocator s_mmap_stack_allocator;
+
+/**
+ * @brief 根据配置选择协程栈分配器
+ */
+static StackAllocator *GetStackAllocator() 
+{
+    if (g_fiber_stack_allocator->getValue() == "malloc") 
+    {
+        return &s_malloc_stack_allocator;
+    }
+    return &s_mmap_stack_allocator;
+}
+
+Fiber::StackStats Fiber::GetStackStats() 
+{
+    StackStats stats;
+    stats.hits           = s_stack_hits;
+    stats.misses         = s_stack_misses;
+    stats.resident_bytes = s_stack_resident;
+    return stats;
+}
 
 uint64_t Fiber::GetFiberId() 
 {
@@ -114,12 +281,13 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
              m_cb(cb), 
              m_runInScheduler(run_in_scheduler) 
 {
-    //每创建一个协程，协程数+1
-    ++s_fiber_count;
     //设置协程栈的大小
     m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
-    //申请协程的栈内存
-    m_stack     = StackAllocator::Alloc(m_stacksize);
+    //申请协程的栈内存，失败时抛出std::bad_alloc，此时协程还没有计数
+    m_allocator = GetStackAllocator();
+    m_stack     = m_allocator->alloc(m_stacksize);
+    //每创建一个协程，协程数+1
+    ++s_fiber_count;
     
     //getcontext 初始化ucp结构体，将当前上下文保存在ucp中。成功时，返回0，错误返回-1，并设置errno
     if (getcontext(&m_ctx)) 
@@ -151,7 +319,7 @@ Fiber::~Fiber()
         // 有栈，说明是子协程，需要确保子协程一定是结束状态
         // 后面的调度协程也有栈 只是栈的大小为0
         SYLAR_ASSERT(m_state == TERM);
-        StackAllocator::Dealloc(m_stack, m_stacksize);
+        m_allocator->dealloc(m_stack, m_stacksize);
         SYLAR_LOG_DEBUG(g_logger) << "dealloc stack, id = " << m_id;
     } 
     else 
@@ -220,6 +388,13 @@ void Fiber::resume()
             SYLAR_ASSERT2(false, "swapcontext");
         }
     }
+
+    // 走到这里说明协程已经yield，上下文已经保存好了，这时才能把状态改为READY
+    // 如果在yield里swapcontext之前就改，其他线程可能看到READY后立即resume一个还没保存完上下文的协程
+    if (m_state == RUNNING) 
+    {
+        m_state = READY;
+    }
 }
 
 void Fiber::yield() 
@@ -239,11 +414,7 @@ void Fiber::yield()
         SetThis(sylar::Scheduler::GetMainFiber());
     }
 
-    //该协程不是运行结束而是被挂起 则设置其状态为等待（ready）
-    if (m_state != TERM) 
-    {
-        m_state = READY;
-    }
+    // 这里不把状态改为READY，要等上下文保存完、切回resume的一方之后再改，见resume()
 
     // 如果协程参与调度器调度，那么应该和调度器的主协程进行swap，而不是线程主协程
     if (m_runInScheduler) 
@@ -16,6 +16,26 @@
 
 namespace sylar {
 
+/**
+ * @brief 协程栈分配器接口
+ * @details 具体实现见fiber.cc，通过配置项fiber.stack_allocator选择malloc或mmap实现
+ */
+class StackAllocator {
+public:
+    virtual ~StackAllocator() {}
+
+    /**
+     * @brief 分配size大小的协程栈，返回栈的低地址
+     * @exception 分配失败(包括设置不了保护页)时抛出std::bad_alloc
+     */
+    virtual void *alloc(size_t size) = 0;
+
+    /**
+     * @brief 释放协程栈，size必须与alloc时一致
+     */
+    virtual void dealloc(void *vp, size_t size) = 0;
+};
+
 /**
  * @brief 协程类
  */
@@ -40,6 +60,18 @@ public:
         TERM
     };
 
+    /**
+     * @brief 协程栈分配统计
+     */
+    struct StackStats {
+        /// 从线程栈缓存池中命中的次数
+        uint64_t hits = 0;
+        /// 缓存池未命中，需要重新申请栈的次数
+        uint64_t misses = 0;
+        /// 当前常驻的栈内存字节数(使用中的和缓存池中的)
+        uint64_t resident_bytes = 0;
+    };
+
 private:
     /**
      * @brief 构造函数
@@ -76,7 +108,7 @@ public:
 
     /**
      * @brief 当前协程让出执行权
-     * @details 当前协程与上次resume时退到后台的协程进行交换，前者状态变为READY，后者状态变为RUNNING
+     * @details 当前协程与上次resume时退到后台的协程进行交换，前者状态变为READY（切回resume的一方之后才改），后者状态变为RUNNING
      */
     void yield();
 
@@ -120,6 +152,11 @@ public:
      */
     static uint64_t GetFiberId();
 
+    /**
+     * @brief 获取协程栈分配统计
+     */
+    static StackStats GetStackStats();
+
 private:
     /// 协程id
     uint64_t m_id        = 0;
@@ -136,6 +173,9 @@ private:
     /// 协程栈地址
     void *m_stack = nullptr;
 
+    /// 分配协程栈的分配器，释放时必须归还给同一个分配器
+    StackAllocator *m_allocator = nullptr;
+
     /// 协程入口函数
     std::function<void()> m_cb;
 
@@ -6,6 +6,8 @@
 #include "fiber.h"
 #include "iomanager.h"
 #include "fd_manager.h"
+#include "blocking_pool.h"
+#include "io_uring.h"
 #include "macro.h"
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
@@ -34,11 +36,22 @@ static thread_local bool t_hook_enable = false;
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendfile) \
+    XX(splice) \
+    XX(tee) \
+    XX(copy_file_range) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
     XX(getsockopt) \
-    XX(setsockopt)
+    XX(setsockopt) \
+    XX(open) \
+    XX(stat) \
+    XX(fsync) \
+    XX(getaddrinfo) \
+    XX(poll) \
+    XX(select) \
+    XX(epoll_wait)
 
 void hook_init() 
 {
@@ -47,6 +60,7 @@ void hook_init()
     {
         return;
     }
+    is_inited = true;
 //sleep_f = (sleep_fun)dlsym(RTLD_NEXT, sleep); RTLD_NEXT 表示返回第一个匹配到的sleep函数 后面即使有也不会被替换
 #define XX(name) name ## _f = (name ## _fun)dlsym(RTLD_NEXT, #name);
     HOOK_FUN(XX);
@@ -90,10 +104,23 @@ void set_hook_enable(bool flag)
 
 }
 
-struct timer_info 
+/**
+ * 在阻塞调用线程池上执行原来的调用，当前协程让出直到调用完成
+ * errno是线程局部的，调用前后在两个线程之间传递
+ */
+template<typename OriginFun, typename... Args>
+static auto do_blocking(OriginFun fun, Args&&... args) -> decltype(fun(std::forward<Args>(args)...))
 {
-    int cancelled = 0;
-};
+    decltype(fun(std::forward<Args>(args)...)) rt;
+    int err = errno;
+    sylar::async_blocking([&]() {
+        errno = err;
+        rt    = fun(std::forward<Args>(args)...);
+        err   = errno;
+    });
+    errno = err;
+    return rt;
+}
 
 template<typename OriginFun, typename... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
@@ -119,80 +146,222 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
         return -1;
     }
 
-    //不是socket 或则用户已主动设置非阻塞 返回老接口
-    if(!ctx->isSocket() || ctx->getUserNonblock()) 
+    //用户已主动设置非阻塞 返回老接口
+    if(ctx->getUserNonblock()) 
     {
         return fun(fd, std::forward<Args>(args)...);
     }
+
+    //不是socket，是hook的open打开的普通文件，读写没有就绪通知，交给阻塞调用线程池
+    if(!ctx->isSocket()) 
+    {
+        return do_blocking(fun, fd, std::forward<Args>(args)...);
+    }
     
     //是socket_fd 且用户没有主动设置非阻塞 走下面的流程，但其实在初始化fd的时候我们已经给这个fd添加了非阻塞属性 只是用户不知道而已
 
-    //获取超时时间
+    //获取超时时间，超时的状态和定时器保存在IOManager的fd事件上下文中，这里不分配任何内存
     uint64_t to = ctx->getTimeout(timeout_so);
-    //创建一个超时的条件
-    std::shared_ptr<timer_info> tinfo(new timer_info);
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
 
 retry:
     //此时fd暗地里已添加O_NONBLOCK
+    if(iom) 
+    {
+        iom->countSyscall();
+    }
     ssize_t n = fun(fd, std::forward<Args>(args)...);
     while(n == -1 && errno == EINTR) //EINTR 中断
     {
+        if(iom) 
+        {
+            iom->countSyscall();
+        }
         n = fun(fd, std::forward<Args>(args)...);
     }
     //不成功肯定会返回-1 且是再试一次EAGAIN 即说明读缓冲区此时还没有数据
     if(n == -1 && errno == EAGAIN) 
     {
-        sylar::IOManager* iom = sylar::IOManager::GetThis();
-        sylar::Timer::ptr timer;
-        std::weak_ptr<timer_info> winfo(tinfo); //条件定时器的条件
-
-        //1、添加条件定时器
-        if(to != (uint64_t)-1) 
-        {
-            timer = iom->addConditionTimer(to, [winfo, fd, iom, event]() {
-                //winfo是weak_ptr 要通过lock来拿到winfo所指的对象 然后进行访问
-                auto t = winfo.lock();
-                if(!t || t->cancelled) //条件t不存在 或者t已取消
-                {
-                    return;
-                }
-                t->cancelled = ETIMEDOUT; //这里是设置超时标志
-                iom->cancelEvent(fd, (sylar::IOManager::Event)(event));
-            }, winfo);
-        }
-
-        //2、向fd添加事件 没有传回调 默认将当前协程最为处理对象
-        int rt = iom->addEvent(fd, (sylar::IOManager::Event)(event));
-        if(SYLAR_UNLIKELY(rt)) 
+        //向fd添加事件并挂起当前协程，超时由fd上复用的定时器取消事件
+        int rt = iom->waitEvent(fd, (sylar::IOManager::Event)(event), to, ctx->getGeneration());
+        if(SYLAR_UNLIKELY(rt == -1)) 
         {
             SYLAR_LOG_ERROR(g_logger) << hook_fun_name << " addEvent("
                 << fd << ", " << event << ")";
-            if(timer) 
-            {
-                timer->cancel();
-            }
             return -1;
         } 
-        else 
+        // 从这点有两种情况可以使协程resume：1、确实可以进行io操作了，2、超时定时器取消了事件
+        if(rt) 
         {
-            sylar::Fiber::GetThis()->yield();           
-            // 从这点有两种情况可以使协程resume：1、确实可以进行io操作了，2、条件定时器到时执行了该定时器的回调函数
-            if(timer) 
-            {
-                timer->cancel();
-            }
-            if(tinfo->cancelled) 
-            {
-                errno = tinfo->cancelled;
-                return -1;
-            }
-            goto retry;
+            errno = rt;
+            return -1;
+        }
+        // 被close唤醒时fd已经(或即将)关闭，不能再去等待它的事件
+        if(ctx->isClose()) 
+        {
+            errno = EBADF;
+            return -1;
         }
+        goto retry;
     }
     
     return n;
 }
 
+/**
+ * io_uring后端：把读写请求直接交给内核，完成后再恢复协程，
+ * 省掉epoll后端"先试一次、等待就绪、再读写一次"的多次系统调用，提交也在idle里批量进行
+ * 返回false表示不走io_uring（不是io_uring后端、不是socket、用户设置了非阻塞，或者内核没有等待直接返回了EAGAIN），
+ * 调用方按原来的epoll方式处理
+ * timeout_so不为0时超时时间取fd上对应的超时设置，否则使用timeout_ms
+ */
+static bool uring_io(int fd, uint8_t op, const void* addr, size_t len, uint64_t off, int flags,
+        int timeout_so, uint64_t timeout_ms, ssize_t& n) 
+{
+    if(!sylar::t_hook_enable) 
+    {
+        return false;
+    }
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    if(!iom || !iom->isIoUring()) 
+    {
+        return false;
+    }
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+    if(!ctx || ctx->isClose() || !ctx->isSocket() || ctx->getUserNonblock()) 
+    {
+        return false;
+    }
+    if(timeout_so) 
+    {
+        timeout_ms = ctx->getTimeout(timeout_so);
+    }
+
+    io_uring_sqe sqe;
+    //单次IO最多0x7ffff000字节，和read/write的系统调用一致
+    sylar::IoUring::PrepSqe(sqe, op, fd, addr, std::min(len, (size_t)0x7ffff000), off);
+    sqe.msg_flags = flags;
+    int rt = iom->submitIo(fd, sqe, timeout_ms);
+    if(rt == -EAGAIN) 
+    {
+        return false;
+    }
+    if(rt < 0) 
+    {
+        errno = -rt;
+        n     = -1;
+    } 
+    else 
+    {
+        n = rt;
+    }
+    return true;
+}
+
+
+/**
+ * 在IOManager上等待epoll fd可读，期间让出协程，超时由定时器负责
+ * 每次醒来先用check做一次不阻塞的检查，check返回非0或者超时才返回，所以缓存的就绪和超时前的唤醒都不会误报
+ * timeout小于0表示一直等待，超时返回0
+ */
+template<typename CheckFun>
+static int wait_epoll_fd(int epfd, int timeout, CheckFun check) 
+{
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    // 截止时间用单调时钟，不受修改系统时间影响
+    uint64_t deadline = timeout < 0 ? ~0ull : sylar::GetElapsedMS() + timeout;
+    while(true) 
+    {
+        int rt = check();
+        if(rt != 0 || timeout == 0) 
+        {
+            return rt;
+        }
+        uint64_t now = sylar::GetElapsedMS();
+        if(deadline != ~0ull && now >= deadline) 
+        {
+            return 0;
+        }
+        // 超时或就绪都回到循环开头重新检查
+        if(iom->waitEvent(epfd, sylar::IOManager::READ, deadline == ~0ull ? -1 : deadline - now) == -1) 
+        {
+            SYLAR_LOG_ERROR(g_logger) << "wait_epoll_fd addEvent(" << epfd << ", READ)";
+            errno = EINVAL;
+            return -1;
+        }
+    }
+}
+
+/**
+ * poll和select的公共实现：把关心的fd放进一个临时的epoll，在IOManager上等它可读，醒来后用原来的poll计算结果
+ * 这样即使fd上已经有协程在IOManager里等待同一个事件也不会冲突
+ * 只有第一次检查没有就绪、需要等待时才创建临时epoll，代价是epoll_create、每个fd一次epoll_ctl和close，
+ * 外加IOManager注册和删除epoll fd各一次。临时epoll不跨调用复用：复用时要逐个删除fd，fd多时反而更慢，
+ * 而且同一个线程上可能有多个协程同时在poll。频繁poll大量fd的场景应直接在IOManager上等待
+ */
+static int do_poll(struct pollfd *fds, nfds_t nfds, int timeout) 
+{
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    if(!sylar::t_hook_enable || !iom) 
+    {
+        return poll_f(fds, nfds, timeout);
+    }
+    int rt = poll_f(fds, nfds, 0);
+    if(rt != 0 || timeout == 0) 
+    {
+        return rt;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(epfd < 0) 
+    {
+        return -1;
+    }
+    for(nfds_t i = 0; i < nfds; ++i) 
+    {
+        if(fds[i].fd < 0) 
+        {
+            continue;
+        }
+        // poll和epoll的事件位取值相同；同一个fd出现多次时合并关心的事件
+        epoll_event event;
+        event.events  = fds[i].events & (POLLIN | POLLPRI | POLLOUT | POLLRDHUP);
+        event.data.fd = fds[i].fd;
+        int ctl = epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i].fd, &event);
+        if(ctl && errno == EEXIST) 
+        {
+            for(nfds_t j = 0; j < i; ++j) 
+            {
+                if(fds[j].fd == fds[i].fd) 
+                {
+                    event.events |= fds[j].events & (POLLIN | POLLPRI | POLLOUT | POLLRDHUP);
+                }
+            }
+            ctl = epoll_ctl(epfd, EPOLL_CTL_MOD, fds[i].fd, &event);
+        }
+        if(ctl == 0 || errno == EPERM) 
+        {
+            // EPERM是普通文件，poll总是报告它可读可写，第一次检查已经返回，关心的其它事件永远不会发生
+            continue;
+        }
+        int err = errno;
+        close_f(epfd);
+        if(err == EBADF) 
+        {
+            // fd在第一次检查之后被关闭，和poll一样在revents里报告POLLNVAL
+            return poll_f(fds, nfds, 0);
+        }
+        errno = err;
+        return -1;
+    }
+    rt = wait_epoll_fd(epfd, timeout, [fds, nfds]() { return poll_f(fds, nfds, 0); });
+    int err = errno;
+    // 临时epoll上可能还留着IOManager的注册，关闭前删除
+    iom->cancelAll(epfd);
+    close_f(epfd);
+    errno = err;
+    return rt;
+}
 
 extern "C" {
 //sleep_fun sleep_f = nullptr; 初始化为空(头文件中已经声明过了)
@@ -267,6 +436,62 @@ int socket(int domain, int type, int protocol)
     return fd;
 }
 
+int open(const char *pathname, int flags, ...) 
+{
+    //只有创建文件时才有第三个参数
+    mode_t mode = 0;
+    if((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) 
+    {
+        va_list va;
+        va_start(va, flags);
+        mode = va_arg(va, int);
+        va_end(va);
+    }
+    if(!sylar::t_hook_enable) 
+    {
+        return open_f(pathname, flags, mode);
+    }
+    int fd = do_blocking(open_f, pathname, flags, mode);
+    if(fd == -1) 
+    {
+        return fd;
+    }
+    //记录下fd，之后的读写交给阻塞调用线程池；用户要求非阻塞时直接调用
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd, true);
+    if(ctx && !ctx->isSocket()) 
+    {
+        ctx->setUserNonblock(flags & O_NONBLOCK);
+    }
+    return fd;
+}
+
+int stat(const char *pathname, struct stat *statbuf) 
+{
+    if(!sylar::t_hook_enable) 
+    {
+        return stat_f(pathname, statbuf);
+    }
+    return do_blocking(stat_f, pathname, statbuf);
+}
+
+int fsync(int fd) 
+{
+    if(!sylar::t_hook_enable) 
+    {
+        return fsync_f(fd);
+    }
+    return do_blocking(fsync_f, fd);
+}
+
+int getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res) 
+{
+    if(!sylar::t_hook_enable) 
+    {
+        return getaddrinfo_f(node, service, hints, res);
+    }
+    return do_blocking(getaddrinfo_f, node, service, hints, res);
+}
+
 int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms) 
 {
     if(!sylar::t_hook_enable) 
@@ -293,7 +518,22 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
 
     //调⽤系统的connect函数成功返回0，失败返回-1，
     //由于套接字是⾮阻塞的，如果对方服务器没准备好，这⾥会直接返回-1，且errno=EINPROGRESS
-    int n = connect_f(fd, addr, addrlen);
+    //io_uring后端由内核等待连接完成，内核没有等待而是返回EINPROGRESS时，和epoll后端一样等待可写
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    ssize_t un = 0;
+    int n      = 0;
+    if(uring_io(fd, IORING_OP_CONNECT, addr, 0, addrlen, 0, 0, timeout_ms, un)) 
+    {
+        n = un;
+    } 
+    else 
+    {
+        if(iom) 
+        {
+            iom->countSyscall();
+        }
+        n = connect_f(fd, addr, addrlen);
+    }
     if(n == 0) 
     {
         return 0;
@@ -305,58 +545,33 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     //EINPROGRESS表示socket为非阻塞套接字，已建立连接请求但没有立即完成，等待对方服务器准备好后（即掉accept函数）就可以建立连接。
     //那么何时才可以知道已经建立连接了？此时只需要给fd注册一个写事件，当fd可写，就表示已经建立连接。
 
-    //此时线程不能阻塞在连接的协程上，要设置一个条件定时器，然后去调度别的协程进行工作
-    sylar::IOManager* iom = sylar::IOManager::GetThis();
-    sylar::Timer::ptr timer;
-    std::shared_ptr<timer_info> tinfo(new timer_info);
-    std::weak_ptr<timer_info> winfo(tinfo);
-
-    //如果超时参数有效，则添加⼀个条件定时器，在定时时间到后通过t->cancelled设置超时标志并触发⼀次WRITE事件
-    if(timeout_ms != (uint64_t)-1) 
-    {
-        //添加一个条件定时器
-        timer = iom->addConditionTimer(timeout_ms, [winfo, fd, iom]() {
-                auto t = winfo.lock();
-                if(!t || t->cancelled) 
-                {
-                    return;
-                }
-                t->cancelled = ETIMEDOUT;
-                iom->cancelEvent(fd, sylar::IOManager::WRITE); //在下面添加触发事件时没有传回调和协程，就是直接默认把当前协程对象传给写事件的上下文
-            }, winfo);
-    }
-
-    //给fd添加一个写事件，写事件的任务协程就是当前协程
-    int rt = iom->addEvent(fd, sylar::IOManager::WRITE);//后面还有第三个参数 不传就默认是当前协程
-    if(rt == 0) 
+    //此时线程不能阻塞在连接的协程上，给fd添加一个写事件并挂起当前协程，超时后由定时器取消写事件，去调度别的协程进行工作
+    int rt = iom->waitEvent(fd, sylar::IOManager::WRITE, timeout_ms, ctx->getGeneration());
+    if(rt != -1) 
     {
-        sylar::Fiber::GetThis()->yield();
         //两种情况会使得调度协程切回到这个任务协程
         //1、就是添加的事件有响应，正常处理就行了
-        //2、条件定时器到时，执行条件定时器的回调-> 把条件设置为超时，同时取消这个fd上面对应的事件，sylar的处理是在取消事件后再触发一次这个事件
-        //   即schedule(fiber), 这个fiber就是当前运行到此处的fiber 后面调度协程切到这个fiber上 刚好从这个位置开始运行
-        if(timer) 
+        //2、定时器到时，把这次等待标记为超时，同时取消这个fd上面对应的事件，sylar的处理是在取消事件后再触发一次这个事件
+        if(rt) 
         {
-            timer->cancel();
+            errno = rt;
+            return -1;
         }
-        if(tinfo->cancelled) 
+        if(ctx->isClose()) 
         {
-            errno = tinfo->cancelled;
+            errno = EBADF;
             return -1;
         }
     } 
     else 
     {
-        if(timer) 
-        {
-            timer->cancel();
-        }
         SYLAR_LOG_ERROR(g_logger) << "connect addEvent(" << fd << ", WRITE) error";
     }
 
     //这部分主要是调用失败时获取一个错误号，如果成功直接返回0
     int error = 0;
     socklen_t len = sizeof(int);
+    iom->countSyscall();
     if(-1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len)) 
     {
         return -1;
@@ -379,7 +594,16 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
 
 int accept(int s, struct sockaddr *addr, socklen_t *addrlen) 
 {
-    int fd = do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    ssize_t n = 0;
+    int fd    = 0;
+    if(uring_io(s, IORING_OP_ACCEPT, addr, 0, (uint64_t)(uintptr_t)addrlen, 0, SO_RCVTIMEO, -1, n)) 
+    {
+        fd = n;
+    } 
+    else 
+    {
+        fd = do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    }
     if(fd >= 0) 
     {
         sylar::FdMgr::GetInstance()->get(fd, true);
@@ -388,6 +612,10 @@ int accept(int s, struct sockaddr *addr, socklen_t *addrlen)
 }
 
 ssize_t read(int fd, void *buf, size_t count) {
+    ssize_t n = 0;
+    if(uring_io(fd, IORING_OP_READ, buf, count, -1, 0, SO_RCVTIMEO, -1, n)) {
+        return n;
+    }
     return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);
 }
 
@@ -396,6 +624,10 @@ ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+    ssize_t n = 0;
+    if(uring_io(sockfd, IORING_OP_RECV, buf, len, 0, flags, SO_RCVTIMEO, -1, n)) {
+        return n;
+    }
     return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
 }
 
@@ -408,6 +640,10 @@ ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
+    ssize_t n = 0;
+    if(uring_io(fd, IORING_OP_WRITE, buf, count, -1, 0, SO_SNDTIMEO, -1, n)) {
+        return n;
+    }
     return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
 }
 
@@ -416,6 +652,10 @@ ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
 }
 
 ssize_t send(int s, const void *msg, size_t len, int flags) {
+    ssize_t n = 0;
+    if(uring_io(s, IORING_OP_SEND, msg, len, 0, flags, SO_SNDTIMEO, -1, n)) {
+        return n;
+    }
     return do_io(s, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
 }
 
@@ -427,23 +667,165 @@ ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
     return do_io(s, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
-int close(int fd) 
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    //等待的是socket可写，超时取发送超时
+    return do_io(out_fd, sendfile_f, "sendfile", sylar::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
+/**
+ * splice的两端至少有一个是管道，hook只管理socket，所以按socket所在的一端等待：
+ * 写入socket时等可写，从socket读出时等可读；两端都不是socket时直接调用
+ */
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags) {
+    auto fun = [=](int) { return splice_f(fd_in, off_in, fd_out, off_out, len, flags); };
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd_out);
+    if(ctx && ctx->isSocket()) {
+        return do_io(fd_out, fun, "splice", sylar::IOManager::WRITE, SO_SNDTIMEO);
+    }
+    ctx = sylar::FdMgr::GetInstance()->get(fd_in);
+    if(ctx && ctx->isSocket()) {
+        return do_io(fd_in, fun, "splice", sylar::IOManager::READ, SO_RCVTIMEO);
+    }
+    return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+}
+
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+    //两端都是管道，hook不管理管道，只有登记过的fd按读事件等待
+    return do_io(fd_in, tee_f, "tee", sylar::IOManager::READ, SO_RCVTIMEO, fd_out, len, flags);
+}
+
+ssize_t copy_file_range(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags) {
+    //普通文件之间复制，没有就绪通知，交给阻塞调用线程池
+    if(!sylar::t_hook_enable) {
+        return copy_file_range_f(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    return do_blocking(copy_file_range_f, fd_in, off_in, fd_out, off_out, len, flags);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) 
 {
-    if(!sylar::t_hook_enable) 
+    return do_poll(fds, nfds, timeout);
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) 
+{
+    if(!sylar::t_hook_enable || !sylar::IOManager::GetThis()) 
+    {
+        return select_f(nfds, readfds, writefds, exceptfds, timeout);
+    }
+    // 转成pollfd，异常条件对应POLLPRI
+    std::vector<pollfd> fds;
+    for(int fd = 0; fd < nfds; ++fd) 
+    {
+        short events = 0;
+        if(readfds && FD_ISSET(fd, readfds)) 
+        {
+            events |= POLLIN;
+        }
+        if(writefds && FD_ISSET(fd, writefds)) 
+        {
+            events |= POLLOUT;
+        }
+        if(exceptfds && FD_ISSET(fd, exceptfds)) 
+        {
+            events |= POLLPRI;
+        }
+        if(events) 
+        {
+            fds.push_back({fd, events, 0});
+        }
+    }
+
+    int timeout_ms = -1;
+    if(timeout) 
+    {
+        // 向上取整到毫秒，不能比要求的时间提前返回
+        timeout_ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+    }
+    uint64_t begin = sylar::GetCurrentMS();
+    int rt = do_poll(fds.data(), fds.size(), timeout_ms);
+    if(timeout) 
+    {
+        // 和linux的select一样把剩余时间写回timeout
+        int64_t left = timeout_ms - (int64_t)(sylar::GetCurrentMS() - begin);
+        left = std::max(left, (int64_t)0);
+        timeout->tv_sec  = left / 1000;
+        timeout->tv_usec = left % 1000 * 1000;
+    }
+    if(rt < 0) 
     {
-        return close_f(fd);
+        return rt;
     }
 
-    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
-    if(ctx) 
+    int count = 0;
+    for(auto& i : fds) 
     {
-        auto iom = sylar::IOManager::GetThis();
-        if(iom) 
+        if(i.revents & POLLNVAL) 
         {
-            iom->cancelAll(fd);
+            errno = EBADF;
+            return -1;
         }
+    }
+    if(readfds) 
+    {
+        FD_ZERO(readfds);
+    }
+    if(writefds) 
+    {
+        FD_ZERO(writefds);
+    }
+    if(exceptfds) 
+    {
+        FD_ZERO(exceptfds);
+    }
+    for(auto& i : fds) 
+    {
+        if(readfds && (i.events & POLLIN) && (i.revents & (POLLIN | POLLHUP | POLLERR))) 
+        {
+            FD_SET(i.fd, readfds);
+            ++count;
+        }
+        if(writefds && (i.events & POLLOUT) && (i.revents & (POLLOUT | POLLERR))) 
+        {
+            FD_SET(i.fd, writefds);
+            ++count;
+        }
+        if(exceptfds && (i.events & POLLPRI) && (i.revents & POLLPRI)) 
+        {
+            FD_SET(i.fd, exceptfds);
+            ++count;
+        }
+    }
+    return count;
+}
+
+/**
+ * 第三方库自己的epoll fd：把它当成一个普通fd注册到IOManager上等待可读，醒来后不阻塞地取出就绪事件
+ */
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) 
+{
+    if(!sylar::t_hook_enable || !sylar::IOManager::GetThis()) 
+    {
+        return epoll_wait_f(epfd, events, maxevents, timeout);
+    }
+    return wait_epoll_fd(epfd, timeout, [=]() { return epoll_wait_f(epfd, events, maxevents, 0); });
+}
+
+int close(int fd) 
+{
+    // 没有开启hook时也要作废fd的记录，否则同号的新fd会沿用旧fd的FdCtx和IOManager里的常驻注册
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+    if(ctx) 
+    {
+        ctx->setClose();
         sylar::FdMgr::GetInstance()->del(fd);
     }
+    // 没有FdCtx的fd（比如hook的epoll_wait等待过的第三方epoll fd）也可能在IOManager里注册过
+    auto iom = sylar::IOManager::GetThis();
+    if(iom) 
+    {
+        iom->cancelAll(fd);
+    }
     return close_f(fd);
 }
 
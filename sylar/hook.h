@@ -12,8 +12,14 @@
 
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <netdb.h>
 #include <stdint.h>
 #include <time.h>
 #include <unistd.h>
@@ -27,6 +33,40 @@ namespace sylar {
      * @brief 设置当前线程的hook状态
      */
     void set_hook_enable(bool flag);
+
+    /**
+     * @brief 取得被hook的原始函数地址，保存到xxx_f，重复调用直接返回
+     * @details 静态初始化时由hook.cc自动调用，在它之前就要用xxx_f的代码先调用一次
+     */
+    void hook_init();
+
+    /**
+     * @brief 作用域内关闭当前线程的hook，析构时恢复
+     * @details 持有锁或者线程局部状态的代码（比如写日志）里不能让出协程，协程恢复时可能已经换了线程，
+     *          关闭hook之后作用域内的系统调用都直接执行
+     */
+    class HookDisableGuard {
+    public:
+        HookDisableGuard() : m_enable(is_hook_enable())
+        {
+            if(m_enable)
+            {
+                set_hook_enable(false);
+            }
+        }
+
+        ~HookDisableGuard()
+        {
+            if(m_enable)
+            {
+                set_hook_enable(true);
+            }
+        }
+    private:
+        HookDisableGuard(const HookDisableGuard&) = delete;
+        HookDisableGuard& operator=(const HookDisableGuard&) = delete;
+        bool m_enable;
+    };
 }
 
 //加上extern "C"后，会指示编译器这部分代码按C语言（而不是C++）的方式进行编译
@@ -90,6 +130,19 @@ extern sendto_fun sendto_f;
 typedef ssize_t (*sendmsg_fun)(int s, const struct msghdr *msg, int flags);
 extern sendmsg_fun sendmsg_f;
 
+//zero copy 内核里直接在fd之间搬运数据，不经过用户态
+typedef ssize_t (*sendfile_fun)(int out_fd, int in_fd, off_t *offset, size_t count);
+extern sendfile_fun sendfile_f;
+
+typedef ssize_t (*splice_fun)(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags);
+extern splice_fun splice_f;
+
+typedef ssize_t (*tee_fun)(int fd_in, int fd_out, size_t len, unsigned int flags);
+extern tee_fun tee_f;
+
+typedef ssize_t (*copy_file_range_fun)(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags);
+extern copy_file_range_fun copy_file_range_f;
+
 typedef int (*close_fun)(int fd);
 extern close_fun close_f;
 
@@ -106,6 +159,29 @@ extern getsockopt_fun getsockopt_f;
 typedef int (*setsockopt_fun)(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
 extern setsockopt_fun setsockopt_f;
 
+//blocking 普通文件和域名解析没有就绪通知，交给阻塞调用线程池执行
+typedef int (*open_fun)(const char *pathname, int flags, ...);
+extern open_fun open_f;
+
+typedef int (*stat_fun)(const char *pathname, struct stat *statbuf);
+extern stat_fun stat_f;
+
+typedef int (*fsync_fun)(int fd);
+extern fsync_fun fsync_f;
+
+typedef int (*getaddrinfo_fun)(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res);
+extern getaddrinfo_fun getaddrinfo_f;
+
+//poll 第三方库内部的多路复用等待，转成在IOManager上等待
+typedef int (*poll_fun)(struct pollfd *fds, nfds_t nfds, int timeout);
+extern poll_fun poll_f;
+
+typedef int (*select_fun)(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+extern select_fun select_f;
+
+typedef int (*epoll_wait_fun)(int epfd, struct epoll_event *events, int maxevents, int timeout);
+extern epoll_wait_fun epoll_wait_f;
+
 extern int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms);
 
 }
@@ -6,6 +6,10 @@
  */
 #include "http.h"
 #include "sylar/util.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace sylar {
 namespace http {
@@ -429,10 +433,18 @@ std::ostream &HttpResponse::dump(std::ostream &os) const
     }
 
     // 响应正文，body部分
-    if (!m_body.empty()) 
+    size_t body_size = getBodySize();
+    if (body_size) 
     {
-        os << "content-length: " << m_body.size() << "\r\n\r\n"
-           << m_body;
+        os << "content-length: " << body_size << "\r\n\r\n";
+        if (m_bodyHolder) 
+        {
+            os.write((const char *)m_bodyRef, m_bodyRefSize);
+        } 
+        else 
+        {
+            os << m_body;
+        }
     } 
     else 
     {
@@ -441,6 +453,127 @@ std::ostream &HttpResponse::dump(std::ostream &os) const
     return os;
 }
 
+/**
+ * @brief 往ByteArray写入C字符串
+ */
+static void WriteCString(ByteArray::ptr ba, const char *str) 
+{
+    ba->write(str, strlen(str));
+}
+
+size_t HttpResponse::serialize(ByteArray::ptr ba, std::vector<iovec> &iovs) const 
+{
+    size_t begin = ba->getPosition();
+    // 响应首行，和dump的格式一致
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "HTTP/%u.%u %u "
+                       , (uint32_t)(m_version >> 4), (uint32_t)(m_version & 0x0F), (uint32_t)m_status);
+    ba->write(buf, len);
+    if (m_reason.empty()) 
+    {
+        WriteCString(ba, HttpStatusToString(m_status));
+    } 
+    else 
+    {
+        ba->writeStringWithoutLength(m_reason);
+    }
+    ba->write("\r\n", 2);
+
+    // 响应头部
+    for (auto &i : m_headers) 
+    {
+        if (!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0) 
+        {
+            continue;
+        }
+        ba->writeStringWithoutLength(i.first);
+        ba->write(": ", 2);
+        ba->writeStringWithoutLength(i.second);
+        ba->write("\r\n", 2);
+    }
+    for (auto &i : m_cookies) 
+    {
+        WriteCString(ba, "Set-Cookie: ");
+        ba->writeStringWithoutLength(i);
+        ba->write("\r\n", 2);
+    }
+    if (!m_websocket) 
+    {
+        WriteCString(ba, m_close ? "connection: close\r\n" : "connection: keep-alive\r\n");
+    }
+
+    size_t body_size = getBodySize();
+    if (body_size) 
+    {
+        len = snprintf(buf, sizeof(buf), "content-length: %zu\r\n\r\n", body_size);
+        ba->write(buf, len);
+    } 
+    else 
+    {
+        ba->write("\r\n", 2);
+    }
+
+    size_t head_size = ba->getPosition() - begin;
+    ba->getReadBuffers(iovs, head_size, begin);
+    if (body_size) 
+    {
+        iovec iov;
+        iov.iov_base = (void *)(m_bodyHolder ? m_bodyRef : m_body.data());
+        iov.iov_len  = body_size;
+        iovs.push_back(iov);
+    }
+    return head_size;
+}
+
+void HttpResponse::setBodyRef(const void *data, size_t size, std::shared_ptr<const void> holder) 
+{
+    m_bodyRef     = data;
+    m_bodyRefSize = size;
+    m_bodyHolder  = holder ? holder : std::shared_ptr<const void>(data, [](const void *) {});
+}
+
+void HttpResponse::setBodyRef(std::shared_ptr<const std::string> body) 
+{
+    setBodyRef(body->data(), body->size(), body);
+}
+
+bool HttpResponse::setBodyFile(const std::string &path) 
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) 
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) 
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    if (size == 0) 
+    {
+        close(fd);
+        setBodyRef("", 0, nullptr);
+        return true;
+    }
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) 
+    {
+        return false;
+    }
+    setBodyRef(data, size, std::shared_ptr<const void>(data, [size](const void *p) { munmap((void *)p, size); }));
+    return true;
+}
+
+void HttpResponse::clearBodyRef() 
+{
+    m_bodyRef     = nullptr;
+    m_bodyRefSize = 0;
+    m_bodyHolder.reset();
+}
+
 std::ostream &operator<<(std::ostream &os, const HttpRequest &req) 
 {
     return req.dump(os);
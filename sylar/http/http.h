@@ -15,6 +15,7 @@
 #include <sstream>
 #include <memory>
 #include <boost/lexical_cast.hpp>
+#include "../bytearray.h"
 
 namespace sylar {
 namespace http {
@@ -581,7 +582,7 @@ public:
      * @brief 设置响应消息体
      * @param[in] v 消息体
      */
-    void setBody(const std::string& v) { m_body = v;}
+    void setBody(const std::string& v) { m_body = v; clearBodyRef();}
 
     /**
      * @brief 追加HTTP请求的消息体
@@ -589,6 +590,42 @@ public:
      */
     void appendBody(const std::string &v) { m_body.append(v); }
 
+    /**
+     * @brief 引用外部内存作为消息体，发送时直接引用这块内存，不拷贝
+     * @details 设置后代替getBody()的内容发送，getBody()不包含外部消息体
+     * @param[in] data 消息体地址
+     * @param[in] size 消息体长度
+     * @param[in] holder 持有这块内存的对象，发送完成前保证data有效
+     */
+    void setBodyRef(const void *data, size_t size, std::shared_ptr<const void> holder);
+
+    /**
+     * @brief 引用共享的字符串作为消息体，不拷贝
+     */
+    void setBodyRef(std::shared_ptr<const std::string> body);
+
+    /**
+     * @brief 把文件映射到内存作为消息体，不拷贝
+     * @param[in] path 文件路径
+     * @return 文件打开或映射失败返回false
+     */
+    bool setBodyFile(const std::string &path);
+
+    /**
+     * @brief 取消外部消息体
+     */
+    void clearBodyRef();
+
+    /**
+     * @brief 是否设置了外部消息体
+     */
+    bool hasBodyRef() const { return m_bodyHolder != nullptr;}
+
+    /**
+     * @brief 返回发送的消息体长度（外部消息体或者getBody()）
+     */
+    size_t getBodySize() const { return m_bodyHolder ? m_bodyRefSize : m_body.size();}
+
     /**
      * @brief 设置响应原因
      * @param[in] v 原因
@@ -681,6 +718,16 @@ public:
      */
     std::string toString() const;
 
+    /**
+     * @brief 序列化到ByteArray和iovec数组，用于writev/sendmsg一次发送
+     * @details 响应首行和头部从ba的当前位置追加写入ba，消息体不拷贝，直接引用m_body或外部消息体的内存；
+     *          发送完成前必须保持ba和响应对象有效
+     * @param[in, out] ba 保存首行和头部的ByteArray
+     * @param[out] iovs 追加首行、头部和消息体的iovec
+     * @return 写入ba的字节数，消息体的长度由getBodySize()得到
+     */
+    size_t serialize(ByteArray::ptr ba, std::vector<iovec> &iovs) const;
+
     /**
      * @brief 设置重定向，在头部添加Location字段，值为uri
      * @param[] uri 目标uri
@@ -710,6 +757,12 @@ private:
     bool m_websocket;
     /// 响应消息体
     std::string m_body;
+    /// 外部消息体地址
+    const void *m_bodyRef = nullptr;
+    /// 外部消息体长度
+    size_t m_bodyRefSize = 0;
+    /// 持有外部消息体内存的对象
+    std::shared_ptr<const void> m_bodyHolder;
     /// 响应原因 响应状态码后面的字符串
     std::string m_reason;
     /// 响应头部MAP
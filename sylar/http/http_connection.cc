@@ -331,7 +331,7 @@ HttpConnectionPool::HttpConnectionPool(const std::string& host
 HttpConnection::ptr HttpConnectionPool::getConnection() 
 {   
     // 拿到当前时间
-    uint64_t now_ms = sylar::GetCurrentMS();
+    uint64_t now_ms = sylar::GetCachedCurrentMS();
     std::vector<HttpConnection*> invalid_conns;
     // 创建客户端connection会话
     HttpConnection* ptr = nullptr;
@@ -395,7 +395,7 @@ void HttpConnectionPool::ReleasePtr(HttpConnection* ptr, HttpConnectionPool* poo
 {
     ++ptr->m_request;
     if(!ptr->isConnected()
-            || ((ptr->m_createTime + pool->m_maxAliveTime) >= sylar::GetCurrentMS())
+            || ((ptr->m_createTime + pool->m_maxAliveTime) >= sylar::GetCachedCurrentMS())
             || (ptr->m_request >= pool->m_maxRequest)) 
     {
         delete ptr;
@@ -8,6 +8,26 @@ namespace http {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+/**
+ * @brief 返回Date响应头的值，每个线程每秒只格式化一次
+ */
+static const std::string &GetHttpDate()
+{
+    static thread_local time_t s_last = 0;
+    static thread_local std::string s_date;
+    time_t now = sylar::GetCachedTime();
+    if(now != s_last)
+    {
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        char buf[64];
+        strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        s_date = buf;
+        s_last = now;
+    }
+    return s_date;
+}
+
 HttpServer::HttpServer(bool keepalive
                         ,sylar::IOManager* worker
                         ,sylar::IOManager* io_worker
@@ -47,6 +67,7 @@ void HttpServer::handleClient(Socket::ptr client)
         // 2、返回响应
         HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), req->isClose() || !m_isKeepalive));
         rsp->setHeader("Server", getName());
+        rsp->setHeader("Date", GetHttpDate());
         m_dispatch->handle(req, rsp, session);
         // 3、发送到socket缓冲区
         session->sendResponse(rsp);
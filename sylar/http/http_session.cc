@@ -1,5 +1,6 @@
 #include "http_session.h"
 #include "http_parser.h"
+#include <atomic>
 
 namespace sylar {
 namespace http {
@@ -84,13 +85,34 @@ HttpRequest::ptr HttpSession::recvRequest()
     return parser->getData();
 }
 
+/// 发送响应时拷贝的字节数
+static std::atomic<uint64_t> s_bytes_copied{0};
+/// 发送响应时直接引用的字节数
+static std::atomic<uint64_t> s_bytes_referenced{0};
+
 int HttpSession::sendResponse(HttpResponse::ptr rsp) 
 {
-    std::stringstream ss;
-    ss << *rsp;
-    std::string data = ss.str();
+    if (!m_sendBuffer) 
+    {
+        m_sendBuffer.reset(new ByteArray);
+    }
+    m_sendBuffer->clear();
+    m_sendIovs.clear();
+    size_t head_size = rsp->serialize(m_sendBuffer, m_sendIovs);
+    s_bytes_copied.fetch_add(head_size, std::memory_order_relaxed);
+    s_bytes_referenced.fetch_add(rsp->getBodySize(), std::memory_order_relaxed);
     // 写到socket缓冲区
-    return writeFixSize(data.c_str(), data.size());
+    return writevFixSize(&m_sendIovs[0], m_sendIovs.size());
+}
+
+uint64_t HttpSession::GetBytesCopied() 
+{
+    return s_bytes_copied.load(std::memory_order_relaxed);
+}
+
+uint64_t HttpSession::GetBytesReferenced() 
+{
+    return s_bytes_referenced.load(std::memory_order_relaxed);
 }
 
 } // namespace http
@@ -39,12 +39,29 @@ public:
 
     /**
      * @brief 发送HTTP响应
+     * @details 首行和头部序列化到会话复用的ByteArray，消息体直接引用响应对象或外部内存，用一次sendmsg发送
      * @param[in] rsp HTTP响应
      * @return >0 发送成功
      *         =0 对方关闭
      *         <0 Socket异常
      */
     int sendResponse(HttpResponse::ptr rsp);
+
+    /**
+     * @brief 所有会话发送响应时拷贝的字节数（首行和头部）
+     */
+    static uint64_t GetBytesCopied();
+
+    /**
+     * @brief 所有会话发送响应时直接引用、没有拷贝的字节数（消息体）
+     */
+    static uint64_t GetBytesReferenced();
+
+private:
+    /// 序列化响应首行和头部的缓冲区，同一个会话的响应依次发送，可以复用
+    ByteArray::ptr m_sendBuffer;
+    /// 发送用的iovec数组
+    std::vector<iovec> m_sendIovs;
 };
 
 }
@@ -0,0 +1,271 @@
+/**
+ * @file io_uring.cc
+ * @brief io_uring提交/完成队列的封装实现
+ * @version 0.1
+ * @date 2026-10-16
+ */
+
+#include <errno.h>
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "io_uring.h"
+#include "log.h"
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+IoUring::IoUring(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "io_uring_setup(" << entries << ") errno="
+                                  << errno << " errstr=" << strerror(errno);
+        return;
+    }
+
+    // 提交队列和完成队列的环形缓冲区，内核支持时两者共用一次映射
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        SYLAR_LOG_ERROR(g_logger) << "io_uring without IORING_FEAT_SINGLE_MMAP is not supported";
+        close(fd);
+        return;
+    }
+    m_ringSize = std::max(sq_size, cq_size);
+    m_ring     = mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQ_RING);
+    if (m_ring == MAP_FAILED)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "mmap io_uring errno=" << errno << " errstr=" << strerror(errno);
+        m_ring = nullptr;
+        close(fd);
+        return;
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "mmap io_uring sqes errno=" << errno << " errstr=" << strerror(errno);
+        munmap(m_ring, m_ringSize);
+        m_ring = nullptr;
+        close(fd);
+        return;
+    }
+    m_sqes = (io_uring_sqe *)sqes;
+
+    char *ring  = (char *)m_ring;
+    m_sqTail    = (unsigned *)(ring + params.sq_off.tail);
+    m_sqMask    = *(unsigned *)(ring + params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+    m_sqFlags   = (unsigned *)(ring + params.sq_off.flags);
+    m_sqArray   = (unsigned *)(ring + params.sq_off.array);
+
+    m_cqHead = (unsigned *)(ring + params.cq_off.head);
+    m_cqTail = (unsigned *)(ring + params.cq_off.tail);
+    m_cqMask = *(unsigned *)(ring + params.cq_off.ring_mask);
+    m_cqes   = (io_uring_cqe *)(ring + params.cq_off.cqes);
+
+    m_extArg = params.features & IORING_FEAT_EXT_ARG;
+    m_fd     = fd;
+}
+
+IoUring::~IoUring()
+{
+    if (m_sqes)
+    {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if (m_ring)
+    {
+        munmap(m_ring, m_ringSize);
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+void IoUring::PrepSqe(io_uring_sqe &sqe, uint8_t op, int fd, const void *addr, uint32_t len, uint64_t off)
+{
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = op;
+    sqe.fd     = fd;
+    sqe.addr   = (uint64_t)(uintptr_t)addr;
+    sqe.len    = len;
+    sqe.off    = off;
+}
+
+io_uring_sqe *IoUring::getSqe()
+{
+    // 没有SQPOLL时内核在io_uring_enter里同步消费提交队列，未提交的请求数就是被占用的槽位数
+    if (m_sqPending >= m_sqEntries)
+    {
+        return nullptr;
+    }
+    // 只有持锁的线程会修改尾指针
+    unsigned index = *m_sqTail & m_sqMask;
+    m_sqArray[index] = index;
+    return &m_sqes[index];
+}
+
+bool IoUring::push(const io_uring_sqe &sqe, const __kernel_timespec *timeout,
+                   uint64_t timeout_data, bool submit_now)
+{
+    MutexType::Lock lock(m_mutex);
+    unsigned need = timeout ? 2 : 1;
+    if (m_sqPending + need > m_sqEntries)
+    {
+        // 队列已满，先把攒下的请求提交掉腾出槽位
+        submitLocked();
+        if (m_sqPending + need > m_sqEntries)
+        {
+            return false;
+        }
+    }
+
+    io_uring_sqe *s = getSqe();
+    *s = sqe;
+    if (timeout)
+    {
+        s->flags |= IOSQE_IO_LINK;
+    }
+    __atomic_store_n(m_sqTail, *m_sqTail + 1, __ATOMIC_RELEASE);
+    ++m_sqPending;
+
+    if (timeout)
+    {
+        io_uring_sqe *t = getSqe();
+        PrepSqe(*t, IORING_OP_LINK_TIMEOUT, -1, timeout, 1, 0);
+        t->user_data = timeout_data;
+        __atomic_store_n(m_sqTail, *m_sqTail + 1, __ATOMIC_RELEASE);
+        ++m_sqPending;
+    }
+
+    if (submit_now)
+    {
+        return submitLocked() >= 0;
+    }
+    return true;
+}
+
+bool IoUring::cancelFd(int fd)
+{
+    io_uring_sqe sqe;
+    PrepSqe(sqe, IORING_OP_ASYNC_CANCEL, fd, nullptr, 0, 0);
+    sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe.user_data    = 0;
+    return push(sqe, nullptr, 0, true);
+}
+
+int IoUring::submit()
+{
+    MutexType::Lock lock(m_mutex);
+    return submitLocked();
+}
+
+int IoUring::submitLocked()
+{
+    int submitted = 0;
+    while (m_sqPending)
+    {
+        int rt = enter(m_sqPending, 0);
+        if (rt < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // EAGAIN/EBUSY表示内核暂时没有资源或完成队列积压，已提交的部分照常生效
+            if (submitted || errno == EAGAIN || errno == EBUSY)
+            {
+                break;
+            }
+            SYLAR_LOG_ERROR(g_logger) << "io_uring_enter(" << m_fd << ", " << m_sqPending
+                                      << ") errno=" << errno << " errstr=" << strerror(errno);
+            return -errno;
+        }
+        if (rt == 0)
+        {
+            break;
+        }
+        m_sqPending -= rt;
+        submitted += rt;
+    }
+    return submitted;
+}
+
+int IoUring::submitAndWait(uint64_t timeout_ms)
+{
+    unsigned to_submit = 0;
+    {
+        MutexType::Lock lock(m_mutex);
+        to_submit = m_sqPending;
+    }
+
+    __kernel_timespec ts;
+    ts.tv_sec  = timeout_ms / 1000;
+    ts.tv_nsec = timeout_ms % 1000 * 1000000;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+
+    // 阻塞期间不能持锁，其他线程同时提交时内核按顺序消费提交队列，各自只扣减自己实际提交的个数
+    int rt = enter(to_submit, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, 1, &arg, sizeof(arg));
+    if (rt > 0)
+    {
+        MutexType::Lock lock(m_mutex);
+        m_sqPending -= rt;
+        return rt;
+    }
+    if (rt < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+    {
+        SYLAR_LOG_ERROR(g_logger) << "io_uring_enter(" << m_fd << ", " << to_submit
+                                  << ", GETEVENTS) errno=" << errno << " errstr=" << strerror(errno);
+        return -errno;
+    }
+    return 0;
+}
+
+int IoUring::enter(unsigned to_submit, unsigned flags, unsigned min_complete,
+                   const void *arg, size_t argsz)
+{
+    ++m_enterCount;
+    return syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+size_t IoUring::popCompletions(io_uring_cqe *cqes, size_t max)
+{
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+    {
+        // 完成队列曾经溢出时，积压在内核里的完成事件要通过io_uring_enter刷回完成队列
+        if (!(__atomic_load_n(m_sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW))
+        {
+            return 0;
+        }
+        enter(0, IORING_ENTER_GETEVENTS);
+        tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    size_t n = 0;
+    while (head != tail && n < max)
+    {
+        cqes[n++] = m_cqes[head & m_cqMask];
+        ++head;
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+} // end namespace sylar
@@ -0,0 +1,165 @@
+/**
+ * @file io_uring.h
+ * @brief io_uring提交/完成队列的封装
+ * @details 直接使用io_uring_setup/io_uring_enter系统调用，不依赖liburing
+ * @version 0.1
+ * @date 2026-10-16
+ */
+
+#ifndef __SYLAR_IO_URING_H__
+#define __SYLAR_IO_URING_H__
+
+#include <linux/io_uring.h>
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace sylar {
+
+/**
+ * @brief 一个io_uring实例
+ * @details 提交队列可以被多个线程使用，由内部的锁保护；完成队列只能由所属的调度线程收割
+ */
+class IoUring : Noncopyable {
+public:
+    typedef Spinlock MutexType;
+
+    /**
+     * @brief 创建io_uring
+     * @param[in] entries 提交队列长度，完成队列长度为它的两倍
+     * @attention 内核不支持或禁用了io_uring时创建失败，isValid()返回false
+     */
+    IoUring(unsigned entries);
+
+    /**
+     * @brief 析构函数
+     */
+    ~IoUring();
+
+    /**
+     * @brief 是否创建成功
+     */
+    bool isValid() const { return m_fd >= 0; }
+
+    /**
+     * @brief 返回io_uring的句柄，有已完成的请求时可读，可以放入epoll中等待
+     */
+    int getFd() const { return m_fd; }
+
+    /**
+     * @brief 内核是否支持带超时的submitAndWait(IORING_FEAT_EXT_ARG)
+     */
+    bool canWait() const { return m_extArg; }
+
+    /**
+     * @brief 放入一个请求
+     * @param[in] sqe 请求内容，user_data由调用方设置
+     * @param[in] timeout 不为空时附加一个链接的超时请求，超时后请求被取消，超时请求的user_data为timeout_data
+     * @param[in] timeout_data 超时请求的user_data
+     * @param[in] submit_now 是否立即提交，否则留到下一次submit()时一起提交
+     * @return 提交队列已满且提交失败时返回false
+     */
+    bool push(const io_uring_sqe &sqe, const __kernel_timespec *timeout = nullptr,
+              uint64_t timeout_data = 0, bool submit_now = false);
+
+    /**
+     * @brief 取消fd上所有未完成的请求，立即提交
+     * @details 被取消的请求以-ECANCELED完成，取消请求本身的user_data为0
+     */
+    bool cancelFd(int fd);
+
+    /**
+     * @brief 提交所有尚未提交的请求
+     * @return 提交的请求数，失败返回-errno
+     */
+    int submit();
+
+    /**
+     * @brief 提交所有尚未提交的请求，并在同一次io_uring_enter里等待至少一个完成事件
+     * @details 等待期间不持有锁，其他线程可以继续放入和提交请求，需要canWait()为true
+     * @param[in] timeout_ms 最长等待时间，毫秒
+     * @return 提交的请求数，超时或被信号打断时返回0，失败返回-errno
+     */
+    int submitAndWait(uint64_t timeout_ms);
+
+    /**
+     * @brief 取出已完成的请求，只能由所属的调度线程调用
+     * @param[out] cqes 已完成请求的数组
+     * @param[in] max 最多取多少个
+     * @return 取出的个数
+     */
+    size_t popCompletions(io_uring_cqe *cqes, size_t max);
+
+    /**
+     * @brief 返回io_uring_enter的调用次数
+     */
+    uint64_t getEnterCount() const { return m_enterCount; }
+
+    /**
+     * @brief 填充一个请求
+     * @param[out] sqe 请求
+     * @param[in] op 操作码IORING_OP_XXX
+     * @param[in] fd 文件句柄
+     * @param[in] addr 缓冲区或地址
+     * @param[in] len 长度
+     * @param[in] off 偏移，connect时为地址长度，accept时为地址长度的指针
+     */
+    static void PrepSqe(io_uring_sqe &sqe, uint8_t op, int fd, const void *addr, uint32_t len, uint64_t off);
+
+private:
+    /**
+     * @brief 在持有锁时取一个空闲的请求槽位，队列已满时返回nullptr
+     */
+    io_uring_sqe *getSqe();
+
+    /**
+     * @brief 在持有锁时提交请求
+     */
+    int submitLocked();
+
+    /**
+     * @brief 调用io_uring_enter
+     */
+    int enter(unsigned to_submit, unsigned flags, unsigned min_complete = 0,
+              const void *arg = nullptr, size_t argsz = 0);
+
+private:
+    /// io_uring句柄
+    int m_fd = -1;
+    /// 提交队列和完成队列共用的映射
+    void *m_ring = nullptr;
+    /// m_ring的大小
+    size_t m_ringSize = 0;
+    /// 请求数组
+    io_uring_sqe *m_sqes = nullptr;
+    /// m_sqes的大小
+    size_t m_sqesSize = 0;
+
+    /// 提交队列的尾、掩码、标志和下标数组
+    unsigned *m_sqTail  = nullptr;
+    unsigned m_sqMask   = 0;
+    unsigned m_sqEntries = 0;
+    unsigned *m_sqFlags = nullptr;
+    unsigned *m_sqArray = nullptr;
+    /// 已放入但尚未提交的请求数
+    unsigned m_sqPending = 0;
+    /// 内核是否支持IORING_ENTER_EXT_ARG
+    bool m_extArg = false;
+
+    /// 完成队列的头、尾、掩码和数组
+    unsigned *m_cqHead = nullptr;
+    unsigned *m_cqTail = nullptr;
+    unsigned m_cqMask  = 0;
+    io_uring_cqe *m_cqes = nullptr;
+
+    /// 保护提交队列
+    MutexType m_mutex;
+    /// io_uring_enter的调用次数
+    std::atomic<uint64_t> m_enterCount = {0};
+};
+
+} // end namespace sylar
+
+#endif
@@ -5,10 +5,15 @@
  * @date 2021-06-16
  */
 
-#include <unistd.h>    // for pipe()
-#include <sys/epoll.h> // for epoll_xxx()
+#include <unistd.h>      // for read()/write()
+#include <sys/epoll.h>   // for epoll_xxx()
+#include <sys/eventfd.h> // for eventfd()
 #include <fcntl.h>     // for fcntl()
+#include <poll.h>      // for POLLIN
 #include "iomanager.h"
+#include "config.h"
+#include "hook.h"
+#include "io_uring.h"
 #include "log.h"
 #include "macro.h"
 
@@ -16,6 +21,42 @@ namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+static ConfigVar<std::string>::ptr g_iomanager_backend =
+    Config::Lookup<std::string>("iomanager.backend", "epoll", "iomanager io backend, epoll or io_uring");
+
+static ConfigVar<uint32_t>::ptr g_io_uring_entries =
+    Config::Lookup<uint32_t>("iomanager.io_uring.entries", 256, "io_uring submission queue entries per thread");
+
+static ConfigVar<bool>::ptr g_iomanager_coarse_clock =
+    Config::Lookup<bool>("iomanager.coarse_clock", false,
+                         "refresh the cached clock from CLOCK_MONOTONIC_COARSE/CLOCK_REALTIME_COARSE");
+
+static ConfigVar<bool>::ptr g_iomanager_per_thread_timer =
+    Config::Lookup<bool>("iomanager.per_thread_timer", false, "every worker thread owns a timer wheel");
+
+static ConfigVar<bool>::ptr g_iomanager_edge_cache =
+    Config::Lookup<bool>("iomanager.edge_cache", false,
+                         "keep hooked socket fds registered with EPOLLET and cache readiness between waits");
+
+/// io_uring中等待线程私有epoll的POLL_ADD请求的user_data，请求的user_data是对齐的指针，不会和它冲突
+static const uint64_t URING_EPOLL_DATA = 2;
+
+struct IOManager::UringRequest 
+{
+    /// 等待请求完成的协程
+    Fiber::ptr fiber;
+    /// 请求所在fd的上下文
+    FdContext *fdCtx = nullptr;
+    /// 请求的结果
+    int res = 0;
+    /// 还没收到的完成事件数，带超时的请求还有一个超时请求的完成事件
+    int remaining = 1;
+    /// 超时请求是否已触发
+    bool timedOut = false;
+    /// 超时时间
+    __kernel_timespec timeout;
+};
+
 enum EpollCtlOp {};
 
 static std::ostream &operator<<(std::ostream &os, const EpollCtlOp &op) 
@@ -88,7 +129,7 @@ void IOManager::FdContext::resetEventContext(EventContext &ctx)
 }
 
 //triggerEvent只是把触发的事件的协程或者回调函数添加到任务队列等待调度协程的调度
-void IOManager::FdContext::triggerEvent(IOManager::Event event) 
+void IOManager::FdContext::triggerEvent(IOManager::Event event, std::vector<ScheduleTask *> *batch) 
 {
     // 待触发的事件必须已被注册过
     SYLAR_ASSERT(events & event);
@@ -101,7 +142,18 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event)
     events = (Event)(events & ~event);
     // 调度对应的协程
     EventContext &ctx = getEventContext(event);
-    if (ctx.cb) 
+    if (batch && ctx.scheduler == Scheduler::GetThis()) 
+    {
+        if (ctx.cb) 
+        {
+            batch->push_back(new ScheduleTask(&ctx.cb, -1));
+        } 
+        else 
+        {
+            batch->push_back(new ScheduleTask(&ctx.fiber, -1));
+        }
+    } 
+    else if (ctx.cb) 
     {
         ctx.scheduler->schedule(ctx.cb);
     } 
@@ -113,31 +165,101 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event)
     return;
 }
 
-IOManager::IOManager(size_t threads, bool use_caller, const std::string &name)
-                    : Scheduler(threads, use_caller, name) 
+IOManager::IOManager(size_t threads, bool use_caller, const std::string &name, bool per_thread_epoll,
+                     Backend backend)
+                    : Scheduler(threads, use_caller, name)
+                    , m_perThreadEpoll(per_thread_epoll) 
 {
     //创建一个epoll对象
     m_epfd = epoll_create(5000);
     SYLAR_ASSERT(m_epfd > 0);
-    //创建一个管道 m_tickleFds[0]读端 m_tickleFds[1]写端 成功返回0
-    int rt = pipe(m_tickleFds);
-    SYLAR_ASSERT(!rt);
+    //创建唤醒poller用的eventfd，非阻塞，配合边缘触发
+    m_pollerEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    SYLAR_ASSERT(m_pollerEventFd >= 0);
 
-    // 关注pipe读句柄的可读事件，用于tickle协程
+    // 关注eventfd的可读事件，用于tickle poller
     epoll_event event;
     memset(&event, 0, sizeof(epoll_event));
     event.events  = EPOLLIN | EPOLLET; //添加读事件和边沿触发模式
-    event.data.fd = m_tickleFds[0];
+    event.data.fd = m_pollerEventFd;
 
-    // 管道0端的fd添加非阻塞方式，配合边缘触发
-    rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
+    //将eventfd加⼊epoll多路复⽤，如果eventfd可读，poller的epoll_wait会返回
+    int rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_pollerEventFd, &event);
     SYLAR_ASSERT(!rt);
 
-    //将管道的读描述符加⼊epoll多路复⽤，如果管道可读，idle中的epoll_wait会返回
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
-    SYLAR_ASSERT(!rt);
+    // 每个调度线程一个eventfd和只监听它的epoll，不做poller的空闲线程休眠在这里，只能被定向唤醒
+    m_wakeups.resize(getWorkerCount());
+    for (auto &i : m_wakeups) 
+    {
+        i          = new WakeupContext;
+        i->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        SYLAR_ASSERT(i->eventFd >= 0);
+        i->epfd = epoll_create(1);
+        SYLAR_ASSERT(i->epfd >= 0);
+
+        memset(&event, 0, sizeof(epoll_event));
+        event.events  = EPOLLIN;
+        event.data.fd = i->eventFd;
+        rt            = epoll_ctl(i->epfd, EPOLL_CTL_ADD, i->eventFd, &event);
+        SYLAR_ASSERT(!rt);
+    }
+
+    if (backend == BACKEND_DEFAULT) 
+    {
+        backend = g_iomanager_backend->getValue() == "io_uring" ? BACKEND_IO_URING : BACKEND_EPOLL;
+    }
+    if (backend == BACKEND_IO_URING) 
+    {
+        // 每个调度线程一个io_uring，内核支持带超时的等待时idle直接阻塞在io_uring_enter上，由它等待线程私有的epoll，
+        // 否则把io_uring注册到线程私有的epoll上（水平触发），有完成的请求时唤醒该线程
+        m_ioUring = true;
+        for (auto &i : m_wakeups) 
+        {
+            i->ring = new IoUring(g_io_uring_entries->getValue());
+            if (!i->ring->isValid()) 
+            {
+                m_ioUring = false;
+                break;
+            }
+            if (i->ring->canWait()) 
+            {
+                continue;
+            }
+            memset(&event, 0, sizeof(epoll_event));
+            event.events  = EPOLLIN;
+            event.data.fd = i->ring->getFd();
+            rt            = epoll_ctl(i->epfd, EPOLL_CTL_ADD, i->ring->getFd(), &event);
+            SYLAR_ASSERT(!rt);
+        }
+        if (m_ioUring) 
+        {
+            m_perThreadEpoll = true;
+        } 
+        else 
+        {
+            SYLAR_LOG_WARN(g_logger) << "io_uring unavailable, IOManager " << name << " falls back to epoll";
+            for (auto &i : m_wakeups) 
+            {
+                delete i->ring;
+                i->ring = nullptr;
+            }
+        }
+    }
 
-    contextResize(32);
+    for (int i = 0; i < FD_MAX_SEGMENTS; ++i) 
+    {
+        m_fdSegments[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    // 每线程时间轮：调度线程i添加的定时器放在i + 1号时间轮，由它自己等待和处理，不和其它线程争一把锁
+    // 0号时间轮留给调度器之外的线程，由poller处理
+    m_perThreadTimer = g_iomanager_per_thread_timer->getValue();
+    m_edgeCache      = g_iomanager_edge_cache->getValue();
+    SetCoarseClock(g_iomanager_coarse_clock->getValue());
+    if (m_perThreadTimer) 
+    {
+        setTimerWheelCount(m_wakeups.size() + 1);
+    }
     // 这⾥直接开启了Schedluer的start函数，也就是说IOManager创建即可调度协程
     start();
 }
@@ -153,30 +275,53 @@ IOManager::~IOManager()
     //在析构里调stop方法，让所有的任务都会被完成才结束
     stop();
     close(m_epfd);
-    close(m_tickleFds[0]);
-    close(m_tickleFds[1]);
+    close(m_pollerEventFd);
+    for (auto &i : m_wakeups) 
+    {
+        close(i->epfd);
+        close(i->eventFd);
+        delete i->ring;
+        delete i;
+    }
 
-    for (size_t i = 0; i < m_fdContexts.size(); ++i) 
+    for (int i = 0; i < FD_MAX_SEGMENTS; ++i) 
     {
-        if (m_fdContexts[i]) 
-        {
-            delete m_fdContexts[i];
-        }
+        delete m_fdSegments[i].load(std::memory_order_relaxed);
     }
 }
 
-void IOManager::contextResize(size_t size) 
+IOManager::FdContext *IOManager::getFdContext(int fd, bool auto_create) 
 {
-    m_fdContexts.resize(size);
-
-    for (size_t i = 0; i < m_fdContexts.size(); ++i) 
+    if (SYLAR_UNLIKELY(fd < 0 || fd >= FD_SEGMENT_SIZE * FD_MAX_SEGMENTS)) 
+    {
+        return nullptr;
+    }
+    std::atomic<FdSegment *> &slot = m_fdSegments[fd >> FD_SEGMENT_SHIFT];
+    FdSegment *segment = slot.load(std::memory_order_acquire);
+    if (SYLAR_UNLIKELY(!segment)) 
     {
-        if (!m_fdContexts[i]) 
+        if (!auto_create) 
         {
-            m_fdContexts[i]     = new FdContext;
-            m_fdContexts[i]->fd = i;
+            return nullptr;
+        }
+        // 段只增不减，多个线程同时分配同一段时只有一个能装上，其余的释放自己分配的
+        // 其它段的读者完全不受影响，不存在扩容时的全局停顿
+        FdSegment *fresh = new FdSegment;
+        int base         = fd & ~(FD_SEGMENT_SIZE - 1);
+        for (int i = 0; i < FD_SEGMENT_SIZE; ++i) 
+        {
+            fresh->contexts[i].fd = base + i;
+        }
+        if (slot.compare_exchange_strong(segment, fresh, std::memory_order_acq_rel)) 
+        {
+            segment = fresh;
+        } 
+        else 
+        {
+            delete fresh;
         }
     }
+    return &segment->contexts[fd & (FD_SEGMENT_SIZE - 1)];
 }
 
 /**
@@ -188,21 +333,18 @@ void IOManager::contextResize(size_t size)
 * @return 添加成功返回0,失败返回-1
  */
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) 
+{
+    return addEvent(fd, event, cb, 0);
+}
+
+int IOManager::addEvent(int fd, Event event, std::function<void()> cb, uint64_t generation) 
 {
     // 找到fd对应的FdContext，如果不存在，那就分配一个
-    FdContext *fd_ctx = nullptr;
-    RWMutexType::ReadLock lock(m_mutex);
-    if ((int)m_fdContexts.size() > fd) 
+    FdContext *fd_ctx = getFdContext(fd, true);
+    if (SYLAR_UNLIKELY(!fd_ctx)) 
     {
-        fd_ctx = m_fdContexts[fd];
-        lock.unlock();
-    } 
-    else 
-    {
-        lock.unlock();
-        RWMutexType::WriteLock lock2(m_mutex);
-        contextResize(fd * 1.5);
-        fd_ctx = m_fdContexts[fd];
+        SYLAR_LOG_ERROR(g_logger) << "addEvent fd=" << fd << " out of range";
+        return -1;
     }
 
     // 同一个fd不允许重复添加相同的事件
@@ -216,21 +358,58 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
         SYLAR_ASSERT(!(fd_ctx->events & event));
     }
 
+    // 每线程epoll模式下，fd第一次添加事件时分配给一个调度线程，之后一直由它的epoll监听
+    // 优先分配给当前调度线程，调度器之外的线程添加时轮流分配
+    if (m_perThreadEpoll && fd_ctx->owner < 0) 
+    {
+        fd_ctx->owner = getThisWorkerIndex();
+        if (fd_ctx->owner < 0) 
+        {
+            fd_ctx->owner = m_assignCursor++ % m_wakeups.size();
+        }
+    }
+
     // 将新的事件加入epoll_wait，使用epoll_event的私有指针存储FdContext的位置
     // fd_ctx->events? 判断此时的fd上面是否有事件 有时候初始化的fd上面什么事件也没有 那么就是add 如果该fd上面已有别的事件 那么就是mod
-    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-    epoll_event epevent;
-    epevent.events   = EPOLLET | fd_ctx->events | event; //此时只是将事件添加到监听列表，fd_ctx内部还没添加之和事件
-    epevent.data.ptr = fd_ctx;
-
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent); // 成功返回0
-    if (rt) 
+    // 常驻注册过这个方向的fd不需要再调用epoll_ctl
+    bool persistent = generation && m_edgeCache;
+    bool reused     = false;
+    if (persistent && fd_ctx->persistent && fd_ctx->generation != generation) 
     {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
-                                  << (EPOLL_EVENTS)fd_ctx->events;
-        return -1;
+        // 常驻注册之后fd被关闭或从FdManager删除过，同号的新fd不一定在epoll里，旧fd留下的就绪状态作废。
+        // hook的close会先用cancelAll删除注册，走到这里的是绕过它关闭的fd(close_f)，
+        // 注册一般随旧fd关闭被内核删除了，旧文件还被别的fd引用时注册还在
+        fd_ctx->persistent = NONE;
+        fd_ctx->ready      = NONE;
+        reused             = true;
+    }
+    if (!(fd_ctx->persistent & event)) 
+    {
+        int op = (fd_ctx->events | fd_ctx->persistent) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        //此时只是将事件添加到监听列表，fd_ctx内部还没添加之和事件
+        //常驻注册只关注等待过的方向，只读的fd不会因为发送缓冲区的变化被唤醒
+        uint32_t events = EPOLLET | fd_ctx->events | fd_ctx->persistent | event;
+        // fd号被复用时不知道旧注册还在不在，失败了换另一种操作
+        int expected = reused ? (op == EPOLL_CTL_ADD ? EEXIST : ENOENT) : 0;
+        if (epollCtl(fd_ctx, op, events, expected)) 
+        {
+            if (!expected || errno != expected 
+                    || epollCtl(fd_ctx, op == EPOLL_CTL_ADD ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, events)) 
+            {
+                return -1;
+            }
+        }
+        if (fd_ctx->persistent) 
+        {
+            // 已经常驻注册的fd上新增的方向也常驻，注册时已经就绪的话内核会报告一次，之后只在状态变化时报告
+            fd_ctx->persistent = (Event)(fd_ctx->persistent | event);
+        }
+        else if (persistent) 
+        {
+            fd_ctx->persistent = (Event)(fd_ctx->events | event);
+            fd_ctx->generation = generation;
+            fd_ctx->ready      = NONE;
+        }
     }
 
     // 待执行IO事件数加1
@@ -254,19 +433,45 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
         event_ctx.fiber = Fiber::GetThis();
         SYLAR_ASSERT2(event_ctx.fiber->getState() == Fiber::RUNNING, "state=" << event_ctx.fiber->getState());
     }
+
+    // 没有等待者期间已经报告过就绪，内核不会再报告，直接触发
+    if (fd_ctx->ready & event) 
+    {
+        fd_ctx->ready = (Event)(fd_ctx->ready & ~event);
+        fd_ctx->triggerEvent(event);
+        --m_pendingEventCount;
+    }
     return 0;
 }
 
+int IOManager::epollCtl(FdContext *fd_ctx, int op, uint32_t events, int expected_errno) 
+{
+    epoll_event epevent;
+    epevent.events   = events;
+    epevent.data.ptr = fd_ctx;
+
+    int epfd = getEpollFd(fd_ctx);
+    countSyscall();
+    ++m_epollCtlCount;
+    int rt   = epoll_ctl(epfd, op, fd_ctx->fd, &epevent); // 成功返回0
+    if (rt && errno != expected_errno) 
+    {
+        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                                  << (EpollCtlOp)op << ", " << fd_ctx->fd << ", " << (EPOLL_EVENTS)events << "):"
+                                  << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
+                                  << (EPOLL_EVENTS)fd_ctx->events;
+    }
+    return rt;
+}
+
 bool IOManager::delEvent(int fd, Event event) 
 {
-    // 找到fd对应的FdContext ->找到文件描述符fd对应的文件描述符FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if ((int)m_fdContexts.size() <= fd) 
+    // 找到fd对应的FdContext，所在的段还没分配说明fd上从未添加过事件
+    FdContext *fd_ctx = getFdContext(fd, false);
+    if (!fd_ctx) 
     {
         return false;
     }
-    FdContext *fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
     // 给fd加锁
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
@@ -277,19 +482,15 @@ bool IOManager::delEvent(int fd, Event event)
     }
 
     // 清除指定的事件，表示不关心这个事件了，如果清除之后结果为0，则从epoll_wait中删除该文件描述符
+    // 常驻注册的fd保持注册，只清除等待者
     Event new_events = (Event)(fd_ctx->events & ~event);
-    int op           = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events   = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
-
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if (rt) 
+    if (!fd_ctx->persistent) 
     {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        if (epollCtl(fd_ctx, op, EPOLLET | new_events)) 
+        {
+            return false;
+        }
     }
 
     // 待执行事件数减1
@@ -305,36 +506,34 @@ bool IOManager::delEvent(int fd, Event event)
 
 bool IOManager::cancelEvent(int fd, Event event) 
 {
-    // 找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if ((int)m_fdContexts.size() <= fd) 
+    // 找到fd对应的FdContext，所在的段还没分配说明fd上从未添加过事件
+    FdContext *fd_ctx = getFdContext(fd, false);
+    if (!fd_ctx) 
     {
         return false;
     }
-    FdContext *fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
-    // fd上没有该事件 返回false
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    return cancelEventLocked(fd_ctx, event);
+}
+
+bool IOManager::cancelEventLocked(FdContext *fd_ctx, Event event) 
+{
+    // fd上没有该事件 返回false
     if (SYLAR_UNLIKELY(!(fd_ctx->events & event))) 
     {
         return false;
     }
 
-    // 删除事件
+    // 删除事件，常驻注册的fd保持注册
     Event new_events = (Event)(fd_ctx->events & ~event);
-    int op           = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events   = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
-
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if (rt) 
+    if (!fd_ctx->persistent) 
     {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        if (epollCtl(fd_ctx, op, EPOLLET | new_events)) 
+        {
+            return false;
+        }
     }
 
     // 删除之前触发一次事件
@@ -344,36 +543,153 @@ bool IOManager::cancelEvent(int fd, Event event)
     return true;
 }
 
+int IOManager::waitEvent(int fd, Event event, uint64_t timeout_ms, uint64_t generation) 
+{
+    FdContext *fd_ctx = getFdContext(fd, true);
+    if (SYLAR_UNLIKELY(!fd_ctx)) 
+    {
+        SYLAR_LOG_ERROR(g_logger) << "waitEvent fd=" << fd << " out of range";
+        return -1;
+    }
+    // 同一个fd同一个事件同时只有一个等待者，waitSeq和timer只由等待者修改，超时回调在锁内读取
+    FdContext::EventContext &event_ctx = fd_ctx->getEventContext(event);
+    uint32_t seq = 0;
+    {
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        // 上次等待之后内核已经报告过就绪，调用方这次失败只是因为数据被之前的读写取完之前还没到，
+        // 直接返回让调用方重试，不用添加事件和切换协程
+        if (fd_ctx->persistent && fd_ctx->generation == generation && (fd_ctx->ready & event)) 
+        {
+            fd_ctx->ready = (Event)(fd_ctx->ready & ~event);
+            return 0;
+        }
+        if (timeout_ms != (uint64_t)-1) 
+        {
+            // 序号每次加2，最低位留给事件类型
+            event_ctx.waitSeq += 2;
+            event_ctx.timedOut = false;
+            seq = event_ctx.waitSeq | (event == WRITE ? 1 : 0);
+        }
+    }
+
+    if (timeout_ms == (uint64_t)-1) 
+    {
+        if (addEvent(fd, event, nullptr, generation)) 
+        {
+            return -1;
+        }
+        Fiber::GetThis()->yield();
+        return 0;
+    }
+
+    // 和原来的条件定时器一样先启动定时器再添加事件
+    // 回调只捕获this和一个整数，std::function内部可以直接存放，不分配内存
+    uint64_t key = (uint64_t)(uint32_t)fd << 32 | seq;
+    auto cb = [this, key]() { onWaitTimeout(key); };
+    if (!event_ctx.timer) 
+    {
+        event_ctx.timer = addTimer(timeout_ms, cb);
+    } 
+    else if (!event_ctx.timer->restart(timeout_ms, cb)) 
+    {
+        // 上一次等待结束时已经取消了定时器，不会还在时间轮里
+        SYLAR_ASSERT2(false, "waitEvent timer still armed fd=" << fd);
+    }
+
+    if (addEvent(fd, event, nullptr, generation)) 
+    {
+        event_ctx.timer->cancel();
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        event_ctx.waitSeq += 2;
+        return -1;
+    }
+    {
+        // 添加事件之前就已经超时，回调找不到事件，由这里取消
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        if (event_ctx.timedOut) 
+        {
+            cancelEventLocked(fd_ctx, event);
+        }
+    }
+
+    Fiber::GetThis()->yield();
+
+    event_ctx.timer->cancel();
+    FdContext::MutexType::Lock lock(fd_ctx->mutex);
+    // 作废已经取出但还没执行的超时回调
+    event_ctx.waitSeq += 2;
+    return event_ctx.timedOut ? ETIMEDOUT : 0;
+}
+
+void IOManager::onWaitTimeout(uint64_t key) 
+{
+    int fd            = (int)(key >> 32);
+    uint32_t seq      = (uint32_t)key;
+    Event event       = (seq & 1) ? WRITE : READ;
+    FdContext *fd_ctx = getFdContext(fd, false);
+    if (!fd_ctx) 
+    {
+        return;
+    }
+    FdContext::MutexType::Lock lock(fd_ctx->mutex);
+    FdContext::EventContext &event_ctx = fd_ctx->getEventContext(event);
+    // 等待已经结束，或者已经是下一次等待
+    if ((event_ctx.waitSeq | (seq & 1)) != seq) 
+    {
+        return;
+    }
+    event_ctx.timedOut = true;
+    // 事件还没添加时由waitEvent在添加之后取消
+    if (fd_ctx->events & event) 
+    {
+        cancelEventLocked(fd_ctx, event);
+    }
+}
+
 bool IOManager::cancelAll(int fd) 
 {
-    // 找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if ((int)m_fdContexts.size() <= fd) 
+    // 找到fd对应的FdContext，所在的段还没分配说明fd上从未添加过事件
+    FdContext *fd_ctx = getFdContext(fd, false);
+    if (!fd_ctx) 
     {
         return false;
     }
-    FdContext *fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
-    // fd上没有事件 返回fales
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-    if (!fd_ctx->events) 
+    if (m_ioUring && fd_ctx->uringOps > 0 && fd_ctx->owner >= 0) 
     {
-        return false;
+        // fd上还有未完成的io_uring请求，关闭fd不会让它们结束，要显式取消，等待的协程返回EBADF
+        m_wakeups[fd_ctx->owner]->ring->cancelFd(fd);
     }
 
-    // 删除全部事件
-    int op = EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events   = 0;
-    epevent.data.ptr = fd_ctx;
+    // fd上没有事件 返回fales
+    // 常驻注册的fd即使没有等待者也还在epoll里，关闭前要删除，否则同号的新fd会收到旧fd的事件
+    if (!fd_ctx->events && !fd_ctx->persistent) 
+    {
+        // cancelAll一般发生在fd关闭时，解除fd和调度线程的绑定，同号的新fd重新分配
+        // 还有io_uring请求没收割时保留绑定，它们的完成事件只会出现在原来线程的io_uring上
+        if (!fd_ctx->uringOps) 
+        {
+            fd_ctx->owner = -1;
+        }
+        return false;
+    }
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if (rt) 
+    // 删除全部事件，常驻注册的fd可能已经在IOManager之外被关闭，注册随之没了
+    if (epollCtl(fd_ctx, EPOLL_CTL_DEL, 0, fd_ctx->persistent ? ENOENT : 0)
+            && (!fd_ctx->persistent || errno != ENOENT)) 
+    {
+        return false;
+    }
+    fd_ctx->persistent = NONE;
+    fd_ctx->generation = 0;
+    fd_ctx->ready      = NONE;
+    if (!fd_ctx->events) 
     {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
+        if (!fd_ctx->uringOps) 
+        {
+            fd_ctx->owner = -1;
+        }
         return false;
     }
 
@@ -390,15 +706,294 @@ bool IOManager::cancelAll(int fd)
     }
 
     SYLAR_ASSERT(fd_ctx->events == 0);
+    if (!fd_ctx->uringOps) 
+    {
+        fd_ctx->owner = -1;
+    }
     return true;
 }
 
+int IOManager::submitIo(int fd, const io_uring_sqe &sqe, uint64_t timeout_ms) 
+{
+    SYLAR_ASSERT(m_ioUring);
+    int index = getThisWorkerIndex();
+    SYLAR_ASSERT(index >= 0);
+    FdContext *fd_ctx = getFdContext(fd, true);
+    if (SYLAR_UNLIKELY(!fd_ctx)) 
+    {
+        return -EBADF;
+    }
+
+    // 和每线程epoll一样，fd第一次使用时分配给当前调度线程，之后的请求都放进它的io_uring，由它收割
+    int owner = -1;
+    {
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        if (fd_ctx->owner < 0) 
+        {
+            fd_ctx->owner = index;
+        }
+        owner = fd_ctx->owner;
+        ++fd_ctx->uringOps;
+    }
+
+    UringRequest req;
+    req.fiber = Fiber::GetThis();
+    req.fdCtx = fd_ctx;
+
+    io_uring_sqe request = sqe;
+    request.user_data    = (uint64_t)(uintptr_t)&req;
+    __kernel_timespec *timeout = nullptr;
+    if (timeout_ms != (uint64_t)-1) 
+    {
+        // 链接一个超时请求，由内核在超时后取消本请求，超时请求的user_data低位置1以示区分
+        req.timeout.tv_sec  = timeout_ms / 1000;
+        req.timeout.tv_nsec = timeout_ms % 1000 * 1000000;
+        req.remaining       = 2;
+        timeout             = &req.timeout;
+    }
+
+    ++m_pendingEventCount;
+    // 所属线程就是当前线程时先不提交，回到idle时一次io_uring_enter把本轮攒下的请求全部提交
+    if (!m_wakeups[owner]->ring->push(request, timeout, request.user_data | 1, owner != index)) 
+    {
+        --m_pendingEventCount;
+        --fd_ctx->uringOps;
+        return -EAGAIN;
+    }
+
+    // 请求完成后协程在所属线程上恢复，之后对这个fd的请求都是本线程的，不用再立即提交；
+    // 其它线程发起的请求可能在这里yield之前就完成了，调度器会等协程让出之后再恢复它
+    Fiber::GetThis()->yield();
+
+    if (req.timedOut && (req.res == -ECANCELED || req.res == -EINTR)) 
+    {
+        return -ETIMEDOUT;
+    }
+    if (req.res == -ECANCELED) 
+    {
+        return -EBADF;
+    }
+    return req.res;
+}
+
+size_t IOManager::reapCompletions(WakeupContext *ctx, std::vector<ScheduleTask *> &batch) 
+{
+    static const size_t MAX_CQES = 64;
+    io_uring_cqe cqes[MAX_CQES];
+    size_t done = 0;
+    size_t n    = 0;
+    do {
+        n = ctx->ring->popCompletions(cqes, MAX_CQES);
+        for (size_t i = 0; i < n; ++i) 
+        {
+            uint64_t data = cqes[i].user_data;
+            if (!data) 
+            {
+                // 取消请求自己的完成事件
+                continue;
+            }
+            if (data == URING_EPOLL_DATA) 
+            {
+                // 线程私有的epoll上有就绪的fd，POLL_ADD是一次性的，取完之后再重新放入
+                ctx->epollArmed = false;
+                ctx->epollReady = true;
+                continue;
+            }
+            UringRequest *req = (UringRequest *)(uintptr_t)(data & ~1ull);
+            if (data & 1) 
+            {
+                // 超时请求：-ETIME表示超时已触发，-ECANCELED表示请求先完成了
+                if (cqes[i].res == -ETIME || cqes[i].res == -EALREADY) 
+                {
+                    req->timedOut = true;
+                }
+            } 
+            else 
+            {
+                req->res = cqes[i].res;
+            }
+            if (--req->remaining == 0) 
+            {
+                --req->fdCtx->uringOps;
+                batch.push_back(new ScheduleTask(&req->fiber, GetThreadId()));
+                ++done;
+            }
+        }
+    } while (n == MAX_CQES);
+    return done;
+}
+
+int IOManager::waitRing(WakeupContext *self, epoll_event *events, int max, uint64_t timeout,
+                        std::vector<ScheduleTask *> &batch, size_t &triggered) 
+{
+    if (!self->epollArmed && !self->epollReady) 
+    {
+        // 上一次的POLL_ADD已经完成，重新放入，和本轮攒下的请求一起提交
+        io_uring_sqe sqe;
+        IoUring::PrepSqe(sqe, IORING_OP_POLL_ADD, self->epfd, nullptr, 0, 0);
+        sqe.poll32_events = POLLIN;
+        sqe.user_data     = URING_EPOLL_DATA;
+        self->epollArmed  = self->ring->push(sqe);
+        if (!self->epollArmed) 
+        {
+            // 提交队列满了放不进去，不能阻塞太久，否则epfd上的事件和唤醒都收不到
+            timeout = std::min(timeout, (uint64_t)1);
+        }
+    }
+
+    if (self->epollReady) 
+    {
+        // epfd已经就绪，只提交不等待
+        self->ring->submit();
+    } 
+    else 
+    {
+        self->ring->submitAndWait(timeout);
+    }
+    triggered += reapCompletions(self, batch);
+
+    if (!self->epollReady) 
+    {
+        return 0;
+    }
+    self->epollReady = false;
+    int rt = 0;
+    do {
+        countSyscall();
+        rt = epoll_wait_f(self->epfd, events, max, 0);
+    } while (rt < 0 && errno == EINTR);
+    return rt;
+}
+
+void IOManager::countSyscall(uint64_t n) 
+{
+    int index = getThisWorkerIndex();
+    if (index >= 0) 
+    {
+        m_wakeups[index]->syscalls += n;
+    } 
+    else 
+    {
+        m_syscallCount += n;
+    }
+}
+
+uint64_t IOManager::getSyscallCount() 
+{
+    uint64_t count = m_syscallCount;
+    for (auto &i : m_wakeups) 
+    {
+        count += i->syscalls;
+        if (i->ring) 
+        {
+            count += i->ring->getEnterCount();
+        }
+    }
+    return count;
+}
+
 IOManager *IOManager::GetThis() 
 {
     // 父转子
     return dynamic_cast<IOManager *>(Scheduler::GetThis());
 }
 
+bool IOManager::wakeup(WakeupContext *ctx) 
+{
+    // 已经有未处理的唤醒，不用重复写eventfd
+    if (ctx->pending.exchange(true)) 
+    {
+        return false;
+    }
+    uint64_t one = 1;
+    countSyscall();
+    int rt = write(ctx->eventFd, &one, sizeof(one));
+    SYLAR_ASSERT(rt == sizeof(one));
+    ++m_wakeupWriteCount;
+    return true;
+}
+
+int IOManager::getEpollFd(FdContext *fd_ctx) 
+{
+    if (m_perThreadEpoll && fd_ctx->owner >= 0) 
+    {
+        return m_wakeups[fd_ctx->owner]->epfd;
+    }
+    return m_epfd;
+}
+
+bool IOManager::wakeupPoller() 
+{
+    int poller = m_poller;
+    if (poller == -1) 
+    {
+        return false;
+    }
+    if (m_perThreadEpoll) 
+    {
+        // 每线程epoll模式下poller等待的是自己的epoll
+        return wakeup(m_wakeups[poller]);
+    }
+    if (m_pollerPending.exchange(true)) 
+    {
+        return false;
+    }
+    uint64_t one = 1;
+    countSyscall();
+    int rt = write(m_pollerEventFd, &one, sizeof(one));
+    SYLAR_ASSERT(rt == sizeof(one));
+    ++m_wakeupWriteCount;
+    return true;
+}
+
+bool IOManager::wakeupSleeper() 
+{
+    size_t n     = m_wakeups.size();
+    size_t start = m_wakeupCursor++;
+    for (size_t i = 0; i < n; ++i) 
+    {
+        WakeupContext *ctx = m_wakeups[(start + i) % n];
+        if (ctx->sleeping && wakeup(ctx)) 
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void IOManager::wakeupAllSleepers() 
+{
+    for (auto &i : m_wakeups) 
+    {
+        if (i->sleeping) 
+        {
+            wakeup(i);
+        }
+    }
+}
+
+void IOManager::releasePoller() 
+{
+    m_poller = -1;
+    // 每线程epoll模式下poller只负责0号时间轮，时间轮为空时不用交接，之后插入的定时器看到没有poller会唤醒休眠的线程
+    if (m_perThreadEpoll && !hasTimer(0)) 
+    {
+        return;
+    }
+    // 交接poller，保证有线程在休眠时IO事件和定时器仍然有人等待
+    wakeupSleeper();
+}
+
+void IOManager::yieldIdle() 
+{
+    Fiber::ptr cur = Fiber::GetThis(); //返回当前正在执行的协程，也就是idle协程 此时idle协程的引用计数+1
+    auto raw_ptr   = cur.get(); //返回该idle协程的裸指针
+    cur.reset(); //引用计数-1
+
+    //当前idle协程让出执行权 调度协程被resume
+    raw_ptr->yield();
+}
+
 /**
  * 通知调度协程、也就是Scheduler::run()从idle中退出
  * Scheduler::run()每次从idle协程中退出之后，都会重新把任务队列里的所有任务执行完了再重新进入idle
@@ -407,16 +1002,46 @@ IOManager *IOManager::GetThis()
 void IOManager::tickle() 
 {
     SYLAR_LOG_DEBUG(g_logger) << "tickle";
-    // 判断的是其他线程上有无正在运行的idle协程 此处的逻辑就是：如果任务队列还有任务且此时还有idle协程在运行，即别的线程的idle协程陷在
-    // epoll_wait里，此时立即写管道让epoll_wait返回，如果没有idle协程在运行则说明其他线程都在运行工作协程或者是自己的调度协程，那也就
-    // 没必要通知了 
+    ++m_tickleCount;
+    // 判断的是其他线程上有无空闲的调度线程，如果没有则说明其他线程都在运行工作协程或者是自己的调度协程，那也就没必要通知了
     if(!hasIdleThreads()) 
     {
         return;
     }
-    //有任务->向管道的写端写入一个字节用于触发epoll_wait 
-    int rt = write(m_tickleFds[1], "T", 1);
-    SYLAR_ASSERT(rt == 1);
+    // 优先唤醒一个休眠的线程，都已被唤醒或者没有休眠的线程时再唤醒poller
+    if (wakeupSleeper()) 
+    {
+        return;
+    }
+    wakeupPoller();
+}
+
+void IOManager::tickleThread(int thread) 
+{
+    SYLAR_LOG_DEBUG(g_logger) << "tickle thread " << thread;
+    int index = getWorkerIndex(thread);
+    if (index < 0) 
+    {
+        tickle();
+        return;
+    }
+    if (index == getThisWorkerIndex()) 
+    {
+        // 目标就是当前线程，它在休眠之前会检查自己的收件箱，不用唤醒
+        return;
+    }
+    ++m_tickleCount;
+    // 只唤醒目标线程：它是poller就写poller的eventfd，在休眠就写它自己的eventfd，正在执行任务则不用通知
+    if (m_poller == index) 
+    {
+        wakeupPoller();
+        return;
+    }
+    WakeupContext *ctx = m_wakeups[index];
+    if (ctx->sleeping) 
+    {
+        wakeup(ctx);
+    }
 }
 
 bool IOManager::stopping() 
@@ -430,7 +1055,15 @@ bool IOManager::stopping(uint64_t &timeout)
     // 对于IOManager而言，必须等所有待调度的IO事件都执行完了才可以退出
     // 增加定时器功能后，还应该保证没有剩余的定时器待触发
     // Scheduler::stopping() m_stopping && m_tasks.empty() && m_activeThreadCount == 0;
-    timeout = getNextTimer();
+    // 每线程时间轮模式下各线程在idle里取自己的超时时间，这里只判断有没有定时器，不去锁其它线程的时间轮
+    if (m_perThreadTimer) 
+    {
+        timeout = hasTimer() ? 0 : ~0ull;
+    } 
+    else 
+    {
+        timeout = getNextTimer();
+    }
     return timeout == ~0ull && m_pendingEventCount == 0 && Scheduler::stopping();
 }
 
@@ -449,8 +1082,14 @@ void IOManager::idle()
     // 方便events数组释放，使用智能指针（其实不使用这个智能指针，只是在离开idle的时候可以自动的释放掉这个数组）
     std::shared_ptr<epoll_event> shared_events(events, [](epoll_event *ptr) { delete[] ptr; });
 
+    int index = getThisWorkerIndex();
+    SYLAR_ASSERT(index >= 0);
+    WakeupContext *self = m_wakeups[index];
+
     while (true) 
     {
+        // 每轮循环开始和epoll_wait返回时刷新本线程缓存的时钟，检查到期的定时器等在两次刷新之间都使用缓存值
+        UpdateCachedClock();
         // 获取下一个定时器的超时时间，顺便判断调度器是否停止
         uint64_t next_timeout = 0;
         if( SYLAR_UNLIKELY(stopping(next_timeout))) //调stopping同时会获得第一个定时器超时时间
@@ -460,46 +1099,177 @@ void IOManager::idle()
             // ☆☆☆☆☆☆☆☆☆☆☆
 
             // 定时器集合为空，IO事件做完，scheduler::stopping()为真 然后就从这个位置跳出循环，idle协程结束状态为term
+            // 休眠中的线程和poller不会自己发现可以停止了，逐个唤醒
+            int expected = index;
+            m_poller.compare_exchange_strong(expected, -1);
+            wakeupPoller();
+            wakeupAllSleepers();
             break;
         }
 
-        // 阻塞在epoll_wait上，等待事件发生或定时器超时
-        int rt = 0;
-        do{
-            // 默认超时时间5秒，如果下一个定时器的超时时间大于5秒，仍以5秒来计算超时，避免定时器超时时间太大时，epoll_wait一直阻塞
-            static const int MAX_TIMEOUT = 5000;
-            if(next_timeout != ~0ull) //下一个超时时间不是最大值
+        // 默认超时时间5秒，如果下一个定时器的超时时间大于5秒，仍以5秒来计算超时，避免定时器超时时间太大时，epoll_wait一直阻塞
+        static const int MAX_TIMEOUT = 5000;
+        if(next_timeout != ~0ull) //下一个超时时间不是最大值
+        {
+            next_timeout = std::min((int)next_timeout, MAX_TIMEOUT);
+        } 
+        else 
+        {
+            next_timeout = MAX_TIMEOUT;
+        }
+
+        // 同一时间只有一个空闲线程(poller)阻塞在m_epfd上等待IO事件和定时器，其他空闲线程休眠在自己的eventfd上
+        // 每线程epoll模式下，每个空闲线程都阻塞在自己的epoll上等待自己的fd，poller只是额外负责定时器
+        bool was_poller = (m_poller == index);
+        int expected    = -1;
+        bool is_poller  = was_poller || m_poller.compare_exchange_strong(expected, index);
+        if (!is_poller && !m_perThreadEpoll) 
+        {
+            // 先标记休眠再检查任务，和添加任务的一方先放任务再检查休眠标记配对，不会错过唤醒
+            // pending在休眠之前清除，上一轮迟到的唤醒最多让这次epoll_wait立即返回
+            self->pending  = false;
+            self->sleeping = true;
+            if (m_perThreadTimer) 
             {
-                next_timeout = std::min((int)next_timeout, MAX_TIMEOUT);
-            } 
-            else 
+                // 先标记休眠再取超时时间，其它线程往本线程的时间轮插入更早的定时器时一定能看到休眠标记
+                next_timeout = std::min(getNextTimer(index + 1), (uint64_t)MAX_TIMEOUT);
+            }
+            if (!hasPendingTasks()) 
+            {
+                epoll_event event;
+                int rt = 0;
+                do {
+                    countSyscall();
+                    // 调度线程开启了hook，idle自己的等待要绕过hook的epoll_wait
+                    rt = epoll_wait_f(self->epfd, &event, 1, (int)next_timeout);
+                } while (rt < 0 && errno == EINTR);
+                UpdateCachedClock();
+            }
+            self->sleeping = false;
+            uint64_t dummy;
+            do {
+                countSyscall();
+            } while (read(self->eventFd, &dummy, sizeof(dummy)) > 0);
+            if (m_perThreadTimer) 
+            {
+                scheduleExpiredTimers(index + 1);
+            }
+            yieldIdle();
+            continue;
+        }
+
+        if (is_poller && !was_poller) 
+        {
+            // 刚成为poller，清除上一任poller遗留的唤醒标记
+            m_pollerPending = false;
+        }
+
+        int wait_fd = m_epfd;
+        int wake_fd = m_pollerEventFd;
+        if (m_perThreadEpoll) 
+        {
+            wait_fd = self->epfd;
+            wake_fd = self->eventFd;
+            if (!is_poller) 
             {
                 next_timeout = MAX_TIMEOUT;
             }
-            //在超时时间内获取有响应的事件 并将其存储在events数组中 
-            //如果在请求的超时毫秒内没有文件描述符准备就绪，则返回零
-            rt = epoll_wait(m_epfd, events, MAX_EVNETS, (int)next_timeout);
-            if(rt < 0 && errno == EINTR) 
+            self->pending  = false;
+            self->sleeping = true;
+        }
+        if (m_perThreadTimer) 
+        {
+            // 每线程时间轮模式下等待自己的时间轮，poller还要等待0号时间轮
+            next_timeout = std::min(getNextTimer(index + 1), (uint64_t)MAX_TIMEOUT);
+            if (is_poller) 
             {
-                continue;
-            } 
-            else 
+                next_timeout = std::min(next_timeout, getNextTimer(0));
+            }
+        }
+
+        // 本轮就绪的协程和回调先收集起来，最后一次性批量调度，只加一次锁，tickle次数不超过任务数
+        std::vector<ScheduleTask *> batch;
+        // 已触发但尚未放入任务队列的事件数，批量调度之后再从m_pendingEventCount中减掉，避免其他线程误判可以停止
+        size_t triggered = 0;
+        // 是否被tickle唤醒
+        bool tickled = false;
+
+        // io_uring后端：已经完成的请求直接收割，不用等待；本线程攒下的请求在这里一次性提交，
+        // 能阻塞在io_uring_enter上等待时留到下面和等待合成一次系统调用
+        if (self->ring) 
+        {
+            if (!self->ring->canWait()) 
             {
-                break;
+                self->ring->submit();
             }
-        } while(true);
+            triggered += reapCompletions(self, batch);
+        }
 
-        // 收集所有到时或者超时的定时器的回调函数
-        std::vector<std::function<void()>> cbs;
-        listExpiredCb(cbs);
-        if(!cbs.empty()) 
+        if (!batch.empty() || hasPendingTasks()) 
         {
-            for(const auto &cb : cbs) 
+            if (self->ring) 
+            {
+                self->ring->submit();
+            }
+            // 等待之前已经有任务了，先去执行任务，让休眠的线程接替poller
+            self->sleeping = false;
+            if (is_poller) 
+            {
+                releasePoller();
+            }
+            if (!batch.empty()) 
+            {
+                scheduleBatch(batch);
+                m_pendingEventCount -= triggered;
+            }
+            if (m_perThreadTimer) 
             {
-                //把所有超时的定时器的回调加入到任务队列
-                schedule(cb);
+                // 自己的时间轮只有自己处理，别的线程有任务时本线程可能一直走不到epoll_wait
+                scheduleExpiredTimers(index + 1);
             }
-            cbs.clear();
+            yieldIdle();
+            continue;
+        }
+
+        // 阻塞在epoll_wait上，等待事件发生或定时器超时
+        int rt = 0;
+        if (self->ring && self->ring->canWait()) 
+        {
+            rt = waitRing(self, events, MAX_EVNETS, next_timeout, batch, triggered);
+        } 
+        else 
+        {
+            do {
+                //在超时时间内获取有响应的事件 并将其存储在events数组中 
+                //如果在请求的超时毫秒内没有文件描述符准备就绪，则返回零
+                countSyscall();
+                rt = epoll_wait_f(wait_fd, events, MAX_EVNETS, (int)next_timeout);
+                if(rt < 0 && errno == EINTR) 
+                {
+                    continue;
+                } 
+                else 
+                {
+                    break;
+                }
+            } while(true);
+        }
+        UpdateCachedClock();
+        self->sleeping = false;
+
+        // 收集所有到时或者超时的定时器的回调函数，0号时间轮只由poller处理，每线程时间轮由所属线程处理
+        std::vector<std::function<void()>> cbs;
+        if (is_poller) 
+        {
+            listExpiredCb(0, cbs);
+        }
+        if (m_perThreadTimer) 
+        {
+            listExpiredCb(index + 1, cbs);
+        }
+        for (auto &cb : cbs) 
+        {
+            batch.push_back(new ScheduleTask(&cb, -1));
         }
         
         // 遍历所有发生的事件，根据epoll_event的私有指针找到对应的FdContext，进行事件处理
@@ -507,12 +1277,19 @@ void IOManager::idle()
         {
             //struct event-> events, data(data又是一个联合体，他的ptr指针保存着fd_ctx的指针)
             epoll_event &event = events[i];
-            if (event.data.fd == m_tickleFds[0]) 
+            if (event.data.fd == wake_fd) 
+            {
+                // wake_fd用于唤醒本线程，这时只需要把eventfd的计数读掉即可
+                tickled = true;
+                uint64_t dummy;
+                do {
+                    countSyscall();
+                } while (read(wake_fd, &dummy, sizeof(dummy)) > 0);
+                continue;
+            }
+            if (self->ring && event.data.fd == self->ring->getFd()) 
             {
-                // ticklefd[0]用于通知协程调度，这时只需要把管道里的内容读完即可
-                uint8_t dummy[256];
-                while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0)
-                    ;
+                // io_uring有完成的请求，循环结束后统一收割
                 continue;
             }
 
@@ -525,7 +1302,8 @@ void IOManager::idle()
              */ 
             if (event.events & (EPOLLERR | EPOLLHUP)) 
             {
-                event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+                // 常驻注册的fd上没有等待者的方向也要记下来，之后的等待不会再收到这次通知
+                event.events |= (EPOLLIN | EPOLLOUT) & (fd_ctx->persistent | fd_ctx->events);
             }
             int real_events = NONE;
             if (event.events & EPOLLIN) 
@@ -537,54 +1315,145 @@ void IOManager::idle()
                 real_events |= WRITE;
             }
 
-            if ((fd_ctx->events & real_events) == NONE) 
+            if (fd_ctx->persistent) 
             {
-                continue;
-            }
-
-            // 剔除已经发生的事件，将剩下的事件重新加入epoll_wait
-            int left_events = (fd_ctx->events & ~real_events);
-            int op          = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-            event.events    = EPOLLET | left_events;
-
-            int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-            if (rt2) 
+                // 常驻注册的方向一直被关注，边缘触发只报告一次，没有等待者的方向缓存起来留给下一次等待
+                fd_ctx->ready = (Event)(fd_ctx->ready | (real_events & ~fd_ctx->events));
+                real_events &= fd_ctx->events;
+                if (real_events == NONE) 
+                {
+                    continue;
+                }
+            } 
+            else 
             {
-                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                          << (EpollCtlOp)op << ", " << fd_ctx->fd << ", " << (EPOLL_EVENTS)event.events << "):"
-                                          << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
-                continue;
+                if ((fd_ctx->events & real_events) == NONE) 
+                {
+                    continue;
+                }
+
+                // 剔除已经发生的事件，将剩下的事件重新加入epoll_wait
+                int left_events = (fd_ctx->events & ~real_events);
+                int op          = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+                if (epollCtl(fd_ctx, op, EPOLLET | left_events)) 
+                {
+                    continue;
+                }
             }
 
             // 处理已经发生的事件，也就是让调度器调度指定的函数或协程
             if (real_events & READ) 
             {
-                fd_ctx->triggerEvent(READ);//这里的triggerEvent函数只是把对应的fiber重新加入调度，要执行的话还是要等到idle协程退出
-                --m_pendingEventCount;
+                fd_ctx->triggerEvent(READ, &batch);//这里的triggerEvent函数只是把对应的fiber放入batch，要执行的话还是要等到idle协程退出
+                ++triggered;
             }
             if (real_events & WRITE) 
             {
-                fd_ctx->triggerEvent(WRITE);
-                --m_pendingEventCount;
+                fd_ctx->triggerEvent(WRITE, &batch);
+                ++triggered;
             }
         } // end for
 
+        if (self->ring) 
+        {
+            triggered += reapCompletions(self, batch);
+        }
+
+        if (batch.empty() && !tickled) 
+        {
+            // 纯超时返回，没有新任务，继续做poller
+            continue;
+        }
+
+        // 本线程要去执行任务了，先交出poller，批量调度唤醒的线程或者被交接的线程会接替poller
+        if (is_poller) 
+        {
+            m_pollerPending = false;
+            releasePoller();
+        }
+        if (!batch.empty()) 
+        {
+            scheduleBatch(batch);
+        }
+        m_pendingEventCount -= triggered;
+
         /**
          * 一旦处理完所有的事件，idle协程yield，这样可以让调度协程(Scheduler::run)重新检查是否有新任务要调度
          * 上面triggerEvent实际也只是把对应的fiber重新加入调度，要执行的话还要等idle协程退出！！！
          */ 
-        Fiber::ptr cur = Fiber::GetThis(); //返回当前正在执行的协程，也就是idle协程 此时idle协程的引用计数+1
-        auto raw_ptr   = cur.get(); //返回该idle协程的裸指针
-        cur.reset(); //引用计数-1
-
-        //当前idle协程让出执行权 调度协程被resume
-        raw_ptr->yield();
+        yieldIdle();
     } // end while(true)
 }
 
-void IOManager::onTimerInsertedAtFront() 
+void IOManager::onTimerInsertedAtFront(size_t wheel) 
 {
-    tickle();
+    if (wheel == 0) 
+    {
+        // 0号时间轮由poller等待，没有poller时唤醒一个休眠的线程来接替
+        if (m_poller != -1) 
+        {
+            wakeupPoller();
+        } 
+        else 
+        {
+            wakeupSleeper();
+        }
+        return;
+    }
+
+    // 每线程时间轮只由所属线程等待，是当前线程时回到idle会重新取超时时间
+    int index = wheel - 1;
+    if (index == getThisWorkerIndex()) 
+    {
+        return;
+    }
+    if (m_poller == index) 
+    {
+        wakeupPoller();
+        return;
+    }
+    WakeupContext *ctx = m_wakeups[index];
+    if (ctx->sleeping) 
+    {
+        wakeup(ctx);
+    }
+}
+
+void IOManager::scheduleExpiredTimers(size_t wheel) 
+{
+    std::vector<std::function<void()>> cbs;
+    listExpiredCb(wheel, cbs);
+    if (cbs.empty()) 
+    {
+        return;
+    }
+    std::vector<ScheduleTask *> batch;
+    batch.reserve(cbs.size());
+    for (auto &cb : cbs) 
+    {
+        batch.push_back(new ScheduleTask(&cb, -1));
+    }
+    scheduleBatch(batch);
+}
+
+void IOManager::busyPoll() 
+{
+    // 一直不进入idle时缓存的时钟也要定期刷新
+    UpdateCachedClock();
+    int index = getThisWorkerIndex();
+    if (m_perThreadTimer && index >= 0) 
+    {
+        scheduleExpiredTimers(index + 1);
+    }
+}
+
+size_t IOManager::selectTimerWheel() 
+{
+    if (!m_perThreadTimer) 
+    {
+        return 0;
+    }
+    return getThisWorkerIndex() + 1;
 }
 
 } // end namespace sylar
\ No newline at end of file
@@ -11,8 +11,13 @@
 #include "scheduler.h"
 #include "timer.h"
 
+struct io_uring_sqe;
+struct epoll_event;
+
 namespace sylar {
 
+class IoUring;
+
 class IOManager : public Scheduler, public TimerManager {
 public:
     typedef std::shared_ptr<IOManager> ptr;
@@ -32,6 +37,19 @@ public:
         WRITE = 0x4,
     };
 
+    /**
+     * @brief IO后端
+     */
+    enum Backend 
+    {
+        /// 由配置项iomanager.backend决定
+        BACKEND_DEFAULT = 0,
+        /// epoll等待就绪后再由hook发起读写
+        BACKEND_EPOLL = 1,
+        /// hook的读写直接提交给io_uring，完成后恢复协程
+        BACKEND_IO_URING = 2,
+    };
+
 private:
     /**
      * @brief socket fd上下文结构体
@@ -53,6 +71,12 @@ private:
             Fiber::ptr fiber;
             /// 事件回调函数
             std::function<void()> cb;
+            /// waitEvent的超时定时器，同一个fd同一个事件的等待之间重复使用
+            Timer::ptr timer;
+            /// waitEvent的等待序号，定时器回调据此判断是否还是它所属的那次等待
+            uint32_t waitSeq = 0;
+            /// 本次等待是否已超时
+            bool timedOut = false;
         };
 
         /**
@@ -72,8 +96,9 @@ private:
          * @brief 触发事件
          * @details 根据事件类型调用对应上下文结构中的调度器去调度回调协程或回调函数
          * @param[in] event 事件类型
+         * @param[out] batch 不为空且事件由当前调度器处理时，任务放入batch，由调用方统一批量调度
          */
-        void triggerEvent(Event event);
+        void triggerEvent(Event event, std::vector<ScheduleTask *> *batch = nullptr);
 
         /// 读事件上下文
         EventContext read;
@@ -81,20 +106,76 @@ private:
         EventContext write;
         /// 事件关联的句柄（文件描述符fd）
         int fd = 0;
+        /// 每线程epoll模式下fd所属的调度线程下标，-1表示尚未分配
+        int owner = -1;
+        /// 尚未完成的io_uring请求数
+        std::atomic<int> uringOps{0};
         /// fd的event 
         Event events = NONE;
+        /// 常驻注册在epoll上(边缘触发)的方向，只包含等待过的方向，之后的触发和取消不再调用epoll_ctl
+        Event persistent = NONE;
+        /// 常驻注册时fd的代数(FdCtx::getGeneration)，和等待者带来的代数不同说明fd号已经被复用
+        uint64_t generation = 0;
+        /// 常驻注册时，没有等待者期间边缘触发报告的就绪事件，下一次等待直接消耗
+        Event ready = NONE;
         /// 事件的Mutex
         MutexType mutex;
     };
 
+    /**
+     * @brief 调度线程的唤醒上下文
+     * @details 每个调度线程一个eventfd，不做poller时休眠在线程私有的epoll上，
+     *          只有写它自己的eventfd才能唤醒它，pending用于合并重复的唤醒
+     */
+    struct WakeupContext 
+    {
+        /// 唤醒用的eventfd
+        int eventFd = -1;
+        /// 线程私有的epoll句柄，监听eventFd，每线程epoll模式下还监听分配给本线程的fd
+        int epfd = -1;
+        /// 是否正在休眠
+        std::atomic<bool> sleeping{false};
+        /// 是否已有尚未处理的唤醒
+        std::atomic<bool> pending{false};
+        /// io_uring后端下本线程的io_uring，内核支持带超时的等待时由它等待epfd，否则注册在epfd上
+        IoUring *ring = nullptr;
+        /// epfd的POLL_ADD请求是否已放入ring
+        bool epollArmed = false;
+        /// POLL_ADD已完成，epfd上有就绪的事件待取
+        bool epollReady = false;
+        /// 本线程在IO路径上发起的系统调用数
+        std::atomic<uint64_t> syscalls{0};
+    };
+
+    /// 一个进行中的io_uring请求，位于发起请求的协程栈上
+    struct UringRequest;
+
+    /// fd表每段的fd数为2^FD_SEGMENT_SHIFT
+    static const int FD_SEGMENT_SHIFT = 8;
+    static const int FD_SEGMENT_SIZE  = 1 << FD_SEGMENT_SHIFT;
+    /// fd表最多的段数，可容纳的fd上限为FD_SEGMENT_SIZE * FD_MAX_SEGMENTS
+    static const int FD_MAX_SEGMENTS  = 4096;
+
+    /**
+     * @brief fd表的一段，包含连续FD_SEGMENT_SIZE个fd的上下文
+     */
+    struct FdSegment
+    {
+        FdContext contexts[FD_SEGMENT_SIZE];
+    };
+
 public:
     /**
      * @brief 构造函数
      * @param[in] threads 线程数量
      * @param[in] use_caller 是否将调用线程包含进去
      * @param[in] name 调度器的名称
+     * @param[in] per_thread_epoll 是否每个调度线程使用自己的epoll，fd在第一次添加事件时分配给一个调度线程，
+     *            之后只由该线程等待和处理，避免所有线程争抢同一个epoll
+     * @param[in] backend IO后端，io_uring后端总是每线程epoll，内核不支持io_uring时退回epoll
      */
-    IOManager(size_t threads = 1, bool use_caller = true, const std::string &name = "IOManager");
+    IOManager(size_t threads = 1, bool use_caller = true, const std::string &name = "IOManager",
+              bool per_thread_epoll = false, Backend backend = BACKEND_DEFAULT);
 
     /**
      * @brief 析构函数
@@ -129,6 +210,21 @@ public:
      */
     bool cancelEvent(int fd, Event event);
 
+    /**
+     * @brief 在fd上添加事件并挂起当前协程，直到事件发生、被取消或超时
+     * @details 超时定时器保存在fd的事件上下文中，同一个fd同一个事件只在第一次带超时等待时创建，
+     *          之后的等待重复使用，整个等待过程不分配内存。
+     *          开启iomanager.edge_cache并传入generation时，fd第一次等待某个方向就把它常驻注册在epoll上，
+     *          之后同一代数的等待不再调用epoll_ctl，上次等待之后已经报告过就绪时直接返回，不挂起协程。
+     *          代数变了说明fd号已经被复用，重新注册，旧fd留下的就绪状态作废
+     * @param[in] fd socket句柄
+     * @param[in] event 事件类型
+     * @param[in] timeout_ms 超时时间，-1表示不超时
+     * @param[in] generation fd的代数(FdCtx::getGeneration)，0表示不常驻注册
+     * @return 事件发生或被取消返回0，超时返回ETIMEDOUT，添加事件失败返回-1
+     */
+    int waitEvent(int fd, Event event, uint64_t timeout_ms, uint64_t generation = 0);
+
     /**
      * @brief 把传进来的fd上的事件全部取消
      * @details 所有被注册的回调事件在cancel之前都会被执行一次
@@ -142,13 +238,80 @@ public:
      */
     static IOManager *GetThis();
 
+    /**
+     * @brief 是否每个调度线程使用自己的epoll
+     */
+    bool isPerThreadEpoll() const { return m_perThreadEpoll; }
+
+    /**
+     * @brief 是否使用io_uring后端
+     */
+    bool isIoUring() const { return m_ioUring; }
+
+    /**
+     * @brief 是否每个调度线程使用自己的时间轮
+     */
+    bool isPerThreadTimer() const { return m_perThreadTimer; }
+
+    /**
+     * @brief 通过io_uring执行一次IO，挂起当前协程直到完成
+     * @details 请求放入fd所属调度线程的io_uring，所属线程就是当前线程时留到idle里批量提交，否则立即提交
+     * @param[in] fd 文件句柄
+     * @param[in] sqe 填好的请求，user_data会被覆盖
+     * @param[in] timeout_ms 超时时间，-1表示不超时
+     * @return 同系统调用的返回值，失败时为-errno，超时返回-ETIMEDOUT，fd被关闭返回-EBADF
+     */
+    int submitIo(int fd, const io_uring_sqe &sqe, uint64_t timeout_ms);
+
+    /**
+     * @brief 登记一个由调度器之外的线程恢复的协程，和IO事件一样计入待处理数，恢复之前IOManager不会停止
+     */
+    void addExternalWait() { ++m_pendingEventCount; }
+
+    /**
+     * @brief 注销addExternalWait登记的等待，要在协程重新放入调度器之后调用
+     */
+    void doneExternalWait() { --m_pendingEventCount; }
+
+    /**
+     * @brief 累加当前线程在IO路径上发起的系统调用数
+     */
+    void countSyscall(uint64_t n = 1);
+
+    /**
+     * @brief 返回IO路径上的系统调用总数，包括hook的读写、epoll、eventfd和io_uring_enter
+     */
+    uint64_t getSyscallCount();
+
+    /**
+     * @brief 返回对fd调用epoll_ctl的次数，不包括eventfd和io_uring的注册
+     */
+    uint64_t getEpollCtlCount() const { return m_epollCtlCount; }
+
+    /**
+     * @brief 返回tickle的次数（包括定向唤醒）
+     */
+    uint64_t getTickleCount() const { return m_tickleCount; }
+
+    /**
+     * @brief 返回为唤醒线程而写eventfd的次数，即唤醒产生的系统调用数
+     */
+    uint64_t getWakeupWriteCount() const { return m_wakeupWriteCount; }
+
 protected:
     /**
      * @brief 通知调度器有任务要调度
-     * @details 写pipe让idle协程从epoll_wait退出，待idle协程yield之后Scheduler::run就可以调度其他任务
+     * @details 优先写一个休眠线程的eventfd，没有休眠的线程时写poller的eventfd让它从epoll_wait退出，
+     *          待idle协程yield之后Scheduler::run就可以调度其他任务
      */
     void tickle() override;
 
+    /**
+     * @brief 只唤醒指定的调度线程
+     * @param[in] thread 线程id
+     */
+    void tickleThread(int thread) override;
+
     /**
      * @brief 判断是否可以停止
      * @details 判断条件是Scheduler::stopping()外加IOManager的m_pendingEventCount为0，表示没有IO事件可调度了
@@ -171,27 +334,152 @@ protected:
 
     /**
      * @brief 当有定时器插入到头部时，要重新更新epoll_wait的超时时间，这里是唤醒idle协程以便于使用新的超时时间
+     * @param[in] wheel 定时器所在的时间轮，0号由poller等待，其它的由对应的调度线程等待
+     */
+    void onTimerInsertedAtFront(size_t wheel) override;
+
+    /**
+     * @brief 每线程时间轮模式下，调度线程添加的定时器放入自己的时间轮，调度器之外的线程放入0号时间轮
+     */
+    size_t selectTimerWheel() override;
+
+    /**
+     * @brief 本线程一直有任务执行时定期刷新缓存的时钟，每线程时间轮模式下还处理自己时间轮上到期的定时器
+     */
+    void busyPoll() override;
+
+private:
+    /**
+     * @brief 写eventfd唤醒指定的线程，已有未处理的唤醒时直接返回
+     * @return 是否写了eventfd
+     */
+    bool wakeup(WakeupContext *ctx);
+
+    /**
+     * @brief 返回fd对应的FdContext
+     * @param[in] fd 文件句柄
+     * @param[in] auto_create fd所在的段不存在时是否分配
+     * @return fd超出范围或段不存在且auto_create为false时返回nullptr
+     * @details 只读原子指针，不加任何共享锁，段一旦分配直到析构才释放
+     */
+    FdContext *getFdContext(int fd, bool auto_create);
+
+    /**
+     * @brief 添加事件的实现
+     * @param[in] generation 常驻注册时fd的代数，0表示不常驻注册
+     */
+    int addEvent(int fd, Event event, std::function<void()> cb, uint64_t generation);
+
+    /**
+     * @brief 对fd调用epoll_ctl，失败时输出日志
+     * @param[in] expected_errno 调用方自己处理的errno，失败原因是它时不输出日志
+     */
+    int epollCtl(FdContext *fd_ctx, int op, uint32_t events, int expected_errno = 0);
+
+    /**
+     * @brief 取消事件并触发一次，调用方已持有fd_ctx->mutex
+     */
+    bool cancelEventLocked(FdContext *fd_ctx, Event event);
+
+    /**
+     * @brief waitEvent的超时回调
+     * @param[in] key 高32位为fd，低32位为等待序号，序号最低位为0表示读事件、为1表示写事件
+     */
+    void onWaitTimeout(uint64_t key);
+
+    /**
+     * @brief 把指定时间轮中到期的定时器回调批量放入调度队列
+     */
+    void scheduleExpiredTimers(size_t wheel);
+
+    /**
+     * @brief 收割本线程io_uring中已完成的请求，把等待的协程放入batch
+     * @return 完成的请求数
+     */
+    size_t reapCompletions(WakeupContext *ctx, std::vector<ScheduleTask *> &batch);
+
+    /**
+     * @brief io_uring后端的idle等待，一次io_uring_enter同时提交本线程攒下的请求并等待完成事件
+     * @details epfd通过一个POLL_ADD请求在ring里等待，只有它完成时才调用一次不阻塞的epoll_wait取出就绪的fd
+     * @param[in] self 本线程的唤醒上下文
+     * @param[out] events 就绪的epoll事件
+     * @param[in] max events的大小
+     * @param[in] timeout 最长等待时间，毫秒
+     * @param[out] batch 已完成请求的协程
+     * @param[out] triggered 已完成的请求数
+     * @return 就绪的epoll事件数
+     */
+    int waitRing(WakeupContext *self, epoll_event *events, int max, uint64_t timeout,
+                 std::vector<ScheduleTask *> &batch, size_t &triggered);
+
+    /**
+     * @brief 返回fd所在的epoll句柄
+     */
+    int getEpollFd(FdContext *fd_ctx);
+
+    /**
+     * @brief 唤醒poller，没有poller或已有未处理的唤醒时直接返回
+     * @return 是否写了eventfd
+     */
+    bool wakeupPoller();
+
+    /**
+     * @brief 唤醒一个休眠中且尚未被唤醒的线程
+     * @return 是否唤醒了线程
+     */
+    bool wakeupSleeper();
+
+    /**
+     * @brief 唤醒所有休眠中的线程
+     */
+    void wakeupAllSleepers();
+
+    /**
+     * @brief 当前线程不再做poller，并唤醒一个休眠的线程接替
      */
-    void onTimerInsertedAtFront() override;
+    void releasePoller();
 
     /**
-     * @brief 重置socket句柄上下文的容器大小
-     * @param[in] size 容量大小
+     * @brief idle协程让出执行权
      */
-    void contextResize(size_t size);
+    void yieldIdle();
 
 private:
-    /// epoll 文件句柄
+    /// 是否每个调度线程使用自己的epoll
+    bool m_perThreadEpoll = false;
+    /// 是否使用io_uring后端
+    bool m_ioUring = false;
+    /// 是否每个调度线程使用自己的时间轮
+    bool m_perThreadTimer = false;
+    /// waitEvent是否常驻注册fd并缓存就绪事件
+    bool m_edgeCache = false;
+    /// 对fd调用epoll_ctl的次数
+    std::atomic<uint64_t> m_epollCtlCount = {0};
+    /// 调度器之外的线程发起的系统调用数
+    std::atomic<uint64_t> m_syscallCount = {0};
+    /// 下一个由调度器之外的线程添加的fd分配给哪个调度线程
+    std::atomic<size_t> m_assignCursor = {0};
+    /// epoll 文件句柄，每线程epoll模式下不监听socket fd
     int m_epfd = 0;
-    /// pipe 文件句柄，fd[0]读端，fd[1]写端
-    int m_tickleFds[2];
+    /// 唤醒poller用的eventfd，注册在m_epfd上
+    int m_pollerEventFd = -1;
+    /// 当前阻塞在m_epfd上的调度线程下标，-1表示没有
+    std::atomic<int> m_poller = {-1};
+    /// poller是否已有尚未处理的唤醒
+    std::atomic<bool> m_pollerPending = {false};
+    /// 每个调度线程的唤醒上下文，下标与Scheduler的调度线程下标一致
+    std::vector<WakeupContext *> m_wakeups;
+    /// 下一次普通唤醒从哪个调度线程开始找，让唤醒均匀分布
+    std::atomic<size_t> m_wakeupCursor = {0};
+    /// tickle次数
+    std::atomic<uint64_t> m_tickleCount = {0};
+    /// 写eventfd的次数
+    std::atomic<uint64_t> m_wakeupWriteCount = {0};
     
     /// 当前等待执行的IO事件数量
     std::atomic<size_t> m_pendingEventCount = {0};
-    /// IOManager的Mutex
-    RWMutexType m_mutex;
-    /// fd事件上下文集合
-    std::vector<FdContext *> m_fdContexts;
+    /// fd事件上下文表，按段懒分配，段指针只会从空变为非空
+    std::atomic<FdSegment *> m_fdSegments[FD_MAX_SEGMENTS];
 };
 
 } // end namespace sylar
@@ -6,9 +6,23 @@
  */
 
 #include <utility> // for std::pair
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include "log.h"
 #include "config.h"
 #include "env.h"
+#include "thread.h"
+#include "bytearray.h"
+#include "hook.h"
+#include "scheduler.h"
 
 namespace sylar {
 
@@ -57,574 +71,1794 @@ LogLevel::Level LogLevel::FromString(const std::string &str)
     return LogLevel::NOTSET;
 }
 
+LogStreamBuf::LogStreamBuf(size_t size)
+{
+    m_storage.resize(size);
+    reset();
+}
+
+void LogStreamBuf::reserve(size_t n)
+{
+    if((size_t)(epptr() - pptr()) >= n) 
+    {
+        return;
+    }
+    size_t used = size();
+    size_t capacity = m_storage.size();
+    while(capacity - used < n) 
+    {
+        capacity *= 2;
+    }
+    m_storage.resize(capacity);
+    setp(&m_storage[0], &m_storage[0] + m_storage.size());
+    pbump(used);
+}
+
+LogStreamBuf::int_type LogStreamBuf::overflow(int_type c) 
+{
+    if(traits_type::eq_int_type(c, traits_type::eof())) 
+    {
+        return traits_type::not_eof(c);
+    }
+    reserve(1);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+
+std::streamsize LogStreamBuf::xsputn(const char *s, std::streamsize n) 
+{
+    reserve(n);
+    memcpy(pptr(), s, n);
+    pbump(n);
+    return n;
+}
+
+void LogStreamBuf::vprintf(const char *fmt, va_list ap) 
+{
+    // 先尝试直接格式化到剩余空间，放不下时扩容后再格式化一次
+    va_list aq;
+    va_copy(aq, ap);
+    size_t avail = epptr() - pptr();
+    int len = vsnprintf(pptr(), avail, fmt, aq);
+    va_end(aq);
+    if(len < 0) 
+    {
+        return;
+    }
+    if((size_t)len >= avail) 
+    {
+        reserve(len + 1);
+        vsnprintf(pptr(), len + 1, fmt, ap);
+    }
+    pbump(len);
+}
+
+/**
+ * @brief 驻留字符串，相同内容返回同一个对象的引用，对象永不释放
+ */
+static const std::string &InternLogName(const std::string &name) 
+{
+    static Spinlock s_mutex;
+    static std::set<std::string> *s_names = new std::set<std::string>;
+    Spinlock::Lock lock(s_mutex);
+    return *s_names->insert(name).first;
+}
+
 LogEvent::LogEvent(const std::string &logger_name, LogLevel::Level level, const char *file, int32_t line
         , int64_t elapse, uint32_t thread_id, uint64_t fiber_id, time_t time
         , const std::string &thread_name)
     : m_level(level)
+    , m_ss(&m_buf)
     , m_file(file)
     , m_line(line)
     , m_elapse(elapse)
     , m_threadId(thread_id)
     , m_fiberId(fiber_id)
     , m_time(time)
-    , m_threadName(thread_name)
-    , m_loggerName(logger_name) {
+    , m_threadName(&InternLogName(thread_name))
+    , m_loggerName(&InternLogName(logger_name)) {
+}
+
+LogEvent::LogEvent()
+    : m_level(LogLevel::NOTSET)
+    , m_ss(&m_buf)
+    , m_time(0)
+    , m_threadName(&InternLogName(""))
+    , m_loggerName(m_threadName) {
+}
+
+void LogEvent::reset(const std::string &logger_name, LogLevel::Level level, const char *file, int32_t line
+        , int64_t elapse, uint32_t thread_id, uint64_t fiber_id, time_t time
+        , const std::string &thread_name)
+{
+    m_level      = level;
+    m_file       = file;
+    m_line       = line;
+    m_elapse     = elapse;
+    m_threadId   = thread_id;
+    m_fiberId    = fiber_id;
+    m_time       = time;
+    m_threadName = &thread_name;
+    m_loggerName = &logger_name;
+    m_buf.reset();
+    // 上一条日志可能改过流的格式（比如std::hex），恢复成默认值
+    m_ss.clear();
+    m_ss.flags(std::ios_base::dec | std::ios_base::skipws);
+    m_ss.precision(6);
+    m_ss.width(0);
+    m_ss.fill(' ');
+}
+
+void LogEvent::printf(const char *fmt, ...) 
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+void LogEvent::vprintf(const char *fmt, va_list ap) 
+{
+    m_buf.vprintf(fmt, ap);
+}
+
+/// 格式器编号生成器
+static std::atomic<uint64_t> s_formatter_id{0};
+
+/**
+ * @brief 线程本地的时间格式化缓存，按(格式器编号, 指令下标)直接映射
+ */
+struct DateTimeCache
+{
+    uint64_t formatter = 0;
+    size_t index = 0;
+    time_t time = -1;
+    size_t len = 0;
+    char buf[64];
+};
+
+static const size_t DATETIME_CACHE_SIZE = 8;
+static thread_local DateTimeCache t_datetime_cache[DATETIME_CACHE_SIZE];
+
+/**
+ * @brief 把无符号整数按十进制追加到buf
+ */
+static inline void AppendUInt(std::string &buf, uint64_t v)
+{
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+    do
+    {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while(v);
+    buf.append(p, tmp + sizeof(tmp) - p);
+}
+
+/**
+ * @brief 把有符号整数按十进制追加到buf
+ */
+static inline void AppendInt(std::string &buf, int64_t v)
+{
+    if(v < 0)
+    {
+        buf.push_back('-');
+        AppendUInt(buf, -(uint64_t)v);
+        return;
+    }
+    AppendUInt(buf, v);
+}
+
+LogFormatter::LogFormatter(const std::string &pattern)
+    : m_pattern(pattern)
+    , m_id(++s_formatter_id)
+{
+    init();
+}
+
+void LogFormatter::addOp(OpType type, const std::string &str)
+{
+    Op op;
+    op.type   = type;
+    op.offset = m_literals.size();
+    op.len    = str.size();
+    m_literals.append(str);
+    m_literals.push_back('\0');
+    m_ops.push_back(op);
+}
+
+/**
+ * 从头到尾遍历pattern，常规字符累积到literal中，遇到%就看下一个字符：
+ * 
+ * %T、%n、%%是固定的字符，也累积到literal中，这样相邻的常量只需一条指令
+ * 
+ * %d后面可以接一对大括号指定时间格式，比如%%d{%%Y-%%m-%%d %%H:%%M:%%S}，大括号没有闭合算出错
+ * 
+ * 其它模式字符先把累积的literal作为一条常量指令，再添加对应的指令，未识别的模式字符也算出错
+ * 
+ * @see LogFormatter::LogFormatter
+ */
+void LogFormatter::init() 
+{
+    m_ops.clear();
+    m_literals.clear();
+    m_flush = false;
+    m_error = false;
+
+    // 累积的常量字符串
+    std::string literal;
+    size_t i = 0;
+    while(i < m_pattern.size()) 
+    {
+        char c = m_pattern[i++];
+        if(c != '%' || i >= m_pattern.size()) 
+        {
+            literal.push_back(c);
+            continue;
+        }
+
+        c = m_pattern[i++];
+        if(c == '%' || c == 'T' || c == 'n') 
+        {
+            literal.push_back(c == 'T' ? '\t' : (c == 'n' ? '\n' : '%'));
+            m_flush = m_flush || c == 'n';
+            continue;
+        }
+
+        if(!literal.empty()) 
+        {
+            addOp(OP_LITERAL, literal);
+            literal.clear();
+        }
+
+        switch(c) 
+        {
+#define XX(ch, type) case ch: addOp(type); break;
+        XX('m', OP_MESSAGE);           // m:消息
+        XX('p', OP_LEVEL);             // p:日志级别
+        XX('c', OP_LOGGER_NAME);       // c:日志器名称
+        XX('r', OP_ELAPSE);            // r:累计毫秒数
+        XX('f', OP_FILE_NAME);         // f:文件名
+        XX('l', OP_LINE);              // l:行号
+        XX('t', OP_THREAD_ID);         // t:线程号
+        XX('F', OP_FIBER_ID);          // F:协程号
+        XX('N', OP_THREAD_NAME);       // N:线程名称
+#undef XX
+        case 'd': 
+        {
+            // d:日期时间，如果%d后面直接跟了一对大括号，那么把大括号里面的内容提取出来作为时间格式
+            std::string dateformat;
+            if(i < m_pattern.size() && m_pattern[i] == '{') 
+            {
+                size_t end = m_pattern.find('}', i);
+                if(end == std::string::npos) 
+                {
+                    std::cout << "[ERROR] LogFormatter::init() " << "pattern: [" << m_pattern << "] '{' not closed" << std::endl;
+                    m_error = true;
+                    return;
+                }
+                dateformat = m_pattern.substr(i + 1, end - i - 1);
+                i = end + 1;
+            }
+            addOp(OP_DATETIME, dateformat.empty() ? "%Y-%m-%d %H:%M:%S" : dateformat);
+            break;
+        }
+        default:
+            std::cout << "[ERROR] LogFormatter::init() " << "pattern: [" << m_pattern << "] " << 
+            "unknown format item: " << c << std::endl;
+            m_error = true;
+            return;
+        }
+    }
+
+    // 模板解析结束之后剩余的常规字符也要算进去
+    if(!literal.empty()) 
+    {
+        addOp(OP_LITERAL, literal);
+    }
+}
+
+void LogFormatter::formatDateTime(std::string &buf, size_t index, time_t time) 
+{
+    DateTimeCache &cache = t_datetime_cache[(m_id * 31 + index) % DATETIME_CACHE_SIZE];
+    if(cache.formatter != m_id || cache.index != index || cache.time != time) 
+    {
+        struct tm tm;
+        // localtime_r函数将给定的时间值转换为本地时区的日历时间表示 结果存在tm结构体中
+        localtime_r(&time, &tm);
+        cache.len       = strftime(cache.buf, sizeof(cache.buf), m_literals.c_str() + m_ops[index].offset, &tm);
+        cache.formatter = m_id;
+        cache.index     = index;
+        cache.time      = time;
+    }
+    buf.append(cache.buf, cache.len);
+}
+
+void LogFormatter::format(std::string &buf, LogEvent::ptr event) 
+{
+    for(size_t i = 0; i < m_ops.size(); ++i) 
+    {
+        const Op &op = m_ops[i];
+        switch(op.type) 
+        {
+        case OP_LITERAL:
+            buf.append(m_literals.data() + op.offset, op.len);
+            break;
+        case OP_MESSAGE:
+            buf.append(event->getContentData(), event->getContentSize());
+            break;
+        case OP_LEVEL:
+            buf.append(LogLevel::ToString(event->getLevel()));
+            break;
+        case OP_ELAPSE:
+            AppendInt(buf, event->getElapse());
+            break;
+        case OP_LOGGER_NAME:
+            buf.append(event->getLoggerName());
+            break;
+        case OP_THREAD_ID:
+            AppendUInt(buf, event->getThreadId());
+            break;
+        case OP_FIBER_ID:
+            AppendUInt(buf, event->getFiberId());
+            break;
+        case OP_THREAD_NAME:
+            buf.append(event->getThreadName());
+            break;
+        case OP_DATETIME:
+            formatDateTime(buf, i, event->getTime());
+            break;
+        case OP_FILE_NAME:
+            buf.append(event->getFile());
+            break;
+        case OP_LINE:
+            AppendInt(buf, event->getLine());
+            break;
+        }
+    }
+}
+
+std::string LogFormatter::format(LogEvent::ptr event) 
+{
+    std::string buf;
+    buf.reserve(256);
+    format(buf, event);
+    return buf;
+}
+
+// 流式输出到os中 也就是传过来的cout 或者是文件流
+std::ostream &LogFormatter::format(std::ostream &os, LogEvent::ptr event) 
+{
+    static thread_local std::string t_buf;
+    t_buf.clear();
+    format(t_buf, event);
+    os.write(t_buf.data(), t_buf.size());
+    if(m_flush) 
+    {
+        // 和原来%n输出std::endl一样，每条日志写完刷新
+        os.flush();
+    }
+    return os;
+}
+
+static void LogRetire(std::function<void()> release);
+
+// LogAppender的default_formatter会通过子类传进来
+LogAppender::LogAppender(LogFormatter::ptr default_formatter)
+    : m_defaultFormatter(default_formatter)
+    , m_activeFormatter(default_formatter.get()) {
+}
+
+void LogAppender::setFormatter(LogFormatter::ptr val) 
+{
+    LogFormatter::ptr old;
+    {
+        MutexType::Lock lock(m_mutex);
+        old.swap(m_formatter);
+        m_formatter = val;
+        m_activeFormatter.store(val ? val.get() : m_defaultFormatter.get(), std::memory_order_release);
+    }
+    if(old && old != val) 
+    {
+        // 其它线程可能正在用旧的格式器写日志，和Appender列表一样等读区都退出后再释放
+        LogRetire([old]() mutable { old.reset(); });
+    }
+}
+
+LogFormatter::ptr LogAppender::getFormatter() 
+{
+    MutexType::Lock lock(m_mutex);
+    return m_formatter ? m_formatter : m_defaultFormatter;
+}
+
+// 输出到cout的子类，在构造时给父类构造传一个默认的日志格式的格式器智能指针
+StdoutLogAppender::StdoutLogAppender()
+    : LogAppender(LogFormatter::ptr(new LogFormatter)) {
+}
+
+void StdoutLogAppender::log(LogEvent::ptr event) 
+{
+    // format的两个参数：1、输出到标准输出 2、日志事件
+    activeFormatter()->format(std::cout, event);
+}
+
+std::string StdoutLogAppender::toYamlString() 
+{
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"] = "StdoutLogAppender";
+    // node["pattern"] = m_formatter->getPattern() 原来这行代码是有bug的，也就是考虑的不全面 换成下面这一行就行了
+    node["pattern"] = m_formatter ? m_formatter->getPattern() : m_defaultFormatter->getPattern();
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 异步日志
+
+static ConfigVar<uint32_t>::ptr g_log_async_buffer_size =
+    Config::Lookup<uint32_t>("log.async.buffer_size", 1024 * 1024, "async log ring buffer bytes per thread");
+
+static ConfigVar<std::string>::ptr g_log_async_overflow =
+    Config::Lookup<std::string>("log.async.overflow", "block", "async log full buffer policy, block or drop");
+
+static ConfigVar<uint32_t>::ptr g_log_async_flush_interval =
+    Config::Lookup<uint32_t>("log.async.flush_interval", 50, "async log flush interval in ms");
+
+static std::atomic<int> s_log_async_overflow{AsyncLogWriter::BLOCK};
+static std::atomic<uint32_t> s_log_async_flush_interval{50};
+
+static int ParseOverflowPolicy(const std::string &v)
+{
+    return v == "drop" ? AsyncLogWriter::DROP : AsyncLogWriter::BLOCK;
+}
+
+namespace {
+struct _AsyncLogIniter
+{
+    _AsyncLogIniter()
+    {
+        s_log_async_overflow       = ParseOverflowPolicy(g_log_async_overflow->getValue());
+        s_log_async_flush_interval = g_log_async_flush_interval->getValue();
+
+        g_log_async_overflow->addListener(
+            [](const std::string &ov, const std::string &nv)
+            {
+                s_log_async_overflow = ParseOverflowPolicy(nv);
+            });
+
+        g_log_async_flush_interval->addListener(
+            [](const uint32_t &ov, const uint32_t &nv)
+            {
+                s_log_async_flush_interval = nv;
+            });
+    }
+};
+static _AsyncLogIniter _async_log_init;
+} // namespace
+
+/// 日志头部，后面紧跟日志内容
+struct AsyncLogHeader
+{
+    /// 日志长度，ASYNC_LOG_WRAP表示回绕标记
+    uint32_t len;
+    /// 输出文件编号
+    uint32_t target;
+};
+
+static const uint32_t ASYNC_LOG_WRAP = 0xffffffff;
+
+static inline size_t AsyncLogAlign(size_t len)
+{
+    return (len + 7) & ~(size_t)7;
+}
+
+/// 当前线程的缓冲区
+static thread_local AsyncLogWriter::Buffer *t_async_buffer = nullptr;
+/// 当前线程是否已经开始退出，退出过程中的日志直接写入文件
+static thread_local bool t_async_exited = false;
+
+/**
+ * @brief 线程退出时归还缓冲区，缓冲区中剩余的日志仍由刷盘线程写出
+ */
+struct AsyncLogBufferHolder
+{
+    ~AsyncLogBufferHolder()
+    {
+        t_async_exited = true;
+        if(t_async_buffer)
+        {
+            t_async_buffer->owned.store(false, std::memory_order_release);
+            t_async_buffer = nullptr;
+        }
+    }
+};
+
+/**
+ * @brief 打开日志文件
+ * @details 日志自己的文件操作都直接调用hook之前的原始函数：写日志时持有锁和线程局部的状态，不能让出协程，
+ *          日志文件也不登记到FdManager，读写不会交给阻塞调用线程池。日志可能在hook.cc的静态初始化之前打开文件，
+ *          先确保原始函数已经取得
+ */
+static int LogOpenFile(const std::string &file, int flags)
+{
+    hook_init();
+    return open_f(file.c_str(), flags, 0644);
+}
+
+/**
+ * @brief 把一条日志直接写入fd
+ */
+static void LogWriteAll(int fd, const char *data, size_t len)
+{
+    while(len > 0)
+    {
+        ssize_t rt = write_f(fd, data, len);
+        if(rt < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        data += rt;
+        len -= rt;
+    }
+}
+
+AsyncLogWriter *AsyncLogWriter::GetInstance()
+{
+    static AsyncLogWriter *s_writer = new AsyncLogWriter;
+    return s_writer;
+}
+
+AsyncLogWriter::AsyncLogWriter()
+{
+    hook_init();
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_running = true;
+    m_thread.reset(new Thread(std::bind(&AsyncLogWriter::run, this), "log_flush"));
+    std::atexit([]() { AsyncLogWriter::GetInstance()->stop(); });
+}
+
+int AsyncLogWriter::addTarget(const std::string &file)
+{
+    Mutex::Lock lock(m_mutex);
+    int count = m_targetCount;
+    for(int i = 0; i < count; ++i)
+    {
+        if(m_targets[i].file == file)
+        {
+            return i;
+        }
+    }
+    if(count >= MAX_TARGETS)
+    {
+        return -1;
+    }
+    int fd = LogOpenFile(file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    m_targets[count].file = file;
+    m_targets[count].fd   = fd;
+    m_targetCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+AsyncLogWriter::Buffer *AsyncLogWriter::getThreadBuffer()
+{
+    if(t_async_buffer || t_async_exited)
+    {
+        return t_async_buffer;
+    }
+    static thread_local AsyncLogBufferHolder s_holder;
+    (void)s_holder;
+
+    Mutex::Lock lock(m_mutex);
+    for(auto i : m_buffers)
+    {
+        bool expected = false;
+        if(!i->owned.load(std::memory_order_relaxed)
+                && i->owned.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+            t_async_buffer = i;
+            return i;
+        }
+    }
+    size_t capacity = 4096;
+    while(capacity < g_log_async_buffer_size->getValue())
+    {
+        capacity <<= 1;
+    }
+    Buffer *buf   = new Buffer;
+    buf->data     = new char[capacity];
+    buf->capacity = capacity;
+    buf->owned    = true;
+    m_buffers.push_back(buf);
+    t_async_buffer = buf;
+    return buf;
+}
+
+void AsyncLogWriter::append(int target, const char *data, size_t len)
+{
+    int fd = m_targets[target].fd;
+    Buffer *buf = m_running ? getThreadBuffer() : nullptr;
+    size_t need = sizeof(AsyncLogHeader) + AsyncLogAlign(len);
+    if(!buf || need > buf->capacity / 2)
+    {
+        LogWriteAll(fd, data, len);
+        ++m_flushed;
+        return;
+    }
+
+    size_t mask  = buf->capacity - 1;
+    uint64_t head = buf->head.load(std::memory_order_relaxed);
+    uint64_t tail = 0;
+    while(true)
+    {
+        tail = buf->tail.load(std::memory_order_acquire);
+        size_t contiguous = buf->capacity - (head & mask);
+        size_t total = need <= contiguous ? need : contiguous + need;
+        if(buf->capacity - (head - tail) >= total)
+        {
+            break;
+        }
+        if(!m_running)
+        {
+            LogWriteAll(fd, data, len);
+            ++m_flushed;
+            return;
+        }
+        if(s_log_async_overflow == DROP)
+        {
+            ++m_dropped;
+            return;
+        }
+        // 直接写文件会和缓冲区里还没写出的日志乱序，阻塞到刷盘线程写完一轮再重试
+        waitProgress();
+    }
+
+    if(need > buf->capacity - (head & mask))
+    {
+        // 缓冲区末尾放不下，写回绕标记
+        AsyncLogHeader *wrap = (AsyncLogHeader *)(buf->data + (head & mask));
+        wrap->len = ASYNC_LOG_WRAP;
+        head += buf->capacity - (head & mask);
+    }
+    AsyncLogHeader *header = (AsyncLogHeader *)(buf->data + (head & mask));
+    header->len    = len;
+    header->target = target;
+    memcpy(header + 1, data, len);
+    head += need;
+    buf->head.store(head, std::memory_order_release);
+
+    // stop()先清除m_running再做最后一次drain，这里先发布日志再检查m_running，两边至少有一方能看到对方，
+    // 看到已经停止时这条日志可能错过了最后一次drain，自己补写
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!m_running.load(std::memory_order_relaxed))
+    {
+        drain();
+        return;
+    }
+
+    if(head - tail > buf->capacity / 2)
+    {
+        notify();
+    }
+}
+
+void AsyncLogWriter::flush()
+{
+    Buffer *buf = t_async_buffer;
+    if(!buf)
+    {
+        return;
+    }
+    uint64_t head = buf->head.load(std::memory_order_relaxed);
+    while(m_running && buf->tail.load(std::memory_order_acquire) < head)
+    {
+        waitProgress();
+    }
+}
+
+void AsyncLogWriter::waitProgress()
+{
+    // 先登记再唤醒刷盘线程：它在drain之后才取走等待数，登记晚于取走时notify会让它再转一轮；
+    // 刷盘线程已经停止时没有人会再唤醒，自己取走
+    m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    if(m_running)
+    {
+        notify();
+    }
+    else
+    {
+        wakeWaiters();
+    }
+    m_progress.wait();
+}
+
+void AsyncLogWriter::wakeWaiters()
+{
+    uint32_t waiters = m_waiters.exchange(0);
+    for(uint32_t i = 0; i < waiters; ++i)
+    {
+        m_progress.notify();
+    }
+}
+
+void AsyncLogWriter::notify()
+{
+    if(m_notified.load(std::memory_order_relaxed) || m_notified.exchange(true))
+    {
+        return;
+    }
+    uint64_t one = 1;
+    ssize_t rt = write_f(m_eventFd, &one, sizeof(one));
+    (void)rt;
+}
+
+void AsyncLogWriter::stop()
+{
+    if(!m_running.exchange(false))
+    {
+        return;
+    }
+    m_stopping = true;
+    m_notified = false;
+    notify();
+    m_thread->join();
+    // 刷盘线程退出之前还在追加的日志
+    drain();
+    runTasks();
+    wakeWaiters();
+}
+
+void AsyncLogWriter::post(std::function<void()> task)
+{
+    if(!m_running)
+    {
+        task();
+        return;
+    }
+    {
+        Mutex::Lock lock(m_taskMutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_notified = false;
+    notify();
+}
+
+void AsyncLogWriter::runTasks()
+{
+    std::vector<std::function<void()> > tasks;
+    {
+        Mutex::Lock lock(m_taskMutex);
+        tasks.swap(m_tasks);
+    }
+    for(auto &i : tasks)
+    {
+        i();
+    }
+}
+
+void AsyncLogWriter::run()
+{
+    uint64_t last_reopen = GetElapsedMS();
+    while(true)
+    {
+        struct pollfd pfd;
+        pfd.fd      = m_eventFd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        int rt = poll_f(&pfd, 1, s_log_async_flush_interval);
+        if(rt > 0)
+        {
+            uint64_t dummy;
+            ssize_t n = read_f(m_eventFd, &dummy, sizeof(dummy));
+            (void)n;
+        }
+        m_notified = false;
+
+        bool stopping = m_stopping;
+        drain();
+        runTasks();
+        wakeWaiters();
+        // 和同步模式一样，每3秒重新打开一次文件
+        uint64_t now = GetElapsedMS();
+        if(now >= last_reopen + 3000)
+        {
+            reopenTargets();
+            last_reopen = now;
+        }
+        if(stopping)
+        {
+            drain();
+            wakeWaiters();
+            break;
+        }
+    }
+}
+
+void AsyncLogWriter::drain()
+{
+    Mutex::Lock drain_lock(m_drainMutex);
+    std::vector<Buffer *> buffers;
+    {
+        Mutex::Lock lock(m_mutex);
+        buffers = m_buffers;
+    }
+
+    std::vector<uint64_t> tails(buffers.size());
+    uint64_t records = 0;
+    for(size_t i = 0; i < buffers.size(); ++i)
+    {
+        Buffer *buf   = buffers[i];
+        size_t mask   = buf->capacity - 1;
+        uint64_t pos  = buf->tail.load(std::memory_order_relaxed);
+        uint64_t head = buf->head.load(std::memory_order_acquire);
+        while(pos < head)
+        {
+            AsyncLogHeader *header = (AsyncLogHeader *)(buf->data + (pos & mask));
+            if(header->len == ASYNC_LOG_WRAP)
+            {
+                pos += buf->capacity - (pos & mask);
+                continue;
+            }
+            iovec iov;
+            iov.iov_base = header + 1;
+            iov.iov_len  = header->len;
+            m_iovs[header->target].push_back(iov);
+            pos += sizeof(AsyncLogHeader) + AsyncLogAlign(header->len);
+            ++records;
+        }
+        tails[i] = pos;
+    }
+    if(!records)
+    {
+        return;
+    }
+
+    int count = m_targetCount.load(std::memory_order_acquire);
+    for(int i = 0; i < count; ++i)
+    {
+        if(!m_iovs[i].empty())
+        {
+            writeAll(m_targets[i].fd, m_iovs[i]);
+            m_iovs[i].clear();
+        }
+    }
+    for(size_t i = 0; i < buffers.size(); ++i)
+    {
+        buffers[i]->tail.store(tails[i], std::memory_order_release);
+    }
+    m_flushed += records;
+}
+
+void AsyncLogWriter::writeAll(int fd, std::vector<iovec> &iovs)
+{
+    size_t begin = 0;
+    while(begin < iovs.size())
+    {
+        int cnt = std::min(iovs.size() - begin, (size_t)IOV_MAX);
+        ssize_t rt = writev_f(fd, &iovs[begin], cnt);
+        ++m_writevs;
+        if(rt < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            std::cout << "[ERROR] AsyncLogWriter::writeAll() writev errno=" << errno << std::endl;
+            return;
+        }
+        // 跳过已经写完的iovec，部分写入的调整起始位置
+        size_t n = rt;
+        while(begin < iovs.size() && n >= iovs[begin].iov_len)
+        {
+            n -= iovs[begin].iov_len;
+            ++begin;
+        }
+        if(n > 0)
+        {
+            iovs[begin].iov_base = (char *)iovs[begin].iov_base + n;
+            iovs[begin].iov_len -= n;
+        }
+    }
+}
+
+void AsyncLogWriter::reopenTargets()
+{
+    int count = m_targetCount.load(std::memory_order_acquire);
+    for(int i = 0; i < count; ++i)
+    {
+        int fd = LogOpenFile(m_targets[i].file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC);
+        if(fd < 0)
+        {
+            continue;
+        }
+        dup3(fd, m_targets[i].fd, O_CLOEXEC);
+        close_f(fd);
+    }
+}
+
+// 输出到文件的子类
+FileLogAppender::FileLogAppender(const std::string &file, bool async)
+    : LogAppender(LogFormatter::ptr(new LogFormatter)) 
+{
+    m_filename = file;
+    if(async) 
+    {
+        m_asyncTarget = AsyncLogWriter::GetInstance()->addTarget(file);
+        if(m_asyncTarget >= 0) 
+        {
+            return;
+        }
+        std::cout << "async log file " << m_filename << " error, fallback to sync" << std::endl;
+    }
+    reopen();
+    if(m_reopenError) 
+    {
+        std::cout << "reopen file " << m_filename << " error" << std::endl;
+    }
+}
+
+/**
+ * 如果一个日志事件距离上次写日志超过3秒，那就重新打开一次日志文件
+ */
+void FileLogAppender::log(LogEvent::ptr event) 
+{
+    if(m_asyncTarget >= 0) 
+    {
+        // 异步模式：格式化后放入当前线程的缓冲区，不加锁也不打开文件，
+        // ERROR及以上级别的日志等待写入文件，避免随后的abort丢失日志
+        static thread_local std::string t_buf;
+        t_buf.clear();
+        activeFormatter()->format(t_buf, event);
+        AsyncLogWriter *writer = AsyncLogWriter::GetInstance();
+        writer->append(m_asyncTarget, t_buf.data(), t_buf.size());
+        if(event->getLevel() <= LogLevel::ERROR) 
+        {
+            writer->flush();
+        }
+        return;
+    }
+
+    uint64_t now = event->getTime();
+    if(now >= (m_lastTime + 3)) 
+    {
+        reopen();
+        if(m_reopenError) 
+        {
+            std::cout << "reopen file " << m_filename << " error" << std::endl;
+        }
+        m_lastTime = now;
+    }
+    if(m_reopenError) 
+    {
+        return;
+    }
+
+    // 同步模式下多个线程共用一个文件流，写入时仍需加锁
+    MutexType::Lock lock(m_mutex);
+    if(!activeFormatter()->format(m_filestream, event)) 
+    {
+        std::cout << "[ERROR] FileLogAppender::log() format error" << std::endl;
+    }
 }
 
-void LogEvent::printf(const char *fmt, ...) 
+bool FileLogAppender::reopen() 
 {
-    va_list ap;
-    va_start(ap, fmt);
-    vprintf(fmt, ap);
-    va_end(ap);
+    if(m_asyncTarget >= 0) 
+    {
+        // 异步模式由刷盘线程定期重新打开文件
+        return true;
+    }
+    MutexType::Lock lock(m_mutex);
+    // 如果已经打开则先关闭
+    if(m_filestream) 
+    {
+        m_filestream.close();
+    }
+    // 以流式追加的方式打开文件m_filename，然后往m_filestream输入的内容就会直接输出到文件m_filename
+    m_filestream.open(m_filename, std::ios::app);
+    // 文件错误打开标识：如果上面打开失败m_reopenError为true 成功为false
+    m_reopenError = !m_filestream;
+    // 返回重新打开是否成功
+    return !m_reopenError;
 }
 
-void LogEvent::vprintf(const char *fmt, va_list ap) 
+std::string FileLogAppender::toYamlString() 
+{
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"] = "FileLogAppender";
+    node["file"] = m_filename;
+    if(m_asyncTarget >= 0) 
+    {
+        node["async"] = true;
+    }
+    node["pattern"] = m_formatter ? m_formatter->getPattern() : m_defaultFormatter->getPattern();
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// 按大小和时间切分的文件
+
+/// 每段的最大字节数
+static const size_t ROTATING_LOG_SEGMENT_SIZE = 4 * 1024 * 1024;
+
+RotatingFileLogAppender::RotatingFileLogAppender(const std::string &file, uint64_t max_size
+        , uint32_t rotate_interval, uint32_t max_files)
+    : LogAppender(LogFormatter::ptr(new LogFormatter))
+    , m_filename(file)
+    , m_maxSize(max_size)
+    , m_rotateInterval(rotate_interval)
+    , m_maxFiles(max_files) 
 {
-    char *buf = nullptr;
-    // vasprintf 用来动态给buf分配内存来存放格式化后的字符串
-    int len = vasprintf(&buf, fmt, ap);
-    if(len != -1) 
+    // 段大小不超过单个文件的大小，按页对齐
+    size_t page = sysconf(_SC_PAGESIZE);
+    m_segmentSize = ROTATING_LOG_SEGMENT_SIZE;
+    if(m_maxSize && m_maxSize < m_segmentSize) 
+    {
+        m_segmentSize = (m_maxSize + page - 1) / page * page;
+    }
+    if(m_rotateInterval) 
+    {
+        m_rotateAt = nextRotateTime(time(0));
+    }
+    m_cur = openFile();
+    if(!m_cur.data) 
     {
-        m_ss << std::string(buf, len);
-        free(buf);
+        std::cout << "open rotating log file " << m_filename << " error" << std::endl;
     }
 }
 
-// 这些都是FormatItem的子类 后面通过父类指针指向子类空间实现多态
+RotatingFileLogAppender::~RotatingFileLogAppender() 
+{
+    releaseSegment(m_next, m_segmentSize, -1);
+    releaseSegment(m_nextFile, m_segmentSize, m_nextFile.offset + m_nextFile.pos);
+    releaseSegment(m_cur, m_segmentSize, m_cur.offset + m_cur.pos);
+}
 
-// m 内容
-class MessageFormatItem : public LogFormatter::FormatItem
+RotatingFileLogAppender::Segment RotatingFileLogAppender::mapSegment(int fd, uint64_t offset) 
 {
-public:
-    MessageFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    Segment seg;
+    seg.fd     = fd;
+    seg.offset = offset;
+    // 预先分配磁盘空间，避免写映射内存时缺页再分配，文件系统不支持时退回ftruncate
+    if(fallocate(fd, 0, offset, m_segmentSize) != 0 && ftruncate(fd, offset + m_segmentSize) != 0) 
     {
-        os << event->getContent();
+        return seg;
     }
-};
+    void *data = mmap(nullptr, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    if(data != MAP_FAILED) 
+    {
+        seg.data = (char *)data;
+    }
+    return seg;
+}
 
-// p 日志级别
-class LevelFormatItem : public LogFormatter::FormatItem 
+RotatingFileLogAppender::Segment RotatingFileLogAppender::openFile() 
 {
-public:
-    LevelFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    Segment seg;
+    int fd = LogOpenFile(m_filename, O_RDWR | O_CREAT | O_CLOEXEC);
+    if(fd < 0) 
     {
-        os << LogLevel::ToString(event->getLevel());
+        return seg;
     }
-};
+    struct stat st;
+    if(fstat(fd, &st) != 0) 
+    {
+        close_f(fd);
+        return seg;
+    }
+    uint64_t offset = st.st_size / m_segmentSize * m_segmentSize;
+    seg = mapSegment(fd, offset);
+    if(!seg.data) 
+    {
+        close_f(fd);
+        seg.fd = -1;
+        return seg;
+    }
+    seg.pos = st.st_size - offset;
+    return seg;
+}
 
-// r 累计毫秒数
-class ElapseFormatItem : public LogFormatter::FormatItem 
+void RotatingFileLogAppender::releaseSegment(const Segment &seg, size_t seg_size, int64_t size) 
 {
-public:
-    ElapseFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    if(seg.data) 
     {
-        os << event->getElapse();
+        munmap(seg.data, seg_size);
     }
-};
+    if(size >= 0 && seg.fd >= 0) 
+    {
+        // 去掉预先分配但没有写的部分，映射的脏页由内核回写，不需要fsync
+        if(ftruncate(seg.fd, size) != 0) 
+        {
+            std::cout << "[ERROR] RotatingFileLogAppender ftruncate errno=" << errno << std::endl;
+        }
+        close_f(seg.fd);
+    }
+}
 
-// c 日志器名称
-class LoggerNameFormatItem : public LogFormatter::FormatItem 
+time_t RotatingFileLogAppender::nextRotateTime(time_t now) const 
 {
-public:
-    LoggerNameFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    // 按本地时间对齐，比如间隔为一天时在本地0点切分
+    struct tm tm;
+    localtime_r(&now, &tm);
+    time_t local = now + tm.tm_gmtoff;
+    return (local / m_rotateInterval + 1) * m_rotateInterval - tm.tm_gmtoff;
+}
+
+void RotatingFileLogAppender::log(LogEvent::ptr event) 
+{
+    static thread_local std::string t_buf;
+    t_buf.clear();
+    activeFormatter()->format(t_buf, event);
+
+    MutexType::Lock lock(m_mutex);
+    if(!m_cur.data) 
     {
-        os << event->getLoggerName();
+        return;
     }
-};
+    if(m_nextFile.data) 
+    {
+        switchFile();
+    } 
+    else if(!m_rotating && ((m_maxSize && m_cur.offset + m_cur.pos >= m_maxSize)
+                || (m_rotateInterval && GetCachedTime() >= m_rotateAt))) 
+    {
+        // 新文件准备好之前继续写旧文件
+        m_rotating = true;
+        RotatingFileLogAppender::ptr self = shared_from_this();
+        AsyncLogWriter::GetInstance()->post([self]() { self->rotate(); });
+    }
+    append(t_buf.data(), t_buf.size());
+}
 
-// t 线程号
-class ThreadIdFormatItem : public LogFormatter::FormatItem 
+void RotatingFileLogAppender::append(const char *data, size_t len) 
 {
-public:
-    ThreadIdFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    while(len > 0 && m_cur.data) 
     {
-        os << event->getThreadId();
+        size_t n = std::min(len, m_segmentSize - m_cur.pos);
+        memcpy(m_cur.data + m_cur.pos, data, n);
+        m_cur.pos += n;
+        data      += n;
+        len       -= n;
+        if(m_cur.pos == m_segmentSize) 
+        {
+            nextSegment();
+        }
     }
-};
 
-// F 协程号
-class FiberIdFormatItem : public LogFormatter::FormatItem 
+    if(!m_preparing && !m_next.data && m_cur.data && m_cur.pos > m_segmentSize / 2) 
+    {
+        // 当前段用过一半，让刷盘线程准备下一段
+        m_preparing = true;
+        RotatingFileLogAppender::ptr self = shared_from_this();
+        int fd          = m_cur.fd;
+        uint64_t offset = m_cur.offset + m_segmentSize;
+        AsyncLogWriter::GetInstance()->post([self, fd, offset]() {
+            Segment seg = self->mapSegment(fd, offset);
+            MutexType::Lock lock(self->m_mutex);
+            self->m_preparing = false;
+            if(seg.data && !self->m_next.data && fd == self->m_cur.fd && offset == self->m_cur.offset + self->m_segmentSize) 
+            {
+                self->m_next = seg;
+                return;
+            }
+            // 期间已经换了段或者换了文件
+            releaseSegment(seg, self->m_segmentSize, -1);
+        });
+    }
+}
+
+void RotatingFileLogAppender::nextSegment() 
 {
-public:
-    FiberIdFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    Segment old = m_cur;
+    if(m_next.data && m_next.fd == old.fd && m_next.offset == old.offset + m_segmentSize) 
+    {
+        m_cur  = m_next;
+        m_next = Segment();
+    } 
+    else 
     {
-        os << event->getFiberId();
+        // 刷盘线程还没准备好，只能在当前线程上扩展文件
+        m_cur = mapSegment(old.fd, old.offset + m_segmentSize);
+        ++m_syncMapCount;
+        if(!m_cur.data) 
+        {
+            std::cout << "[ERROR] RotatingFileLogAppender map segment errno=" << errno << std::endl;
+            m_cur = old;
+            releaseSegment(m_cur, m_segmentSize, m_cur.offset + m_cur.pos);
+            m_cur = Segment();
+            return;
+        }
     }
-};
+    m_cur.pos = 0;
+    size_t seg_size = m_segmentSize;
+    AsyncLogWriter::GetInstance()->post([old, seg_size]() { releaseSegment(old, seg_size, -1); });
+}
 
-// N 线程名称
-class ThreadNameFormatItem : public LogFormatter::FormatItem 
+void RotatingFileLogAppender::switchFile() 
 {
-public:
-    ThreadNameFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    Segment old  = m_cur;
+    Segment next = m_next;
+    m_cur        = m_nextFile;
+    m_next       = Segment();
+    m_nextFile   = Segment();
+    m_rotating   = false;
+    ++m_rotateCount;
+    if(m_rotateInterval) 
     {
-        os << event->getThreadName();
+        m_rotateAt = nextRotateTime(GetCachedTime());
     }
-};
+    // 旧文件截断到实际长度和关闭都交给刷盘线程
+    size_t seg_size = m_segmentSize;
+    AsyncLogWriter::GetInstance()->post([old, next, seg_size]() {
+        releaseSegment(next, seg_size, -1);
+        releaseSegment(old, seg_size, old.offset + old.pos);
+    });
+}
 
-// d 时间
-class DateTimeFormatItem : public LogFormatter::FormatItem 
+void RotatingFileLogAppender::rotate() 
 {
-public:
-    DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S"):m_format(format) 
-    {   
-        if(m_format.empty()) 
+    // file.(N-1) -> file.N, ..., file -> file.1，最旧的file.N被覆盖
+    if(m_maxFiles == 0) 
+    {
+        unlink(m_filename.c_str());
+    } 
+    else 
+    {
+        for(uint32_t i = m_maxFiles - 1; i > 0; --i) 
         {
-            m_format = "%Y-%m-%d %H:%M:%S";
+            std::string from = m_filename + "." + std::to_string(i);
+            std::string to   = m_filename + "." + std::to_string(i + 1);
+            rename(from.c_str(), to.c_str());
         }
+        rename(m_filename.c_str(), (m_filename + ".1").c_str());
     }
+    Segment seg = openFile();
 
-    void format(std::ostream& os, LogEvent::ptr event) override 
+    MutexType::Lock lock(m_mutex);
+    if(!seg.data) 
     {
-        struct tm tm;
+        std::cout << "[ERROR] RotatingFileLogAppender open " << m_filename << " errno=" << errno << std::endl;
+        m_rotating = false;
+        return;
+    }
+    m_nextFile = seg;
+}
+
+std::string RotatingFileLogAppender::toYamlString() 
+{
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"] = "RotatingFileLogAppender";
+    node["file"] = m_filename;
+    node["max_size"] = m_maxSize;
+    node["rotate_interval"] = m_rotateInterval;
+    node["max_files"] = m_maxFiles;
+    node["pattern"] = m_formatter ? m_formatter->getPattern() : m_defaultFormatter->getPattern();
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
 
-        // 日志事件直接掉自己的getTime() 获得一个总秒数
-        time_t time = event->getTime();
+///////////////////////////////////////////////////////////////////////////////
+// 二进制日志
 
-        // localtime_r函数将给定的时间值转换为本地时区的日历时间表示 结果存在tm结构体中
-        localtime_r(&time, &tm);
+const char *BinaryLog::MAGIC = "SYLARLG1";
 
-        char buf[64];
-        // 用于日期和时间格式化的函数，它允许你将一个 tm 结构体表示的时间转换成一个基于指定格式的字符串。
-        strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-        os << buf;
-    }
-private:
-    std::string m_format;
-};
+/// 攒下的日志超过这个大小就写入文件
+static const size_t BINARY_LOG_FLUSH_SIZE = 64 * 1024;
 
-// f 文件名
-class FileNameFormatItem : public LogFormatter::FormatItem 
+// 写入端直接编码到std::string，编码结果与ByteArray的writeUint64/writeInt64/writeFuint64相同
+
+static inline void BinaryLogPutVarint(std::string &buf, uint64_t v) 
 {
-public:
-    FileNameFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    char tmp[10];
+    int i = 0;
+    while(v >= 0x80) 
     {
-        os << event->getFile();
+        tmp[i++] = (v & 0x7f) | 0x80;
+        v >>= 7;
     }
-};
+    tmp[i++] = v;
+    buf.append(tmp, i);
+}
 
-// l 行号
-class LineFormatItem : public LogFormatter::FormatItem 
+static inline void BinaryLogPutZigzag(std::string &buf, int64_t v) 
 {
-public:
-    LineFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    BinaryLogPutVarint(buf, v < 0 ? ((uint64_t)(-v)) * 2 - 1 : (uint64_t)v * 2);
+}
+
+static inline void BinaryLogPutFixed64(std::string &buf, uint64_t v) 
+{
+    for(int i = 56; i >= 0; i -= 8) 
     {
-        os << event->getLine();
+        buf.push_back((char)(v >> i));
     }
-};
-// n 换行符 （换行符子类，实现换行）
-class NewLineFormatItem : public LogFormatter::FormatItem 
+}
+
+BinaryLogAppender::BinaryLogAppender(const std::string &file)
+    : LogAppender(LogFormatter::ptr(new LogFormatter))
+    , m_filename(file)
 {
-public:
-    NewLineFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    m_buffer.reserve(BINARY_LOG_FLUSH_SIZE * 2);
+    MutexType::Lock lock(m_mutex);
+    if(!reopen()) 
     {
-        os << std::endl;
+        std::cout << "open binary log file " << m_filename << " error" << std::endl;
     }
-};
+}
 
-// 常规字符处理类
-class StringFormatItem : public LogFormatter::FormatItem 
+BinaryLogAppender::~BinaryLogAppender() 
 {
-public:
-    StringFormatItem(const std::string& str) : m_string(str) {}
-        
-    void format(std::ostream& os, LogEvent::ptr event) override 
+    flush();
+    if(m_fd >= 0) 
     {
-        os << m_string;
+        close_f(m_fd);
     }
-private:
-    std::string m_string;
-};
-// T 制表符
-class TabFormatItem : public LogFormatter::FormatItem 
+}
+
+bool BinaryLogAppender::reopen() 
 {
-public:
-    TabFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    flushLocked();
+    int fd = LogOpenFile(m_filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC);
+    if(fd < 0) 
     {
-        os << "\t";
+        return false;
     }
-};
-// % 百分号
-class PercentSignFormatItem : public LogFormatter::FormatItem 
-{
-public:
-    PercentSignFormatItem(const std::string &str) {}
-    void format(std::ostream &os, LogEvent::ptr event) override 
+    if(m_fd >= 0) 
     {
-        os << "%";
+        close_f(m_fd);
     }
-};
+    m_fd = fd;
+
+    struct stat st;
+    if(fstat(m_fd, &st) == 0 && st.st_size == 0) 
+    {
+        m_buffer.append(BinaryLog::MAGIC, BinaryLog::MAGIC_SIZE);
+    }
+    // 新会话：字典重新编号，时间差从会话起始时间算起
+    m_sites.clear();
+    m_loggerNames.clear();
+    m_threadNames.clear();
+    m_nextId = 1;
+    m_lastMs = GetCachedCurrentMS();
+    m_record.clear();
+    m_record.push_back(BinaryLog::SESSION);
+    BinaryLogPutFixed64(m_record, m_lastMs);
+    BinaryLogPutVarint(m_record, getpid());
+    commitRecord();
+    flushLocked();
+    return true;
+}
 
-LogFormatter::LogFormatter(const std::string &pattern): m_pattern(pattern)    
+void BinaryLogAppender::commitRecord() 
 {
-    init();
+    BinaryLogPutVarint(m_buffer, m_record.size());
+    m_buffer.append(m_record);
 }
 
-/**
- * 简单的状态机判断，提取pattern中的常规字符和模式字符
- * 
- * 解析的过程就是从头到尾遍历，根据状态标志决定当前字符是常规字符还是模式字符
- * 
- * 一共有两种状态，即正在解析常规字符和正在解析模板转义字符
- * 
- * 比较麻烦的是%%d，后面可以接一对大括号指定时间格式，比如%%d{%%Y-%%m-%%d %%H:%%M:%%S}，这个状态需要特殊处理
- * 
- * 一旦状态出错就停止解析，并设置错误标志，未识别的pattern转义字符也算出错
- * 
- * @see LogFormatter::LogFormatter
- */
-void LogFormatter::init() 
+uint32_t BinaryLogAppender::lookupDict(std::unordered_map<std::string, uint32_t> &dict, BinaryLog::DictType type,
+                                       const std::string &str, int32_t line) 
 {
-    // 按顺序存储解析到的pattern项
-    // 每个pattern包括一个整数类型和一个字符串，类型为0表示该pattern是常规字符串，为1表示该pattern需要转义
-    // 日期格式单独用下面的dataformat存储    
-    std::vector<std::pair<int, std::string>> patterns;
-    // 临时存储常规字符串
-    std::string tmp;
-    // 日期格式字符串，默认把位于%d后面的大括号对里的全部字符都当作格式字符，不校验格式是否合法
-    std::string dateformat;
-    // 是否解析出错
-    bool error = false;
-    
-    // 是否正在解析常规字符，初始时为true
-    bool parsing_string = true;
-
-    // "%d{%Y-%m-%d %H:%M:%S} [%rms]%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"
-    size_t i = 0;
-    while(i < m_pattern.size()) 
+    auto it = dict.find(type == BinaryLog::DICT_SITE ? m_siteKey : str);
+    if(it != dict.end()) 
     {
-        std::string c = std::string(1, m_pattern[i]);
-        if(c == "%") 
-        {
-            if(parsing_string) 
-            {
-                // 如果tmp非空
-                if(!tmp.empty()) 
-                {
-                    patterns.push_back(std::make_pair(0, tmp));
-                }
-                tmp.clear();
-                parsing_string = false; // 在解析常规字符时遇到%，表示开始解析模板字符
-                // parsing_pattern = true;
-                i++;
-                continue;
-            } 
-            else 
-            {
-                patterns.push_back(std::make_pair(1, c));
-                parsing_string = true; // 在解析模板字符时遇到%，表示这里是一个%转义
-                // parsing_pattern = false;
-                i++;
-                continue;
-            }
-        } 
-        else 
-        { // not %
-            if(parsing_string) 
-            { // 持续解析常规字符直到遇到%，解析出的字符串作为一个常规字符串加入patterns
-                tmp += c;
-                i++;
-                continue;
-            } 
-            else 
-            { // 模板字符，直接添加到patterns中，添加完成后，状态变为解析常规字符，%d特殊处理
-                patterns.push_back(std::make_pair(1, c));
-                parsing_string = true; 
-
-                // 后面是对%d的特殊处理，如果%d后面直接跟了一对大括号，那么把大括号里面的内容提取出来作为dateformat
-                if(c != "d") 
-                {
-                    i++;
-                    continue;
-                }
-                i++;
-                if(i < m_pattern.size() && m_pattern[i] != '{') 
-                {
-                    continue;
-                }
-                i++;
-                while( i < m_pattern.size() && m_pattern[i] != '}') 
-                {
-                    dateformat.push_back(m_pattern[i]);
-                    i++;
-                }
-                if(m_pattern[i] != '}') 
-                {
-                    // %d后面的大括号没有闭合，直接报错
-                    std::cout << "[ERROR] LogFormatter::init() " << "pattern: [" << m_pattern << "] '{' not closed" << std::endl;
-                    error = true;
-                    break;
-                }
-                i++;
-                continue;
-            }
-        }
-    } // end while(i < m_pattern.size())
+        return it->second;
+    }
+    uint32_t id = m_nextId++;
+    dict[type == BinaryLog::DICT_SITE ? m_siteKey : str] = id;
+    m_record.clear();
+    m_record.push_back(BinaryLog::DICT);
+    m_record.push_back(type);
+    BinaryLogPutVarint(m_record, id);
+    BinaryLogPutVarint(m_record, str.size());
+    m_record.append(str);
+    if(type == BinaryLog::DICT_SITE) 
+    {
+        BinaryLogPutZigzag(m_record, line);
+    }
+    commitRecord();
+    return id;
+}
 
-    if(error) 
+void BinaryLogAppender::log(LogEvent::ptr event) 
+{
+    MutexType::Lock lock(m_mutex);
+    if(m_fd < 0) 
     {
-        m_error = true;
         return;
     }
-
-    // 模板解析结束之后剩余的常规字符也要算进去
-    if(!tmp.empty()) 
-    {
-        patterns.push_back(std::make_pair(0, tmp));
-        tmp.clear();
-    }
-
-    // for debug 
-    // std::cout << "patterns:" << std::endl;
-    // for(auto &v : patterns) {
-    //     std::cout << "type = " << v.first << ", value = " << v.second << std::endl;
-    // }
-    // std::cout << "dataformat = " << dateformat << std::endl;
-    
-    // map<string, function<FormatItem::ptr(const std::string& str)>> function<该种函数类型的返回值 (参数)>
-    // s_format_items是一个函数集合，一个string对应一个函数对象，即传进来什么string就做什么样的处理
-    static std::map<std::string, std::function<FormatItem::ptr(const std::string& str)> > s_format_items = {
-#define XX(str, C)  {#str, [](const std::string& fmt) { return FormatItem::ptr(new C(fmt));} }
-                    // key lamda表达式是value
-        XX(m, MessageFormatItem),           // m:消息
-        XX(p, LevelFormatItem),             // p:日志级别
-        XX(c, LoggerNameFormatItem),        // c:日志器名称
-//        XX(d, DateTimeFormatItem),          // d:日期时间
-        XX(r, ElapseFormatItem),            // r:累计毫秒数
-        XX(f, FileNameFormatItem),          // f:文件名
-        XX(l, LineFormatItem),              // l:行号
-        XX(t, ThreadIdFormatItem),          // t:线程号
-        XX(F, FiberIdFormatItem),           // F:协程号
-        XX(N, ThreadNameFormatItem),        // N:线程名称
-        XX(%, PercentSignFormatItem),       // %:百分号
-        XX(T, TabFormatItem),               // T:制表符
-        XX(n, NewLineFormatItem),           // n:换行符
-#undef XX
-    };
-
-    for(auto &v : patterns) {        
-        if(v.first == 0) // 常规字符
-        {
-            m_items.push_back(FormatItem::ptr(new StringFormatItem(v.second)));
-        } 
-        else if( v.second =="d") //非常规字符且second是d 时间格式
-        {
-            m_items.push_back(FormatItem::ptr(new DateTimeFormatItem(dateformat)));
-        } 
-        else // 转义字符
+    uint64_t now = GetCachedElapsedMS();
+    if(now >= m_lastCheck + 3000) 
+    {
+        // 和FileLogAppender一样每3秒检查一次，文件被移走（比如日志切分）时重新打开
+        m_lastCheck = now;
+        struct stat path_st, fd_st;
+        if(stat_f(m_filename.c_str(), &path_st) != 0 || fstat(m_fd, &fd_st) != 0
+                || path_st.st_ino != fd_st.st_ino || path_st.st_dev != fd_st.st_dev) 
         {
-            auto it = s_format_items.find(v.second); //在map里找到对应的转义字符的迭代器（索引）
-            // 没有该转义字符
-            if(it == s_format_items.end()) 
-            {
-                std::cout << "[ERROR] LogFormatter::init() " << "pattern: [" << m_pattern << "] " << 
-                "unknown format item: " << v.second << std::endl;
-                error = true;
-                break;
-            } 
-            else 
-            {
-                // 用map里相应的处理函数对其进行处理 再添加到 m_items
-                m_items.push_back(it->second(v.second));
-            }
+            reopen();
         }
     }
 
-    if(error) 
+    // 代码位置的键：文件名 + 二进制的行号
+    int32_t line = event->getLine();
+    m_siteKey.assign(event->getFile());
+    m_siteKey.append((const char *)&line, sizeof(line));
+    uint32_t site   = lookupDict(m_sites, BinaryLog::DICT_SITE, event->getFile(), line);
+    uint32_t logger = lookupDict(m_loggerNames, BinaryLog::DICT_LOGGER_NAME, event->getLoggerName());
+    uint32_t thread = lookupDict(m_threadNames, BinaryLog::DICT_THREAD_NAME, event->getThreadName());
+
+    uint64_t ms = GetCachedCurrentMS();
+    m_record.clear();
+    m_record.push_back(BinaryLog::EVENT);
+    BinaryLogPutVarint(m_record, event->getLevel());
+    BinaryLogPutVarint(m_record, site);
+    BinaryLogPutVarint(m_record, logger);
+    BinaryLogPutVarint(m_record, thread);
+    BinaryLogPutVarint(m_record, event->getThreadId());
+    BinaryLogPutVarint(m_record, event->getFiberId());
+    BinaryLogPutZigzag(m_record, (int64_t)(ms - m_lastMs));
+    BinaryLogPutZigzag(m_record, event->getElapse());
+    BinaryLogPutVarint(m_record, event->getContentSize());
+    m_record.append(event->getContentData(), event->getContentSize());
+    m_lastMs = ms;
+    commitRecord();
+
+    if(m_buffer.size() >= BINARY_LOG_FLUSH_SIZE || event->getLevel() <= LogLevel::ERROR
+            || now >= m_lastFlush + 1000) 
     {
-        m_error = true;
-        return;
+        flushLocked();
     }
 }
 
-std::string LogFormatter::format(LogEvent::ptr event) 
+void BinaryLogAppender::flush() 
 {
-    std::stringstream ss;
-    for(auto &i:m_items) 
-    {
-        // 多态--不同子类的format实现不同的功能
-        i->format(ss, event);
-    }
-    return ss.str();
+    MutexType::Lock lock(m_mutex);
+    flushLocked();
 }
 
-// 流式输出到os中 也就是传过来的cout 或者是文件流
-std::ostream &LogFormatter::format(std::ostream &os, LogEvent::ptr event) 
+void BinaryLogAppender::flushLocked() 
 {
-    for(auto &i:m_items) 
+    m_lastFlush = GetCachedElapsedMS();
+    if(m_fd < 0 || m_buffer.empty()) 
     {
-        i->format(os, event);
+        return;
     }
-    return os;
-}
-
-// LogAppender的default_formatter会通过子类传进来
-LogAppender::LogAppender(LogFormatter::ptr default_formatter)
-    : m_defaultFormatter(default_formatter) {
+    LogWriteAll(m_fd, m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
 }
 
-void LogAppender::setFormatter(LogFormatter::ptr val) 
+std::string BinaryLogAppender::toYamlString() 
 {
     MutexType::Lock lock(m_mutex);
-    m_formatter = val;
+    YAML::Node node;
+    node["type"] = "BinaryLogAppender";
+    node["file"] = m_filename;
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
 }
 
-LogFormatter::ptr LogAppender::getFormatter() 
+BinaryLogReader::BinaryLogReader(const std::string &file)
+    : m_ifs(file, std::ios::binary) 
 {
-    MutexType::Lock lock(m_mutex);
-    return m_formatter ? m_formatter : m_defaultFormatter;
+    char magic[BinaryLog::MAGIC_SIZE];
+    m_open = m_ifs.read(magic, sizeof(magic)) && memcmp(magic, BinaryLog::MAGIC, sizeof(magic)) == 0;
 }
 
-// 输出到cout的子类，在构造时给父类构造传一个默认的日志格式的格式器智能指针
-StdoutLogAppender::StdoutLogAppender()
-    : LogAppender(LogFormatter::ptr(new LogFormatter)) {
+bool BinaryLogReader::readRecord(std::string &body) 
+{
+    // 长度是Varint32
+    uint32_t len = 0;
+    for(int shift = 0; ; shift += 7) 
+    {
+        int c = m_ifs.get();
+        if(c == EOF) 
+        {
+            // 在记录开头结束是正常的文件结尾
+            m_error = shift != 0;
+            return false;
+        }
+        if(shift > 28) 
+        {
+            m_error = true;
+            return false;
+        }
+        len |= (uint32_t)(c & 0x7f) << shift;
+        if(!(c & 0x80)) 
+        {
+            break;
+        }
+    }
+    body.resize(len);
+    if(len && !m_ifs.read(&body[0], len)) 
+    {
+        m_error = true;
+        return false;
+    }
+    return true;
 }
 
-void StdoutLogAppender::log(LogEvent::ptr event) 
+bool BinaryLogReader::next(BinaryLogRecord &rec) 
 {
-    if(m_formatter) 
+    if(!m_open || m_error) 
     {
-        // format的两个参数：1、输出到标准输出 2、日志事件
-        m_formatter->format(std::cout, event);
-    } 
-    else 
+        return false;
+    }
+    std::string body;
+    ByteArray ba(4096);
+    while(readRecord(body)) 
     {
-        m_defaultFormatter->format(std::cout, event);
+        ba.clear();
+        ba.write(body.data(), body.size());
+        ba.setPosition(0);
+        try 
+        {
+            uint8_t type = ba.readFuint8();
+            if(type == BinaryLog::SESSION) 
+            {
+                m_lastMs = ba.readFuint64();
+                m_pid    = ba.readUint32();
+                m_dict.clear();
+            } 
+            else if(type == BinaryLog::DICT) 
+            {
+                uint8_t dict_type = ba.readFuint8();
+                uint32_t id       = ba.readUint32();
+                std::string str   = ba.readStringVint();
+                int32_t line      = dict_type == BinaryLog::DICT_SITE ? ba.readInt32() : 0;
+                m_dict[id] = std::make_pair(str, line);
+            } 
+            else if(type == BinaryLog::EVENT) 
+            {
+                rec.level      = (LogLevel::Level)ba.readUint32();
+                auto &site     = m_dict[ba.readUint32()];
+                rec.file       = site.first;
+                rec.line       = site.second;
+                rec.loggerName = m_dict[ba.readUint32()].first;
+                rec.threadName = m_dict[ba.readUint32()].first;
+                rec.threadId   = ba.readUint32();
+                rec.fiberId    = ba.readUint64();
+                m_lastMs      += ba.readInt64();
+                rec.timeMs     = m_lastMs;
+                rec.elapse     = ba.readInt64();
+                rec.message.resize(ba.readUint64());
+                if(!rec.message.empty()) 
+                {
+                    ba.read(&rec.message[0], rec.message.size());
+                }
+                rec.pid = m_pid;
+                return true;
+            } 
+            else 
+            {
+                m_error = true;
+                return false;
+            }
+        } 
+        catch(std::out_of_range &e) 
+        {
+            m_error = true;
+            return false;
+        }
     }
+    return false;
 }
 
-std::string StdoutLogAppender::toYamlString() 
+/**
+ * @brief 线程读日志器不可变数据（Appender列表、日志器表）的登记项
+ * @details 简化的用户态RCU：线程进入读区时序号加一变为奇数，退出时再加一变为偶数，读区内不加锁；
+ *          替换数据的线程在替换后等待所有进入时间早于替换的读者退出，再释放旧数据。
+ *          读区可以嵌套（Appender里还可以再写日志），只有最外层改变序号。
+ *          登记项不释放，线程退出后留给新线程复用，等待读者的线程不需要持有登记表的锁
+ */
+struct LogReaderSlot 
 {
-    MutexType::Lock lock(m_mutex);
-    YAML::Node node;
-    node["type"] = "StdoutLogAppender";
-    // node["pattern"] = m_formatter->getPattern() 原来这行代码是有bug的，也就是考虑的不全面 换成下面这一行就行了
-    node["pattern"] = m_formatter ? m_formatter->getPattern() : m_defaultFormatter->getPattern();
-    std::stringstream ss;
-    ss << node;
-    return ss.str();
+    /// 读区序号，奇数表示在读区内
+    std::atomic<uint64_t> seq{0};
+    /// 是否有线程在使用
+    bool used = false;
+    /// 读区嵌套深度
+    int depth = 0;
+    /// 在本线程读区内替换下来的旧数据，最外层读区退出后再等待其他读者并释放
+    std::vector<std::function<void()> > retired;
+};
+
+/// 登记表的锁，不随静态对象析构，线程可能在静态对象析构后退出
+static Mutex &GetLogReaderMutex() 
+{
+    static Mutex *s_mutex = new Mutex;
+    return *s_mutex;
 }
 
-// 输出到文件的子类
-FileLogAppender::FileLogAppender(const std::string &file)
-    : LogAppender(LogFormatter::ptr(new LogFormatter)) 
+/// 所有线程的登记项
+static std::vector<LogReaderSlot *> &GetLogReaderSlots() 
 {
-    m_filename = file;
-    reopen();
-    if(m_reopenError) 
-    {
-        std::cout << "reopen file " << m_filename << " error" << std::endl;
-    }
+    static std::vector<LogReaderSlot *> *s_slots = new std::vector<LogReaderSlot *>;
+    return *s_slots;
 }
 
 /**
- * 如果一个日志事件距离上次写日志超过3秒，那就重新打开一次日志文件
+ * @brief 线程的登记项，线程退出时归还
  */
-void FileLogAppender::log(LogEvent::ptr event) 
+struct LogReaderHolder 
 {
-    uint64_t now = event->getTime();
-    if(now >= (m_lastTime + 3)) 
+    LogReaderHolder() 
     {
-        reopen();
-        if(m_reopenError) 
+        Mutex::Lock lock(GetLogReaderMutex());
+        for(auto i : GetLogReaderSlots()) 
         {
-            std::cout << "reopen file " << m_filename << " error" << std::endl;
+            if(!i->used) 
+            {
+                slot = i;
+                break;
+            }
         }
-        m_lastTime = now;
+        if(!slot) 
+        {
+            slot = new LogReaderSlot;
+            GetLogReaderSlots().push_back(slot);
+        }
+        slot->used = true;
     }
-    if(m_reopenError) 
+
+    ~LogReaderHolder() 
     {
-        return;
+        Mutex::Lock lock(GetLogReaderMutex());
+        slot->used = false;
     }
 
-    MutexType::Lock lock(m_mutex);
-    if(m_formatter) // 用户自己设置了日志格式
+    LogReaderSlot *slot = nullptr;
+};
+
+static thread_local LogReaderHolder t_log_reader;
+
+/**
+ * @brief 读区，期间读取的不可变数据不会被释放
+ * @details 读区记录在线程的槽位上，期间关闭hook，Appender里的系统调用不会让出协程换到别的线程
+ */
+struct LogReadSection 
+{
+    LogReadSection() : slot(t_log_reader.slot) 
     {
-        if(!m_formatter->format(m_filestream, event)) 
+        if(slot->depth++ == 0) 
         {
-            std::cout << "[ERROR] FileLogAppender::log() format error" << std::endl;
+            // 和替换数据的线程形成Dekker式的同步：要么替换的线程看到奇数序号，要么这里读到新数据
+            slot->seq.fetch_add(1, std::memory_order_seq_cst);
         }
-    } 
-    else // 默认的日志格式
+    }
+
+    ~LogReadSection() 
     {
-        if(!m_defaultFormatter->format(m_filestream, event)) 
+        if(--slot->depth == 0) 
         {
-            std::cout << "[ERROR] FileLogAppender::log() format error" << std::endl;
+            slot->seq.fetch_add(1, std::memory_order_release);
+            if(!slot->retired.empty()) 
+            {
+                std::vector<std::function<void()> > retired;
+                retired.swap(slot->retired);
+                for(auto &i : retired) 
+                {
+                    LogRetire(std::move(i));
+                }
+            }
         }
     }
-    
-}
 
-bool FileLogAppender::reopen() 
+    LogReaderSlot *slot;
+    HookDisableGuard hook;
+};
+
+/**
+ * @brief 在数据被原子替换之后调用，等所有正在读旧数据的线程退出读区后执行release释放旧数据
+ * @details 不能持有读者可能需要的锁调用；当前线程自己在读区内时推迟到最外层读区退出后再等待，
+ *          这样等待的线程都不在读区内，不会互相等待
+ */
+static void LogRetire(std::function<void()> release) 
 {
-    MutexType::Lock lock(m_mutex);
-    // 如果已经打开则先关闭
-    if(m_filestream) 
+    LogReaderSlot *self = t_log_reader.slot;
+    if(self->depth > 0) 
     {
-        m_filestream.close();
+        self->retired.push_back(std::move(release));
+        return;
     }
-    // 以流式追加的方式打开文件m_filename，然后往m_filestream输入的内容就会直接输出到文件m_filename
-    m_filestream.open(m_filename, std::ios::app);
-    // 文件错误打开标识：如果上面打开失败m_reopenError为true 成功为false
-    m_reopenError = !m_filestream;
-    // 返回重新打开是否成功
-    return !m_reopenError;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::vector<LogReaderSlot *> slots;
+    {
+        Mutex::Lock lock(GetLogReaderMutex());
+        slots = GetLogReaderSlots();
+    }
+    for(auto slot : slots) 
+    {
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        while((seq & 1) && slot->seq.load(std::memory_order_acquire) == seq) 
+        {
+            sched_yield();
+        }
+    }
+    release();
 }
 
-std::string FileLogAppender::toYamlString() 
+/**
+ * @brief 释放被替换下来的Appender列表
+ */
+static void RetireAppenders(const Logger::AppenderList *old) 
 {
-    MutexType::Lock lock(m_mutex);
-    YAML::Node node;
-    node["type"] = "FileLogAppender";
-    node["file"] = m_filename;
-    node["pattern"] = m_formatter ? m_formatter->getPattern() : m_defaultFormatter->getPattern();
-    std::stringstream ss;
-    ss << node;
-    return ss.str();
+    LogRetire([old]() { delete old; });
 }
 
 // 日志器的构造
 Logger::Logger(const std::string &name)
     : m_name(name)
     , m_level(LogLevel::INFO)
+    , m_appenders(new AppenderList)
     , m_createTime(GetElapsedMS()) {
     }
 
+Logger::~Logger() 
+{
+    delete m_appenders.load();
+}
+
 void Logger::addAppender(LogAppender::ptr appender) 
 {
-    MutexType::Lock lock(m_mutex);
-    m_appenders.push_back(appender);
+    const AppenderList *old = nullptr;
+    {
+        MutexType::Lock lock(m_mutex);
+        old = m_appenders.load();
+        AppenderList *appenders = new AppenderList(*old);
+        appenders->push_back(appender);
+        m_appenders.store(appenders, std::memory_order_seq_cst);
+    }
+    RetireAppenders(old);
 }
 
 void Logger::delAppender(LogAppender::ptr appender) 
 {
-    MutexType::Lock lock(m_mutex);
-    for(auto it = m_appenders.begin(); it != m_appenders.end(); it++) 
+    const AppenderList *old = nullptr;
     {
-        if(*it == appender) 
+        MutexType::Lock lock(m_mutex);
+        const AppenderList *cur = m_appenders.load();
+        auto it = std::find(cur->begin(), cur->end(), appender);
+        if(it == cur->end()) 
         {
-            m_appenders.erase(it);
-            break;
+            return;
         }
+        AppenderList *appenders = new AppenderList(*cur);
+        appenders->erase(appenders->begin() + (it - cur->begin()));
+        m_appenders.store(appenders, std::memory_order_seq_cst);
+        old = cur;
     }
+    RetireAppenders(old);
 }
 
 void Logger::clearAppenders() 
 {
-    MutexType::Lock lock(m_mutex);
-    m_appenders.clear();
+    const AppenderList *old = nullptr;
+    {
+        MutexType::Lock lock(m_mutex);
+        old = m_appenders.exchange(new AppenderList, std::memory_order_seq_cst);
+    }
+    RetireAppenders(old);
+}
+
+Logger::AppenderList Logger::getAppenders() 
+{
+    LogReadSection section;
+    return *m_appenders.load(std::memory_order_seq_cst);
 }
 
 // 调用Logger的所有appenders将日志写一遍，Logger至少要有一个appender，否则没有输出   
@@ -633,7 +1867,8 @@ void Logger::log(LogEvent::ptr event)
 {
     if(event->getLevel() <= m_level) 
     {
-        for(auto &i : m_appenders) 
+        LogReadSection section;
+        for(auto &i : *m_appenders.load(std::memory_order_seq_cst)) 
         {
             i->log(event);
         }
@@ -642,11 +1877,19 @@ void Logger::log(LogEvent::ptr event)
 
 std::string Logger::toYamlString() 
 {
-    MutexType::Lock lock(m_mutex);
+    AppenderList appenders = getAppenders();
     YAML::Node node;
     node["name"] = m_name;
     node["level"] = LogLevel::ToString(m_level);
-    for(auto &i : m_appenders) 
+    if(getRateLimit()) 
+    {
+        node["rate_limit"] = getRateLimit();
+    }
+    if(getSampleRate()) 
+    {
+        node["sample"] = getSampleRate();
+    }
+    for(auto &i : appenders) 
     {
         node["appenders"].push_back(YAML::Load(i->toYamlString()));
     }
@@ -655,17 +1898,136 @@ std::string Logger::toYamlString()
     return ss.str();
 }
 
+bool LogRateLimiter::allow(const Logger::ptr &logger, LogLevel::Level level, uint32_t n
+        , const char *file, int32_t line) 
+{
+    uint32_t limit = logger->getRateLimit();
+    if(limit == 0) 
+    {
+        limit = n;
+    }
+    uint64_t window = GetCachedElapsedMS() / 1000;
+    uint64_t state = m_state.load(std::memory_order_relaxed);
+    while(true) 
+    {
+        // 读时钟之后被抢占的线程可能看到更新的窗口，窗口只能向前走
+        if((state >> 32) >= window) 
+        {
+            if((uint32_t)state >= limit) 
+            {
+                m_suppressed.fetch_add(1, std::memory_order_relaxed);
+                m_suppressedTotal.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if(m_state.compare_exchange_weak(state, state + 1, std::memory_order_relaxed)) 
+            {
+                return true;
+            }
+        } 
+        else if(m_state.compare_exchange_weak(state, (window << 32) | 1, std::memory_order_relaxed)) 
+        {
+            break;
+        }
+    }
+
+    // 进入新窗口，报告上个窗口丢弃的条数
+    uint32_t suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+    if(suppressed) 
+    {
+        LogEventWrap(logger, level, file, line).getLogEvent()->getSS()
+            << "[rate limit] suppressed " << suppressed << " messages, limit " << limit << "/s";
+    }
+    return true;
+}
+
+bool LogRateLimiter::sample(const Logger::ptr &logger, uint32_t n) 
+{
+    uint32_t rate = logger->getSampleRate();
+    if(rate == 0) 
+    {
+        rate = n;
+    }
+    if(rate <= 1) 
+    {
+        return true;
+    }
+    if(m_state.fetch_add(1, std::memory_order_relaxed) % rate == 0) 
+    {
+        return true;
+    }
+    m_suppressedTotal.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
 LogEventWrap::LogEventWrap(Logger::ptr logger, LogEvent::ptr event)
                             : m_logger(logger), m_event(event) {
 }
 
+/**
+ * @brief 线程本地的日志事件池，下标是写日志的嵌套深度
+ */
+struct LogEventPool 
+{
+    std::vector<LogEvent::ptr> events;
+    size_t depth = 0;
+};
+
+static thread_local LogEventPool t_log_event_pool;
+
+/**
+ * @brief 当前是否在调度器的任务协程里
+ * @details 任务协程在计算写日志的表达式时可能让出，之后在另一个线程恢复，或者和同线程的其它协程交错写日志，
+ *          不能占用按嵌套深度分配的线程局部事件池
+ */
+static bool InTaskFiber() 
+{
+    if(!Scheduler::GetThis()) 
+    {
+        return false;
+    }
+    Fiber *main_fiber = Scheduler::GetMainFiber();
+    return !main_fiber || Fiber::GetFiberId() != main_fiber->getId();
+}
+
+LogEventWrap::LogEventWrap(const Logger::ptr &logger, LogLevel::Level level, const char *file, int32_t line)
+    : m_logger(logger)
+    , m_pooled(!InTaskFiber()) 
+{
+    if(!m_pooled) 
+    {
+        m_event.reset(new LogEvent);
+        m_event->reset(logger->getName(), level, file, line, GetCachedElapsedMS() - logger->getCreateTime(),
+                       GetThreadId(), GetFiberId(), GetCachedTime(), GetThreadName());
+        return;
+    }
+    LogEventPool &pool = t_log_event_pool;
+    if(pool.depth == pool.events.size()) 
+    {
+        pool.events.push_back(LogEvent::ptr(new LogEvent));
+    }
+    LogEvent::ptr &event = pool.events[pool.depth++];
+    if(event.use_count() != 1) 
+    {
+        // 上次的事件还被别人持有，不能复用
+        event.reset(new LogEvent);
+    }
+    event->reset(logger->getName(), level, file, line, GetCachedElapsedMS() - logger->getCreateTime(),
+                 GetThreadId(), GetFiberId(), GetCachedTime(), GetThreadName());
+    m_event = event;
+}
+
 /**
  * @note LogEventWrap在析构时写日志
  */
 LogEventWrap::~LogEventWrap() 
 {
-    // log里将日志事件输出到所有的输出地集合 list<appender>
+    // log里将日志事件输出到所有的输出地集合 list<appender>，期间读区关闭了hook
     m_logger->log(m_event);
+    if(m_pooled) 
+    {
+        m_event.reset();
+        --t_log_event_pool.depth;
+    }
 }
 
 LoggerManager::LoggerManager() 
@@ -675,25 +2037,50 @@ LoggerManager::LoggerManager()
     // 添加输出地，这里是默认输出到标准输出 （父类指针指向子类空间）
     m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
     // 日志器添加到map里
-    m_loggers[m_root->getName()] = m_root;
+    LoggerMap *loggers = new LoggerMap;
+    (*loggers)[m_root->getName()] = m_root;
+    m_loggers = loggers;
     init();
 }
 
 //如果指定名称的日志器未找到，那会就新创建一个，但是新创建的Logger是不带Appender的，需要手动添加Appender
 Logger::ptr LoggerManager::getLogger(const std::string &name) 
 {
-    MutexType::Lock lock(m_mutex);
-    auto it = m_loggers.find(name);
-    if(it != m_loggers.end()) 
     {
-        return it->second;
+        LogReadSection section;
+        const LoggerMap *loggers = m_loggers.load(std::memory_order_seq_cst);
+        auto it = loggers->find(name);
+        if(it != loggers->end()) 
+        {
+            return it->second;
+        }
     }
 
-    Logger::ptr logger(new Logger(name));
-    m_loggers[name] = logger;
+    Logger::ptr logger;
+    const LoggerMap *old = nullptr;
+    {
+        MutexType::Lock lock(m_mutex);
+        // 加锁前可能已被其他线程创建
+        old = m_loggers.load();
+        auto it = old->find(name);
+        if(it != old->end()) 
+        {
+            return it->second;
+        }
+        logger.reset(new Logger(name));
+        LoggerMap *loggers = new LoggerMap(*old);
+        (*loggers)[name] = logger;
+        m_loggers.store(loggers, std::memory_order_seq_cst);
+    }
+    LogRetire([old]() { delete old; });
     return logger;
 }
 
+LoggerManager::~LoggerManager() 
+{
+    delete m_loggers.load();
+}
+
 /**
  * @todo 实现从配置文件加载日志配置
  */
@@ -702,9 +2089,13 @@ void LoggerManager::init() {
 
 std::string LoggerManager::toYamlString() 
 {
-    MutexType::Lock lock(m_mutex);
+    LoggerMap loggers;
+    {
+        LogReadSection section;
+        loggers = *m_loggers.load(std::memory_order_seq_cst);
+    }
     YAML::Node node;
-    for(auto& i : m_loggers) 
+    for(auto& i : loggers) 
     {
         node.push_back(YAML::Load(i.second->toYamlString()));
     }
@@ -720,14 +2111,19 @@ std::string LoggerManager::toYamlString()
  */
 struct LogAppenderDefine 
 {
-    int type = 0; // 输出地： 1 File, 2 Stdout
+    int type = 0; // 输出地： 1 File, 2 Stdout, 3 Binary, 4 RotatingFile
     std::string pattern; 
     std::string file;
+    bool async = false; // 是否异步写入，只对File有效
+    uint64_t max_size = 0; // 单个文件的最大字节数，只对RotatingFile有效
+    uint32_t rotate_interval = 0; // 按时间切分的间隔秒数，只对RotatingFile有效
+    uint32_t max_files = 7; // 保留的旧文件数，只对RotatingFile有效
 
     //重载 ==号 用于判断两个结构体是否相等
     bool operator==(const LogAppenderDefine &oth) const 
     {
-        return type == oth.type && pattern == oth.pattern && file == oth.file;
+        return type == oth.type && pattern == oth.pattern && file == oth.file && async == oth.async
+            && max_size == oth.max_size && rotate_interval == oth.rotate_interval && max_files == oth.max_files;
     }
 };
 
@@ -738,12 +2134,15 @@ struct LogDefine
 {
     std::string name;
     LogLevel::Level level = LogLevel::NOTSET;
+    uint32_t rate_limit = 0; // 每个调用点每秒最多写的条数，覆盖SYLAR_LOG_RATE_*宏里的n
+    uint32_t sample = 0; // 采样间隔，覆盖SYLAR_LOG_SAMPLE_*宏里的n
     std::vector<LogAppenderDefine> appenders;
 
     // 重载 =
     bool operator==(const LogDefine &oth) const 
     {
-        return name == oth.name && level == oth.level && appenders == appenders;
+        return name == oth.name && level == oth.level && rate_limit == oth.rate_limit
+            && sample == oth.sample && appenders == oth.appenders;
     }
 
     // 重载 <
@@ -759,6 +2158,38 @@ struct LogDefine
     }
 };
 
+/**
+ * @brief 解析文件大小，支持K、M、G后缀，比如"100M"
+ */
+static uint64_t ParseLogFileSize(const std::string &v) 
+{
+    char *end = nullptr;
+    uint64_t size = strtoull(v.c_str(), &end, 10);
+    switch(*end) 
+    {
+        case 'k': case 'K': return size << 10;
+        case 'm': case 'M': return size << 20;
+        case 'g': case 'G': return size << 30;
+        default: return size;
+    }
+}
+
+/**
+ * @brief 解析切分间隔，支持"hourly"、"daily"和秒数
+ */
+static uint32_t ParseLogRotateInterval(const std::string &v) 
+{
+    if(v == "hourly") 
+    {
+        return 3600;
+    }
+    if(v == "daily") 
+    {
+        return 86400;
+    }
+    return strtoul(v.c_str(), nullptr, 10);
+}
+
 template<>
 class LexicalCast<std::string, LogDefine> {
 public:
@@ -774,6 +2205,14 @@ public:
         }
         ld.name = n["name"].as<std::string>();
         ld.level = LogLevel::FromString(n["level"].IsDefined() ? n["level"].as<std::string>() : "");
+        if(n["rate_limit"].IsDefined()) 
+        {
+            ld.rate_limit = n["rate_limit"].as<uint32_t>();
+        }
+        if(n["sample"].IsDefined()) 
+        {
+            ld.sample = n["sample"].as<uint32_t>();
+        }
 
         if(n["appenders"].IsDefined()) 
         {
@@ -797,6 +2236,10 @@ public:
                         continue;
                     }
                     lad.file = a["file"].as<std::string>();
+                    if(a["async"].IsDefined()) 
+                    {
+                        lad.async = a["async"].as<bool>();
+                    }
                     if(a["pattern"].IsDefined()) 
                     {
                         lad.pattern = a["pattern"].as<std::string>();
@@ -810,6 +2253,42 @@ public:
                         lad.pattern = a["pattern"].as<std::string>();
                     }
                 } 
+                else if(type == "BinaryLogAppender") 
+                {
+                    lad.type = 3;
+                    if(!a["file"].IsDefined()) 
+                    {
+                        std::cout << "log appender config error: binary appender file is null, " << a << std::endl;
+                        continue;
+                    }
+                    lad.file = a["file"].as<std::string>();
+                } 
+                else if(type == "RotatingFileLogAppender") 
+                {
+                    lad.type = 4;
+                    if(!a["file"].IsDefined()) 
+                    {
+                        std::cout << "log appender config error: rotating file appender file is null, " << a << std::endl;
+                        continue;
+                    }
+                    lad.file = a["file"].as<std::string>();
+                    if(a["max_size"].IsDefined()) 
+                    {
+                        lad.max_size = ParseLogFileSize(a["max_size"].as<std::string>());
+                    }
+                    if(a["rotate_interval"].IsDefined()) 
+                    {
+                        lad.rotate_interval = ParseLogRotateInterval(a["rotate_interval"].as<std::string>());
+                    }
+                    if(a["max_files"].IsDefined()) 
+                    {
+                        lad.max_files = a["max_files"].as<uint32_t>();
+                    }
+                    if(a["pattern"].IsDefined()) 
+                    {
+                        lad.pattern = a["pattern"].as<std::string>();
+                    }
+                } 
                 else 
                 {
                     std::cout << "log appender config error: appender type is invalid, " << a << std::endl;
@@ -830,6 +2309,14 @@ public:
         YAML::Node n;
         n["name"] = i.name;
         n["level"] = LogLevel::ToString(i.level);
+        if(i.rate_limit) 
+        {
+            n["rate_limit"] = i.rate_limit;
+        }
+        if(i.sample) 
+        {
+            n["sample"] = i.sample;
+        }
         for(auto &a : i.appenders) 
         {
             YAML::Node na;
@@ -837,10 +2324,27 @@ public:
             {
                 na["type"] = "FileLogAppender";
                 na["file"] = a.file;
+                if(a.async) 
+                {
+                    na["async"] = true;
+                }
             } 
             else if(a.type == 2) 
             {
                 na["type"] = "StdoutLogAppender";
+            } 
+            else if(a.type == 3) 
+            {
+                na["type"] = "BinaryLogAppender";
+                na["file"] = a.file;
+            } 
+            else if(a.type == 4) 
+            {
+                na["type"] = "RotatingFileLogAppender";
+                na["file"] = a.file;
+                na["max_size"] = a.max_size;
+                na["rotate_interval"] = a.rotate_interval;
+                na["max_files"] = a.max_files;
             }
             // 非空
             if(!a.pattern.empty()) 
@@ -883,7 +2387,7 @@ struct LogIniter {
                     if(!(i == *it)) 
                     {
                         // 修改的logger   通过名字查找日志器的宏
-                        logger == SYLAR_LOG_NAME(i.name);
+                        logger = SYLAR_LOG_NAME(i.name);
                     } 
                     else 
                     {
@@ -891,6 +2395,8 @@ struct LogIniter {
                     }
                 }
                 logger->setLevel(i.level);
+                logger->setRateLimit(i.rate_limit);
+                logger->setSampleRate(i.sample);
                 logger->clearAppenders();
                 for(auto &a : i.appenders) 
                 {
@@ -899,7 +2405,7 @@ struct LogIniter {
                     if(a.type == 1) // 输出到文件
                     {
                         // 指向子类空间（多态）
-                        ap.reset(new FileLogAppender(a.file));
+                        ap.reset(new FileLogAppender(a.file, a.async));
                     } 
                     else if(a.type == 2) //输出到cout
                     {
@@ -912,6 +2418,14 @@ struct LogIniter {
                         {
                             continue;
                         }
+                    } 
+                    else if(a.type == 3) // 输出二进制日志，不需要格式
+                    {
+                        ap.reset(new BinaryLogAppender(a.file));
+                    }
+                    else if(a.type == 4) // 输出到按大小和时间切分的文件
+                    {
+                        ap.reset(new RotatingFileLogAppender(a.file, a.max_size, a.rotate_interval, a.max_files));
                     }
                     if(!a.pattern.empty()) // 格式非空
                     {
@@ -933,6 +2447,8 @@ struct LogIniter {
                 {
                     auto logger = SYLAR_LOG_NAME(i.name);
                     logger->setLevel(LogLevel::NOTSET);
+                    logger->setRateLimit(0);
+                    logger->setSampleRate(0);
                     logger->clearAppenders();
                 }
             }
@@ -17,6 +17,9 @@
 #include <cstdarg>
 #include <list>
 #include <map>
+#include <unordered_map>
+#include <atomic>
+#include <sys/uio.h>
 #include "util.h"
 #include "mutex.h"
 #include "singleton.h"
@@ -31,16 +34,22 @@
  */
 #define SYLAR_LOG_NAME(name) sylar::LoggerMgr::GetInstance()->getLogger(name)
 
+/**
+ * @brief 编译期保留的最低日志级别（数值最大的级别），级别数值大于它的日志语句条件恒为假，在编译期被去掉
+ * @details 默认保留全部级别，可以在编译时定义，比如-DSYLAR_LOG_COMPILE_LEVEL=600去掉所有DEBUG日志
+ */
+#ifndef SYLAR_LOG_COMPILE_LEVEL
+#define SYLAR_LOG_COMPILE_LEVEL 700
+#endif
+
 /**
  * @brief 使用流式方式将日志级别level的日志写入到logger
- * @details 构造一个LogEventWrap对象，包裹包含日志器和日志事件，在对象析构时调用日志器写日志事件
- * @todo 协程id未实现，暂时写0
+ * @details 构造一个LogEventWrap对象，包裹包含日志器和日志事件，在对象析构时调用日志器写日志事件，
+ *          日志事件取自线程本地的事件池，不分配内存
  */
 #define SYLAR_LOG_LEVEL(logger , level) \
-    if(level <= logger->getLevel()) \
-        sylar::LogEventWrap(logger, sylar::LogEvent::ptr(new sylar::LogEvent(logger->getName(), \
-            level, __FILE__, __LINE__, sylar::GetElapsedMS() - logger->getCreateTime(), \
-            sylar::GetThreadId(), sylar::GetFiberId(), time(0), sylar::GetThreadName()))).getLogEvent()->getSS()
+    if(level <= SYLAR_LOG_COMPILE_LEVEL && level <= logger->getLevel()) \
+        sylar::LogEventWrap(logger, level, __FILE__, __LINE__).getLogEvent()->getSS()
 
 #define SYLAR_LOG_FATAL(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::FATAL)
 
@@ -60,14 +69,12 @@
 
 /**
  * @brief 使用C printf方式将日志级别level的日志写入到logger
- * @details 构造一个LogEventWrap对象，包裹包含日志器和日志事件，在对象析构时调用日志器写日志事件
- * @todo 协程id未实现，暂时写0
+ * @details 构造一个LogEventWrap对象，包裹包含日志器和日志事件，在对象析构时调用日志器写日志事件，
+ *          日志事件取自线程本地的事件池，不分配内存
  */
 #define SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...) \
-    if(level <= logger->getLevel()) \
-        sylar::LogEventWrap(logger, sylar::LogEvent::ptr(new sylar::LogEvent(logger->getName(), \
-            level, __FILE__, __LINE__, sylar::GetElapsedMS() - logger->getCreateTime(), \
-            sylar::GetThreadId(), sylar::GetFiberId(), time(0), sylar::GetThreadName()))).getLogEvent()->printf(fmt, __VA_ARGS__)
+    if(level <= SYLAR_LOG_COMPILE_LEVEL && level <= logger->getLevel()) \
+        sylar::LogEventWrap(logger, level, __FILE__, __LINE__).getLogEvent()->printf(fmt, __VA_ARGS__)
 
 #define SYLAR_LOG_FMT_FATAL(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::FATAL, fmt, __VA_ARGS__)
 
@@ -85,6 +92,62 @@
 
 #define SYLAR_LOG_FMT_DEBUG(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::DEBUG, fmt, __VA_ARGS__)
 
+/**
+ * @brief 当前调用点的限流器，每个调用点（每个lambda表达式）有自己的静态限流器
+ */
+#define SYLAR_LOG_SITE_LIMITER() \
+    ([]() -> sylar::LogRateLimiter& { static sylar::LogRateLimiter s_limiter; return s_limiter; }())
+
+/**
+ * @brief 每个调用点每秒最多写n条日志级别level的日志，多出的日志被丢弃
+ * @details 日志器配置了rate_limit时以配置为准；被丢弃的条数在下一个时间窗口的第一条日志之前报告
+ */
+#define SYLAR_LOG_RATE_LEVEL(logger, level, n) \
+    if(level <= SYLAR_LOG_COMPILE_LEVEL && level <= logger->getLevel() \
+            && SYLAR_LOG_SITE_LIMITER().allow(logger, level, n, __FILE__, __LINE__)) \
+        sylar::LogEventWrap(logger, level, __FILE__, __LINE__).getLogEvent()->getSS()
+
+#define SYLAR_LOG_RATE_FATAL(logger, n) SYLAR_LOG_RATE_LEVEL(logger, sylar::LogLevel::FATAL, n)
+
+#define SYLAR_LOG_RATE_ALERT(logger, n) SYLAR_LOG_RATE_LEVEL(logger, sylar::LogLevel::ALERT, n)
+
+#define SYLAR_LOG_RATE_CRIT(logger, n) SYLAR_LOG_RATE_LEVEL(logger, sylar::LogLevel::CRIT, n)
+
+#define SYLAR_LOG_RATE_ERROR(logger, n) SYLAR_LOG_RATE_LEVEL(logger, sylar::LogLevel::ERROR, n)
+
+#define SYLAR_LOG_RATE_WARN(logger, n) SYLAR_LOG_RATE_LEVEL(logger, sylar::LogLevel::WARN, n)
+
+#define SYLAR_LOG_RATE_NOTICE(logger, n) SYLAR_LOG_RATE_LEVEL(logger, sylar::LogLevel::NOTICE, n)
+
+#define SYLAR_LOG_RATE_INFO(logger, n) SYLAR_LOG_RATE_LEVEL(logger, sylar::LogLevel::INFO, n)
+
+#define SYLAR_LOG_RATE_DEBUG(logger, n) SYLAR_LOG_RATE_LEVEL(logger, sylar::LogLevel::DEBUG, n)
+
+/**
+ * @brief 每个调用点每n条日志级别level的日志只写第一条
+ * @details 日志器配置了sample时以配置为准
+ */
+#define SYLAR_LOG_SAMPLE_LEVEL(logger, level, n) \
+    if(level <= SYLAR_LOG_COMPILE_LEVEL && level <= logger->getLevel() \
+            && SYLAR_LOG_SITE_LIMITER().sample(logger, n)) \
+        sylar::LogEventWrap(logger, level, __FILE__, __LINE__).getLogEvent()->getSS()
+
+#define SYLAR_LOG_SAMPLE_FATAL(logger, n) SYLAR_LOG_SAMPLE_LEVEL(logger, sylar::LogLevel::FATAL, n)
+
+#define SYLAR_LOG_SAMPLE_ALERT(logger, n) SYLAR_LOG_SAMPLE_LEVEL(logger, sylar::LogLevel::ALERT, n)
+
+#define SYLAR_LOG_SAMPLE_CRIT(logger, n) SYLAR_LOG_SAMPLE_LEVEL(logger, sylar::LogLevel::CRIT, n)
+
+#define SYLAR_LOG_SAMPLE_ERROR(logger, n) SYLAR_LOG_SAMPLE_LEVEL(logger, sylar::LogLevel::ERROR, n)
+
+#define SYLAR_LOG_SAMPLE_WARN(logger, n) SYLAR_LOG_SAMPLE_LEVEL(logger, sylar::LogLevel::WARN, n)
+
+#define SYLAR_LOG_SAMPLE_NOTICE(logger, n) SYLAR_LOG_SAMPLE_LEVEL(logger, sylar::LogLevel::NOTICE, n)
+
+#define SYLAR_LOG_SAMPLE_INFO(logger, n) SYLAR_LOG_SAMPLE_LEVEL(logger, sylar::LogLevel::INFO, n)
+
+#define SYLAR_LOG_SAMPLE_DEBUG(logger, n) SYLAR_LOG_SAMPLE_LEVEL(logger, sylar::LogLevel::DEBUG, n)
+
 namespace sylar {
 
 /**
@@ -133,6 +196,53 @@ public:
     static LogLevel::Level FromString(const std::string &str);
 };
 
+/**
+ * @brief 日志内容的流缓冲区
+ * @details 内容追加到自己持有的一块内存中，写满时加倍扩容，reset只移动写指针，扩容后的内存留给之后的日志复用
+ */
+class LogStreamBuf : public std::streambuf {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] size 初始容量
+     */
+    LogStreamBuf(size_t size = 512);
+
+    /**
+     * @brief 清空内容，保留容量
+     */
+    void reset() { setp(&m_storage[0], &m_storage[0] + m_storage.size()); }
+
+    /**
+     * @brief 返回内容的起始地址
+     */
+    const char *data() const { return pbase(); }
+
+    /**
+     * @brief 返回内容长度
+     */
+    size_t size() const { return pptr() - pbase(); }
+
+    /**
+     * @brief C vprintf风格追加内容，直接格式化到缓冲区中
+     */
+    void vprintf(const char *fmt, va_list ap);
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+private:
+    /**
+     * @brief 保证还能再写入n个字节
+     */
+    void reserve(size_t n);
+
+private:
+    /// 存放内容的内存
+    std::string m_storage;
+};
+
 /**
  * @brief 日志事件 (在任何位置写一条日志就是一个日志事件)
  */
@@ -142,6 +252,7 @@ public:
 
     /**
      * @brief 构造函数
+     * @details 日志器名称和线程名称会被驻留，事件只保存驻留后字符串的引用
      * @param[in] logger_name 日志器名称
      * @param[in] level 日志级别
      * @param[in] file 文件名
@@ -155,6 +266,18 @@ public:
     LogEvent(const std::string &logger_name, LogLevel::Level level, const char *file, int32_t line
         , int64_t elapse, uint32_t thread_id, uint64_t fiber_id, time_t time, const std::string &thread_name);
 
+    /**
+     * @brief 构造一个空的日志事件，供线程本地的事件池使用
+     */
+    LogEvent();
+
+    /**
+     * @brief 重新设置事件的各个字段并清空内容，供事件池复用事件
+     * @attention logger_name和thread_name只保存引用，必须在事件使用期间一直有效
+     */
+    void reset(const std::string &logger_name, LogLevel::Level level, const char *file, int32_t line
+        , int64_t elapse, uint32_t thread_id, uint64_t fiber_id, time_t time, const std::string &thread_name);
+
     /**
      * @brief 获取日志级别
      */
@@ -163,12 +286,22 @@ public:
     /**
      * @brief 获取日志内容
      */
-    std::string getContent() const { return m_ss.str(); }
+    std::string getContent() const { return std::string(m_buf.data(), m_buf.size()); }
+
+    /**
+     * @brief 获取日志内容的起始地址，不拷贝
+     */
+    const char *getContentData() const { return m_buf.data(); }
+
+    /**
+     * @brief 获取日志内容的长度
+     */
+    size_t getContentSize() const { return m_buf.size(); }
 
     /**
      * @brief 获取文件名
      */
-    std::string getFile() const { return m_file; }
+    const char *getFile() const { return m_file; }
 
     /**
      * @brief 获取行号
@@ -198,17 +331,17 @@ public:
     /**
      * @brief 获取线程名称
      */
-    const std::string &getThreadName() const { return m_threadName; }
+    const std::string &getThreadName() const { return *m_threadName; }
 
     /**
      * @brief 返回m_ss的引用 用于接收日志事件的内容：m_ss << "hello world!"
      */
-    std::stringstream &getSS() { return m_ss; }
+    std::ostream &getSS() { return m_ss; }
 
     /**
      * @brief 获取日志器名称
      */
-    const std::string &getLoggerName() const { return m_loggerName; }
+    const std::string &getLoggerName() const { return *m_loggerName; }
 
     /**
      * @brief C prinf风格写入日志
@@ -221,16 +354,17 @@ public:
     void vprintf(const char *fmt, va_list ap);
 
 private:
-    LogLevel::Level m_level;         // 日志级别
-    std::stringstream m_ss;          // 日志内容，其实是现将日志内容存在这里 然后再输入到输出地
-    const char *m_file = nullptr;    // 文件名
-    int32_t m_line = 0;              // 行号
-    int64_t m_elapse = 0;            // 从日志器创建开始到当前日志事件的耗时
-    uint32_t m_threadId = 0;         // 线程id
-    uint64_t m_fiberId = 0;          // 协程id
-    time_t m_time;                   // UTC时间戳
-    std::string m_threadName;        // 线程名称
-    std::string m_loggerName;        // 日志器名称：root日志 system日志等等
+    LogLevel::Level m_level;                  // 日志级别
+    LogStreamBuf m_buf;                       // 日志内容，其实是现将日志内容存在这里 然后再输入到输出地
+    std::ostream m_ss;                        // 写入m_buf的流
+    const char *m_file = nullptr;             // 文件名
+    int32_t m_line = 0;                       // 行号
+    int64_t m_elapse = 0;                     // 从日志器创建开始到当前日志事件的耗时
+    uint32_t m_threadId = 0;                  // 线程id
+    uint64_t m_fiberId = 0;                   // 协程id
+    time_t m_time;                            // UTC时间戳
+    const std::string *m_threadName;          // 线程名称
+    const std::string *m_loggerName;          // 日志器名称：root日志 system日志等等
 };
 
 /**
@@ -265,7 +399,8 @@ public:
     LogFormatter(const std::string &pattern = "%d{%Y-%m-%d %H:%M:%S} [%rms]%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n");
 
     /**
-     * @brief 初始化，解析格式模板提取模板项，该函数在LogFormatter的构造函数中被调用，即创建就初始化
+     * @brief 初始化，把格式模板编译成一组格式化指令，该函数在LogFormatter的构造函数中被调用，即创建就初始化
+     * @details 相邻的常规字符、%%T、%%n和%%%合并成一条常量指令，%%d的时间格式保存在指令里
      */
     void init();
 
@@ -283,41 +418,92 @@ public:
 
     /**
      * @brief 对日志事件进行格式化，返回格式化日志流
+     * @details 先格式化到线程本地的缓冲区，再一次写入os，模板中有%%n时写完刷新os
      * @param[in] event 日志事件
      * @param[in] os 日志输出流
      * @return 格式化日志流
      */
     std::ostream &format(std::ostream &os, LogEvent::ptr event);
 
+    /**
+     * @brief 对日志事件进行格式化，结果追加到buf末尾
+     * @details 调用方可以复用buf，格式化本身不分配内存（buf容量不够时除外）
+     * @param[in, out] buf 输出缓冲区
+     * @param[in] event 日志事件
+     */
+    void format(std::string &buf, LogEvent::ptr event);
+
     /**
      * @brief 获取pattern
      */
     std::string getPattern() const { return m_pattern; }
 
-public:
+private:
+    /**
+     * @brief 格式化指令类型
+     */
+    enum OpType
+    {
+        /// 常量字符串
+        OP_LITERAL = 0,
+        /// %%m 消息
+        OP_MESSAGE,
+        /// %%p 日志级别
+        OP_LEVEL,
+        /// %%r 累计毫秒数
+        OP_ELAPSE,
+        /// %%c 日志器名称
+        OP_LOGGER_NAME,
+        /// %%t 线程id
+        OP_THREAD_ID,
+        /// %%F 协程id
+        OP_FIBER_ID,
+        /// %%N 线程名称
+        OP_THREAD_NAME,
+        /// %%d 日期时间
+        OP_DATETIME,
+        /// %%f 文件名
+        OP_FILE_NAME,
+        /// %%l 行号
+        OP_LINE,
+    };
+
     /**
-     * @brief 日志内容格式化项，虚基类，用于派生出不同的格式化项
-     */
-    class FormatItem {
-    public:
-        typedef std::shared_ptr<FormatItem> ptr;
-        
-        /**
-         * @brief 析构函数
-         */
-        virtual ~FormatItem() {}
-
-        /**
-         * @brief 格式化日志事件
-         */
-        virtual void format(std::ostream &os, LogEvent::ptr event) = 0;
+     * @brief 格式化指令
+     */
+    struct Op
+    {
+        /// 指令类型
+        OpType type;
+        /// 常量字符串或时间格式在m_literals中的偏移
+        uint32_t offset;
+        /// 常量字符串或时间格式的长度
+        uint32_t len;
     };
 
+    /**
+     * @brief 添加一条指令
+     * @param[in] type 指令类型
+     * @param[in] str 常量字符串或时间格式，其它指令为空
+     */
+    void addOp(OpType type, const std::string &str = "");
+
+    /**
+     * @brief 按指令中的时间格式格式化时间，同一线程同一秒内复用上次的结果
+     */
+    void formatDateTime(std::string &buf, size_t index, time_t time);
+
 private:
     /// 日志格式模板
     std::string m_pattern;
-    /// 解析后的格式模板数组 装的是父类型指向子类空间的智能指针，实现多态
-    std::vector<FormatItem::ptr> m_items;
+    /// 编译后的格式化指令
+    std::vector<Op> m_ops;
+    /// 所有指令的常量字符串和时间格式（以'\0'分隔，便于直接传给strftime）
+    std::string m_literals;
+    /// 格式器编号，进程内唯一，用作线程本地时间缓存的键
+    uint64_t m_id;
+    /// 模板中是否有换行，有的话流式输出后刷新
+    bool m_flush = false;
     /// 是否出错
     bool m_error = false;
 };
@@ -362,6 +548,13 @@ public:
      */
     virtual std::string toYamlString() = 0;
 
+protected:
+    /**
+     * @brief 获取写日志时使用的格式器，不加锁
+     * @details 只能在Logger::log的读区内调用，被替换下来的格式器等所有读区退出之后才释放
+     */
+    LogFormatter *activeFormatter() const { return m_activeFormatter.load(std::memory_order_acquire); }
+
 protected:
     /// Mutex
     MutexType m_mutex;
@@ -369,6 +562,8 @@ protected:
     LogFormatter::ptr m_formatter;
     /// 默认日志格式器
     LogFormatter::ptr m_defaultFormatter;
+    /// 写日志时使用的格式器，m_formatter为空时指向m_defaultFormatter
+    std::atomic<LogFormatter *> m_activeFormatter;
 };
 
 /**
@@ -394,6 +589,205 @@ public:
     std::string toYamlString() override;
 };
 
+class Thread;
+
+/**
+ * @brief 异步日志写入器
+ * @details 每个写日志的线程有一个自己的环形缓冲区（单生产者单消费者，无锁），异步模式的Appender把格式化好的日志
+ *          追加到当前线程的缓冲区后立即返回，后台刷盘线程定期或在缓冲区过半时把所有缓冲区中的日志按输出文件分组，
+ *          用writev批量写入。缓冲区满时按配置丢弃日志或等待刷盘线程腾出空间。
+ *          写入器不随静态对象析构，进程正常退出时由atexit停止刷盘线程并写完剩余日志
+ */
+class AsyncLogWriter {
+public:
+    /// 最多的输出文件数
+    static const int MAX_TARGETS = 64;
+
+    /**
+     * @brief 缓冲区满时的处理策略
+     */
+    enum OverflowPolicy
+    {
+        /// 丢弃这条日志并计数
+        DROP = 0,
+        /// 阻塞等待刷盘线程腾出空间
+        BLOCK = 1,
+    };
+
+    /**
+     * @brief 一个线程的环形缓冲区
+     * @details 每条日志由8字节的头部（长度、输出文件编号）和按8字节对齐的内容组成，不会跨越缓冲区末尾，
+     *          末尾放不下时写一个回绕标记，从缓冲区开头继续
+     */
+    struct Buffer
+    {
+        /// 缓冲区内存
+        char *data = nullptr;
+        /// 缓冲区大小，2的幂
+        size_t capacity = 0;
+        /// 是否有线程正在使用，线程退出后缓冲区留给新线程复用
+        std::atomic<bool> owned{false};
+        char pad1[64];
+        /// 写入位置，只由所属线程修改
+        std::atomic<uint64_t> head{0};
+        char pad2[64];
+        /// 读取位置，只由刷盘线程修改
+        std::atomic<uint64_t> tail{0};
+    };
+
+    /**
+     * @brief 返回写入器，第一次调用时启动刷盘线程
+     */
+    static AsyncLogWriter *GetInstance();
+
+    /**
+     * @brief 注册一个输出文件
+     * @param[in] file 文件路径，同一个文件只打开一次
+     * @return 输出文件的编号，打开失败或超出MAX_TARGETS时返回-1
+     */
+    int addTarget(const std::string &file);
+
+    /**
+     * @brief 把一条格式化好的日志追加到当前线程的缓冲区
+     * @details 超过缓冲区一半大小的日志，以及刷盘线程停止之后的日志，直接同步写入文件
+     * @param[in] target 输出文件编号
+     * @param[in] data 日志内容
+     * @param[in] len 日志长度
+     */
+    void append(int target, const char *data, size_t len);
+
+    /**
+     * @brief 等待当前线程缓冲区中已有的日志全部写入文件
+     */
+    void flush();
+
+    /**
+     * @brief 停止刷盘线程并写完所有缓冲区中的日志，之后的日志同步写入
+     * @details 和stop()同时追加、刷盘线程最后一次写入时还没发布的日志，由追加的线程自己补写
+     */
+    void stop();
+
+    /**
+     * @brief 把一个后台任务交给刷盘线程执行，用于打开、扩展、切分日志文件等会阻塞的操作
+     * @details 任务按提交顺序执行，刷盘线程停止之后在调用线程上直接执行
+     */
+    void post(std::function<void()> task);
+
+    /**
+     * @brief 返回因缓冲区满而丢弃的日志条数
+     */
+    uint64_t getDroppedCount() const { return m_dropped; }
+
+    /**
+     * @brief 返回已写入文件的日志条数
+     */
+    uint64_t getFlushedCount() const { return m_flushed; }
+
+    /**
+     * @brief 返回刷盘线程调用writev的次数
+     */
+    uint64_t getWritevCount() const { return m_writevs; }
+
+private:
+    /**
+     * @brief 输出文件
+     */
+    struct Target
+    {
+        /// 文件路径
+        std::string file;
+        /// 文件句柄，重新打开文件时用dup2保持编号不变，任何线程都可以直接写
+        int fd = -1;
+    };
+
+    AsyncLogWriter();
+
+    /**
+     * @brief 返回当前线程的缓冲区，没有就复用一个空闲的或新建一个
+     * @return 线程退出过程中返回nullptr
+     */
+    Buffer *getThreadBuffer();
+
+    /**
+     * @brief 刷盘线程的执行函数
+     */
+    void run();
+
+    /**
+     * @brief 把所有缓冲区中的日志写入文件
+     * @details 平时只由刷盘线程调用，停止过程中追加日志的线程也会调用，用m_drainMutex互斥
+     */
+    void drain();
+
+    /**
+     * @brief 唤醒刷盘线程并阻塞到它下一次写完缓冲区
+     */
+    void waitProgress();
+
+    /**
+     * @brief 唤醒所有在waitProgress中等待的线程
+     */
+    void wakeWaiters();
+
+    /**
+     * @brief 把一组iovec全部写入fd，处理部分写入
+     */
+    void writeAll(int fd, std::vector<iovec> &iovs);
+
+    /**
+     * @brief 重新打开所有输出文件，日志文件被移走后会创建新文件
+     */
+    void reopenTargets();
+
+    /**
+     * @brief 唤醒刷盘线程，已有未处理的唤醒时直接返回
+     */
+    void notify();
+
+    /**
+     * @brief 执行已提交的后台任务
+     */
+    void runTasks();
+
+private:
+    /// 保护m_buffers和目标注册
+    Mutex m_mutex;
+    /// 所有线程的缓冲区
+    std::vector<Buffer *> m_buffers;
+    /// 输出文件，只追加，下标即编号
+    Target m_targets[MAX_TARGETS];
+    /// 已注册的输出文件数
+    std::atomic<int> m_targetCount{0};
+    /// 保护drain，以及它使用的m_iovs
+    Mutex m_drainMutex;
+    /// 刷盘线程按输出文件分组的iovec
+    std::vector<iovec> m_iovs[MAX_TARGETS];
+    /// 刷盘线程
+    std::shared_ptr<Thread> m_thread;
+    /// 唤醒刷盘线程的eventfd
+    int m_eventFd = -1;
+    /// 是否已有尚未处理的唤醒
+    std::atomic<bool> m_notified{false};
+    /// 刷盘线程是否在运行
+    std::atomic<bool> m_running{false};
+    /// 是否正在停止
+    std::atomic<bool> m_stopping{false};
+    /// 丢弃的日志条数
+    std::atomic<uint64_t> m_dropped{0};
+    /// 写入的日志条数
+    std::atomic<uint64_t> m_flushed{0};
+    /// writev次数
+    std::atomic<uint64_t> m_writevs{0};
+    /// 在waitProgress中等待的线程数
+    std::atomic<uint32_t> m_waiters{0};
+    /// 刷盘线程每写完一轮唤醒等待的线程
+    Semaphore m_progress;
+    /// 保护m_tasks
+    Mutex m_taskMutex;
+    /// 待执行的后台任务
+    std::vector<std::function<void()> > m_tasks;
+};
+
 /**
  * @brief 输出到文件
  */
@@ -404,8 +798,9 @@ public:
     /**
      * @brief 构造函数
      * @param[in] file 日志文件路径
+     * @param[in] async 是否异步写入，异步模式下日志交给AsyncLogWriter批量写入，不再使用文件流
      */
-    FileLogAppender(const std::string &file);
+    FileLogAppender(const std::string &file, bool async = false);
 
     /**
      * @brief 写日志
@@ -418,6 +813,11 @@ public:
      */
     bool reopen();
 
+    /**
+     * @brief 是否异步写入
+     */
+    bool isAsync() const { return m_asyncTarget >= 0; }
+
     /**
      * @brief 将日志输出目标的配置转成YAML String
      */
@@ -426,6 +826,8 @@ public:
 private:
     /// 文件路径
     std::string m_filename;
+    /// 异步模式下在AsyncLogWriter中的输出文件编号，同步模式为-1
+    int m_asyncTarget = -1;
     /// 文件流---以流式追加的方式打开文件m_filename，然后往m_filestream输入的内容就会直接输出到文件m_filename
     /// m_filestream.open(m_filename, std::ios::app) app 是追加方式的宏
     std::ofstream m_filestream;
@@ -435,6 +837,330 @@ private:
     bool m_reopenError = false;
 };
 
+/**
+ * @brief 按大小和时间切分的文件Appender
+ * @details 日志直接拷贝到文件的内存映射段中，当前段用过一半时由AsyncLogWriter的刷盘线程预先扩展文件并映射下一段，
+ *          文件超过max_size或跨过rotate_interval的时间边界时，刷盘线程把file改名为file.1（原来的file.1改名为file.2，
+ *          以此类推，最多保留max_files个旧文件），再打开新文件并映射好第一段，写日志的线程在下一条日志时切换过去。
+ *          打开文件、扩展文件、截断、改名和删除都在刷盘线程上进行，写日志的线程只做拷贝，
+ *          只有刷盘线程来不及准备下一段时才在写日志的线程上扩展文件。
+ *          文件按段预先分配，进程异常退出时文件末尾可能有一段'\0'，正常关闭时截断到实际长度
+ */
+class RotatingFileLogAppender : public LogAppender
+                              , public std::enable_shared_from_this<RotatingFileLogAppender> {
+public:
+    typedef std::shared_ptr<RotatingFileLogAppender> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] file 日志文件路径
+     * @param[in] max_size 单个文件的最大字节数，0表示不按大小切分
+     * @param[in] rotate_interval 按时间切分的间隔秒数，按本地时间对齐（比如86400在每天0点切分），0表示不按时间切分
+     * @param[in] max_files 保留的旧文件个数
+     */
+    RotatingFileLogAppender(const std::string &file, uint64_t max_size, uint32_t rotate_interval, uint32_t max_files);
+
+    /**
+     * @brief 析构函数，解除映射并把文件截断到实际长度
+     */
+    ~RotatingFileLogAppender();
+
+    /**
+     * @brief 写日志
+     */
+    void log(LogEvent::ptr event) override;
+
+    /**
+     * @brief 将日志输出目标的配置转成YAML String
+     */
+    std::string toYamlString() override;
+
+    /**
+     * @brief 返回已经切分的次数
+     */
+    uint64_t getRotateCount() const { return m_rotateCount; }
+
+    /**
+     * @brief 返回刷盘线程来不及准备、在写日志的线程上映射的段数
+     */
+    uint64_t getSyncMapCount() const { return m_syncMapCount; }
+
+private:
+    /**
+     * @brief 文件的一个内存映射段
+     */
+    struct Segment
+    {
+        /// 所属文件
+        int fd = -1;
+        /// 映射的内存
+        char *data = nullptr;
+        /// 段在文件中的偏移
+        uint64_t offset = 0;
+        /// 段内的写入位置
+        size_t pos = 0;
+    };
+
+    /**
+     * @brief 扩展文件并映射从offset开始的一段
+     * @return 失败时返回的段data为nullptr
+     */
+    Segment mapSegment(int fd, uint64_t offset);
+
+    /**
+     * @brief 打开日志文件并映射文件末尾所在的段，从文件末尾继续写
+     */
+    Segment openFile();
+
+    /**
+     * @brief 把日志拷贝到当前段，写满时切换到下一段，调用时已加锁
+     */
+    void append(const char *data, size_t len);
+
+    /**
+     * @brief 切换到当前文件的下一段，调用时已加锁
+     */
+    void nextSegment();
+
+    /**
+     * @brief 切换到已经打开好的新文件，旧文件交给刷盘线程关闭，调用时已加锁
+     */
+    void switchFile();
+
+    /**
+     * @brief 刷盘线程上执行：改名旧文件，打开新文件
+     */
+    void rotate();
+
+    /**
+     * @brief 刷盘线程上执行：解除旧段的映射，size不为-1时把文件截断到size并关闭
+     */
+    static void releaseSegment(const Segment &seg, size_t seg_size, int64_t size);
+
+    /**
+     * @brief 计算下一个按时间切分的时间点
+     */
+    time_t nextRotateTime(time_t now) const;
+
+private:
+    /// 文件路径
+    std::string m_filename;
+    /// 单个文件的最大字节数
+    uint64_t m_maxSize;
+    /// 按时间切分的间隔秒数
+    uint32_t m_rotateInterval;
+    /// 保留的旧文件个数
+    uint32_t m_maxFiles;
+    /// 每段的大小
+    size_t m_segmentSize;
+    /// 当前段
+    Segment m_cur;
+    /// 刷盘线程准备好的下一段
+    Segment m_next;
+    /// 刷盘线程打开好的新文件的第一段
+    Segment m_nextFile;
+    /// 是否已经请求刷盘线程准备下一段
+    bool m_preparing = false;
+    /// 是否已经请求刷盘线程切分
+    bool m_rotating = false;
+    /// 下一个按时间切分的时间点
+    time_t m_rotateAt = 0;
+    /// 切分次数
+    std::atomic<uint64_t> m_rotateCount{0};
+    /// 在写日志的线程上映射的段数
+    std::atomic<uint64_t> m_syncMapCount{0};
+};
+
+/**
+ * @brief 二进制日志文件格式
+ * @details 文件以BINARY_LOG_MAGIC开头，之后是一条条记录，每条记录是Varint32长度 + 记录体，记录体第一个字节是记录类型，
+ *          字段的编码与ByteArray一致（Varint、Zigzag、大端的定长整数），可以直接用ByteArray读取：
+ * - SESSION：Fuint64 起始毫秒时间戳，Uint32 进程id。每次打开文件写一条，之后的字典编号和时间差都相对于本会话
+ * - DICT：Fuint8 字典类型，Uint32 编号，StringVint 字符串，代码位置类型后面还有Int32 行号
+ * - EVENT：Uint32 级别，Uint32 代码位置编号，Uint32 日志器名称编号，Uint32 线程名称编号，Uint32 线程id，
+ *          Uint64 协程id，Int64 与上一条日志的毫秒时间差，Int64 日志器创建后的累计毫秒数，Uint64 消息长度 + 消息
+ */
+struct BinaryLog
+{
+    /// 文件头
+    static const char *MAGIC;
+    /// 文件头长度
+    static const size_t MAGIC_SIZE = 8;
+
+    /**
+     * @brief 记录类型
+     */
+    enum RecordType
+    {
+        SESSION = 1,
+        DICT    = 2,
+        EVENT   = 3,
+    };
+
+    /**
+     * @brief 字典类型
+     */
+    enum DictType
+    {
+        /// 代码位置（文件名 + 行号）
+        DICT_SITE        = 1,
+        /// 日志器名称
+        DICT_LOGGER_NAME = 2,
+        /// 线程名称
+        DICT_THREAD_NAME = 3,
+    };
+};
+
+/**
+ * @brief 输出二进制日志到文件
+ * @details 日志不经过LogFormatter，代码位置、日志器名称、线程名称第一次出现时写一条字典记录，之后只写编号，
+ *          消息原样拷贝。记录先攒在内存中，超过64KB、距上次写入超过1秒或者遇到ERROR及以上级别时写入文件，
+ *          每3秒检查一次文件是否被移走，被移走时重新打开并开始新的会话。用sylar-logcat解码
+ */
+class BinaryLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<BinaryLogAppender> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] file 日志文件路径
+     */
+    BinaryLogAppender(const std::string &file);
+
+    /**
+     * @brief 析构函数，写入剩余的日志
+     */
+    ~BinaryLogAppender();
+
+    /**
+     * @brief 写日志
+     */
+    void log(LogEvent::ptr event) override;
+
+    /**
+     * @brief 把攒下的日志写入文件
+     */
+    void flush();
+
+    /**
+     * @brief 将日志输出目标的配置转成YAML String
+     */
+    std::string toYamlString() override;
+
+private:
+    /**
+     * @brief 打开文件，开始新的会话，调用时已加锁
+     */
+    bool reopen();
+
+    /**
+     * @brief 把m_record作为一条记录（加上长度前缀）追加到m_buffer
+     */
+    void commitRecord();
+
+    /**
+     * @brief 返回字符串在字典中的编号，第一次出现时写一条字典记录
+     */
+    uint32_t lookupDict(std::unordered_map<std::string, uint32_t> &dict, BinaryLog::DictType type,
+                        const std::string &str, int32_t line = 0);
+
+    /**
+     * @brief 把m_buffer写入文件，调用时已加锁
+     */
+    void flushLocked();
+
+private:
+    /// 文件路径
+    std::string m_filename;
+    /// 文件句柄
+    int m_fd = -1;
+    /// 攒下的记录
+    std::string m_buffer;
+    /// 正在编码的记录体
+    std::string m_record;
+    /// 代码位置字典，键是文件名和行号
+    std::unordered_map<std::string, uint32_t> m_sites;
+    /// 日志器名称字典
+    std::unordered_map<std::string, uint32_t> m_loggerNames;
+    /// 线程名称字典
+    std::unordered_map<std::string, uint32_t> m_threadNames;
+    /// 代码位置的键，复用内存
+    std::string m_siteKey;
+    /// 下一个字典编号
+    uint32_t m_nextId = 1;
+    /// 上一条日志的毫秒时间戳
+    uint64_t m_lastMs = 0;
+    /// 上次写入文件的时间
+    uint64_t m_lastFlush = 0;
+    /// 上次检查文件是否被移走的时间
+    uint64_t m_lastCheck = 0;
+};
+
+/**
+ * @brief 解码后的二进制日志
+ */
+struct BinaryLogRecord
+{
+    LogLevel::Level level = LogLevel::NOTSET;
+    std::string file;
+    int32_t line = 0;
+    std::string loggerName;
+    std::string threadName;
+    uint32_t threadId = 0;
+    uint64_t fiberId = 0;
+    /// 毫秒时间戳
+    uint64_t timeMs = 0;
+    int64_t elapse = 0;
+    std::string message;
+    /// 写日志的进程id
+    uint32_t pid = 0;
+};
+
+/**
+ * @brief 二进制日志文件读取器
+ */
+class BinaryLogReader {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] file 日志文件路径
+     */
+    BinaryLogReader(const std::string &file);
+
+    /**
+     * @brief 文件是否打开成功且文件头正确
+     */
+    bool isOpen() const { return m_open; }
+
+    /**
+     * @brief 读取下一条日志，字典和会话记录在内部处理
+     * @return 读到日志返回true，文件结束或者格式错误返回false，可用isError区分
+     */
+    bool next(BinaryLogRecord &rec);
+
+    /**
+     * @brief 是否遇到格式错误（包括末尾不完整的记录）
+     */
+    bool isError() const { return m_error; }
+
+private:
+    /**
+     * @brief 读取下一条记录体
+     */
+    bool readRecord(std::string &body);
+
+private:
+    std::ifstream m_ifs;
+    bool m_open = false;
+    bool m_error = false;
+    /// 本会话的字典，编号 -> (字符串, 行号)
+    std::unordered_map<uint32_t, std::pair<std::string, int32_t> > m_dict;
+    /// 本会话上一条日志的毫秒时间戳
+    uint64_t m_lastMs = 0;
+    /// 本会话的进程id
+    uint32_t m_pid = 0;
+};
+
 /**
  * @brief 日志器类
  * @note 日志器类不带root logger
@@ -443,6 +1169,8 @@ class Logger{
 public:
     typedef std::shared_ptr<Logger> ptr;
     typedef Spinlock MutexType;
+    /// 不可变的Appender列表，修改时复制一份再替换
+    typedef std::vector<LogAppender::ptr> AppenderList;
 
     /**
      * @brief 构造函数
@@ -485,11 +1213,43 @@ public:
      */
     void clearAppenders();
 
+    /**
+     * @brief 析构函数
+     */
+    ~Logger();
+
+    /**
+     * @brief 获取当前Appender列表的副本
+     */
+    AppenderList getAppenders();
+
     /**
      * @brief 写日志
+     * @details 不加锁，只读当前的Appender列表；修改Appender时复制一份列表再原子替换，
+     *          等正在读旧列表的线程都退出后才释放旧列表
      */
     void log(LogEvent::ptr event);
 
+    /**
+     * @brief 设置每个调用点每秒最多写的日志条数，覆盖SYLAR_LOG_RATE_*宏里的n，0表示使用宏里的n
+     */
+    void setRateLimit(uint32_t v) { m_rateLimit.store(v, std::memory_order_relaxed); }
+
+    /**
+     * @brief 获取每个调用点每秒最多写的日志条数，0表示使用宏里的n
+     */
+    uint32_t getRateLimit() const { return m_rateLimit.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 设置采样间隔，覆盖SYLAR_LOG_SAMPLE_*宏里的n，0表示使用宏里的n
+     */
+    void setSampleRate(uint32_t v) { m_sampleRate.store(v, std::memory_order_relaxed); }
+
+    /**
+     * @brief 获取采样间隔，0表示使用宏里的n
+     */
+    uint32_t getSampleRate() const { return m_sampleRate.load(std::memory_order_relaxed); }
+
     /**
      * @brief 将日志器的配置转成YAML String
      */
@@ -502,8 +1262,12 @@ private:
     std::string m_name;
     /// 日志器等级
     LogLevel::Level m_level;
-    /// LogAppender集合
-    std::list<LogAppender::ptr> m_appenders;
+    /// 配置的每个调用点每秒最多写的日志条数
+    std::atomic<uint32_t> m_rateLimit{0};
+    /// 配置的采样间隔
+    std::atomic<uint32_t> m_sampleRate{0};
+    /// LogAppender集合，不可变，修改时整体替换
+    std::atomic<const AppenderList *> m_appenders;
     /// 创建时间（毫秒）
     uint64_t m_createTime;
 };
@@ -520,22 +1284,78 @@ public:
      */
     LogEventWrap(Logger::ptr logger, LogEvent::ptr event);
 
+    /**
+     * @brief 构造函数 从线程本地的事件池取一个日志事件，用当前线程、协程和缓存的时钟填好
+     * @details 事件池按嵌套深度分配事件（写日志的表达式里还可以再写日志），事件被Appender留住时换一个新的，
+     *          其余情况下不分配内存。事件池是线程局部的，调度器的任务协程在计算<<的操作数时可能让出并换到别的线程，
+     *          这时不用事件池，每次新建事件；hook只在析构时写Appender的期间关闭，操作数里的IO照常让出协程
+     * @param[in] logger 日志器
+     * @param[in] level 日志级别
+     * @param[in] file 文件名
+     * @param[in] line 行号
+     */
+    LogEventWrap(const Logger::ptr &logger, LogLevel::Level level, const char *file, int32_t line);
+
     /**
      * @brief 析构函数
-     * @details 日志事件在析构时由日志器进行输出
+     * @details 日志事件在析构时由日志器进行输出，事件来自事件池时归还
      */
     ~LogEventWrap();
 
     /**
      * @brief 获取日志事件
      */
-    LogEvent::ptr getLogEvent() const { return m_event; }
+    const LogEvent::ptr &getLogEvent() const { return m_event; }
 
 private:
     /// 日志器
     Logger::ptr m_logger;
     /// 日志事件
     LogEvent::ptr m_event;
+    /// 事件是否来自事件池
+    bool m_pooled = false;
+};
+
+/**
+ * @brief 一个写日志调用点的限流和采样状态
+ * @details 由SYLAR_LOG_RATE_*和SYLAR_LOG_SAMPLE_*宏为每个调用点生成一个静态实例，判断只用原子操作，不加锁。
+ *          限流按秒划分时间窗口，窗口编号和窗口内的条数放在同一个64位原子变量里，
+ *          超过限制时只累加丢弃计数；进入新窗口的第一条日志先报告上个窗口丢弃的条数
+ */
+class LogRateLimiter {
+public:
+    /**
+     * @brief 限流判断
+     * @param[in] logger 日志器，配置了rate_limit时覆盖n
+     * @param[in] level 日志级别，报告丢弃条数时使用
+     * @param[in] n 每秒最多写的条数
+     * @param[in] file 文件名，报告丢弃条数时使用
+     * @param[in] line 行号，报告丢弃条数时使用
+     * @return 是否写这条日志
+     */
+    bool allow(const std::shared_ptr<Logger> &logger, LogLevel::Level level, uint32_t n
+            , const char *file, int32_t line);
+
+    /**
+     * @brief 采样判断，每n条写第一条
+     * @param[in] logger 日志器，配置了sample时覆盖n
+     * @param[in] n 采样间隔
+     * @return 是否写这条日志
+     */
+    bool sample(const std::shared_ptr<Logger> &logger, uint32_t n);
+
+    /**
+     * @brief 获取累计丢弃的日志条数
+     */
+    uint64_t getSuppressedTotal() const { return m_suppressedTotal.load(std::memory_order_relaxed); }
+
+private:
+    /// 高32位是窗口编号（秒），低32位是窗口内已写的条数；采样时是调用次数
+    std::atomic<uint64_t> m_state{0};
+    /// 当前窗口丢弃的条数
+    std::atomic<uint32_t> m_suppressed{0};
+    /// 累计丢弃的条数
+    std::atomic<uint64_t> m_suppressedTotal{0};
 };
 
 /**
@@ -550,6 +1370,11 @@ public:
      */
     LoggerManager();
 
+    /**
+     * @brief 析构函数
+     */
+    ~LoggerManager();
+
     /**
      * @brief 初始化，主要是结合配置模块实现日志模块初始化
      */
@@ -557,6 +1382,7 @@ public:
 
     /**
      * @brief 获取/创建日志器，新创建的日志器没有输出地 需要用户自己添加
+     * @details 查找已有的日志器不加锁；创建日志器时复制一份表再原子替换
      */
     Logger::ptr getLogger(const std::string &name);
 
@@ -571,10 +1397,13 @@ public:
     std::string toYamlString();
 
 private:
-    /// Mutex
+    /// 日志器表
+    typedef std::map<std::string, Logger::ptr> LoggerMap;
+
+    /// Mutex，只在创建日志器时使用
     MutexType m_mutex;
-    /// 日志器集合
-    std::map<std::string, Logger::ptr> m_loggers;
+    /// 日志器集合，不可变，创建日志器时整体替换
+    std::atomic<const LoggerMap *> m_loggers;
     /// root日志器
     Logger::ptr m_root;
 };
@@ -15,6 +15,8 @@
 #include <stdint.h>
 #include <atomic>
 #include <list>
+#include <string>
+#include <stdexcept>
 
 #include "noncopyable.h"
 
@@ -59,7 +61,7 @@ public:
      * @brief 构造函数 在构造函数里直接加锁
      * @param[in] mutex Mutex
      */
-    ScopedLockImpl(T& mutex):m_mutex(mutex) 
+    ScopedLockImpl(T& mutex):m_mutex(mutex), m_locked(false)
     {
         //m_mutex.lock();
         lock();
@@ -114,7 +116,7 @@ public:
      * @brief 构造函数
      * @param[in] mutex 读写锁
      */
-    ReadScopedLockImpl(T& mutex):m_mutex(mutex)     
+    ReadScopedLockImpl(T& mutex):m_mutex(mutex), m_locked(false)
     {
         lock();
         m_locked = true;
@@ -168,7 +170,7 @@ public:
      * @brief 构造函数
      * @param[in] mutex 读写锁
      */
-    WriteScopedLockImpl(T& mutex):m_mutex(mutex) 
+    WriteScopedLockImpl(T& mutex):m_mutex(mutex), m_locked(false)
     {
         //m_mutex.wrlock();
         lock();
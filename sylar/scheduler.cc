@@ -18,6 +18,127 @@ static thread_local Scheduler *t_scheduler = nullptr;
 /// 当前线程的调度协程，每个线程都独有一份
 static thread_local Fiber *t_scheduler_fiber = nullptr;
 
+/// 当前线程在所属调度器中的调度线程信息，仅当t_scheduler有效时有意义
+static thread_local void *t_worker = nullptr;
+
+/// 窃取任务时选择victim用的随机数状态
+static thread_local uint32_t t_steal_seed = 0;
+
+/**
+ * @brief 固定容量的work-stealing双端队列(Chase-Lev)
+ * @details 只有所属线程可以push/pop底部，其他线程只能从顶部steal，三者都不加锁
+ */
+class WorkStealingQueue {
+public:
+    /// 容量，必须是2的幂，队列满时任务转入全局队列
+    static const int64_t CAPACITY = 4096;
+
+    WorkStealingQueue() 
+    {
+        for (int64_t i = 0; i < CAPACITY; ++i) 
+        {
+            m_buffer[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 所属线程放入任务
+     * @return 队列已满返回false
+     */
+    bool push(void *item) 
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY) 
+        {
+            return false;
+        }
+        m_buffer[b & (CAPACITY - 1)].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief 队列是否为空，任意线程可调用，结果只是一个快照
+     */
+    bool empty() const 
+    {
+        return m_bottom.load(std::memory_order_seq_cst) <= m_top.load(std::memory_order_seq_cst);
+    }
+
+    /**
+     * @brief 所属线程取出最近放入的任务
+     */
+    void *pop() 
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if (t > b) 
+        {
+            // 队列为空
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        void *item = m_buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (t == b) 
+        {
+            // 只剩最后一个任务，和窃取者竞争
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) 
+            {
+                item = nullptr;
+            }
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /**
+     * @brief 其他线程窃取最早放入的任务
+     */
+    void *steal() 
+    {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b) 
+        {
+            return nullptr;
+        }
+        void *item = m_buffer[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) 
+        {
+            return nullptr;
+        }
+        return item;
+    }
+
+private:
+    std::atomic<int64_t> m_top{0};
+    std::atomic<int64_t> m_bottom{0};
+    std::atomic<void *> m_buffer[CAPACITY];
+};
+
+/**
+ * @brief 调度线程的本地队列和收件箱
+ */
+struct Scheduler::Worker {
+    /// 在m_workers中的下标
+    int index = 0;
+    /// 调度线程id，线程启动前为-1
+    std::atomic<int> thread{-1};
+    /// 本地任务队列
+    WorkStealingQueue local;
+    /// 收件箱，指定在本线程执行的任务
+    std::list<ScheduleTask *> inbox;
+    /// 收件箱中的任务数
+    std::atomic<size_t> inboxCount{0};
+    /// 保护收件箱
+    MutexType mutex;
+};
+
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name) 
 {
     //用于判断threads是否合法（条件为假发生断言）
@@ -58,6 +179,19 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name)
         m_rootThread = -1;
     }
     m_threadCount = threads;
+
+    m_workers.resize(m_threadCount + (use_caller ? 1 : 0));
+    for (size_t i = 0; i < m_workers.size(); ++i) 
+    {
+        m_workers[i]        = new Worker;
+        m_workers[i]->index = i;
+    }
+    if (use_caller) 
+    {
+        // caller线程在run之前添加的任务直接放入自己的本地队列
+        m_workers[0]->thread = m_rootThread;
+        t_worker             = m_workers[0];
+    }
 }
 
 //获取当前线程调度器指针
@@ -85,6 +219,25 @@ Scheduler::~Scheduler()
     if (GetThis() == this) //这里的this就是调度器指针
     {
         t_scheduler = nullptr;
+        t_worker    = nullptr;
+    }
+
+    for (auto &i : m_tasks) 
+    {
+        delete i;
+    }
+    for (auto &i : m_workers) 
+    {
+        void *task = nullptr;
+        while ((task = i->local.steal())) 
+        {
+            delete (ScheduleTask *)task;
+        }
+        for (auto &j : i->inbox) 
+        {
+            delete j;
+        }
+        delete i;
     }
 }
 
@@ -111,14 +264,240 @@ void Scheduler::start()
                                       m_name + "_" + std::to_string(i)));
         //加入到线程id数组
         m_threadIds.push_back(m_threads[i]->getId());
+        m_workers[m_threadIds.size() - 1]->thread = m_threads[i]->getId();
     }
 }
 
-bool Scheduler::stopping() 
+std::vector<int> Scheduler::getThreadIds() 
 {
     MutexType::Lock lock(m_mutex);
+    return m_threadIds;
+}
+
+Scheduler::Worker *Scheduler::getWorker(int thread) 
+{
+    for (auto &i : m_workers) 
+    {
+        if (i->thread == thread) 
+        {
+            return i;
+        }
+    }
+    return nullptr;
+}
+
+int Scheduler::getWorkerIndex(int thread) 
+{
+    Worker *worker = getWorker(thread);
+    return worker ? worker->index : -1;
+}
+
+int Scheduler::getThisWorkerIndex() 
+{
+    if (t_scheduler != this || !t_worker) 
+    {
+        return -1;
+    }
+    return ((Worker *)t_worker)->index;
+}
+
+bool Scheduler::hasPendingTasks() 
+{
+    if (m_globalTaskCount) 
+    {
+        return true;
+    }
+    int index = getThisWorkerIndex();
+    if (index >= 0 && m_workers[index]->inboxCount) 
+    {
+        return true;
+    }
+    for (auto &i : m_workers) 
+    {
+        if (!i->local.empty()) 
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::pushGlobal(ScheduleTask *task) 
+{
+    MutexType::Lock lock(m_mutex);
+    bool need_tickle = m_tasks.empty();
+    m_tasks.push_back(task);
+    ++m_globalTaskCount;
+    return need_tickle;
+}
+
+bool Scheduler::enqueue(ScheduleTask *task) 
+{
+    ++m_taskCount;
+    if (task->thread != -1) 
+    {
+        Worker *worker = getWorker(task->thread);
+        if (worker) 
+        {
+            MutexType::Lock lock(worker->mutex);
+            bool need_tickle = worker->inbox.empty();
+            worker->inbox.push_back(task);
+            ++worker->inboxCount;
+            return need_tickle;
+        }
+        // 指定的线程不属于本调度器(或尚未启动)，退化为任意线程执行
+        SYLAR_LOG_WARN(g_logger) << "schedule task to unknown thread " << task->thread;
+        task->thread = -1;
+    }
+
+    // 本调度器的调度线程内添加的任务，放入本地队列，空闲的线程可以来窃取
+    if (t_scheduler == this && t_worker) 
+    {
+        if (((Worker *)t_worker)->local.push(task)) 
+        {
+            return hasIdleThreads();
+        }
+    }
+    return pushGlobal(task);
+}
+
+void Scheduler::scheduleBatch(std::vector<ScheduleTask *> &tasks)
+{
+    // 先剔除空任务并统计，任务数要在任务入队之前加上，否则run中可能先减后加
+    size_t count    = 0;
+    size_t unpinned = 0;
+    for (auto &i : tasks)
+    {
+        if (!i->fiber && !i->cb)
+        {
+            delete i;
+            i = nullptr;
+            continue;
+        }
+        ++count;
+        if (i->thread == -1)
+        {
+            ++unpinned;
+        }
+    }
+    if (count == 0)
+    {
+        tasks.clear();
+        return;
+    }
+    m_taskCount += unpinned;
+
+    Worker *worker = (t_scheduler == this) ? (Worker *)t_worker : nullptr;
+    size_t wakeups = 0;
+    std::vector<ScheduleTask *> global;
+    for (auto &i : tasks)
+    {
+        if (!i)
+        {
+            continue;
+        }
+        if (i->thread != -1)
+        {
+            // 指定线程的任务走原来的收件箱路径，enqueue自己会增加任务数，只唤醒目标线程
+            int thread = i->thread;
+            if (enqueue(i))
+            {
+                tickleThread(thread);
+            }
+            continue;
+        }
+        if (worker && worker->local.push(i))
+        {
+            ++wakeups;
+            continue;
+        }
+        global.push_back(i);
+    }
+    tasks.clear();
+
+    // 放入全局队列的任务只加一次锁
+    if (!global.empty())
+    {
+        MutexType::Lock lock(m_mutex);
+        m_tasks.insert(m_tasks.end(), global.begin(), global.end());
+        m_globalTaskCount += global.size();
+        wakeups += global.size();
+    }
+
+    ++m_batchCount;
+    m_batchTaskCount += count;
+
+    // 最多唤醒min(新任务数, 空闲线程数)个线程
+    wakeups = std::min(wakeups, (size_t)m_idleThreadCount);
+    for (size_t i = 0; i < wakeups; ++i)
+    {
+        tickle();
+    }
+}
+
+Scheduler::ScheduleTask *Scheduler::nextTask(Worker *worker) 
+{
+    ScheduleTask *task = nullptr;
+    if (worker->inboxCount) 
+    {
+        MutexType::Lock lock(worker->mutex);
+        if (!worker->inbox.empty()) 
+        {
+            task = worker->inbox.front();
+            worker->inbox.pop_front();
+            --worker->inboxCount;
+            return task;
+        }
+    }
+
+    task = (ScheduleTask *)worker->local.pop();
+    if (task) 
+    {
+        return task;
+    }
+
+    if (m_globalTaskCount) 
+    {
+        MutexType::Lock lock(m_mutex);
+        if (!m_tasks.empty()) 
+        {
+            task = m_tasks.front();
+            m_tasks.pop_front();
+            --m_globalTaskCount;
+            return task;
+        }
+    }
+
+    // 从随机的victim开始，依次尝试窃取其他线程的本地队列
+    size_t n = m_workers.size();
+    if (n > 1) 
+    {
+        t_steal_seed ^= t_steal_seed << 13;
+        t_steal_seed ^= t_steal_seed >> 17;
+        t_steal_seed ^= t_steal_seed << 5;
+        size_t start = t_steal_seed % n;
+        for (size_t i = 0; i < n; ++i) 
+        {
+            Worker *victim = m_workers[(start + i) % n];
+            if (victim == worker) 
+            {
+                continue;
+            }
+            task = (ScheduleTask *)victim->local.steal();
+            if (task) 
+            {
+                return task;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool Scheduler::stopping() 
+{
     //正在停止 and 任务队列为空 and 活跃的线程数为0
-    return m_stopping && m_tasks.empty() && m_activeThreadCount == 0;
+    //先读任务数再读活跃线程数，run中取任务时先增加活跃线程数再减少任务数
+    return m_stopping && m_taskCount == 0 && m_activeThreadCount == 0;
 }
 
 void Scheduler::tickle() 
@@ -126,6 +505,11 @@ void Scheduler::tickle()
     SYLAR_LOG_DEBUG(g_logger) << "ticlke"; 
 }
 
+void Scheduler::tickleThread(int thread) 
+{
+    tickle();
+}
+
 // 当stopping为真 idle协程的state变为term
 void Scheduler::idle() 
 {
@@ -216,63 +600,70 @@ void Scheduler::run()
         t_scheduler_fiber = sylar::Fiber::GetThis().get();
     }
 
+    //找到本线程对应的本地队列，start()持有m_mutex直到所有线程id都记录完毕
+    Worker *worker = nullptr;
+    {
+        MutexType::Lock lock(m_mutex);
+        for (size_t i = 0; i < m_threadIds.size(); ++i) 
+        {
+            if (m_threadIds[i] == sylar::GetThreadId()) 
+            {
+                worker = m_workers[i];
+                break;
+            }
+        }
+    }
+    SYLAR_ASSERT(worker);
+    t_worker     = worker;
+    t_steal_seed = worker->thread * 2654435761u + 1;
+
     //设置idle协程
     Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
     Fiber::ptr cb_fiber; //如果任务传进来的是一个函数对象，则把这个函数对象包装进这个新的协程里
 
     ScheduleTask task;
+    // 连续执行了多少个任务没有进入idle
+    uint32_t busy = 0;
     while (true) 
     {
         task.reset();
-        bool tickle_me = false; // 是否tickle其他线程进行任务调度（处理任务）
+        ScheduleTask *next = nextTask(worker);
+        if (next) 
         {
-            MutexType::Lock lock(m_mutex);
-            auto it = m_tasks.begin();
-            // 遍历所有调度任务 （遍历任务队列list）
-            while (it != m_tasks.end()) 
+            SYLAR_ASSERT(next->fiber || next->cb);
+
+            // [BUG FIX]: hook IO相关的系统调用时，在检测到IO未就绪的情况下，会先添加对应的读写事件，再yield当前协程，等IO就绪后再resume当前协程
+            // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
+            // 这里把任务放回全局队列稍后再试，以损失一点性能为代价，否则整个协程框架都要大改
+            if (next->fiber && next->fiber->getState() == Fiber::RUNNING) 
             {
-                //it->thread是那个任务所指定的线程号，-1表示任一线程都可以执那个任务，不等于-1表示需要指定的线程来处理这个任务
-                //该任务指定了某个线程来完成，且这个线程不是当前线程
-                if (it->thread != -1 && it->thread != sylar::GetThreadId()) 
+                if (next->thread != -1) 
                 {
-                    // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
-                    ++it;
-                    tickle_me = true;
-                    continue;
-                }
-
-                // 找到一个未指定线程，或是指定了当前线程的任务
-                SYLAR_ASSERT(it->fiber || it->cb);
-
-                // if (it->fiber) {
-                //     // 任务队列时的协程一定是READY状态，谁会把RUNNING或TERM状态的协程加入调度呢？
-                //     SYLAR_ASSERT(it->fiber->getState() == Fiber::READY);
-                // }
-
-                // [BUG FIX]: hook IO相关的系统调用时，在检测到IO未就绪的情况下，会先添加对应的读写事件，再yield当前协程，等IO就绪后再resume当前协程
-                // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
-                // 这里简单地跳过这种情况，以损失一点性能为代价，否则整个协程框架都要大改
-                
-                //该fiber正在运行状态
-                if(it->fiber && it->fiber->getState() == Fiber::RUNNING) 
+                    MutexType::Lock lock(worker->mutex);
+                    worker->inbox.push_back(next);
+                    ++worker->inboxCount;
+                } 
+                else 
                 {
-                    ++it;
-                    continue;
+                    pushGlobal(next);
                 }
-                
-                // 当前调度线程找到一个任务，准备开始调度，将其从任务队列中剔除，活动线程数加1
-                task = *it;
-                m_tasks.erase(it++);
-                ++m_activeThreadCount;
-                break;
+                continue;
             }
-            // 当前线程拿完一个任务后，发现任务队列还有剩余，那么tickle一下其他线程
-            tickle_me |= (it != m_tasks.end());
-        }
 
-        if (tickle_me) 
-        {
-            tickle();
+            // 当前调度线程找到一个任务，准备开始调度，活动线程数加1
+            ++m_activeThreadCount;
+            --m_taskCount;
+            task.fiber.swap(next->fiber);
+            task.cb.swap(next->cb);
+            task.thread = next->thread;
+            delete next;
+
+            // 当前线程拿完一个任务后，发现还有别的线程能拿走的剩余任务，那么tickle一下其他线程
+            // 指定线程的任务在放入收件箱时已经唤醒过目标线程，别的线程被叫醒也拿不走
+            if (m_globalTaskCount || !worker->local.empty()) 
+            {
+                tickle();
+            }
         }
 
         if (task.fiber) //协程对象
@@ -301,6 +692,7 @@ void Scheduler::run()
         } 
         else 
         {
+            busy = 0;
             // 进到这个分支情况一定是任务队列空了，调度idle协程即可
             if (idle_fiber->getState() == Fiber::TERM) 
             {
@@ -311,8 +703,18 @@ void Scheduler::run()
             ++m_idleThreadCount;
             idle_fiber->resume();
             --m_idleThreadCount;
+            continue;
+        }
+
+        static const uint32_t MAX_BUSY_TASKS = 64;
+        if (++busy >= MAX_BUSY_TASKS) 
+        {
+            busy = 0;
+            busyPoll();
         }
     }
+    // 缓存的时钟只在调度线程的循环里刷新，退出之后不再有效
+    ClearCachedClock();
     SYLAR_LOG_DEBUG(g_logger) << "Scheduler::run() exit";
 }
 
@@ -12,6 +12,7 @@
 #include <list>
 #include <memory>
 #include <string>
+#include <vector>
 #include "fiber.h"
 #include "log.h"
 #include "thread.h"
@@ -22,6 +23,9 @@ namespace sylar {
  * @brief 协程调度器
  * @details 封装的是N-M的协程调度器
  *          内部有一个线程池,支持协程在线程池里面切换
+ *          每个调度线程有自己的本地任务队列，调度线程内添加的任务优先放入本地队列，
+ *          空闲的调度线程会随机选择其他线程的本地队列窃取任务；指定了线程的任务放入目标线程的收件箱，
+ *          调度器之外的线程添加的任务放入全局队列
  */
 class Scheduler {
 public:
@@ -49,7 +53,7 @@ public:
     /**
      * @brief 返回当前任务队列中的任务数量
      */
-    unsigned int getTaskCount() { return m_tasks.size(); }
+    unsigned int getTaskCount() { return m_taskCount; }
 
     /**
      * @brief 获取当前协程调度器指针
@@ -71,18 +75,61 @@ public:
     template <class FiberOrCb>
     void schedule(FiberOrCb fc, int thread = -1) 
     {
-        bool need_tickle = false;
+        //初始化调度任务task
+        ScheduleTask *task = new ScheduleTask(fc, thread);
+        if (!task->fiber && !task->cb) 
+        {
+            delete task;
+            return;
+        }
+
+        if (enqueue(task)) 
         {
-            MutexType::Lock lock(m_mutex);
-            need_tickle = scheduleNoLock(fc, thread);
+            // 指定了线程的任务只需要唤醒目标线程
+            if (thread == -1) 
+            {
+                tickle(); // 唤醒idle协程
+            } 
+            else 
+            {
+                tickleThread(thread);
+            }
         }
+    }
 
-        if (need_tickle) 
+    /**
+     * @brief 批量添加调度任务
+     * @tparam InputIterator 迭代器，指向协程对象或函数对象，其内容会被swap进调度任务
+     * @param[] begin 起始迭代器
+     * @param[] end 结束迭代器
+     */
+    template <class InputIterator>
+    void schedule(InputIterator begin, InputIterator end) 
+    {
+        std::vector<ScheduleTask *> tasks;
+        while (begin != end) 
         {
-            tickle(); // 唤醒idle协程
+            tasks.push_back(new ScheduleTask(&*begin, -1));
+            ++begin;
         }
+        scheduleBatch(tasks);
     }
 
+    /**
+     * @brief 返回批量添加的次数
+     */
+    uint64_t getBatchCount() const { return m_batchCount; }
+
+    /**
+     * @brief 返回批量添加的任务总数，除以getBatchCount()即平均每批的任务数
+     */
+    uint64_t getBatchTaskCount() const { return m_batchTaskCount; }
+
+    /**
+     * @brief 返回所有调度线程的线程id，use_caller时第一个为caller线程
+     */
+    std::vector<int> getThreadIds();
+
     /**
      * @brief 启动调度器
      */
@@ -99,6 +146,13 @@ protected:
      */
     virtual void tickle();
 
+    /**
+     * @brief 通知指定的调度线程有任务了
+     * @details 默认实现退化为tickle()
+     * @param[in] thread 线程id
+     */
+    virtual void tickleThread(int thread);
+
     /**
      * @brief 协程调度函数
      */
@@ -109,6 +163,12 @@ protected:
      */
     virtual void idle();
 
+    /**
+     * @brief 调度线程连续执行了很多任务、一直没有进入idle时调用
+     * @details 子类在这里处理只能由本线程处理的工作，避免本线程一直忙时它们得不到处理，比如刷新缓存的时钟
+     */
+    virtual void busyPoll() {}
+
     /**
      * @brief 返回是否可以停止
      */
@@ -125,27 +185,27 @@ protected:
      */
     bool hasIdleThreads() { return m_idleThreadCount > 0; }
 
-private:
     /**
-     * @brief 添加调度任务，无锁
-     * @tparam FiberOrCb 调度任务类型，可以是协程对象或函数指针
-     * @param[] fc 协程对象或指针
-     * @param[] thread 指定运行该任务的线程号，-1表示任意线程
+     * @brief 返回调度线程数，包含use_caller的caller线程
      */
-    template <class FiberOrCb>
-    bool scheduleNoLock(FiberOrCb fc, int thread) 
-    {
-        bool need_tickle = m_tasks.empty();
-        //初始化调度任务task
-        ScheduleTask task(fc, thread);
-        if (task.fiber || task.cb) 
-        {
-            m_tasks.push_back(task);
-        }
-        return need_tickle;
-    }
+    size_t getWorkerCount() const { return m_workers.size(); }
+
+    /**
+     * @brief 返回线程id对应的调度线程下标，不属于本调度器时返回-1
+     */
+    int getWorkerIndex(int thread);
+
+    /**
+     * @brief 返回当前线程的调度线程下标，不是本调度器的调度线程时返回-1
+     */
+    int getThisWorkerIndex();
+
+    /**
+     * @brief 返回当前调度线程是否有可执行的任务
+     * @details 查看本线程的收件箱、全局队列和所有线程的本地队列，调度线程休眠前用来避免错过唤醒
+     */
+    bool hasPendingTasks();
 
-private:
     /**
      * @brief 调度任务，协程/函数二选一，可指定在哪个线程上调度
      */
@@ -174,6 +234,12 @@ private:
             thread = thr;
         }
 
+        ScheduleTask(std::function<void()> *f, int thr) 
+        {
+            cb.swap(*f);
+            thread = thr;
+        }
+
         ScheduleTask() { thread = -1; }
 
         void reset() 
@@ -184,6 +250,41 @@ private:
         }
     };
 
+    /**
+     * @brief 批量添加调度任务
+     * @details 全局队列只加一次锁，最多tickle min(任务数, 空闲线程数)次，tasks中的任务所有权转交给调度器
+     * @param[in, out] tasks 调度任务，返回时被清空
+     */
+    void scheduleBatch(std::vector<ScheduleTask *> &tasks);
+
+private:
+    struct Worker;
+
+    /**
+     * @brief 把任务放入合适的队列
+     * @details 指定了线程的任务放入目标线程的收件箱，调度线程内添加的任务放入本线程的本地队列，
+     *          其他情况放入全局队列
+     * @return 是否需要tickle
+     */
+    bool enqueue(ScheduleTask *task);
+
+    /**
+     * @brief 放入全局队列
+     * @return 全局队列之前是否为空
+     */
+    bool pushGlobal(ScheduleTask *task);
+
+    /**
+     * @brief 为调度线程取下一个任务
+     * @details 依次查看本线程的收件箱、本地队列、全局队列，最后随机窃取其他线程的本地队列
+     */
+    ScheduleTask *nextTask(Worker *worker);
+
+    /**
+     * @brief 根据线程id查找调度线程
+     */
+    Worker *getWorker(int thread);
+
 private:
     /// 协程调度器名称
     std::string m_name;
@@ -191,8 +292,18 @@ private:
     MutexType m_mutex;
     /// 线程池
     std::vector<Thread::ptr> m_threads;
-    /// 任务队列
-    std::list<ScheduleTask> m_tasks;
+    /// 全局任务队列，调度器之外的线程添加的任务放在这里，受m_mutex保护
+    std::list<ScheduleTask *> m_tasks;
+    /// 全局任务队列中的任务数
+    std::atomic<size_t> m_globalTaskCount = {0};
+    /// 所有队列中尚未开始执行的任务总数
+    std::atomic<size_t> m_taskCount = {0};
+    /// 每个调度线程的本地队列和收件箱，use_caller时下标0为caller线程
+    std::vector<Worker *> m_workers;
+    /// 批量添加的次数
+    std::atomic<uint64_t> m_batchCount = {0};
+    /// 批量添加的任务总数
+    std::atomic<uint64_t> m_batchTaskCount = {0};
     /// 线程池的线程ID数组
     std::vector<int> m_threadIds;
     /// 工作线程数量，不包含use_caller的主线程
@@ -152,6 +152,20 @@ bool Socket::setOption(int level, int option, const void *result, socklen_t len)
     return true;
 }
 
+bool Socket::setReusePort(bool v) 
+{
+    if (!isValid()) 
+    {
+        newSock();
+        if (SYLAR_UNLIKELY(!isValid())) 
+        {
+            return false;
+        }
+    }
+    int val = v ? 1 : 0;
+    return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
 Socket::ptr Socket::accept() 
 {
     // 先为接受的连接创建一个socket（智能指针）
@@ -154,6 +154,12 @@ public:
         return setOption(level, option, &value, sizeof(T));
     }
 
+    /**
+     * @brief 设置SO_REUSEPORT，多个socket可以绑定同一地址，由内核在它们之间分发连接
+     * @attention 需要在bind之前调用，socket句柄尚未创建时会先创建
+     */
+    bool setReusePort(bool v = true);
+
     /**
      * @brief 接收connect链接
      * @return 成功返回新连接的socket,失败返回nullptr
@@ -1,5 +1,8 @@
 #include "socket_stream.h"
 #include "../util.h"
+#include "../hook.h"
+#include <limits.h>
+#include <algorithm>
 
 namespace sylar {
 
@@ -73,6 +76,65 @@ int SocketStream::write(ByteArray::ptr ba, size_t length)
     return rt;
 }
 
+int SocketStream::writevFixSize(iovec *iovs, size_t count) 
+{
+    if(!isConnected()) 
+    {
+        return -1;
+    }
+    int64_t total = 0;
+    while(count > 0) 
+    {
+        int rt = m_socket->send(iovs, std::min(count, (size_t)IOV_MAX));
+        if(rt <= 0) 
+        {
+            return rt;
+        }
+        total += rt;
+        // 跳过已发送完的内存块，调整发送了一部分的内存块
+        size_t sent = rt;
+        while(count > 0 && sent >= iovs->iov_len) 
+        {
+            sent -= iovs->iov_len;
+            ++iovs;
+            --count;
+        }
+        if(count > 0 && sent > 0) 
+        {
+            iovs->iov_base = (char *)iovs->iov_base + sent;
+            iovs->iov_len -= sent;
+        }
+    }
+    return total;
+}
+
+int64_t SocketStream::sendFile(int fd, uint64_t offset, uint64_t len) 
+{
+    if(!isConnected()) 
+    {
+        return -1;
+    }
+    int64_t total = 0;
+    off_t off     = offset;
+    while(len > 0) 
+    {
+        // 单次sendfile最多0x7ffff000字节，off由内核推进
+        ssize_t rt = sendfile(m_socket->getSocket(), fd, &off, std::min(len, (uint64_t)0x7ffff000));
+        if(rt < 0) 
+        {
+            return rt;
+        }
+        if(rt == 0) 
+        {
+            // 文件提前结束
+            break;
+        }
+        total += rt;
+        len   -= rt;
+    }
+    return total;
+}
+
 void SocketStream::close() 
 {
     if(m_socket) 
@@ -80,6 +80,29 @@ public:
      */
     virtual int write(ByteArray::ptr ba, size_t length) override;
 
+    /**
+     * @brief 用一次sendmsg发送多块内存，直到全部发送完成（部分发送时继续发送剩余部分）
+     * @param[in, out] iovs 待发送的内存块，发送过程中会被修改
+     * @param[in] count 内存块个数
+     * @return
+     *      @retval >0 返回发送的总字节数
+     *      @retval =0 socket被远端关闭
+     *      @retval <0 socket错误
+     */
+    int writevFixSize(iovec *iovs, size_t count);
+
+    /**
+     * @brief 用sendfile把文件从offset开始的len字节直接发送到socket，数据不经过用户态，直到全部发送完成
+     * @param[in] fd 已打开的文件
+     * @param[in] offset 文件偏移，不改变fd自己的读写位置
+     * @param[in] len 发送的字节数
+     * @return
+     *      @retval >0 返回发送的总字节数，文件比offset+len短时小于len
+     *      @retval =0 offset处已经是文件末尾，或socket被远端关闭
+     *      @retval <0 socket错误
+     */
+    int64_t sendFile(int fd, uint64_t offset, uint64_t len);
+
     /**
      * @brief 关闭socket
      */
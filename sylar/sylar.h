@@ -35,6 +35,7 @@
 #include "iomanager.h"
 #include "fd_manager.h"
 #include "hook.h"
+#include "blocking_pool.h"
 #include "endian.h"
 #include "address.h"
 #include "socket.h"
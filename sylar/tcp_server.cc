@@ -11,6 +11,10 @@ static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
     sylar::Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2),
             "tcp server read timeout");
 
+static sylar::ConfigVar<bool>::ptr g_tcp_server_reuse_port =
+    sylar::Config::Lookup("tcp_server.reuse_port", false,
+            "tcp server one SO_REUSEPORT listen socket per accept thread");
+
 TcpServer::TcpServer(sylar::IOManager* io_worker,
                     sylar::IOManager* accept_worker)
                     :m_ioWorker(io_worker)
@@ -18,7 +22,8 @@ TcpServer::TcpServer(sylar::IOManager* io_worker,
                     ,m_recvTimeout(g_tcp_server_read_timeout->getValue())
                     ,m_name("sylar/1.0.0")
                     ,m_type("tcp")
-                    ,m_isStop(true) 
+                    ,m_isStop(true)
+                    ,m_reusePort(g_tcp_server_reuse_port->getValue()) 
 {
     // accept_worker主要负责listen socket的调度工作
     // io_worker主要负责服务器accept之后客户端socket的调度工做
@@ -50,10 +55,26 @@ bool TcpServer::bind(sylar::Address::ptr addr)
 bool TcpServer::bind(const std::vector<Address::ptr>& addrs
                         ,std::vector<Address::ptr>& fails ) 
 {
-    for(auto& addr : addrs) 
+    // SO_REUSEPORT模式下每个地址为每个accept线程创建一个监听socket
+    size_t count = 1;
+    if(m_reusePort) 
+    {
+        count = std::max((size_t)1, m_acceptWorker->getThreadIds().size());
+    }
+
+    for(size_t n = 0; n < addrs.size() * count; ++n) 
     {
+        auto& addr = addrs[n / count];
         // 根据地址类型创建相应类型的socket
         Socket::ptr sock = Socket::CreateTCP(addr);
+        if(m_reusePort && !sock->setReusePort(true)) 
+        {
+            SYLAR_LOG_ERROR(g_logger) << "set SO_REUSEPORT fail errno="
+                << errno << " errstr=" << strerror(errno)
+                << " addr=[" << addr->toString() << "]";
+            fails.push_back(addr);
+            continue;
+        }
         // socket绑定地址
         if(!sock->bind(addr)) 
         {
@@ -123,10 +144,18 @@ bool TcpServer::start()
     }
     m_isStop = false;
 
-    for(auto& sock : m_socks) 
+    // SO_REUSEPORT模式下第i个监听socket的accept协程指定在第i个accept线程上运行
+    std::vector<int> threads;
+    if(m_reusePort) 
+    {
+        threads = m_acceptWorker->getThreadIds();
+    }
+
+    for(size_t i = 0; i < m_socks.size(); ++i) 
     {
         m_acceptWorker->schedule(std::bind(&TcpServer::startAccept,
-                    shared_from_this(), sock));
+                    shared_from_this(), m_socks[i]),
+                    threads.empty() ? -1 : threads[i % threads.size()]);
     }
     return true;
 }
@@ -158,7 +187,8 @@ std::string TcpServer::toString(const std::string& prefix)
        << " name=" << m_name
        << " io_worker=" << (m_ioWorker ? m_ioWorker->getName() : "")
        << " accept_worker=" << (m_acceptWorker ? m_acceptWorker->getName() : "")
-       << " recv_timeout=" << m_recvTimeout << "]" << std::endl;
+       << " recv_timeout=" << m_recvTimeout
+       << " reuse_port=" << m_reusePort << "]" << std::endl;
     
     std::string pfx = prefix.empty() ? "    " : prefix;
 
@@ -86,6 +86,19 @@ public:
      */
     virtual void setName(const std::string& v) { m_name = v;}
 
+    /**
+     * @brief 返回是否每个accept线程使用一个SO_REUSEPORT监听socket
+     */
+    bool isReusePort() const { return m_reusePort;}
+
+    /**
+     * @brief 设置是否每个accept线程使用一个SO_REUSEPORT监听socket
+     * @details 开启后bind会为每个地址创建accept_worker线程数个监听socket，start时每个socket的accept协程
+     *          指定在一个线程上运行，由内核把新连接分发到各个线程，配合IOManager的每线程epoll模式使用
+     * @pre 需要在bind之前调用
+     */
+    void setReusePort(bool v) { m_reusePort = v;}
+
     /**
      * @brief 是否停止
      */
@@ -122,6 +135,8 @@ protected:
     std::string m_type;
     /// 服务是否停止
     bool m_isStop;
+    /// 是否每个accept线程使用一个SO_REUSEPORT监听socket
+    bool m_reusePort;
 };
 
 }
@@ -1,139 +1,453 @@
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 #include "timer.h"
 #include "util.h"
 #include "macro.h"
 
 namespace sylar {
-//按超时时间从小到大排序
-bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const 
-{
-    if(!lhs && !rhs) 
+
+/**
+ * @brief 分层时间轮，精度1毫秒
+ * @details 第0层256个槽位，每个槽位1毫秒；第1~4层各64个槽位，每层槽位跨度是下一层整圈的长度，总共覆盖2^32毫秒。
+ *          定时器按到期时间与当前时间的差放入对应的层，低层转完一圈时把高层的一个槽位下沉到低层。
+ *          添加和取消只是链表操作，位图记录非空的槽位，推进和求下一个到期时间时跳过空槽位。
+ *          所有成员由m_mutex保护
+ */
+class TimerWheel {
+public:
+    typedef TimerManager::MutexType MutexType;
+
+    /// 第0层的位数和槽位数
+    static const int ROOT_BITS  = 8;
+    static const int ROOT_SIZE  = 1 << ROOT_BITS;
+    /// 第1层以上每层的位数和槽位数
+    static const int LEVEL_BITS = 6;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    /// 层数
+    static const int LEVELS     = 5;
+    /// 槽位总数，第0层槽位编号为[0, 256)，第n层为[256 + (n - 1) * 64, 256 + n * 64)
+    static const int SLOTS      = ROOT_SIZE + (LEVELS - 1) * LEVEL_SIZE;
+
+    TimerWheel(size_t index)
+        :m_index(index)
     {
-        return false;
+        m_current = sylar::GetElapsedMS();
+        memset(m_slots, 0, sizeof(m_slots));
+        memset(m_bitmap, 0, sizeof(m_bitmap));
     }
-    if(!lhs) 
+
+    ~TimerWheel()
     {
-        return true;
+        // 槽位中的定时器持有自己，要逐个解开，否则不会被释放
+        for(int i = 0; i < SLOTS; ++i)
+        {
+            Timer* timer = takeSlot(i);
+            while(timer)
+            {
+                Timer* next = timer->m_slotNext;
+                detach(timer);
+                timer = next;
+            }
+        }
     }
-    if(!rhs) 
+
+    /**
+     * @brief 放入定时器
+     * @return 是否早于等待中的超时时间，需要唤醒等待的线程
+     */
+    bool add(const Timer::ptr& timer)
     {
-        return false;
+        link(timer);
+        bool at_front = !m_tickled && timer->m_next < m_deadline;
+        if(at_front)
+        {
+            m_tickled = true;
+        }
+        return at_front;
     }
-    if(lhs->m_next < rhs->m_next) 
+
+    /**
+     * @brief 把定时器放入对应的槽位
+     */
+    void link(const Timer::ptr& timer)
     {
-        return true;
+        uint64_t expires = std::max(timer->m_next, m_current);
+        uint64_t delta   = expires - m_current;
+        int slot = 0;
+        if(delta < ROOT_SIZE)
+        {
+            slot = expires & (ROOT_SIZE - 1);
+        }
+        else
+        {
+            // 超出覆盖范围的定时器先放在最高层的最后，下沉时会按真实的到期时间重新放置
+            if(delta >> (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS))
+            {
+                expires = m_current + (1ull << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS)) - 1;
+                delta   = expires - m_current;
+            }
+            int level = 1;
+            while(delta >> (ROOT_BITS + level * LEVEL_BITS))
+            {
+                ++level;
+            }
+            int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+            slot = ROOT_SIZE + (level - 1) * LEVEL_SIZE + ((expires >> shift) & (LEVEL_SIZE - 1));
+        }
+
+        Timer* head       = m_slots[slot];
+        timer->m_slot     = slot;
+        timer->m_slotPrev = nullptr;
+        timer->m_slotNext = head;
+        if(head)
+        {
+            head->m_slotPrev = timer.get();
+        }
+        m_slots[slot] = timer.get();
+        m_bitmap[slot >> 6] |= 1ull << (slot & 63);
+        timer->m_self = timer;
+        ++m_count;
     }
-    if(lhs->m_next > rhs->m_next) 
+
+    /**
+     * @brief 把定时器从槽位中取出
+     * @return 定时器原来持有的自己，不在时间轮中时返回nullptr
+     */
+    Timer::ptr unlink(Timer* timer)
     {
-        return false;
+        if(timer->m_slot < 0)
+        {
+            return nullptr;
+        }
+        if(timer->m_slotPrev)
+        {
+            timer->m_slotPrev->m_slotNext = timer->m_slotNext;
+        }
+        else
+        {
+            m_slots[timer->m_slot] = timer->m_slotNext;
+            if(!timer->m_slotNext)
+            {
+                m_bitmap[timer->m_slot >> 6] &= ~(1ull << (timer->m_slot & 63));
+            }
+        }
+        if(timer->m_slotNext)
+        {
+            timer->m_slotNext->m_slotPrev = timer->m_slotPrev;
+        }
+        return detach(timer);
     }
-    // 时间相同 地址较小的那个排在前面
-    return lhs.get() < rhs.get();
-}
 
+    /**
+     * @brief 推进时间轮到now，收集所有到期的定时器
+     */
+    void advance(uint64_t now, std::vector<Timer::ptr>& expired)
+    {
+        while(m_current <= now)
+        {
+            if(!m_count)
+            {
+                m_current = now + 1;
+                break;
+            }
+            int index = m_current & (ROOT_SIZE - 1);
+            if(!index)
+            {
+                // 第0层转完一圈，逐层下沉，上一层的下标不为0时更高层还没转到边界
+                for(int level = 1; level < LEVELS; ++level)
+                {
+                    int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+                    int i     = (m_current >> shift) & (LEVEL_SIZE - 1);
+                    cascade(ROOT_SIZE + (level - 1) * LEVEL_SIZE + i);
+                    if(i)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            Timer* timer = takeSlot(index);
+            while(timer)
+            {
+                Timer* next     = timer->m_slotNext;
+                Timer::ptr self = detach(timer);
+                if(timer->m_next > m_current)
+                {
+                    link(self);
+                }
+                else
+                {
+                    expired.push_back(std::move(self));
+                }
+                timer = next;
+            }
+
+            // 跳过第0层本圈剩下的空槽位，最多跳到下一圈的边界
+            uint64_t next = (m_current & ~(uint64_t)(ROOT_SIZE - 1)) + findRoot(index + 1);
+            m_current     = std::min(next, now + 1);
+        }
+    }
+
+    /**
+     * @brief 返回下一次需要推进时间轮的时间，没有定时器时返回~0ull
+     * @details 第0层本圈的槽位给出准确的到期时间，其它槽位给出它下沉或到期的时间，不会晚于其中任何定时器的到期时间
+     */
+    uint64_t nextExpire() const
+    {
+        if(!m_count)
+        {
+            return ~0ull;
+        }
+        uint64_t base = m_current & ~(uint64_t)(ROOT_SIZE - 1);
+        int index     = m_current & (ROOT_SIZE - 1);
+        int bit       = findRoot(index);
+        if(bit < ROOT_SIZE)
+        {
+            return base + bit;
+        }
+
+        uint64_t result = ~0ull;
+        bit = findRoot(0);
+        if(bit < index)
+        {
+            result = base + ROOT_SIZE + bit;
+        }
+        for(int level = 1; level < LEVELS; ++level)
+        {
+            uint64_t word = m_bitmap[(ROOT_SIZE >> 6) + level - 1];
+            if(!word)
+            {
+                continue;
+            }
+            // 当前下标的槽位要等到下一圈才下沉，除非低位正好为0，这时它就在m_current下沉
+            int shift      = ROOT_BITS + (level - 1) * LEVEL_BITS;
+            uint64_t group = m_current >> shift;
+            int start      = (m_current & ((1ull << shift) - 1)) ? 1 : 0;
+            int rot        = (group + start) & (LEVEL_SIZE - 1);
+            uint64_t rotated = (word >> rot) | (word << ((LEVEL_SIZE - rot) & (LEVEL_SIZE - 1)));
+            uint64_t when  = (group + start + __builtin_ctzll(rotated)) << shift;
+            result = std::min(result, when);
+        }
+        return result;
+    }
+
+    /// 在第几个时间轮
+    size_t m_index;
+    /// 时间轮的锁
+    MutexType m_mutex;
+    /// 定时器数量，可以不加锁读取
+    std::atomic<size_t> m_count = {0};
+    /// 是否已经为当前等待的超时时间触发过onTimerInsertedAtFront
+    bool m_tickled = false;
+    /// 等待线程最近一次取得的下一个到期时间
+    uint64_t m_deadline = ~0ull;
+private:
+    /**
+     * @brief 取出整个槽位的链表
+     */
+    Timer* takeSlot(int slot)
+    {
+        Timer* head   = m_slots[slot];
+        m_slots[slot] = nullptr;
+        m_bitmap[slot >> 6] &= ~(1ull << (slot & 63));
+        return head;
+    }
+
+    /**
+     * @brief 清除定时器的槽位信息，返回它持有的自己
+     */
+    Timer::ptr detach(Timer* timer)
+    {
+        timer->m_slot     = -1;
+        timer->m_slotPrev = nullptr;
+        timer->m_slotNext = nullptr;
+        --m_count;
+        Timer::ptr self;
+        self.swap(timer->m_self);
+        return self;
+    }
+
+    /**
+     * @brief 把高层的一个槽位中的定时器按到期时间重新放入低层
+     */
+    void cascade(int slot)
+    {
+        Timer* timer = takeSlot(slot);
+        while(timer)
+        {
+            Timer* next = timer->m_slotNext;
+            link(detach(timer));
+            timer = next;
+        }
+    }
+
+    /**
+     * @brief 第0层中下标不小于from的第一个非空槽位，没有时返回ROOT_SIZE
+     */
+    int findRoot(int from) const
+    {
+        for(int i = from >> 6; i < (ROOT_SIZE >> 6); ++i)
+        {
+            uint64_t word = m_bitmap[i];
+            if(i == (from >> 6))
+            {
+                word &= ~0ull << (from & 63);
+            }
+            if(word)
+            {
+                return (i << 6) + __builtin_ctzll(word);
+            }
+        }
+        return ROOT_SIZE;
+    }
+
+private:
+    /// 下一个要处理的第0层时刻，早于它的定时器都已处理
+    uint64_t m_current = 0;
+    /// 每个槽位的链表头
+    Timer* m_slots[SLOTS];
+    /// 非空槽位的位图
+    uint64_t m_bitmap[SLOTS >> 6];
+};
 
 Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager)
-            : m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager)     
+            : m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager)
 {
-    //当前时间(毫秒级) + 超时时间
-    m_next = sylar::GetElapsedMS() + m_ms;
+    //当前时间(毫秒级) + 超时时间，使用调度线程缓存的时钟，最多落后一个时钟节拍
+    m_next = sylar::GetCachedElapsedMS() + m_ms;
 }
 
-// 该构造只会传入一个到时的时间，其他属性都没赋值
-Timer::Timer(uint64_t next) :m_next(next)  {}
-
 //取消定时器且不会执行定时器上的回调函数
-bool Timer::cancel() 
+bool Timer::cancel()
 {
-    TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(m_cb) 
+    TimerManager::MutexType::Lock lock(m_wheel->m_mutex);
+    if(m_cb)
     {
         //回调赋空
         m_cb = nullptr;
-        //在set集合中找这个定时器
-        auto it = m_manager->m_timers.find(shared_from_this());
-        //找到删除
-        m_manager->m_timers.erase(it);
+        //从时间轮的槽位中摘掉，O(1)
+        m_wheel->unlink(this);
         return true;
     }
     return false;
 }
 
-//刷新定时器 就是将当前时间+间隔时间m_ms，再加入定时器集合
-bool Timer::refresh() 
+//刷新定时器 就是将当前时间+间隔时间m_ms，再放回时间轮
+bool Timer::refresh()
 {
-    TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(!m_cb) 
+    TimerManager::MutexType::Lock lock(m_wheel->m_mutex);
+    if(!m_cb)
     {
         return false;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    //该定时器不在集合里 返回false
-    if(it == m_manager->m_timers.end()) 
+    Timer::ptr self = m_wheel->unlink(this);
+    //该定时器不在时间轮里 返回false
+    if(!self)
     {
         return false;
     }
     //先删除在插入
-    m_manager->m_timers.erase(it);
-    m_next = sylar::GetElapsedMS() + m_ms;
-    m_manager->m_timers.insert(shared_from_this());
+    m_next = sylar::GetCachedElapsedMS() + m_ms;
+    m_wheel->link(self);
     return true;
 }
 
 //重置定时器
-bool Timer::reset(uint64_t ms, bool from_now) 
+bool Timer::reset(uint64_t ms, bool from_now)
 {
-    if(ms == m_ms && !from_now) 
+    if(ms == m_ms && !from_now)
     {
         return true;
     }
-    TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(!m_cb) 
+    TimerManager::MutexType::Lock lock(m_wheel->m_mutex);
+    if(!m_cb)
     {
         return false;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    //不在集定时器合里 返回false
-    if(it == m_manager->m_timers.end()) 
+    Timer::ptr self = m_wheel->unlink(this);
+    //不在时间轮里 返回false
+    if(!self)
     {
         return false;
     }
-    //在集合里 先删，
-    m_manager->m_timers.erase(it);
     uint64_t start = 0;
     if(from_now) //如果是从当前开始算
     {
-        start = sylar::GetElapsedMS();
-    } 
+        start = sylar::GetCachedElapsedMS();
+    }
     else //从原来的开始时间
     {
         start = m_next - m_ms;
     }
     m_ms = ms;
     m_next = start + m_ms;
+    m_manager->addTimer(self, lock);
+    return true;
+
+}
+
+//重新启动定时器 不在时间轮中时才能重新启动
+bool Timer::restart(uint64_t ms, std::function<void()> cb)
+{
+    TimerManager::MutexType::Lock lock(m_wheel->m_mutex);
+    if(m_slot >= 0)
+    {
+        return false;
+    }
+    m_recurring = false;
+    m_cb.swap(cb);
+    m_ms   = ms;
+    m_next = sylar::GetCachedElapsedMS() + m_ms;
     m_manager->addTimer(shared_from_this(), lock);
     return true;
+}
 
+TimerManager::TimerManager()
+{
+    m_wheels.push_back(new TimerWheel(0));
 }
 
-//TimerManager的构造就是获取当前时间保存在m_previouseTime
-TimerManager::TimerManager() 
+TimerManager::~TimerManager()
 {
-    m_previouseTime = sylar::GetElapsedMS();
+    for(auto i : m_wheels)
+    {
+        delete i;
+    }
 }
 
-TimerManager::~TimerManager() {}
+void TimerManager::setTimerWheelCount(size_t count)
+{
+    SYLAR_ASSERT(count > 0);
+    SYLAR_ASSERT(!hasTimer());
+    while(m_wheels.size() > count)
+    {
+        delete m_wheels.back();
+        m_wheels.pop_back();
+    }
+    while(m_wheels.size() < count)
+    {
+        m_wheels.push_back(new TimerWheel(m_wheels.size()));
+    }
+}
 
-Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring) 
-{                         
+Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring)
+{
     Timer::ptr timer(new Timer(ms, cb, recurring, this));
-    RWMutexType::WriteLock lock(m_mutex);
-    //外部的add是增加一个定时器，此处的add是将定时器添加到manager
+    size_t index = selectTimerWheel();
+    if(index >= m_wheels.size())
+    {
+        index = 0;
+    }
+    timer->m_wheel = m_wheels[index];
+    MutexType::Lock lock(timer->m_wheel->m_mutex);
+    //外部的add是增加一个定时器，此处的add是将定时器添加到时间轮
     addTimer(timer, lock);
     return timer;
 }
 
 //辅助函数 查看传进来的条件是否还有效
-static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) 
+static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb)
 {
     //访问weak_ptr指向的内存std::shared_ptr sptr = wptr.lock();
     std::shared_ptr<void> tmp = weak_cond.lock();
@@ -144,138 +458,118 @@ static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb)
 }
 
 // 条件定时器的回调先检查条件是否有效，再执行传进来的cb
-Timer::ptr TimerManager::addConditionTimer(uint64_t ms, 
+Timer::ptr TimerManager::addConditionTimer(uint64_t ms,
                                            std::function<void()> cb,
                                            std::weak_ptr<void> weak_cond,
-                                           bool recurring ) 
+                                           bool recurring )
 {
     //给定时器ms添加一个执行函数OnTimer，OnTimer自己绑定weak_cond和cb两个参数
     return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
 }
 
-// 返回定时器集合中第一个定时器到时的时间间隔
-uint64_t TimerManager::getNextTimer() 
+// 返回所有时间轮中最近一个定时器到时的时间间隔
+uint64_t TimerManager::getNextTimer()
 {
-    RWMutexType::ReadLock lock(m_mutex);
-    m_tickled = false;
-    if(m_timers.empty()) 
+    uint64_t next = ~0ull;
+    for(size_t i = 0; i < m_wheels.size(); ++i)
     {
-        //没有定时任务 返回最大值（0取反就是最大）
-        return ~0ull;
-    }
-    //取集合中的第一个元素（即最快要超时的定时器）
-    const Timer::ptr& next = *m_timers.begin();
-    //获取当前的时间
-    uint64_t now_ms = sylar::GetElapsedMS();
-    //如果当前时间大于等于next定时器的时间说明由于一些原因没有在定时器到时时执行对应的cb以及删除对用的定时器
-    if(now_ms >= next->m_next) 
-    {
-        return 0;
-    } 
-    else  //否则定时器next还未超时，计算等待的时间
-    {
-        return next->m_next - now_ms;
+        next = std::min(next, getNextTimer(i));
     }
+    return next;
 }
 
-void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) 
+uint64_t TimerManager::getNextTimer(size_t wheel)
 {
-    //拿到当前时间
-    uint64_t now_ms = sylar::GetElapsedMS();
-    //已超时的定时器数组
-    std::vector<Timer::ptr> expired;
-    { //这点加大括号的原因就是制造出一个作用域，除了这个作用域锁自动释放
-        RWMutexType::ReadLock lock(m_mutex);
-        if(m_timers.empty()) 
-        {
-            return;
-        }
-    }
-    RWMutexType::WriteLock lock(m_mutex);
-    if(m_timers.empty()) 
+    TimerWheel* w = m_wheels[wheel];
+    uint64_t next = 0;
     {
-        return;
+        MutexType::Lock lock(w->m_mutex);
+        w->m_tickled  = false;
+        next          = w->nextExpire();
+        w->m_deadline = next;
     }
-    bool rollover = false;
-    if(SYLAR_UNLIKELY(detectClockRollover(now_ms))) 
+    if(next == ~0ull)
     {
-        // 使用clock_gettime(CLOCK_MONOTONIC_RAW)，应该不可能出现时间回退的问题
-        rollover = true;
+        //没有定时任务 返回最大值（0取反就是最大）
+        return ~0ull;
     }
-    //系统时间未被修改且第一个都没超时 自然后面都没超时 返回空列表
-    if(!rollover && ((*m_timers.begin())->m_next > now_ms)) 
+    //获取当前的时间
+    uint64_t now_ms = sylar::GetCachedElapsedMS();
+    //如果当前时间大于等于下一个到期时间说明由于一些原因没有在定时器到时时执行对应的cb以及删除对应的定时器
+    return now_ms >= next ? 0 : next - now_ms;
+}
+
+void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs)
+{
+    for(size_t i = 0; i < m_wheels.size(); ++i)
     {
-        return;
+        listExpiredCb(i, cbs);
     }
+}
 
-    //根据当前时间创建一个定时器，入口函数为nullptr 主要是用来比较用的 不会插入到集合中
-    Timer::ptr now_timer(new Timer(now_ms));
-    auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer); //返回大于或等于now_timer的第一个元素位置（迭代器）
-    while(it != m_timers.end() && (*it)->m_next == now_ms) 
+void TimerManager::listExpiredCb(size_t wheel, std::vector<std::function<void()>>& cbs)
+{
+    TimerWheel* w = m_wheels[wheel];
+    if(!w->m_count)
     {
-        ++it;
+        return;
     }
-    //将所有过期的定时器都放到vector里
-    expired.insert(expired.begin(), m_timers.begin(), it);
-    //集合中删除这些定时器
-    m_timers.erase(m_timers.begin(), it);
+    //已超时的定时器数组
+    std::vector<Timer::ptr> expired;
+    MutexType::Lock lock(w->m_mutex);
+    //拿到当前时间，使用clock_gettime(CLOCK_MONOTONIC)，不会出现时间回退的问题
+    uint64_t now_ms = sylar::GetCachedElapsedMS();
+    w->advance(now_ms, expired);
 
     //扩展cbs数组的大小，将超时的定时器的回调函数对象放进数组
-    //同时判断这个定时器是否会循环，如果是则需要重新设置他的精确执行时间 然后再添加到定时器管理器
-    cbs.reserve(expired.size());
-    for(auto& timer : expired) 
+    //同时判断这个定时器是否会循环，如果是则需要重新设置他的精确执行时间 然后再放回时间轮
+    cbs.reserve(cbs.size() + expired.size());
+    for(auto& timer : expired)
     {
-        cbs.push_back(timer->m_cb);
-        //如果是循环定时器，再把它放回去
-        if(timer->m_recurring) 
+        if(timer->m_recurring)
         {
+            cbs.push_back(timer->m_cb);
             timer->m_next = now_ms + timer->m_ms;
-            m_timers.insert(timer);
-        } 
-        else 
+            w->link(timer);
+        }
+        else
         {
+            cbs.push_back(std::move(timer->m_cb));
             timer->m_cb = nullptr;
         }
     }
 }
 
-void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) 
+void TimerManager::addTimer(Timer::ptr val, MutexType::Lock& lock)
 {
-    //两步操作 插入并获取插入的位置
-    //set 的insert操作成功的话返回一个pair类型的值，first->插入位置，second->是否插入成功
-    auto it = m_timers.insert(val).first;
-    bool at_front = (it == m_timers.begin()) && !m_tickled; // m_tickled 在 getNextTimer()刷新 
-    if(at_front) 
-    {
-        m_tickled = true;
-    }
+    TimerWheel* wheel = val->m_wheel;
+    // 比等待线程正在等的超时时间更早，需要唤醒它重新计算超时，m_tickled 在 getNextTimer()刷新
+    bool at_front = wheel->add(val);
     lock.unlock();
 
-    //如果插在第一个位置
-    if(at_front) 
+    if(at_front)
     {
-        // 纯虚函数 在iomanager中实现，就是调了一下tickle函数
-        onTimerInsertedAtFront();
+        // 纯虚函数 在iomanager中实现，就是唤醒等待这个时间轮的线程
+        onTimerInsertedAtFront(wheel->m_index);
     }
 }
 
-bool TimerManager::detectClockRollover(uint64_t now_ms) 
+//有返回真
+bool TimerManager::hasTimer()
 {
-    bool rollover = false;
-    if(now_ms < m_previouseTime && now_ms < (m_previouseTime - 60 * 60 * 1000)) 
+    for(auto i : m_wheels)
     {
-            
-        rollover = true;
+        if(i->m_count)
+        {
+            return true;
+        }
     }
-    m_previouseTime = now_ms;
-    return rollover;
+    return false;
 }
 
-//有返回真
-bool TimerManager::hasTimer() 
+bool TimerManager::hasTimer(size_t wheel)
 {
-    RWMutexType::ReadLock lock(m_mutex);
-    return !m_timers.empty();
+    return m_wheels[wheel]->m_count;
 }
 
 }
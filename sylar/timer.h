@@ -11,17 +11,18 @@
 
 #include <memory>
 #include <vector>
-#include <set>
 #include "mutex.h"
 
 namespace sylar {
 
 class TimerManager;
+class TimerWheel;
 /**
  * @brief 定时器
  */
 class Timer : public std::enable_shared_from_this<Timer> {
 friend class TimerManager;  //友元类TimerManager内的方法可以访问Timer中的私有成员
+friend class TimerWheel;
 public:
     /// 定时器的智能指针类型
     typedef std::shared_ptr<Timer> ptr;
@@ -42,6 +43,16 @@ public:
      * @param[in] from_now 是否从当前时间开始计算
      */
     bool reset(uint64_t ms, bool from_now);
+
+    /**
+     * @brief 重新启动已经到期或已取消的定时器
+     * @details 定时器对象和所在的时间轮不变，只替换回调函数和执行时间，
+     *          回调函数足够小时(不超过两个指针且可平凡复制)整个过程不分配内存
+     * @param[in] ms 定时器执行间隔时间(毫秒)
+     * @param[in] cb 回调函数
+     * @return 定时器还在时间轮中时返回false
+     */
+    bool restart(uint64_t ms, std::function<void()> cb);
 private:
     /**
      * @brief 构造函数
@@ -52,11 +63,6 @@ private:
      */
     Timer(uint64_t ms, std::function<void()> cb,
           bool recurring, TimerManager* manager);
-    /**
-     * @brief 构造函数
-     * @param[in] next 执行的时间戳(毫秒)
-     */
-    Timer(uint64_t next);
 private:
     /// 是否循环定时器
     bool m_recurring = false;
@@ -68,29 +74,28 @@ private:
     std::function<void()> m_cb;
     /// 定时器管理者
     TimerManager* m_manager = nullptr;
-private:
-    /**
-     * @brief 定时器比较仿函数
-     */
-    struct Comparator 
-    {
-        /**
-         * @brief 比较定时器的智能指针的大小(按执行时间排序)
-         * @param[in] lhs 定时器智能指针
-         * @param[in] rhs 定时器智能指针
-         */
-        bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
-    };
+    /// 所在的时间轮
+    TimerWheel* m_wheel = nullptr;
+    /// 所在时间轮槽位的编号，-1表示不在时间轮中
+    int m_slot = -1;
+    /// 槽位链表中的前一个和后一个定时器
+    Timer* m_slotPrev = nullptr;
+    Timer* m_slotNext = nullptr;
+    /// 在时间轮中时持有自己，槽位链表只保存裸指针
+    Timer::ptr m_self;
 };
 
 /**
  * @brief 定时器管理器
+ * @details 定时器放在分层时间轮中，添加、取消和刷新都是O(1)。
+ *          可以有多个时间轮，每个时间轮有自己的锁，由selectTimerWheel决定新定时器放入哪个时间轮
  */
 class TimerManager {
 friend class Timer;
+friend class TimerWheel;
 public:
-    /// 读写锁类型
-    typedef RWMutex RWMutexType;
+    /// 时间轮的锁类型
+    typedef Mutex MutexType;
 
     /**
      * @brief 构造函数
@@ -123,12 +128,13 @@ public:
                         ,bool recurring = false);
 
     /**
-     * @brief 到最近一个定时器执行的时间间隔，就是集合中第一个定时器
+     * @brief 到最近一个定时器执行的时间间隔，所有时间轮中最早的一个
+     * @details 时间轮高层的定时器只能算出下一次下沉的时间，返回值可能早于实际到期时间，提前醒来不会执行未到期的定时器
      */
     uint64_t getNextTimer();
 
     /**
-     * @brief 获取需要执行的定时器的回调函数列表
+     * @brief 获取所有时间轮中需要执行的定时器的回调函数列表
      * @param[out] cbs 回调函数数组
      */
     void listExpiredCb(std::vector<std::function<void()> >& cbs);
@@ -140,28 +146,51 @@ public:
 protected:
 
     /**
-     * @brief 当有新的定时器插入到定时器的首部,执行该函数
+     * @brief 当有比等待中的超时时间更早的定时器插入时，执行该函数
+     * @param[in] wheel 定时器所在的时间轮下标
      */
-    virtual void onTimerInsertedAtFront() = 0;
+    virtual void onTimerInsertedAtFront(size_t wheel) = 0;
 
     /**
-     * @brief 将定时器添加到管理器中
+     * @brief 返回新定时器放入的时间轮下标，超出范围时放入0号时间轮
      */
-    void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
-private:
+    virtual size_t selectTimerWheel() { return 0; }
+
+    /**
+     * @brief 设置时间轮的个数，只能在添加定时器之前调用
+     */
+    void setTimerWheelCount(size_t count);
+
+    /**
+     * @brief 返回时间轮的个数
+     */
+    size_t getTimerWheelCount() const { return m_wheels.size(); }
+
+    /**
+     * @brief 指定时间轮中最近一个定时器执行的时间间隔
+     */
+    uint64_t getNextTimer(size_t wheel);
+
+    /**
+     * @brief 指定时间轮中是否有定时器
+     */
+    bool hasTimer(size_t wheel);
+
+    /**
+     * @brief 获取指定时间轮中需要执行的定时器的回调函数列表
+     * @param[in] wheel 时间轮下标
+     * @param[out] cbs 回调函数数组，追加在末尾
+     */
+    void listExpiredCb(size_t wheel, std::vector<std::function<void()> >& cbs);
+
     /**
-     * @brief 检测服务器时间是否被调后了
+     * @brief 将定时器添加到它所在的时间轮中
+     * @param[in] lock 已锁住的时间轮的锁，函数内解锁
      */
-    bool detectClockRollover(uint64_t now_ms);
+    void addTimer(Timer::ptr val, MutexType::Lock& lock);
 private:
-    /// Mutex
-    RWMutexType m_mutex;
-    /// 定时器集合
-    std::set<Timer::ptr, Timer::Comparator> m_timers;
-    /// 是否触发onTimerInsertedAtFront
-    bool m_tickled = false;
-    /// 上次执行时间
-    uint64_t m_previouseTime = 0;
+    /// 时间轮
+    std::vector<TimerWheel*> m_wheels;
 };
 
 }
@@ -23,10 +23,32 @@ namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+/// 缓存的线程id，0表示尚未获取
+static thread_local pid_t t_thread_id = 0;
+
+// fork之后子进程中调用fork的线程id变了，清掉缓存
+static void ResetThreadIdAfterFork() 
+{
+    t_thread_id = 0;
+}
+
+struct _ThreadIdIniter 
+{
+    _ThreadIdIniter() 
+    {
+        pthread_atfork(nullptr, nullptr, &ResetThreadIdAfterFork);
+    }
+};
+static _ThreadIdIniter s_thread_id_initer;
+
 // 返回的是全局唯一的线程id
 pid_t GetThreadId() 
 {
-    return syscall(SYS_gettid);
+    if(t_thread_id == 0) 
+    {
+        t_thread_id = syscall(SYS_gettid);
+    }
+    return t_thread_id;
 }
 
 uint64_t GetFiberId() 
@@ -40,21 +62,35 @@ uint64_t GetElapsedMS()
     // struct timespec的两个属性值：秒，纳秒
     struct timespec ts = {0}; 
     // CLOCK_MONOTONIC:从系统启动这一刻起开始计时,不受系统时间被用户改变的影响。
-    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    // 和缓存的时钟使用同一个时钟，CLOCK_MONOTONIC_RAW没有对应的粗粒度时钟
+    clock_gettime(CLOCK_MONOTONIC, &ts);
     // 返回的是毫秒
     return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 // 返回线程名称
-std::string GetThreadName() 
+/// 缓存的线程名称
+static thread_local std::string t_thread_name;
+/// 线程名称是否已缓存
+static thread_local bool t_thread_name_cached = false;
+
+const std::string &GetThreadName() 
 {
-    char thread_name[16] = {0};
-    pthread_getname_np(pthread_self(), thread_name, 16);
-    return std::string(thread_name);
+    if(!t_thread_name_cached) 
+    {
+        // glibc的pthread_getname_np要读/proc下的文件，只在第一次调用时读
+        char thread_name[16] = {0};
+        pthread_getname_np(pthread_self(), thread_name, 16);
+        t_thread_name        = thread_name;
+        t_thread_name_cached = true;
+    }
+    return t_thread_name;
 }
 
 void SetThreadName(const std::string &name) 
 {
     pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+    t_thread_name        = name.substr(0, 15);
+    t_thread_name_cached = true;
 }
 
 static std::string demangle(const char *str) 
@@ -125,6 +161,108 @@ uint64_t GetCurrentUS()
     return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
 }
 
+/// 刷新缓存时钟时是否使用粗粒度时钟
+static bool s_coarse_clock = false;
+/// 当前线程是否刷新过缓存的时钟
+static thread_local bool t_clock_cached = false;
+/// 当前线程缓存的启动毫秒数
+static thread_local uint64_t t_cached_elapsed_ms = 0;
+/// 当前线程缓存的当前时间毫秒数
+static thread_local uint64_t t_cached_current_ms = 0;
+/// 刷新缓存时粗粒度单调时钟的读数，纳秒
+static thread_local uint64_t t_cached_coarse_ns = 0;
+
+/**
+ * @brief 读取粗粒度单调时钟，纳秒
+ * @details 只读取内核每个时钟节拍更新一次的值，不访问硬件计时器
+ */
+static inline uint64_t GetCoarseNS() 
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+/**
+ * @brief 刷新缓存的时钟，coarse_ns为刚读到的粗粒度单调时钟
+ */
+static void UpdateCachedClock(uint64_t coarse_ns) 
+{
+    struct timespec ts = {0};
+    if (s_coarse_clock) 
+    {
+        t_cached_elapsed_ms = coarse_ns / 1000000;
+    } 
+    else 
+    {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        t_cached_elapsed_ms = ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+    }
+    clock_gettime(s_coarse_clock ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME, &ts);
+    t_cached_current_ms = ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+    t_cached_coarse_ns  = coarse_ns;
+    t_clock_cached      = true;
+}
+
+void UpdateCachedClock() 
+{
+    UpdateCachedClock(GetCoarseNS());
+}
+
+/**
+ * @brief 检查缓存的时钟是否过期
+ * @details 一个任务运行很久时缓存会落后，粗粒度时钟走过一个节拍之后重新读取，
+ *          缓存最多落后一个时钟节拍，精确时钟每个节拍最多读一次
+ */
+static inline void CheckCachedClock() 
+{
+    uint64_t coarse_ns = GetCoarseNS();
+    if (coarse_ns != t_cached_coarse_ns) 
+    {
+        UpdateCachedClock(coarse_ns);
+    }
+}
+
+void ClearCachedClock() 
+{
+    t_clock_cached = false;
+}
+
+void SetCoarseClock(bool v) 
+{
+    s_coarse_clock = v;
+}
+
+uint64_t GetCachedElapsedMS() 
+{
+    if (!t_clock_cached) 
+    {
+        return GetElapsedMS();
+    }
+    CheckCachedClock();
+    return t_cached_elapsed_ms;
+}
+
+uint64_t GetCachedCurrentMS() 
+{
+    if (!t_clock_cached) 
+    {
+        return GetCurrentMS();
+    }
+    CheckCachedClock();
+    return t_cached_current_ms;
+}
+
+time_t GetCachedTime() 
+{
+    if (!t_clock_cached) 
+    {
+        return time(0);
+    }
+    CheckCachedClock();
+    return t_cached_current_ms / 1000;
+}
+
 std::string ToUpper(const std::string &name) 
 {
     std::string rt = name;
@@ -19,7 +19,7 @@
 namespace sylar {
 
 /**
- * @brief 获取线程id，全局唯一id，通过系统调用syscall(SYS_gettid)来获取
+ * @brief 获取线程id，全局唯一id，通过系统调用syscall(SYS_gettid)来获取，第一次获取后缓存在线程本地，fork之后重新获取
  * @note 这里不要把pid_t和pthread_t混淆，关于它们之的区别可参考gettid(2)
  */
 pid_t GetThreadId();
@@ -31,14 +31,15 @@ pid_t GetThreadId();
 uint64_t GetFiberId();
 
 /**
- * @brief 获取当前启动的毫秒数，参考clock_gettime(2)，使用CLOCK_MONOTONIC_RAW
+ * @brief 获取当前启动的毫秒数，参考clock_gettime(2)，使用CLOCK_MONOTONIC
  */
 uint64_t GetElapsedMS();
 
 /**
  * @brief 获取线程名称，参考pthread_getname_np(3)
+ * @details 第一次调用时读取并缓存在线程本地，SetThreadName会同步更新缓存，返回的引用在线程退出前有效
  */
-std::string GetThreadName();
+const std::string &GetThreadName();
 
 /**
  * @brief 设置线程名称，参考pthread_setname_np(3)
@@ -72,6 +73,41 @@ uint64_t GetCurrentMS();
  */
 uint64_t GetCurrentUS();
 
+/**
+ * @brief 刷新当前线程缓存的时钟
+ * @details IOManager的调度线程在每轮epoll_wait前后刷新，之后本线程的GetCachedXXX返回缓存值，
+ *          任务运行超过一个时钟节拍时由GetCachedXXX自己重新读取，缓存最多落后一个节拍；
+ *          没有刷新过的线程每次都重新读取时钟
+ */
+void UpdateCachedClock();
+
+/**
+ * @brief 清除当前线程缓存的时钟，之后本线程的GetCachedXXX重新每次读取时钟
+ * @details 调度线程退出Scheduler::run时调用，use_caller的线程在调度器停止后还会继续运行
+ */
+void ClearCachedClock();
+
+/**
+ * @brief 设置刷新缓存时钟时是否使用CLOCK_MONOTONIC_COARSE/CLOCK_REALTIME_COARSE
+ * @details 粗粒度时钟的精度是一个时钟节拍（通常1~4毫秒），读取时不用访问硬件计时器
+ */
+void SetCoarseClock(bool v);
+
+/**
+ * @brief 获取缓存的启动毫秒数，与GetElapsedMS同一个时钟
+ */
+uint64_t GetCachedElapsedMS();
+
+/**
+ * @brief 获取缓存的当前时间的毫秒
+ */
+uint64_t GetCachedCurrentMS();
+
+/**
+ * @brief 获取缓存的当前时间的秒，代替time(0)
+ */
+time_t GetCachedTime();
+
 /**
  * @brief 字符串转大写
  */
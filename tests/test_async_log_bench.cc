@@ -0,0 +1,131 @@
+/**
+ * @file test_async_log_bench.cc
+ * @brief 异步日志性能测试
+ * @details 多个线程同时向同一个文件写日志，分别测试同步FileLogAppender和异步FileLogAppender每条日志的耗时，
+ *          并检查文件中的行数与写入、丢弃的条数一致；最后在写日志的同时停止刷盘线程，检查一条都不丢
+ */
+
+#include "sylar/sylar.h"
+#include <stdlib.h>
+#include <fstream>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 每个线程写的日志条数
+static int s_lines = 200000;
+
+static size_t count_lines(const std::string &file)
+{
+    std::ifstream ifs(file);
+    std::string line;
+    size_t n = 0;
+    while (std::getline(ifs, line))
+    {
+        ++n;
+    }
+    return n;
+}
+
+static void bench(int threads, bool async, const std::string &overflow)
+{
+    std::string file = std::string("/tmp/test_async_log_") + (async ? "async_" + overflow : "sync")
+                     + "_" + std::to_string(threads) + ".log";
+    unlink(file.c_str());
+    sylar::Config::Lookup<std::string>("log.async.overflow")->fromString(overflow);
+
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME(file);
+    logger->clearAppenders();
+    logger->addAppender(sylar::LogAppender::ptr(new sylar::FileLogAppender(file, async)));
+
+    sylar::AsyncLogWriter *writer = sylar::AsyncLogWriter::GetInstance();
+    uint64_t dropped = writer->getDroppedCount();
+    uint64_t flushed = writer->getFlushedCount();
+    uint64_t writevs = writer->getWritevCount();
+
+    uint64_t begin = sylar::GetCurrentUS();
+    std::vector<sylar::Thread::ptr> thrs;
+    for (int i = 0; i < threads; ++i)
+    {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger]() {
+            for (int j = 0; j < s_lines; ++j)
+            {
+                SYLAR_LOG_INFO(logger) << "async log bench line " << j;
+            }
+            sylar::AsyncLogWriter::GetInstance()->flush();
+        }, "log_" + std::to_string(i))));
+    }
+    for (auto &i : thrs)
+    {
+        i->join();
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    logger->clearAppenders();
+
+    uint64_t total = (uint64_t)threads * s_lines;
+    dropped = writer->getDroppedCount() - dropped;
+    size_t lines = count_lines(file);
+    SYLAR_LOG_INFO(g_logger) << (async ? "async" : "sync ") << " overflow=" << overflow
+                             << " threads=" << threads << " lines=" << total
+                             << " ns/line=" << used * 1000 / total
+                             << " flushed=" << writer->getFlushedCount() - flushed
+                             << " dropped=" << dropped
+                             << " writev=" << writer->getWritevCount() - writevs;
+    SYLAR_ASSERT(lines + dropped == total);
+    unlink(file.c_str());
+}
+
+/**
+ * @brief 多个线程写异步日志的过程中停止刷盘线程，停止前后的日志都要写入文件
+ */
+static void check_stop(int threads)
+{
+    std::string file = "/tmp/test_async_log_stop.log";
+    unlink(file.c_str());
+    sylar::Config::Lookup<std::string>("log.async.overflow")->fromString("block");
+
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME(file);
+    logger->clearAppenders();
+    logger->addAppender(sylar::LogAppender::ptr(new sylar::FileLogAppender(file, true)));
+
+    std::vector<sylar::Thread::ptr> thrs;
+    for (int i = 0; i < threads; ++i)
+    {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger]() {
+            for (int j = 0; j < s_lines; ++j)
+            {
+                SYLAR_LOG_INFO(logger) << "async log stop line " << j;
+            }
+        }, "log_" + std::to_string(i))));
+    }
+    usleep(1000);
+    sylar::AsyncLogWriter::GetInstance()->stop();
+    for (auto &i : thrs)
+    {
+        i->join();
+    }
+    logger->clearAppenders();
+
+    size_t lines = count_lines(file);
+    SYLAR_LOG_INFO(g_logger) << "stop while logging threads=" << threads << " lines=" << lines;
+    SYLAR_ASSERT(lines == (size_t)threads * s_lines);
+    unlink(file.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    if (argc > 1)
+    {
+        s_lines = atoi(argv[1]);
+    }
+
+    for (int threads = 1; threads <= 4; threads *= 2)
+    {
+        bench(threads, false, "block");
+        bench(threads, true, "block");
+        bench(threads, true, "drop");
+    }
+    // 停止之后不能再启动，放在最后
+    check_stop(4);
+    return 0;
+}
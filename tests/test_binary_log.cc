@@ -0,0 +1,102 @@
+/**
+ * @file test_binary_log.cc
+ * @brief 二进制日志测试
+ * @details 多个线程通过BinaryLogAppender写日志，再用BinaryLogReader读回来逐条校验，
+ *          最后对比文本FileLogAppender和BinaryLogAppender每条日志的耗时
+ */
+
+#include "sylar/sylar.h"
+#include <stdlib.h>
+#include <sys/stat.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 每个线程写的日志条数
+static int s_lines = 100000;
+/// 线程数
+static const int THREADS = 2;
+
+static uint64_t write_logs(sylar::LogAppender::ptr appender, const std::string &name)
+{
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME(name);
+    logger->setLevel(sylar::LogLevel::DEBUG);
+    logger->clearAppenders();
+    logger->addAppender(appender);
+
+    uint64_t begin = sylar::GetCurrentUS();
+    std::vector<sylar::Thread::ptr> thrs;
+    for (int i = 0; i < THREADS; ++i)
+    {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger]() {
+            for (int j = 0; j < s_lines; ++j)
+            {
+                if (j % 1000 == 999)
+                {
+                    SYLAR_LOG_WARN(logger) << "seq=" << j << " warn";
+                }
+                else
+                {
+                    SYLAR_LOG_DEBUG(logger) << "seq=" << j << " value=" << j * 3;
+                }
+            }
+        }, "binlog_" + std::to_string(i))));
+    }
+    for (auto &i : thrs)
+    {
+        i->join();
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    logger->clearAppenders();
+    return used;
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    if (argc > 1)
+    {
+        s_lines = atoi(argv[1]);
+    }
+    uint64_t total = (uint64_t)THREADS * s_lines;
+
+    std::string text_file = "/tmp/test_binary_log.txt";
+    std::string bin_file  = "/tmp/test_binary_log.bin";
+    unlink(text_file.c_str());
+    unlink(bin_file.c_str());
+
+    uint64_t text_used = write_logs(sylar::LogAppender::ptr(new sylar::FileLogAppender(text_file)), "binlog_text");
+    uint64_t bin_used  = write_logs(sylar::LogAppender::ptr(new sylar::BinaryLogAppender(bin_file)), "binlog_bin");
+
+    // 读回校验：条数、每个线程的序号连续、级别和消息内容一致
+    sylar::BinaryLogReader reader(bin_file);
+    SYLAR_ASSERT(reader.isOpen());
+    sylar::BinaryLogRecord rec;
+    std::map<uint32_t, int> next_seq;
+    uint64_t count = 0;
+    while (reader.next(rec))
+    {
+        int &seq = next_seq[rec.threadId];
+        bool warn = seq % 1000 == 999;
+        std::string expect = "seq=" + std::to_string(seq) + (warn ? " warn" : " value=" + std::to_string(seq * 3));
+        SYLAR_ASSERT(rec.message == expect);
+        SYLAR_ASSERT(rec.level == (warn ? sylar::LogLevel::WARN : sylar::LogLevel::DEBUG));
+        SYLAR_ASSERT(rec.loggerName == "binlog_bin");
+        SYLAR_ASSERT(rec.threadName.compare(0, 7, "binlog_") == 0);
+        SYLAR_ASSERT(rec.file == "tests/test_binary_log.cc");
+        ++seq;
+        ++count;
+    }
+    SYLAR_ASSERT(!reader.isError());
+    SYLAR_ASSERT(count == total);
+    SYLAR_ASSERT((int)next_seq.size() == THREADS);
+
+    struct stat text_st, bin_st;
+    stat(text_file.c_str(), &text_st);
+    stat(bin_file.c_str(), &bin_st);
+    SYLAR_LOG_INFO(g_logger) << "records=" << total
+                             << " text ns/record=" << text_used * 1000 / total << " bytes=" << text_st.st_size
+                             << " binary ns/record=" << bin_used * 1000 / total << " bytes=" << bin_st.st_size;
+    unlink(text_file.c_str());
+    unlink(bin_file.c_str());
+    return 0;
+}
@@ -0,0 +1,340 @@
+/**
+ * @file test_bytearray_bench.cc
+ * @brief ByteArray序列化性能测试
+ * @details 每条消息新建一个ByteArray，写入若干字段和一段数据后读出再释放，
+ *          对比关闭和打开内存块缓存池时每条消息的耗时，并检查缓存池的命中统计；
+ *          检查批量Varint编解码和逐个编解码的结果一致，并对比两者的耗时；
+ *          按test_bytearray.cc的定长读写方式，对比经过通用write/read和内联快速路径的耗时
+ */
+
+#include "sylar/sylar.h"
+#include <type_traits>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 消息条数
+static int s_messages = 200000;
+
+static sylar::ConfigVar<uint64_t>::ptr g_pool_max_bytes =
+    sylar::Config::Lookup<uint64_t>("bytearray.pool.max_bytes", 0, "");
+
+static volatile uint64_t s_sink = 0;
+
+/**
+ * @brief 序列化并反序列化一条消息，数据跨越多个内存块
+ */
+static void one_message(int i, const std::string &payload)
+{
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(512));
+    ba->writeFuint32(i);
+    ba->writeUint64(i * 7919ull);
+    ba->writeStringVint("message");
+    ba->writeStringF32(payload);
+    ba->setPosition(0);
+    s_sink += ba->readFuint32();
+    s_sink += ba->readUint64();
+    s_sink += ba->readStringVint().size();
+    s_sink += ba->readStringF32().size();
+}
+
+static void bench(const char *name, int threads)
+{
+    std::string payload(4 * 1024, 'p');
+    sylar::ByteArray::PoolStats before = sylar::ByteArray::GetPoolStats();
+    uint64_t begin = sylar::GetCurrentUS();
+    std::vector<sylar::Thread::ptr> thrs;
+    for (int t = 0; t < threads; ++t)
+    {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([&payload]() {
+            for (int i = 0; i < s_messages; ++i)
+            {
+                one_message(i, payload);
+            }
+        }, "bench_" + std::to_string(t))));
+    }
+    for (auto &i : thrs)
+    {
+        i->join();
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    sylar::ByteArray::PoolStats after = sylar::ByteArray::GetPoolStats();
+    SYLAR_LOG_INFO(g_logger) << name << " threads=" << threads
+                             << " ns/message=" << (double)used * 1000 / s_messages / threads
+                             << " hits=" << after.hits - before.hits
+                             << " misses=" << after.misses - before.misses
+                             << " drops=" << after.drops - before.drops;
+}
+
+static void test_pool()
+{
+    g_pool_max_bytes->setValue(16 * 1024);
+    sylar::ByteArray::PoolStats before = sylar::ByteArray::GetPoolStats();
+    {
+        // 8个4K内存块，缓存池只能留下4个
+        sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+        std::string data(8 * 4096, 'x');
+        ba->write(data.c_str(), data.size());
+    }
+    sylar::ByteArray::PoolStats after = sylar::ByteArray::GetPoolStats();
+    SYLAR_ASSERT(after.misses - before.misses == 8);
+    SYLAR_ASSERT(after.drops - before.drops == 4);
+
+    {
+        // 再次申请时先用缓存的4块
+        sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+        std::string data(8 * 4096, 'y');
+        ba->write(data.c_str(), data.size());
+        ba->setPosition(0);
+        SYLAR_ASSERT(ba->toString() == data);
+        before = after;
+        after = sylar::ByteArray::GetPoolStats();
+        SYLAR_ASSERT(after.hits - before.hits == 4);
+        SYLAR_ASSERT(after.misses - before.misses == 4);
+
+        // clear后内存块回到缓存池
+        ba->clear();
+        ba->write(data.c_str(), data.size());
+        before = after;
+        after = sylar::ByteArray::GetPoolStats();
+        SYLAR_ASSERT(after.hits - before.hits == 4);
+    }
+    SYLAR_LOG_INFO(g_logger) << "pool ok cached_bytes=" << sylar::ByteArray::GetPoolStats().cached_bytes;
+}
+
+/**
+ * @brief 生成测试数据，bits为数值的最大位数
+ */
+template <class T>
+static std::vector<T> make_values(size_t count, int bits)
+{
+    std::vector<T> values;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t v = ((uint64_t)rand() << 32 | rand()) & (bits >= 64 ? ~0ull : (1ull << bits) - 1);
+        // 有符号类型一半取负数
+        values.push_back((T)(std::is_signed<T>::value && (i & 1) ? -(int64_t)(v >> 1) : v));
+    }
+    return values;
+}
+
+/**
+ * @brief 批量写逐个读、逐个写批量读、批量写批量读三种组合都要得到相同的数据
+ */
+template <class T>
+static void check_varint_array(const std::vector<T> &values, size_t base_size,
+                               void (sylar::ByteArray::*write_one)(T), T (sylar::ByteArray::*read_one)(),
+                               void (sylar::ByteArray::*write_array)(const T *, size_t),
+                               void (sylar::ByteArray::*read_array)(T *, size_t))
+{
+    sylar::ByteArray::ptr one(new sylar::ByteArray(base_size));
+    sylar::ByteArray::ptr bulk(new sylar::ByteArray(base_size));
+    // 先写一个字节，让数组不从内存块的开头开始
+    one->writeFuint8(1);
+    bulk->writeFuint8(1);
+    for (auto &i : values)
+    {
+        (one.get()->*write_one)(i);
+    }
+    (bulk.get()->*write_array)(&values[0], values.size());
+    SYLAR_ASSERT(one->getSize() == bulk->getSize());
+    one->setPosition(0);
+    bulk->setPosition(0);
+    SYLAR_ASSERT(one->toString() == bulk->toString());
+
+    std::vector<T> out(values.size());
+    one->setPosition(1);
+    (one.get()->*read_array)(&out[0], out.size());
+    SYLAR_ASSERT(out == values);
+    SYLAR_ASSERT(one->getReadSize() == 0);
+
+    bulk->setPosition(1);
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        SYLAR_ASSERT((bulk.get()->*read_one)() == values[i]);
+    }
+
+    // 数据不够时抛出异常
+    bulk->setPosition(1);
+    out.push_back(0);
+    bool thrown = false;
+    try
+    {
+        (bulk.get()->*read_array)(&out[0], out.size());
+    }
+    catch (std::out_of_range &)
+    {
+        thrown = true;
+    }
+    SYLAR_ASSERT(thrown);
+}
+
+static void test_varint_array()
+{
+    size_t base_sizes[] = {1, 3, 7, 64, 4096};
+    int bits[] = {7, 14, 28, 32, 64};
+    for (auto base_size : base_sizes)
+    {
+        for (auto b : bits)
+        {
+            typedef sylar::ByteArray BA;
+            check_varint_array(make_values<uint32_t>(1000, std::min(b, 32)), base_size,
+                               &BA::writeUint32, &BA::readUint32, &BA::writeUint32Array, &BA::readUint32Array);
+            check_varint_array(make_values<int32_t>(1000, std::min(b, 32)), base_size,
+                               &BA::writeInt32, &BA::readInt32, &BA::writeInt32Array, &BA::readInt32Array);
+            check_varint_array(make_values<uint64_t>(1000, b), base_size,
+                               &BA::writeUint64, &BA::readUint64, &BA::writeUint64Array, &BA::readUint64Array);
+            check_varint_array(make_values<int64_t>(1000, b), base_size,
+                               &BA::writeInt64, &BA::readInt64, &BA::writeInt64Array, &BA::readInt64Array);
+        }
+    }
+    SYLAR_LOG_INFO(g_logger) << "varint array ok";
+}
+
+static void bench_varint(int bits)
+{
+    const int loops = 100;
+    std::vector<uint32_t> values = make_values<uint32_t>(10000, bits);
+    std::vector<uint32_t> out(values.size());
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+
+    uint64_t write_one = 0, read_one = 0, write_bulk = 0, read_bulk = 0;
+    for (int l = 0; l < loops; ++l)
+    {
+        uint64_t t0 = sylar::GetCurrentUS();
+        ba->clear();
+        for (auto &i : values)
+        {
+            ba->writeUint32(i);
+        }
+        uint64_t t1 = sylar::GetCurrentUS();
+        ba->setPosition(0);
+        for (auto &i : out)
+        {
+            i = ba->readUint32();
+        }
+        uint64_t t2 = sylar::GetCurrentUS();
+        ba->clear();
+        ba->writeUint32Array(&values[0], values.size());
+        uint64_t t3 = sylar::GetCurrentUS();
+        ba->setPosition(0);
+        ba->readUint32Array(&out[0], out.size());
+        uint64_t t4 = sylar::GetCurrentUS();
+        write_one += t1 - t0;
+        read_one += t2 - t1;
+        write_bulk += t3 - t2;
+        read_bulk += t4 - t3;
+    }
+    SYLAR_ASSERT(out == values);
+    double n = (double)loops * values.size() / 1000;
+    SYLAR_LOG_INFO(g_logger) << "varint uint32 bits=" << bits
+                             << " ns/value write=" << write_one / n << " -> " << write_bulk / n
+                             << " read=" << read_one / n << " -> " << read_bulk / n;
+}
+
+/**
+ * @brief test_bytearray.cc的定长读写，每轮写入100个值再全部读出
+ * @details generic模拟原来的实现，先转字节序再走通用的write/read；
+ *          读写函数作为模板参数传入，和直接调用一样可以内联。
+ *          两种方式交替各跑ROUNDS次取最快的一次，减少预热和其它进程的干扰；
+ *          读出的值先累加到局部变量，避免每个值都读写一次volatile的s_sink掩盖读写本身的耗时
+ */
+template <class T, void (sylar::ByteArray::*write_fun)(T), T (sylar::ByteArray::*read_fun)()>
+static void bench_fixed(const char *name, size_t base_size)
+{
+    // 内存块很小时主要耗时在分配内存块上，少跑几轮
+    const int loops  = base_size < 64 ? 1000 : 20000;
+    const int ROUNDS = 5;
+    std::vector<T> values;
+    for (int i = 0; i < 100; ++i)
+    {
+        values.push_back(rand());
+    }
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(base_size));
+
+    uint64_t generic = ~0ull, fast = ~0ull;
+    for (int r = 0; r < ROUNDS; ++r)
+    {
+        uint64_t t0 = sylar::GetCurrentUS();
+        for (int l = 0; l < loops; ++l)
+        {
+            ba->clear();
+            for (auto &i : values)
+            {
+                T v = sylar::byteswapOnLittleEndian(i);
+                ba->write(&v, sizeof(v));
+            }
+            ba->setPosition(0);
+            uint64_t sum = 0;
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                T v;
+                ba->read(&v, sizeof(v));
+                sum += sylar::byteswapOnLittleEndian(v);
+            }
+            s_sink += sum;
+        }
+        uint64_t t1 = sylar::GetCurrentUS();
+        for (int l = 0; l < loops; ++l)
+        {
+            ba->clear();
+            for (auto &i : values)
+            {
+                (ba.get()->*write_fun)(i);
+            }
+            ba->setPosition(0);
+            uint64_t sum = 0;
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                sum += (ba.get()->*read_fun)();
+            }
+            s_sink += sum;
+        }
+        uint64_t t2 = sylar::GetCurrentUS();
+        generic = std::min(generic, t1 - t0);
+        fast    = std::min(fast, t2 - t1);
+    }
+    ba->setPosition(0);
+    for (auto &i : values)
+    {
+        SYLAR_ASSERT((ba.get()->*read_fun)() == i);
+    }
+    double n = (double)loops * values.size() / 1000;
+    SYLAR_LOG_INFO(g_logger) << name << " base_len=" << base_size
+                             << " ns/value generic=" << generic / n
+                             << " fast=" << fast / n
+                             << " speedup=" << (double)generic / (fast ? fast : 1);
+}
+
+static void bench_fixed_all(size_t base_size)
+{
+    typedef sylar::ByteArray BA;
+    bench_fixed<uint16_t, &BA::writeFuint16, &BA::readFuint16>("writeFuint16/readFuint16", base_size);
+    bench_fixed<uint32_t, &BA::writeFuint32, &BA::readFuint32>("writeFuint32/readFuint32", base_size);
+    bench_fixed<uint64_t, &BA::writeFuint64, &BA::readFuint64>("writeFuint64/readFuint64", base_size);
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    if (argc > 1)
+    {
+        s_messages = atoi(argv[1]);
+    }
+
+    test_pool();
+    test_varint_array();
+    bench_varint(7);
+    bench_varint(14);
+    bench_varint(32);
+    bench_fixed_all(1);
+    bench_fixed_all(4096);
+
+    for (int threads = 1; threads <= 2; ++threads)
+    {
+        g_pool_max_bytes->setValue(0);
+        bench("new/delete", threads);
+        g_pool_max_bytes->setValue(4 * 1024 * 1024);
+        bench("pool", threads);
+    }
+    return 0;
+}
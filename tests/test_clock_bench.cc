@@ -0,0 +1,43 @@
+/**
+ * @file test_clock_bench.cc
+ * @brief 时钟读取开销测试
+ * @details 对比直接读取时钟和读取缓存时钟的耗时，以及精确时钟和粗粒度时钟刷新缓存的耗时
+ */
+
+#include "sylar/sylar.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 每项测试的调用次数
+static const int LOOPS = 5000000;
+
+static volatile uint64_t s_sink = 0;
+
+static void bench(const char *name, const std::function<uint64_t()> &fun)
+{
+    uint64_t begin = sylar::GetCurrentUS();
+    for (int i = 0; i < LOOPS; ++i)
+    {
+        s_sink += fun();
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << name << " ns/call=" << (double)used * 1000 / LOOPS;
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+
+    bench("time(0)", []() { return (uint64_t)time(0); });
+    bench("GetCurrentMS", []() { return sylar::GetCurrentMS(); });
+    bench("GetElapsedMS", []() { return sylar::GetElapsedMS(); });
+
+    sylar::SetCoarseClock(false);
+    bench("UpdateCachedClock", []() { sylar::UpdateCachedClock(); return (uint64_t)0; });
+    sylar::SetCoarseClock(true);
+    bench("UpdateCachedClock(coarse)", []() { sylar::UpdateCachedClock(); return (uint64_t)0; });
+
+    bench("GetCachedElapsedMS", []() { return sylar::GetCachedElapsedMS(); });
+    bench("GetCachedTime", []() { return (uint64_t)sylar::GetCachedTime(); });
+    return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file test_fd_table_bench.cc
+ * @brief IOManager fd表的多线程测试
+ * @details 每个调度线程反复对自己的一组fd执行addEvent/cancelEvent（cancelEvent会triggerEvent），
+ *          可选同时让一个协程不断使用更大的fd，迫使fd表扩容，统计每秒完成的addEvent+cancelEvent次数
+ */
+
+#include "sylar/sylar.h"
+#include <sys/eventfd.h>
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 每个调度线程使用的fd数
+static const int FDS = 64;
+/// 每个fd上add/cancel的轮数
+static const int ROUNDS = 2000;
+
+static std::atomic<uint64_t> s_ops{0};
+static std::atomic<uint64_t> s_triggered{0};
+
+static void worker()
+{
+    sylar::IOManager *iom = sylar::IOManager::GetThis();
+    std::vector<int> fds;
+    for (int i = 0; i < FDS; ++i)
+    {
+        fds.push_back(eventfd(0, EFD_NONBLOCK));
+    }
+    for (int r = 0; r < ROUNDS; ++r)
+    {
+        for (auto fd : fds)
+        {
+            iom->addEvent(fd, sylar::IOManager::READ, []() { ++s_triggered; });
+            iom->cancelEvent(fd, sylar::IOManager::READ);
+            ++s_ops;
+        }
+    }
+    for (auto fd : fds)
+    {
+        close(fd);
+    }
+}
+
+/**
+ * @brief 不断把fd复制到更大的编号上并添加事件，让fd表一直扩容
+ */
+static void grower(std::atomic<bool> *stop)
+{
+    sylar::IOManager *iom = sylar::IOManager::GetThis();
+    int src = eventfd(0, EFD_NONBLOCK);
+    int target = 256;
+    while (!*stop && target < 16384)
+    {
+        int fd = dup2(src, target);
+        if (fd >= 0)
+        {
+            iom->addEvent(fd, sylar::IOManager::READ, []() {});
+            iom->delEvent(fd, sylar::IOManager::READ);
+            close(fd);
+        }
+        target += 97;
+    }
+    close(src);
+}
+
+static void bench(size_t threads, bool grow)
+{
+    s_ops       = 0;
+    s_triggered = 0;
+    std::atomic<bool> stop{false};
+    uint64_t begin = sylar::GetCurrentMS();
+    {
+        sylar::IOManager iom(threads, false, "fdtable");
+        if (grow)
+        {
+            iom.schedule(std::bind(&grower, &stop));
+        }
+        for (auto id : iom.getThreadIds())
+        {
+            iom.schedule(&worker, id);
+        }
+        while (s_ops < (uint64_t)threads * FDS * ROUNDS)
+        {
+            usleep(1000);
+        }
+        stop = true;
+    }
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "threads=" << threads << " grow=" << grow
+                             << " ops=" << s_ops << " triggered=" << s_triggered
+                             << " used=" << used << "ms"
+                             << " ops/s=" << (used ? s_ops * 1000 / used : 0);
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+
+    for (size_t threads = 1; threads <= 4; threads *= 2)
+    {
+        bench(threads, false);
+        bench(threads, true);
+    }
+    return 0;
+}
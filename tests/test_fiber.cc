@@ -5,6 +5,8 @@
  * @date 2021-06-15
  */
 #include "sylar/sylar.h"
+#include <stdio.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -68,6 +70,117 @@ void test_fiber()
     SYLAR_LOG_INFO(g_logger) << "test_fiber end";
 }
 
+/// 栈缓存测试里协程栈所在的地址
+static uintptr_t s_stack_addr = 0;
+
+void record_stack() 
+{
+    int local = 0;
+    s_stack_addr = (uintptr_t)&local;
+}
+
+/**
+ * @brief 检查s_stack_addr所在的映射下方紧挨着一个不可访问的保护页
+ */
+static bool has_guard_page() 
+{
+    FILE *fp = fopen("/proc/self/maps", "r");
+    SYLAR_ASSERT(fp);
+    std::vector<std::pair<uintptr_t, uintptr_t>> guards;
+    uintptr_t stack_begin = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) 
+    {
+        unsigned long begin = 0, end = 0;
+        char perms[8] = {0};
+        if (sscanf(line, "%lx-%lx %7s", &begin, &end, perms) != 3) 
+        {
+            continue;
+        }
+        if (strcmp(perms, "---p") == 0) 
+        {
+            guards.push_back(std::make_pair(begin, end));
+        }
+        if (begin <= s_stack_addr && s_stack_addr < end) 
+        {
+            stack_begin = begin;
+        }
+    }
+    fclose(fp);
+    size_t page = sysconf(_SC_PAGESIZE);
+    for (auto &i : guards) 
+    {
+        if (i.second == stack_begin && i.second - i.first == page) 
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 同时创建count个协程并运行结束，全部析构之后返回常驻栈内存的增量
+ */
+static int64_t churn(int count, uint64_t base) 
+{
+    std::vector<sylar::Fiber::ptr> fibers;
+    for (int i = 0; i < count; i++) 
+    {
+        fibers.push_back(sylar::Fiber::ptr(new sylar::Fiber(record_stack, 0, false)));
+        fibers.back()->resume();
+    }
+    fibers.clear();
+    return (int64_t)sylar::Fiber::GetStackStats().resident_bytes - (int64_t)base;
+}
+
+void test_stack_pool() 
+{
+    sylar::Fiber::GetThis();
+    sylar::ConfigVar<uint32_t>::ptr stack_size = sylar::Config::Lookup<uint32_t>("fiber.stack_size");
+    sylar::ConfigVar<uint32_t>::ptr max_count  = sylar::Config::Lookup<uint32_t>("fiber.stack_pool.max_count");
+    sylar::ConfigVar<uint64_t>::ptr max_bytes  = sylar::Config::Lookup<uint64_t>("fiber.stack_pool.max_bytes");
+    size_t page = sysconf(_SC_PAGESIZE);
+    // 每个栈的映射长度：按页对齐再加一个保护页
+    uint64_t len = (stack_size->getValue() + page - 1) / page * page + page;
+    sylar::Fiber::StackStats before = sylar::Fiber::GetStackStats();
+
+    // 预热一次之后，后续创建的协程都应当命中缓存
+    churn(1, before.resident_bytes);
+    sylar::Fiber::StackStats warm = sylar::Fiber::GetStackStats();
+    SYLAR_ASSERT(warm.misses - before.misses == 1);
+    for (int i = 0; i < 100; i++) 
+    {
+        sylar::Fiber::ptr fiber(new sylar::Fiber(record_stack, 0, false));
+        fiber->resume();
+        // 从缓存里复用的栈仍然带着保护页
+        SYLAR_ASSERT(has_guard_page());
+    }
+    sylar::Fiber::StackStats after = sylar::Fiber::GetStackStats();
+    SYLAR_LOG_INFO(g_logger) << "stack pool hits=" << (after.hits - warm.hits)
+                             << " misses=" << (after.misses - warm.misses)
+                             << " resident_bytes=" << after.resident_bytes;
+    SYLAR_ASSERT(after.hits - warm.hits == 100);
+    SYLAR_ASSERT(after.misses == warm.misses);
+
+    // 缓存的栈不超过个数上限
+    max_count->setValue(8);
+    int64_t cached = churn(100, before.resident_bytes);
+    SYLAR_LOG_INFO(g_logger) << "max_count=8 cached=" << cached;
+    SYLAR_ASSERT(cached == (int64_t)(8 * len));
+
+    // 缓存的栈不超过字节数上限
+    max_count->setValue(64);
+    max_bytes->setValue(4 * len + len / 2);
+    cached = churn(100, before.resident_bytes);
+    SYLAR_LOG_INFO(g_logger) << "max_bytes=" << max_bytes->getValue() << " cached=" << cached;
+    SYLAR_ASSERT(cached == (int64_t)(4 * len));
+
+    // 缓存已满之后，再同时创建100个协程最多有100-4次未命中
+    sylar::Fiber::StackStats full = sylar::Fiber::GetStackStats();
+    churn(100, before.resident_bytes);
+    SYLAR_ASSERT(sylar::Fiber::GetStackStats().misses - full.misses == 96);
+}
+
 int main(int argc, char *argv[]) 
 {
     sylar::EnvMgr::GetInstance()->init(argc, argv);
@@ -89,6 +202,10 @@ int main(int argc, char *argv[])
         i->join();
     }
 
+    // 栈缓存的统计是全局的，等其它线程退出、它们缓存的栈释放之后再单独测
+    sylar::Thread::ptr pool_thread(new sylar::Thread(&test_stack_pool, "stack_pool"));
+    pool_thread->join();
+
     SYLAR_LOG_INFO(g_logger) << "main end";
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,258 @@
+/**
+ * @file test_hook_bench.cc
+ * @brief hook读写的内存分配测试
+ * @details 替换全局operator new统计分配次数，在设置了SO_RCVTIMEO的socketpair上测量每次recv的分配次数和耗时：
+ *          数据已就绪时一次系统调用直接返回，不应有任何分配；需要等待时超时定时器在fd上复用，
+ *          recv所在的协程也不应有分配，线程上的分配来自调度器和写数据的任务；最后检查超时仍然返回ETIMEDOUT。
+ *          另外在新的socketpair上做一问一答，分别打开和关闭iomanager.edge_cache，统计每个来回的epoll_ctl次数，
+ *          打开时第一个来回之后不应再有epoll_ctl；
+ *          最后检查常驻注册的fd绕过IOManager关闭、fd号被复用之后，新fd上的等待仍然能被唤醒
+ */
+
+#include "sylar/sylar.h"
+#include <stdlib.h>
+#include <new>
+
+/// 是否统计分配次数
+static thread_local bool t_counting = false;
+/// 统计期间的分配次数
+static thread_local uint64_t t_allocs = 0;
+/// 统计期间recv所在协程的分配次数，不包括等待期间调度器和其它协程的分配
+static thread_local uint64_t t_fiber_allocs = 0;
+/// 执行recv的协程id
+static uint64_t s_fiber_id = 0;
+
+void *operator new(size_t size)
+{
+    if (t_counting)
+    {
+        ++t_allocs;
+        if (sylar::Fiber::GetFiberId() == s_fiber_id)
+        {
+            ++t_fiber_allocs;
+        }
+    }
+    void *p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 每种情况recv的次数
+static int s_rounds = 100000;
+
+static int s_fds[2];
+
+static sylar::ConfigVar<bool>::ptr s_edge_cache =
+    sylar::Config::Lookup<bool>("iomanager.edge_cache", false, "");
+
+/**
+ * @brief 数据已经在缓冲区里，recv第一次系统调用就成功
+ */
+static void bench_ready()
+{
+    char c = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        send(s_fds[1], "x", 1, 0);
+        recv(s_fds[0], &c, 1, 0);
+    }
+
+    uint64_t used = 0;
+    t_allocs = 0;
+    for (int i = 0; i < s_rounds; ++i)
+    {
+        send(s_fds[1], "x", 1, 0);
+        uint64_t begin = sylar::GetCurrentUS();
+        t_counting = true;
+        SYLAR_ASSERT(recv(s_fds[0], &c, 1, 0) == 1);
+        t_counting = false;
+        used += sylar::GetCurrentUS() - begin;
+    }
+    SYLAR_LOG_INFO(g_logger) << "ready recv allocs/recv=" << (double)t_allocs / s_rounds
+                             << " ns/recv=" << (double)used * 1000 / s_rounds;
+    SYLAR_ASSERT(t_allocs == 0);
+}
+
+/**
+ * @brief recv先返回EAGAIN，等另一个协程写入后被唤醒
+ */
+static void bench_wait()
+{
+    sylar::IOManager *iom = sylar::IOManager::GetThis();
+    char c = 0;
+    int rounds = s_rounds / 10;
+    // 第一次等待时创建fd上的超时定时器，之后复用
+    iom->schedule([]() { send(s_fds[1], "x", 1, 0); });
+    recv(s_fds[0], &c, 1, 0);
+
+    t_allocs       = 0;
+    t_fiber_allocs = 0;
+    uint64_t begin = sylar::GetCurrentUS();
+    for (int i = 0; i < rounds; ++i)
+    {
+        // 写入由调度器放入的任务完成，不计入recv的分配
+        iom->schedule([]() { send(s_fds[1], "x", 1, 0); });
+        t_counting = true;
+        SYLAR_ASSERT(recv(s_fds[0], &c, 1, 0) == 1);
+        t_counting = false;
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "wait recv fiber allocs/recv=" << (double)t_fiber_allocs / rounds
+                             << " thread allocs/recv=" << (double)t_allocs / rounds
+                             << " ns/round=" << (double)used * 1000 / rounds;
+    SYLAR_ASSERT(t_fiber_allocs == 0);
+}
+
+static void check_timeout()
+{
+    char c = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        uint64_t begin = sylar::GetCurrentMS();
+        SYLAR_ASSERT(recv(s_fds[0], &c, 1, 0) == -1 && errno == ETIMEDOUT);
+        uint64_t used = sylar::GetCurrentMS() - begin;
+        SYLAR_ASSERT(used >= 40);
+    }
+    SYLAR_LOG_INFO(g_logger) << "timeout ok";
+}
+
+/**
+ * @brief 两个协程在socketpair上一问一答，统计每个来回的epoll_ctl次数
+ * @return 第一个来回之后的epoll_ctl总次数
+ */
+static uint64_t bench_ping_pong(bool edge_cache)
+{
+    s_edge_cache->setValue(edge_cache);
+    int rounds = s_rounds / 10;
+    uint64_t ctl_count = 0;
+    {
+        // 开关只在IOManager构造时读取
+        sylar::IOManager iom(1, false, "ping_pong");
+        int fds[2];
+        SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        sylar::FdMgr::GetInstance()->get(fds[0], true);
+        sylar::FdMgr::GetInstance()->get(fds[1], true);
+        iom.schedule([fds, rounds]() {
+            char c = 0;
+            for (int i = 0; i < rounds; ++i)
+            {
+                SYLAR_ASSERT(recv(fds[1], &c, 1, 0) == 1);
+                SYLAR_ASSERT(send(fds[1], &c, 1, 0) == 1);
+            }
+        });
+        iom.schedule([fds, rounds, edge_cache, &iom, &ctl_count]() {
+            char c = 'x';
+            // 第一个来回注册fd，不计入
+            SYLAR_ASSERT(send(fds[0], &c, 1, 0) == 1);
+            SYLAR_ASSERT(recv(fds[0], &c, 1, 0) == 1);
+            uint64_t before = iom.getEpollCtlCount();
+            uint64_t begin  = sylar::GetCurrentUS();
+            for (int i = 1; i < rounds; ++i)
+            {
+                SYLAR_ASSERT(send(fds[0], &c, 1, 0) == 1);
+                SYLAR_ASSERT(recv(fds[0], &c, 1, 0) == 1);
+            }
+            uint64_t used = sylar::GetCurrentUS() - begin;
+            ctl_count     = iom.getEpollCtlCount() - before;
+            SYLAR_LOG_INFO(g_logger) << "ping-pong edge_cache=" << edge_cache
+                                     << " epoll_ctl/round=" << (double)ctl_count / (rounds - 1)
+                                     << " ns/round=" << (double)used * 1000 / (rounds - 1);
+            // 统计完再关闭，关闭时删除注册的epoll_ctl不计入
+            close(fds[0]);
+            close(fds[1]);
+        });
+    }
+    return ctl_count;
+}
+
+/**
+ * @brief 常驻注册的fd用close_f关闭，IOManager不知道注册已经被内核删除，同号的新fd上等待不能挂起
+ * @details 从FdManager删除后同号的新fd是新的代数，第一次等待时重新注册
+ */
+static void check_fd_reuse()
+{
+    int fds[2];
+    SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    sylar::FdMgr::GetInstance()->get(fds[0], true);
+    sylar::FdMgr::GetInstance()->get(fds[1], true);
+    auto write_later = [](int fd) {
+        sylar::IOManager::GetThis()->schedule([fd]() {
+            usleep(10 * 1000);
+            SYLAR_ASSERT(write(fd, "x", 1) == 1);
+        });
+    };
+    char c;
+    // 等待一次，fds[0]常驻注册
+    write_later(fds[1]);
+    SYLAR_ASSERT(recv(fds[0], &c, 1, 0) == 1);
+    int old0 = fds[0], old1 = fds[1];
+    close_f(fds[0]);
+    close_f(fds[1]);
+    // FdCtx不是这里要测的，按新fd重新创建
+    sylar::FdMgr::GetInstance()->del(old0);
+    sylar::FdMgr::GetInstance()->del(old1);
+
+    SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SYLAR_ASSERT(fds[0] == old0 || fds[1] == old0);
+    sylar::FdMgr::GetInstance()->get(fds[0], true);
+    sylar::FdMgr::GetInstance()->get(fds[1], true);
+    int reader = old0, writer = fds[0] == old0 ? fds[1] : fds[0];
+    timeval tv = {1, 0};
+    setsockopt(reader, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    write_later(writer);
+    SYLAR_ASSERT(recv(reader, &c, 1, 0) == 1);
+    // 没有等待者的时候关闭再复用，缓存的就绪状态也不能让等待提前返回之后挂起
+    write_later(writer);
+    SYLAR_ASSERT(recv(reader, &c, 1, 0) == 1);
+    close(fds[0]);
+    close(fds[1]);
+    SYLAR_LOG_INFO(g_logger) << "fd reuse ok";
+}
+
+static void run()
+{
+    s_fiber_id = sylar::Fiber::GetFiberId();
+    SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, s_fds) == 0);
+    sylar::FdMgr::GetInstance()->get(s_fds[0], true);
+    sylar::FdMgr::GetInstance()->get(s_fds[1], true);
+    timeval tv = {0, 50 * 1000};
+    setsockopt(s_fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    bench_ready();
+    bench_wait();
+    check_timeout();
+    close(s_fds[0]);
+    close(s_fds[1]);
+    check_fd_reuse();
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    if (argc > 1)
+    {
+        s_rounds = atoi(argv[1]);
+    }
+    {
+        // 打开常驻注册，check_fd_reuse要用到
+        s_edge_cache->setValue(true);
+        sylar::IOManager iom(1, false, "hook");
+        iom.schedule(&run);
+    }
+    uint64_t uncached = bench_ping_pong(false);
+    uint64_t cached   = bench_ping_pong(true);
+    // 不常驻注册时每次等待添加和删除各一次；常驻注册之后稳定的等待不再调用epoll_ctl
+    SYLAR_ASSERT(uncached > 0);
+    SYLAR_ASSERT(cached == 0);
+    return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file test_hook_poll.cc
+ * @brief hook的poll/select/epoll_wait测试
+ * @details 在单个调度线程上检查三种等待都会让出协程（等待期间别的协程照常运行）、数据到达时被唤醒、超时按时返回，
+ *          以及和另一个协程在IOManager里等待同一个fd时互不影响；poll里有无效fd时和poll(2)一样立即报告POLLNVAL
+ * @version 0.1
+ * @date 2026-10-16
+ */
+
+#include "sylar/sylar.h"
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_fds[2];
+
+/// 等待期间计数的协程跑了多少次
+static std::atomic<int> s_ticks{0};
+static std::atomic<bool> s_ticking{false};
+
+static void ticker()
+{
+    while (s_ticking)
+    {
+        usleep(5 * 1000);
+        ++s_ticks;
+    }
+}
+
+/**
+ * @brief 10ms之后往s_fds[1]写一个字节
+ */
+static void write_later()
+{
+    sylar::IOManager::GetThis()->schedule([]() {
+        usleep(10 * 1000);
+        SYLAR_ASSERT(write(s_fds[1], "x", 1) == 1);
+    });
+}
+
+static void drain()
+{
+    char c;
+    SYLAR_ASSERT(read(s_fds[0], &c, 1) == 1);
+}
+
+static void test_poll()
+{
+    pollfd pfd = {s_fds[0], POLLIN, 0};
+    s_ticks        = 0;
+    uint64_t begin = sylar::GetCurrentMS();
+    SYLAR_ASSERT(poll(&pfd, 1, 50) == 0);
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "poll timeout used=" << used << "ms ticks=" << s_ticks;
+    SYLAR_ASSERT(used >= 45 && s_ticks > 0);
+
+    write_later();
+    SYLAR_ASSERT(poll(&pfd, 1, -1) == 1 && (pfd.revents & POLLIN));
+    drain();
+}
+
+static void test_poll_nval()
+{
+    int fds[2];
+    SYLAR_ASSERT(pipe(fds) == 0);
+    close(fds[0]);
+    close(fds[1]);
+    pollfd pfds[2] = {{s_fds[0], POLLIN, 0}, {fds[0], POLLIN, 0}};
+    uint64_t begin = sylar::GetCurrentMS();
+    SYLAR_ASSERT(poll(pfds, 2, 1000) == 1);
+    SYLAR_ASSERT(pfds[0].revents == 0 && pfds[1].revents == POLLNVAL);
+    SYLAR_ASSERT(sylar::GetCurrentMS() - begin < 500);
+}
+
+static void test_select()
+{
+    fd_set rset;
+    FD_ZERO(&rset);
+    FD_SET(s_fds[0], &rset);
+    timeval tv = {0, 50 * 1000};
+    s_ticks        = 0;
+    uint64_t begin = sylar::GetCurrentMS();
+    SYLAR_ASSERT(select(s_fds[0] + 1, &rset, nullptr, nullptr, &tv) == 0);
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "select timeout used=" << used << "ms ticks=" << s_ticks;
+    SYLAR_ASSERT(used >= 45 && s_ticks > 0);
+    SYLAR_ASSERT(!FD_ISSET(s_fds[0], &rset));
+
+    write_later();
+    FD_SET(s_fds[0], &rset);
+    fd_set wset;
+    FD_ZERO(&wset);
+    // s_fds[1]一直可写，但这里只关心读
+    SYLAR_ASSERT(select(s_fds[0] + 1, &rset, &wset, nullptr, nullptr) == 1);
+    SYLAR_ASSERT(FD_ISSET(s_fds[0], &rset));
+    drain();
+}
+
+static void test_epoll_wait()
+{
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    SYLAR_ASSERT(epfd >= 0);
+    epoll_event event;
+    event.events  = EPOLLIN;
+    event.data.fd = s_fds[0];
+    SYLAR_ASSERT(epoll_ctl(epfd, EPOLL_CTL_ADD, s_fds[0], &event) == 0);
+
+    epoll_event out;
+    s_ticks        = 0;
+    uint64_t begin = sylar::GetCurrentMS();
+    SYLAR_ASSERT(epoll_wait(epfd, &out, 1, 50) == 0);
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "epoll_wait timeout used=" << used << "ms ticks=" << s_ticks;
+    SYLAR_ASSERT(used >= 45 && s_ticks > 0);
+
+    // 水平触发：数据没读走之前每次都返回
+    write_later();
+    SYLAR_ASSERT(epoll_wait(epfd, &out, 1, -1) == 1 && out.data.fd == s_fds[0]);
+    SYLAR_ASSERT(epoll_wait(epfd, &out, 1, 1000) == 1);
+    drain();
+    close(epfd);
+}
+
+/**
+ * @brief 一个协程在recv里等待，另一个协程poll同一个fd，数据到达时两个都被唤醒
+ */
+static void test_shared_fd()
+{
+    static std::atomic<bool> s_received{false};
+    sylar::IOManager::GetThis()->schedule([]() {
+        char c;
+        SYLAR_ASSERT(recv(s_fds[0], &c, 1, MSG_PEEK) == 1);
+        s_received = true;
+    });
+    write_later();
+    pollfd pfd = {s_fds[0], POLLIN, 0};
+    SYLAR_ASSERT(poll(&pfd, 1, 1000) == 1);
+    // 让recv的协程运行
+    usleep(5 * 1000);
+    SYLAR_ASSERT(s_received);
+    drain();
+}
+
+static void run()
+{
+    SYLAR_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, s_fds) == 0);
+    sylar::FdMgr::GetInstance()->get(s_fds[0], true);
+    sylar::FdMgr::GetInstance()->get(s_fds[1], true);
+    s_ticking = true;
+    sylar::IOManager::GetThis()->schedule(&ticker);
+
+    test_poll();
+    test_poll_nval();
+    test_select();
+    test_epoll_wait();
+    test_shared_fd();
+    // 关闭过的epoll fd号被复用后仍然可以正常等待
+    test_epoll_wait();
+
+    s_ticking = false;
+    close(s_fds[0]);
+    close(s_fds[1]);
+    SYLAR_LOG_INFO(g_logger) << "all ok";
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    sylar::IOManager iom(1, false, "poll");
+    iom.schedule(&run);
+    return 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file test_http_zero_copy.cc
+ * @brief HTTP响应零拷贝发送测试
+ * @details 通过本地TCP连接发送引用共享字符串和文件的响应，检查收到的内容和拷贝、引用的字节数；
+ *          再对比先序列化成std::string再发送和sendResponse直接发送的耗时
+ */
+
+#include "sylar/sylar.h"
+#include "sylar/http/http_session.h"
+#include <atomic>
+#include <fstream>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 本地TCP连接，服务端包装成HttpSession，客户端在另一个协程里接收
+ */
+struct Connection
+{
+    Connection()
+    {
+        sylar::Address::ptr addr = sylar::IPv4Address::Create("127.0.0.1", 0);
+        sylar::Socket::ptr listener = sylar::Socket::CreateTCP(addr);
+        SYLAR_ASSERT(listener->bind(addr));
+        SYLAR_ASSERT(listener->listen());
+        // bind时缓存的是端口为0的地址，这里取内核实际分配的端口
+        sockaddr_in local;
+        socklen_t len = sizeof(local);
+        SYLAR_ASSERT(getsockname(listener->getSocket(), (sockaddr *)&local, &len) == 0);
+        client = sylar::Socket::CreateTCP(addr);
+        SYLAR_ASSERT(client->connect(sylar::Address::ptr(new sylar::IPv4Address(local))));
+        session.reset(new sylar::http::HttpSession(listener->accept()));
+    }
+
+    /**
+     * @brief 在另一个协程里读出size字节
+     */
+    void startRecv(size_t size, bool keep)
+    {
+        received.clear();
+        done = false;
+        sylar::IOManager::GetThis()->schedule([this, size, keep]() {
+            std::vector<char> buf(256 * 1024);
+            size_t total = 0;
+            while (total < size)
+            {
+                int rt = client->recv(&buf[0], std::min(buf.size(), size - total));
+                SYLAR_ASSERT(rt > 0);
+                if (keep)
+                {
+                    received.append(&buf[0], rt);
+                }
+                total += rt;
+            }
+            done = true;
+        });
+    }
+
+    void waitRecv()
+    {
+        while (!done)
+        {
+            usleep(100);
+        }
+    }
+
+    sylar::Socket::ptr client;
+    sylar::http::HttpSession::ptr session;
+    std::atomic<bool> done{false};
+    std::string received;
+};
+
+static void check_send(Connection &conn, sylar::http::HttpResponse::ptr rsp)
+{
+    std::string expect = rsp->toString();
+    uint64_t copied = sylar::http::HttpSession::GetBytesCopied();
+    uint64_t referenced = sylar::http::HttpSession::GetBytesReferenced();
+
+    conn.startRecv(expect.size(), true);
+    SYLAR_ASSERT(conn.session->sendResponse(rsp) == (int)expect.size());
+    conn.waitRecv();
+    SYLAR_ASSERT(conn.received == expect);
+
+    copied = sylar::http::HttpSession::GetBytesCopied() - copied;
+    referenced = sylar::http::HttpSession::GetBytesReferenced() - referenced;
+    SYLAR_ASSERT(referenced == rsp->getBodySize());
+    SYLAR_ASSERT(copied + referenced == expect.size());
+    SYLAR_LOG_INFO(g_logger) << "sent " << expect.size() << " bytes, copied=" << copied
+                             << " referenced=" << referenced;
+}
+
+static void test_send(Connection &conn)
+{
+    std::shared_ptr<std::string> body(new std::string(1024 * 1024, 'x'));
+    for (size_t i = 0; i < body->size(); i += 1000)
+    {
+        (*body)[i] = 'a' + i % 26;
+    }
+
+    // 普通消息体
+    sylar::http::HttpResponse::ptr rsp(new sylar::http::HttpResponse(0x11, false));
+    rsp->setHeader("Content-Type", "text/plain");
+    rsp->setCookie("session", "abc", 0, "/");
+    rsp->setBody("hello world");
+    check_send(conn, rsp);
+
+    // 引用共享字符串
+    rsp.reset(new sylar::http::HttpResponse(0x11, false));
+    rsp->setHeader("Content-Type", "application/octet-stream");
+    rsp->setBodyRef(body);
+    check_send(conn, rsp);
+
+    // 引用文件
+    const char *file = "/tmp/test_http_zero_copy.bin";
+    {
+        std::ofstream ofs(file, std::ios::binary | std::ios::trunc);
+        ofs.write(body->data(), body->size() / 2);
+    }
+    rsp.reset(new sylar::http::HttpResponse(0x11, false));
+    SYLAR_ASSERT(rsp->setBodyFile(file));
+    SYLAR_ASSERT(rsp->getBodySize() == body->size() / 2);
+    check_send(conn, rsp);
+    unlink(file);
+
+    // 没有消息体
+    rsp.reset(new sylar::http::HttpResponse(0x11, false));
+    rsp->setStatus(sylar::http::HttpStatus::NOT_FOUND);
+    check_send(conn, rsp);
+}
+
+static void bench(Connection &conn, bool zero_copy)
+{
+    const int count = 2000;
+    std::shared_ptr<std::string> body(new std::string(64 * 1024, 'b'));
+    sylar::http::HttpResponse::ptr rsp(new sylar::http::HttpResponse(0x11, false));
+    rsp->setHeader("Content-Type", "application/octet-stream");
+    rsp->setHeader("Server", "sylar");
+    if (zero_copy)
+    {
+        rsp->setBodyRef(body);
+    }
+    else
+    {
+        rsp->setBody(*body);
+    }
+    size_t size = rsp->toString().size();
+
+    conn.startRecv(size * count, false);
+    uint64_t begin = sylar::GetCurrentUS();
+    for (int i = 0; i < count; ++i)
+    {
+        if (zero_copy)
+        {
+            SYLAR_ASSERT(conn.session->sendResponse(rsp) == (int)size);
+        }
+        else
+        {
+            // 原来的做法：序列化成std::string再发送
+            std::stringstream ss;
+            ss << *rsp;
+            std::string data = ss.str();
+            SYLAR_ASSERT(conn.session->writeFixSize(data.c_str(), data.size()) == (int)size);
+        }
+    }
+    conn.waitRecv();
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << (zero_copy ? "sendResponse" : "string+write")
+                             << " responses=" << count << " used=" << used / 1000 << "ms"
+                             << " us/response=" << (double)used / count;
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+
+    sylar::IOManager iom(2);
+    iom.schedule([]() {
+        Connection conn;
+        test_send(conn);
+        bench(conn, false);
+        bench(conn, true);
+    });
+    return 0;
+}
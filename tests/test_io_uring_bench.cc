@@ -0,0 +1,131 @@
+/**
+ * @file test_io_uring_bench.cc
+ * @brief epoll后端和io_uring后端的对比测试
+ * @details 本机TCP回显，多个连接同时一问一答，统计每个请求平均产生的系统调用数和吞吐，
+ *          系统调用包括hook的读写、epoll_ctl/epoll_wait、eventfd读写和io_uring_enter。
+ *          io_uring后端每轮idle只有一次io_uring_enter，同时提交攒下的请求并等待完成，每个请求的系统调用数要明显少于epoll
+ */
+
+#include "sylar/sylar.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 并发连接数
+static int s_conns = 64;
+/// 每个连接的请求数
+static int s_rounds = 2000;
+/// 请求大小
+static const size_t MSG_SIZE = 64;
+
+static void echo(sylar::Socket::ptr client)
+{
+    char buf[MSG_SIZE];
+    while (true)
+    {
+        int n = client->recv(buf, sizeof(buf));
+        if (n <= 0 || client->send(buf, n) != n)
+        {
+            break;
+        }
+    }
+    client->close();
+}
+
+/**
+ * @brief 跑一轮回显测试
+ * @return 每个请求平均的系统调用数
+ */
+static double bench(const char *name, sylar::IOManager::Backend backend, size_t threads)
+{
+    sylar::IOManager iom(threads, false, name, false, backend);
+
+    std::atomic<int> finished{0};
+    uint64_t begin    = sylar::GetCurrentMS();
+    uint64_t used     = 0;
+    uint64_t syscalls = 0;
+
+    // socket要在调度线程里创建，hook才会接管它
+    iom.schedule([&]() {
+        sylar::Socket::ptr server = sylar::Socket::CreateTCPSocket();
+        sylar::Address::ptr addr = sylar::Address::LookupAnyIPAddress("127.0.0.1:8933");
+        SYLAR_ASSERT(server->bind(addr));
+        SYLAR_ASSERT(server->listen());
+
+        for (int i = 0; i < s_conns; ++i)
+        {
+            iom.schedule([&, server, addr]() {
+                sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+                SYLAR_ASSERT(sock->connect(addr));
+                char buf[MSG_SIZE] = {0};
+                for (int r = 0; r < s_rounds; ++r)
+                {
+                    SYLAR_ASSERT(sock->send(buf, sizeof(buf)) == (int)sizeof(buf));
+                    size_t got = 0;
+                    while (got < sizeof(buf))
+                    {
+                        int n = sock->recv(buf + got, sizeof(buf) - got);
+                        SYLAR_ASSERT(n > 0);
+                        got += n;
+                    }
+                }
+                sock->close();
+                if (++finished == s_conns)
+                {
+                    // 最后一个连接结束时统计，然后关闭监听socket让accept返回
+                    used     = sylar::GetCurrentMS() - begin;
+                    syscalls = iom.getSyscallCount();
+                    server->close();
+                }
+            });
+        }
+
+        while (true)
+        {
+            sylar::Socket::ptr client = server->accept();
+            if (!client)
+            {
+                break;
+            }
+            iom.schedule(std::bind(&echo, client));
+        }
+    });
+    iom.stop();
+
+    uint64_t requests = (uint64_t)s_conns * s_rounds;
+    SYLAR_LOG_INFO(g_logger) << name << " io_uring=" << iom.isIoUring() << " threads=" << threads
+                             << " requests=" << requests << " used=" << used << "ms"
+                             << " req/s=" << (used ? requests * 1000 / used : 0)
+                             << " syscalls=" << syscalls
+                             << " syscalls/req=" << (double)syscalls / requests
+                             << " tickles=" << iom.getTickleCount()
+                             << " wakeups=" << iom.getWakeupWriteCount();
+    if (backend == sylar::IOManager::BACKEND_IO_URING && !iom.isIoUring())
+    {
+        return -1;
+    }
+    return (double)syscalls / requests;
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+    if (argc > 1)
+    {
+        s_conns = atoi(argv[1]);
+    }
+    if (argc > 2)
+    {
+        s_rounds = atoi(argv[2]);
+    }
+
+    for (size_t threads = 1; threads <= 4; threads *= 2)
+    {
+        double epoll    = bench("epoll", sylar::IOManager::BACKEND_EPOLL, threads);
+        double io_uring = bench("io_uring", sylar::IOManager::BACKEND_IO_URING, threads);
+        // 内核不支持io_uring时退回了epoll，不比较
+        SYLAR_ASSERT(io_uring < 0 || io_uring * 4 < epoll);
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file test_log_alloc.cc
+ * @brief 日志事件内存分配测试
+ * @details 替换全局operator new统计分配次数，预热之后，级别满足的日志调用（流式、printf风格、嵌套日志、
+ *          修改流格式）经过格式化和异步Appender，不应再有任何堆内存分配
+ */
+
+#include "sylar/sylar.h"
+#include <stdlib.h>
+#include <new>
+
+/// 是否统计分配次数
+static thread_local bool t_counting = false;
+/// 统计期间的分配次数
+static thread_local uint64_t t_allocs = 0;
+
+void *operator new(size_t size)
+{
+    if (t_counting)
+    {
+        ++t_allocs;
+    }
+    void *p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 只格式化不输出的Appender，格式化结果写入复用的缓冲区
+ */
+class NullLogAppender : public sylar::LogAppender {
+public:
+    NullLogAppender()
+        : LogAppender(sylar::LogFormatter::ptr(new sylar::LogFormatter)) {}
+
+    void log(sylar::LogEvent::ptr event) override
+    {
+        m_buf.clear();
+        m_defaultFormatter->format(m_buf, event);
+        m_bytes += m_buf.size();
+    }
+
+    std::string toYamlString() override { return ""; }
+
+    uint64_t getBytes() const { return m_bytes; }
+
+private:
+    std::string m_buf;
+    uint64_t m_bytes = 0;
+};
+
+/**
+ * @brief 留住第一个日志事件的Appender
+ */
+class KeepLogAppender : public sylar::LogAppender {
+public:
+    KeepLogAppender()
+        : LogAppender(sylar::LogFormatter::ptr(new sylar::LogFormatter)) {}
+
+    void log(sylar::LogEvent::ptr event) override
+    {
+        if (!m_event)
+        {
+            m_event = event;
+        }
+    }
+
+    std::string toYamlString() override { return ""; }
+
+    sylar::LogEvent::ptr m_event;
+};
+
+static int nested(sylar::Logger::ptr logger, int i)
+{
+    SYLAR_LOG_DEBUG(logger) << "nested " << i;
+    return i;
+}
+
+static void log_some(sylar::Logger::ptr logger, int loops)
+{
+    std::string name = "sylar";
+    for (int i = 0; i < loops; ++i)
+    {
+        SYLAR_LOG_INFO(logger) << "stream " << i << " " << name << " " << 3.14;
+        SYLAR_LOG_FMT_INFO(logger, "printf %d %s %.2f", i, name.c_str(), 2.5);
+        SYLAR_LOG_INFO(logger) << "outer " << nested(logger, i);
+        SYLAR_LOG_INFO(logger) << std::hex << i << " hex";
+        SYLAR_LOG_DEBUG(logger) << "filtered by level " << i;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+
+    std::shared_ptr<NullLogAppender> null_appender(new NullLogAppender);
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("alloc");
+    logger->setLevel(sylar::LogLevel::DEBUG);
+    logger->addAppender(null_appender);
+    logger->addAppender(sylar::LogAppender::ptr(new sylar::FileLogAppender("/tmp/test_log_alloc.log", true)));
+
+    // 预热：事件池、流缓冲区、格式化缓冲区、异步缓冲区都在这里分配
+    log_some(logger, 100);
+
+    const int loops = 10000;
+    t_allocs   = 0;
+    t_counting = true;
+    log_some(logger, loops);
+    t_counting = false;
+
+    SYLAR_LOG_INFO(g_logger) << "log calls=" << loops * 5 << " allocations=" << t_allocs
+                             << " formatted bytes=" << null_appender->getBytes();
+    SYLAR_ASSERT(t_allocs == 0);
+
+    // 被Appender留住的事件不会被复用，流格式的修改也不会带到下一条日志
+    logger->clearAppenders();
+    std::shared_ptr<KeepLogAppender> keep_appender(new KeepLogAppender);
+    logger->addAppender(keep_appender);
+    SYLAR_LOG_INFO(logger) << std::hex << 255;
+    SYLAR_LOG_INFO(logger) << 255;
+    SYLAR_ASSERT(keep_appender->m_event->getContent() == "ff");
+    keep_appender->m_event.reset();
+    SYLAR_LOG_INFO(logger) << 255;
+    SYLAR_ASSERT(keep_appender->m_event->getContent() == "255");
+    logger->clearAppenders();
+    unlink("/tmp/test_log_alloc.log");
+    return 0;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file test_log_formatter_bench.cc
+ * @brief 日志格式化性能测试
+ * @details 用默认格式和几种常见格式反复格式化同一条日志事件，统计每秒格式化的日志条数
+ */
+
+#include "sylar/sylar.h"
+#include <stdlib.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 每种格式的格式化次数
+static int s_loops = 1000000;
+
+static void bench(const std::string &pattern)
+{
+    sylar::LogFormatter::ptr formatter(new sylar::LogFormatter(pattern));
+    sylar::LogEvent::ptr event(new sylar::LogEvent("root", sylar::LogLevel::INFO, __FILE__, __LINE__, 1234,
+                                                   sylar::GetThreadId(), 0, time(0), "formatter"));
+    event->getSS() << "hello formatter " << 42;
+
+    size_t bytes = 0;
+    uint64_t begin = sylar::GetCurrentUS();
+    for (int i = 0; i < s_loops; ++i)
+    {
+        bytes += formatter->format(event).size();
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "pattern=\"" << pattern << "\" records/s=" << (used ? s_loops * 1000000ULL / used : 0)
+                             << " ns/record=" << used * 1000 / s_loops << " bytes=" << bytes;
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    if (argc > 1)
+    {
+        s_loops = atoi(argv[1]);
+    }
+
+    bench("%d{%Y-%m-%d %H:%M:%S} [%rms]%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n");
+    bench("%d%T%p%T%m%n");
+    bench("%m%n");
+    return 0;
+}
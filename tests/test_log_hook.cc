@@ -0,0 +1,109 @@
+/**
+ * @file test_log_hook.cc
+ * @brief 开启hook的多线程调度器里写日志的测试
+ * @details 写日志时持有Appender的锁、线程局部的事件池和读区，期间如果hook把文件操作交给阻塞调用线程池，
+ *          协程让出后可能在另一个线程恢复，破坏这些线程局部的状态。这里用2个调度线程上的大量协程同时写文件日志和二进制日志，
+ *          Appender在调度器之外创建，检查不会崩溃或卡住、每个协程的日志都完整有序，并且写日志没有经过阻塞调用线程池。
+ *          部分日志的<<操作数里调用hook的usleep，检查计算操作数时hook仍然开启，协程让出而不是阻塞调度线程
+ * @version 0.1
+ * @date 2026-10-16
+ */
+
+#include "sylar/sylar.h"
+#include <fstream>
+#include <map>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 协程数
+static int s_fibers = 50;
+/// 每个协程写的日志条数
+static int s_lines = 2000;
+
+/**
+ * @brief 写日志表达式里的操作数，hook的usleep让出协程，之后可能在另一个线程上继续
+ */
+static int sleep_operand()
+{
+    SYLAR_ASSERT(sylar::is_hook_enable());
+    usleep(1000);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    if (argc > 2)
+    {
+        s_fibers = atoi(argv[1]);
+        s_lines  = atoi(argv[2]);
+    }
+    std::string text_file = "/tmp/test_log_hook_" + std::to_string(getpid()) + ".txt";
+    std::string bin_file  = "/tmp/test_log_hook_" + std::to_string(getpid()) + ".bin";
+
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("log_hook");
+    logger->setLevel(sylar::LogLevel::DEBUG);
+    logger->clearAppenders();
+    logger->addAppender(sylar::LogAppender::ptr(new sylar::FileLogAppender(text_file)));
+    logger->addAppender(sylar::LogAppender::ptr(new sylar::BinaryLogAppender(bin_file)));
+
+    sylar::BlockingPool *pool = sylar::BlockingPoolMgr::GetInstance();
+    uint64_t offloaded        = pool->getTaskCount() + pool->getRejectCount();
+    uint64_t begin            = sylar::GetCurrentMS();
+    {
+        sylar::IOManager iom(2, false, "log_hook");
+        for (int i = 0; i < s_fibers; ++i)
+        {
+            iom.schedule([logger, i]() {
+                for (int j = 0; j < s_lines; ++j)
+                {
+                    if (j % 500 == 250)
+                    {
+                        SYLAR_LOG_DEBUG(logger) << "fiber=" << i << " seq=" << j << " sleep=" << sleep_operand();
+                        continue;
+                    }
+                    SYLAR_LOG_DEBUG(logger) << "fiber=" << i << " seq=" << j;
+                    if (j % 100 == 99)
+                    {
+                        // 让出协程，之后可能在另一个线程上继续写
+                        sylar::IOManager::GetThis()->schedule(sylar::Fiber::GetThis());
+                        sylar::Fiber::GetThis()->yield();
+                    }
+                }
+            });
+        }
+    }
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    logger->clearAppenders();
+    SYLAR_ASSERT(pool->getTaskCount() + pool->getRejectCount() == offloaded);
+
+    // 二进制日志逐条校验：每个协程的序号连续
+    sylar::BinaryLogReader reader(bin_file);
+    SYLAR_ASSERT(reader.isOpen());
+    sylar::BinaryLogRecord rec;
+    std::map<int, int> next_seq;
+    uint64_t count = 0;
+    while (reader.next(rec))
+    {
+        int fiber = 0, seq = 0;
+        SYLAR_ASSERT(sscanf(rec.message.c_str(), "fiber=%d seq=%d", &fiber, &seq) == 2);
+        SYLAR_ASSERT(next_seq[fiber]++ == seq);
+        ++count;
+    }
+    SYLAR_ASSERT(!reader.isError());
+    SYLAR_ASSERT(count == (uint64_t)s_fibers * s_lines);
+
+    std::ifstream ifs(text_file);
+    std::string line;
+    uint64_t lines = 0;
+    while (std::getline(ifs, line))
+    {
+        ++lines;
+    }
+    SYLAR_ASSERT(lines == (uint64_t)s_fibers * s_lines);
+
+    SYLAR_LOG_INFO(g_logger) << "records=" << count << " used=" << used << "ms";
+    unlink(text_file.c_str());
+    unlink(bin_file.c_str());
+    return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file test_log_rate_limit.cc
+ * @brief 按调用点限流和采样的日志测试
+ * @details 多个线程在同一个调用点上以限流宏写日志，检查每秒写出的条数和丢弃条数的报告；
+ *          采样宏每n条写一条；通过logs配置在运行时修改限制；最后测试被丢弃和写出时每次调用的耗时
+ */
+
+#include "sylar/sylar.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief 只统计条数的Appender
+ */
+class CountLogAppender : public sylar::LogAppender {
+public:
+    CountLogAppender()
+        : LogAppender(sylar::LogFormatter::ptr(new sylar::LogFormatter)) {}
+
+    void log(sylar::LogEvent::ptr event) override
+    {
+        std::string content(event->getContentData(), event->getContentSize());
+        if (content.compare(0, 12, "[rate limit]") == 0)
+        {
+            ++m_reports;
+            m_reported += strtoull(content.c_str() + 24, nullptr, 10);
+        }
+        else
+        {
+            ++m_records;
+        }
+    }
+
+    std::string toYamlString() override { return ""; }
+
+    std::atomic<uint64_t> m_records{0};
+    std::atomic<uint64_t> m_reports{0};
+    std::atomic<uint64_t> m_reported{0};
+};
+
+static void rate_log(sylar::Logger::ptr logger, int i)
+{
+    SYLAR_LOG_RATE_INFO(logger, 100) << "rate " << i;
+}
+
+static void sample_log(sylar::Logger::ptr logger, int i)
+{
+    SYLAR_LOG_SAMPLE_INFO(logger, 10) << "sample " << i;
+}
+
+static void test_rate()
+{
+    std::shared_ptr<CountLogAppender> appender(new CountLogAppender);
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("rate");
+    logger->setLevel(sylar::LogLevel::INFO);
+    logger->addAppender(appender);
+
+    // 对齐到窗口开始，4个线程写2.5秒，覆盖3个窗口
+    while (sylar::GetElapsedMS() % 1000 > 10)
+    {
+        usleep(1000);
+    }
+    uint64_t begin = sylar::GetElapsedMS();
+    std::atomic<uint64_t> calls{0};
+    std::vector<sylar::Thread::ptr> thrs;
+    for (int i = 0; i < 4; ++i)
+    {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([logger, begin, &calls]() {
+            int n = 0;
+            while (sylar::GetElapsedMS() - begin < 2500)
+            {
+                rate_log(logger, n++);
+            }
+            calls += n;
+        }, "rate_" + std::to_string(i))));
+    }
+    for (auto &i : thrs)
+    {
+        i->join();
+    }
+    // 进入下一个窗口再写一条，报告最后一个窗口丢弃的条数
+    while (sylar::GetElapsedMS() - begin < 3100)
+    {
+        usleep(1000);
+    }
+    rate_log(logger, -1);
+    logger->delAppender(appender);
+
+    SYLAR_LOG_INFO(g_logger) << "rate calls=" << calls << " records=" << appender->m_records
+                             << " reports=" << appender->m_reports << " reported=" << appender->m_reported;
+    SYLAR_ASSERT(appender->m_records == 301);
+    SYLAR_ASSERT(appender->m_reports == 3);
+    SYLAR_ASSERT(appender->m_records + appender->m_reported == calls + 1);
+}
+
+static void test_sample()
+{
+    std::shared_ptr<CountLogAppender> appender(new CountLogAppender);
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("sample");
+    logger->setLevel(sylar::LogLevel::INFO);
+    logger->addAppender(appender);
+    for (int i = 0; i < 10000; ++i)
+    {
+        sample_log(logger, i);
+    }
+    logger->delAppender(appender);
+    SYLAR_LOG_INFO(g_logger) << "sample records=" << appender->m_records;
+    SYLAR_ASSERT(appender->m_records == 1000);
+}
+
+static void test_config()
+{
+    YAML::Node root = YAML::Load("logs:\n"
+                                 "  - name: rate_config\n"
+                                 "    level: info\n"
+                                 "    rate_limit: 5\n"
+                                 "    sample: 100\n");
+    sylar::Config::LoadFromYaml(root);
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("rate_config");
+    SYLAR_ASSERT(logger->getRateLimit() == 5);
+    SYLAR_ASSERT(logger->getSampleRate() == 100);
+
+    std::shared_ptr<CountLogAppender> appender(new CountLogAppender);
+    logger->addAppender(appender);
+    while (sylar::GetElapsedMS() % 1000 > 900)
+    {
+        usleep(1000);
+    }
+    for (int i = 0; i < 1000; ++i)
+    {
+        SYLAR_LOG_RATE_INFO(logger, 100) << "rate " << i;
+    }
+    SYLAR_ASSERT(appender->m_records == 5);
+    appender->m_records = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        SYLAR_LOG_SAMPLE_INFO(logger, 10) << "sample " << i;
+    }
+    SYLAR_ASSERT(appender->m_records == 10);
+    logger->delAppender(appender);
+
+    // 修改配置
+    root = YAML::Load("logs:\n"
+                      "  - name: rate_config\n"
+                      "    level: info\n"
+                      "    rate_limit: 50\n");
+    sylar::Config::LoadFromYaml(root);
+    SYLAR_ASSERT(logger->getRateLimit() == 50);
+    SYLAR_ASSERT(logger->getSampleRate() == 0);
+    SYLAR_LOG_INFO(g_logger) << "config ok: " << logger->toYamlString();
+}
+
+static void bench()
+{
+    std::shared_ptr<CountLogAppender> appender(new CountLogAppender);
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("rate_bench");
+    logger->setLevel(sylar::LogLevel::INFO);
+    logger->addAppender(appender);
+
+    const int loops = 1000000;
+    uint64_t begin = sylar::GetCurrentUS();
+    for (int i = 0; i < loops; ++i)
+    {
+        rate_log(logger, i);
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "rate limited ns/call=" << (double)used * 1000 / loops
+                             << " records=" << appender->m_records;
+
+    begin = sylar::GetCurrentUS();
+    for (int i = 0; i < loops; ++i)
+    {
+        SYLAR_LOG_INFO(logger) << "plain " << i;
+    }
+    used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "plain ns/call=" << (double)used * 1000 / loops;
+    logger->delAppender(appender);
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+
+    test_sample();
+    test_rate();
+    test_config();
+    bench();
+    return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file test_logger_bench.cc
+ * @brief 日志器多线程写日志和查找日志器的性能测试
+ * @details 多个线程同时向同一个日志器写日志（Appender只格式化不输出），同时可选一个线程不断增删Appender、替换格式器；
+ *          另外测试多个线程通过SYLAR_LOG_NAME查找日志器的耗时
+ */
+
+#include "sylar/sylar.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 每个线程写的日志条数
+static int s_lines = 200000;
+
+/**
+ * @brief 只格式化不输出的Appender
+ */
+class NullLogAppender : public sylar::LogAppender {
+public:
+    NullLogAppender()
+        : LogAppender(sylar::LogFormatter::ptr(new sylar::LogFormatter("%m%n"))) {}
+
+    void log(sylar::LogEvent::ptr event) override
+    {
+        static thread_local std::string t_buf;
+        t_buf.clear();
+        activeFormatter()->format(t_buf, event);
+        m_records.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::string toYamlString() override { return ""; }
+
+    std::atomic<uint64_t> m_records{0};
+};
+
+static void run_threads(int threads, const std::function<void()> &cb)
+{
+    std::vector<sylar::Thread::ptr> thrs;
+    for (int i = 0; i < threads; ++i)
+    {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread(cb, "bench_" + std::to_string(i))));
+    }
+    for (auto &i : thrs)
+    {
+        i->join();
+    }
+}
+
+static void bench_log(int threads, bool churn)
+{
+    std::shared_ptr<NullLogAppender> appender(new NullLogAppender);
+    sylar::Logger::ptr logger(new sylar::Logger("bench"));
+    logger->addAppender(appender);
+
+    std::atomic<bool> stop{false};
+    sylar::Thread::ptr churner;
+    if (churn)
+    {
+        // 不断增删另一个Appender，迫使写日志的线程刷新快照；同时替换格式器，旧的格式器在写日志的线程用完之后释放
+        churner.reset(new sylar::Thread([logger, appender, &stop]() {
+            sylar::LogAppender::ptr other(new NullLogAppender);
+            for (int i = 0; !stop; ++i)
+            {
+                logger->addAppender(other);
+                logger->delAppender(other);
+                appender->setFormatter(sylar::LogFormatter::ptr(new sylar::LogFormatter(i % 2 ? "%m%n" : "%p %m%n")));
+                usleep(100);
+            }
+        }, "churn"));
+    }
+
+    uint64_t begin = sylar::GetCurrentUS();
+    run_threads(threads, [logger]() {
+        for (int i = 0; i < s_lines; ++i)
+        {
+            SYLAR_LOG_INFO(logger) << "bench " << i;
+        }
+    });
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    stop = true;
+    if (churner)
+    {
+        churner->join();
+    }
+    SYLAR_ASSERT(appender->m_records == (uint64_t)threads * s_lines);
+    SYLAR_LOG_INFO(g_logger) << "log threads=" << threads << " churn=" << churn
+                             << " records/s=" << appender->m_records * 1000000 / used;
+}
+
+static void bench_lookup(int threads)
+{
+    for (int i = 0; i < 32; ++i)
+    {
+        SYLAR_LOG_NAME("lookup_" + std::to_string(i));
+    }
+    std::vector<std::string> names;
+    for (int i = 0; i < 32; ++i)
+    {
+        names.push_back("lookup_" + std::to_string(i));
+    }
+
+    uint64_t begin = sylar::GetCurrentUS();
+    run_threads(threads, [&names]() {
+        for (int i = 0; i < s_lines; ++i)
+        {
+            SYLAR_ASSERT(SYLAR_LOG_NAME(names[i % names.size()]));
+        }
+    });
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "getLogger threads=" << threads
+                             << " ns/lookup=" << (double)used * 1000 / s_lines;
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    if (argc > 1)
+    {
+        s_lines = atoi(argv[1]);
+    }
+
+    for (int threads = 1; threads <= 4; threads *= 2)
+    {
+        bench_log(threads, false);
+        bench_log(threads, true);
+    }
+    for (int threads = 1; threads <= 4; threads *= 2)
+    {
+        bench_lookup(threads);
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * @file test_rotating_log.cc
+ * @brief 按大小和时间切分的日志文件测试
+ * @details 按大小切分时检查保留的旧文件数、文件末尾没有多余的'\0'以及日志按顺序连续；
+ *          按时间切分时检查每秒切分一次；最后对比FileLogAppender和RotatingFileLogAppender每条日志的耗时
+ */
+
+#include "sylar/sylar.h"
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 日志条数
+static int s_lines = 200000;
+
+/**
+ * @brief 等刷盘线程执行完之前投递的任务
+ */
+static void wait_flush_thread()
+{
+    sylar::Semaphore sem;
+    sylar::AsyncLogWriter::GetInstance()->post([&sem]() { sem.notify(); });
+    sem.wait();
+}
+
+static std::string read_file(const std::string &file)
+{
+    std::ifstream ifs(file);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static bool file_exists(const std::string &file)
+{
+    struct stat st;
+    return stat(file.c_str(), &st) == 0;
+}
+
+static void remove_files(const std::string &file, uint32_t max_files)
+{
+    unlink(file.c_str());
+    for (uint32_t i = 1; i <= max_files + 1; ++i)
+    {
+        unlink((file + "." + std::to_string(i)).c_str());
+    }
+}
+
+static sylar::Logger::ptr make_logger(const std::string &name, sylar::LogAppender::ptr appender)
+{
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME(name);
+    logger->setLevel(sylar::LogLevel::DEBUG);
+    logger->clearAppenders();
+    appender->setFormatter(sylar::LogFormatter::ptr(new sylar::LogFormatter("%m%n")));
+    logger->addAppender(appender);
+    return logger;
+}
+
+static void test_size()
+{
+    const std::string file = "rotating_size.log";
+    const uint64_t max_size = 64 * 1024;
+    const uint32_t max_files = 3;
+    const int lines = 20000;
+    remove_files(file, max_files);
+
+    sylar::RotatingFileLogAppender::ptr appender(new sylar::RotatingFileLogAppender(file, max_size, 0, max_files));
+    sylar::Logger::ptr logger = make_logger("rotating_size", appender);
+    for (int i = 0; i < lines; ++i)
+    {
+        SYLAR_LOG_INFO(logger) << "seq=" << i << " payload=0123456789abcdef";
+        // 每个文件写几十毫秒，给刷盘线程留出准备下一段和切分的时间
+        if (i % 100 == 99)
+        {
+            usleep(1000);
+        }
+    }
+    uint64_t rotates = appender->getRotateCount();
+    uint64_t sync_maps = appender->getSyncMapCount();
+    logger->clearAppenders();
+    appender.reset();
+    // 刷盘线程上的任务还持有appender，执行完后appender才析构
+    wait_flush_thread();
+
+    SYLAR_ASSERT(rotates >= max_files);
+    for (uint32_t i = 1; i <= max_files; ++i)
+    {
+        SYLAR_ASSERT(file_exists(file + "." + std::to_string(i)));
+    }
+    SYLAR_ASSERT(!file_exists(file + "." + std::to_string(max_files + 1)));
+
+    // 从最旧的文件读到当前文件，日志应该连续并以最后一条结束
+    std::string content;
+    for (uint32_t i = max_files; i > 0; --i)
+    {
+        std::string part = read_file(file + "." + std::to_string(i));
+        SYLAR_ASSERT(part.find('\0') == std::string::npos);
+        SYLAR_ASSERT(part.size() < max_size * 2);
+        content += part;
+    }
+    std::string part = read_file(file);
+    SYLAR_ASSERT(part.find('\0') == std::string::npos);
+    content += part;
+
+    std::istringstream iss(content);
+    std::string line;
+    int expect = -1;
+    while (std::getline(iss, line))
+    {
+        int seq = atoi(line.c_str() + 4);
+        SYLAR_ASSERT(line.compare(0, 4, "seq=") == 0);
+        SYLAR_ASSERT(expect == -1 || seq == expect);
+        expect = seq + 1;
+    }
+    SYLAR_ASSERT(expect == lines);
+    SYLAR_LOG_INFO(g_logger) << "size rotation ok rotates=" << rotates << " sync_maps=" << sync_maps
+                             << " kept_bytes=" << content.size();
+    remove_files(file, max_files);
+}
+
+static void test_interval()
+{
+    const std::string file = "rotating_time.log";
+    remove_files(file, 7);
+
+    sylar::RotatingFileLogAppender::ptr appender(new sylar::RotatingFileLogAppender(file, 0, 1, 7));
+    sylar::Logger::ptr logger = make_logger("rotating_time", appender);
+    uint64_t begin = sylar::GetCurrentMS();
+    int i = 0;
+    while (sylar::GetCurrentMS() - begin < 3500)
+    {
+        SYLAR_LOG_INFO(logger) << "tick=" << i++;
+        usleep(10 * 1000);
+    }
+    uint64_t rotates = appender->getRotateCount();
+    logger->clearAppenders();
+    appender.reset();
+    wait_flush_thread();
+
+    SYLAR_ASSERT(rotates >= 3 && rotates <= 4);
+    SYLAR_ASSERT(file_exists(file + ".3"));
+    SYLAR_LOG_INFO(g_logger) << "time rotation ok rotates=" << rotates;
+    remove_files(file, 7);
+}
+
+static void bench(const std::string &name, sylar::LogAppender::ptr appender)
+{
+    sylar::Logger::ptr logger = make_logger("rotating_bench_" + name, appender);
+    uint64_t begin = sylar::GetCurrentUS();
+    for (int i = 0; i < s_lines; ++i)
+    {
+        SYLAR_LOG_INFO(logger) << "seq=" << i << " value=" << i * 3 << " some text to make the line longer";
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    logger->clearAppenders();
+    SYLAR_LOG_INFO(g_logger) << name << " lines=" << s_lines << " used=" << used / 1000 << "ms"
+                             << " ns/line=" << used * 1000 / s_lines;
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    if (argc > 1)
+    {
+        s_lines = atoi(argv[1]);
+    }
+
+    test_size();
+    test_interval();
+
+    bench("file", sylar::LogAppender::ptr(new sylar::FileLogAppender("rotating_bench_file.log")));
+    bench("rotating", sylar::LogAppender::ptr(new sylar::RotatingFileLogAppender("rotating_bench_mmap.log", 64 * 1024 * 1024, 0, 1)));
+    wait_flush_thread();
+    unlink("rotating_bench_file.log");
+    remove_files("rotating_bench_mmap.log", 1);
+    return 0;
+}
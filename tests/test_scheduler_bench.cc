@@ -0,0 +1,94 @@
+/**
+ * @file test_scheduler_bench.cc
+ * @brief 协程调度器吞吐量测试
+ * @details 每个种子任务在调度线程内继续派生子任务，子任务进入本地队列，空闲线程通过窃取分担负载，
+ *          观察吞吐量随线程数的变化；batch模式下子任务通过schedule(begin, end)成批提交
+ */
+
+#include "sylar/sylar.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 每个种子任务派生的子任务数
+static const int CHILDREN = 20000;
+
+/// 种子任务数
+static const int SEEDS = 16;
+
+static std::atomic<uint64_t> s_done{0};
+
+static void child() 
+{
+    // 模拟少量计算
+    volatile uint64_t sum = 0;
+    for (int i = 0; i < 200; ++i) 
+    {
+        sum += i;
+    }
+    ++s_done;
+}
+
+static void seed() 
+{
+    for (int i = 0; i < CHILDREN; ++i) 
+    {
+        sylar::Scheduler::GetThis()->schedule(&child);
+    }
+}
+
+/// 每批提交的子任务数
+static const int BATCH = 64;
+
+static void seed_batch() 
+{
+    std::vector<std::function<void()>> cbs;
+    for (int i = 0; i < CHILDREN; ++i) 
+    {
+        cbs.push_back(&child);
+        if (cbs.size() == BATCH) 
+        {
+            sylar::Scheduler::GetThis()->schedule(cbs.begin(), cbs.end());
+            cbs.clear();
+        }
+    }
+    sylar::Scheduler::GetThis()->schedule(cbs.begin(), cbs.end());
+}
+
+static void bench(size_t threads, bool batch) 
+{
+    s_done = 0;
+    uint64_t batches = 0;
+    uint64_t batch_tasks = 0;
+    uint64_t begin = sylar::GetCurrentMS();
+    {
+        sylar::Scheduler sc(threads, false, "bench");
+        sc.start();
+        for (int i = 0; i < SEEDS; ++i) 
+        {
+            sc.schedule(batch ? &seed_batch : &seed);
+        }
+        sc.stop();
+        batches = sc.getBatchCount();
+        batch_tasks = sc.getBatchTaskCount();
+    }
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << (batch ? "batch " : "single ")
+                             << "threads=" << threads << " tasks=" << s_done
+                             << " used=" << used << "ms"
+                             << " tasks/s=" << (used ? s_done * 1000 / used : 0)
+                             << " tasks/batch=" << (batches ? batch_tasks / batches : 0);
+}
+
+int main(int argc, char *argv[]) 
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+    for (size_t threads = 1; threads <= 8; threads *= 2) 
+    {
+        bench(threads, false);
+        bench(threads, true);
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+/**
+ * @file test_sendfile.cc
+ * @brief hook的sendfile/splice/tee/copy_file_range测试
+ * @details 在同一个调度线程上用SocketStream::sendFile发送一个大文件，同时由另一个协程接收并校验，
+ *          发送缓冲区满时sendfile必须让出协程才能完成；再检查发送超时、socket到管道的splice、tee和copy_file_range
+ * @version 0.1
+ * @date 2026-10-16
+ */
+
+#include "sylar/sylar.h"
+#include "sylar/streams/socket_stream.h"
+#include <string.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 测试文件大小
+static size_t s_file_size = 16 * 1024 * 1024;
+
+static std::string s_path = "/tmp/test_sendfile_" + std::to_string(getpid());
+
+static inline char pattern(uint64_t i)
+{
+    return (char)(i * 31 % 251);
+}
+
+static void make_file()
+{
+    int fd = open(s_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    SYLAR_ASSERT(fd >= 0);
+    std::string buf(1024 * 1024, 0);
+    for (size_t off = 0; off < s_file_size; off += buf.size())
+    {
+        for (size_t i = 0; i < buf.size(); ++i)
+        {
+            buf[i] = pattern(off + i);
+        }
+        SYLAR_ASSERT(write(fd, &buf[0], buf.size()) == (ssize_t)buf.size());
+    }
+    close(fd);
+}
+
+/**
+ * @brief 建立一对回环tcp连接
+ */
+static void make_pair(sylar::Socket::ptr &server, sylar::Socket::ptr &client)
+{
+    sylar::Socket::ptr listener = sylar::Socket::CreateTCPSocket();
+    SYLAR_ASSERT(listener->bind(sylar::Address::LookupAny("127.0.0.1:0")));
+    SYLAR_ASSERT(listener->listen());
+    // 绑定的是0端口，从内核取实际分配的端口
+    sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    SYLAR_ASSERT(getsockname(listener->getSocket(), (sockaddr *)&addr, &addrlen) == 0);
+    client = sylar::Socket::CreateTCPSocket();
+    SYLAR_ASSERT(client->connect(sylar::Address::Create((sockaddr *)&addr, addrlen)));
+    server = listener->accept();
+    SYLAR_ASSERT(server);
+}
+
+static void test_send_file()
+{
+    sylar::Socket::ptr server, client;
+    make_pair(server, client);
+    int sndbuf = 64 * 1024;
+    server->setOption(SOL_SOCKET, SO_SNDBUF, sndbuf);
+
+    static const uint64_t OFFSET = 1000;
+    uint64_t len = s_file_size - OFFSET;
+    sylar::IOManager::GetThis()->schedule([server, len]() {
+        int fd = open(s_path.c_str(), O_RDONLY);
+        SYLAR_ASSERT(fd >= 0);
+        sylar::SocketStream stream(server, false);
+        uint64_t begin = sylar::GetCurrentUS();
+        int64_t rt     = stream.sendFile(fd, OFFSET, len + 4096);
+        uint64_t used  = sylar::GetCurrentUS() - begin;
+        SYLAR_LOG_INFO(g_logger) << "sendFile rt=" << rt << " used=" << used << "us "
+                                 << (double)rt / used << "MB/s";
+        // 文件比请求的长度短，返回实际发送的字节数
+        SYLAR_ASSERT(rt == (int64_t)len);
+        // 不改变fd自己的读写位置
+        SYLAR_ASSERT(lseek(fd, 0, SEEK_CUR) == 0);
+        close(fd);
+        server->close();
+    });
+
+    std::string buf(256 * 1024, 0);
+    uint64_t received = 0;
+    while (true)
+    {
+        int rt = client->recv(&buf[0], buf.size());
+        SYLAR_ASSERT(rt >= 0);
+        if (rt == 0)
+        {
+            break;
+        }
+        for (int i = 0; i < rt; ++i)
+        {
+            SYLAR_ASSERT(buf[i] == pattern(OFFSET + received + i));
+        }
+        received += rt;
+    }
+    SYLAR_ASSERT(received == len);
+}
+
+static void test_send_file_timeout()
+{
+    sylar::Socket::ptr server, client;
+    make_pair(server, client);
+    server->setSendTimeout(50);
+
+    int fd = open(s_path.c_str(), O_RDONLY);
+    SYLAR_ASSERT(fd >= 0);
+    sylar::SocketStream stream(server, false);
+    uint64_t begin = sylar::GetCurrentMS();
+    // 对端不读，发送缓冲区满之后等待可写超时
+    int64_t rt     = stream.sendFile(fd, 0, s_file_size);
+    uint64_t used  = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "sendFile timeout rt=" << rt << " errno=" << errno << " used=" << used << "ms";
+    SYLAR_ASSERT(rt == -1 && errno == ETIMEDOUT && used >= 40);
+    close(fd);
+}
+
+static void test_splice_tee()
+{
+    sylar::Socket::ptr server, client;
+    make_pair(server, client);
+    int p1[2], p2[2];
+    SYLAR_ASSERT(pipe(p1) == 0 && pipe(p2) == 0);
+
+    // splice先于数据到达，在socket可读时被唤醒
+    sylar::IOManager::GetThis()->schedule([client]() {
+        usleep(10 * 1000);
+        client->send("hello", 5);
+    });
+    SYLAR_ASSERT(splice(server->getSocket(), nullptr, p1[1], nullptr, 5, 0) == 5);
+    SYLAR_ASSERT(tee(p1[0], p2[1], 5, 0) == 5);
+
+    char buf[8] = {0};
+    SYLAR_ASSERT(read(p1[0], buf, sizeof(buf)) == 5 && memcmp(buf, "hello", 5) == 0);
+    memset(buf, 0, sizeof(buf));
+    SYLAR_ASSERT(read(p2[0], buf, sizeof(buf)) == 5 && memcmp(buf, "hello", 5) == 0);
+
+    // 管道到socket
+    SYLAR_ASSERT(write(p1[1], "world", 5) == 5);
+    SYLAR_ASSERT(splice(p1[0], nullptr, server->getSocket(), nullptr, 5, 0) == 5);
+    SYLAR_ASSERT(client->recv(buf, 5) == 5 && memcmp(buf, "world", 5) == 0);
+
+    close(p1[0]);
+    close(p1[1]);
+    close(p2[0]);
+    close(p2[1]);
+}
+
+static void test_copy_file_range()
+{
+    std::string copy = s_path + ".copy";
+    int in  = open(s_path.c_str(), O_RDONLY);
+    int out = open(copy.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    SYLAR_ASSERT(in >= 0 && out >= 0);
+    uint64_t before = sylar::BlockingPoolMgr::GetInstance()->getTaskCount();
+    loff_t off_in   = 0;
+    ssize_t total   = 0;
+    while ((size_t)total < s_file_size)
+    {
+        ssize_t rt = copy_file_range(in, &off_in, out, nullptr, s_file_size - total, 0);
+        SYLAR_ASSERT(rt > 0);
+        total += rt;
+    }
+    SYLAR_ASSERT(sylar::BlockingPoolMgr::GetInstance()->getTaskCount() > before);
+    close(in);
+    close(out);
+
+    struct stat st;
+    SYLAR_ASSERT(stat(copy.c_str(), &st) == 0 && (size_t)st.st_size == s_file_size);
+    unlink(copy.c_str());
+}
+
+static void run()
+{
+    make_file();
+    test_send_file();
+    test_send_file_timeout();
+    test_splice_tee();
+    test_copy_file_range();
+    unlink(s_path.c_str());
+    SYLAR_LOG_INFO(g_logger) << "all ok";
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    sylar::IOManager iom(1, false, "sendfile");
+    iom.schedule(&run);
+    return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file test_tickle_bench.cc
+ * @brief IOManager唤醒开销测试
+ * @details 统计每个调度任务平均产生多少次tickle和写eventfd的系统调用，
+ *          分别测试从调度器外部添加任务和添加指定线程执行的任务两种情况
+ */
+
+#include "sylar/sylar.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 任务数
+static const int TASKS = 200000;
+
+static std::atomic<uint64_t> s_done{0};
+
+static void task() 
+{
+    ++s_done;
+}
+
+static void report(const char *name, sylar::IOManager &iom, uint64_t used) 
+{
+    SYLAR_LOG_INFO(g_logger) << name << " tasks=" << s_done << " used=" << used << "ms"
+                             << " tickles=" << iom.getTickleCount()
+                             << " eventfd_writes=" << iom.getWakeupWriteCount()
+                             << " writes/task=" << (double)iom.getWakeupWriteCount() / TASKS;
+}
+
+/**
+ * @brief 调度器之外的线程逐个添加任务
+ */
+static void bench_external(size_t threads) 
+{
+    s_done = 0;
+    uint64_t begin = sylar::GetCurrentMS();
+    sylar::IOManager iom(threads, false, "external");
+    for (int i = 0; i < TASKS; ++i) 
+    {
+        iom.schedule(&task);
+    }
+    iom.stop();
+    report("external", iom, sylar::GetCurrentMS() - begin);
+}
+
+/**
+ * @brief 调度线程内添加指定在另一个线程上执行的任务
+ */
+static void bench_pinned(size_t threads) 
+{
+    s_done = 0;
+    uint64_t begin = sylar::GetCurrentMS();
+    sylar::IOManager iom(threads, false, "pinned");
+    std::atomic<int> target{-1};
+    iom.schedule([&target]() { target = sylar::GetThreadId(); });
+    while (target == -1) 
+    {
+        usleep(1000);
+    }
+    iom.schedule([&iom, &target]() {
+        for (int i = 0; i < TASKS; ++i) 
+        {
+            iom.schedule(&task, target);
+        }
+    });
+    iom.stop();
+    report("pinned", iom, sylar::GetCurrentMS() - begin);
+}
+
+int main(int argc, char *argv[]) 
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+
+    for (size_t threads = 1; threads <= 4; threads *= 2) 
+    {
+        SYLAR_LOG_INFO(g_logger) << "threads=" << threads;
+        bench_external(threads);
+        bench_pinned(threads);
+    }
+    return 0;
+}
@@ -6,6 +6,7 @@
  */
 
 #include "sylar/sylar.h"
+#include <time.h>
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -48,6 +49,45 @@ void test_timer()
     });
 }
 
+/**
+ * @brief 任务运行很久之后缓存的时钟最多落后一个时钟节拍，这时添加的定时器到期时间从添加时算起，而不是从本轮循环开始算起
+ */
+void test_deadline() 
+{
+    // 缓存的时钟最多落后一个粗粒度时钟节拍
+    struct timespec res = {0};
+    clock_getres(CLOCK_MONOTONIC_COARSE, &res);
+    uint64_t tick = (res.tv_sec * 1000000000ul + res.tv_nsec + 999999) / 1000000;
+
+    sylar::IOManager iom(1, false, "deadline");
+    iom.schedule([&iom, tick]() {
+        uint64_t begin = sylar::GetElapsedMS();
+        while(sylar::GetElapsedMS() - begin < 200);
+        uint64_t add = sylar::GetElapsedMS();
+        uint64_t lag = add - sylar::GetCachedElapsedMS();
+        SYLAR_LOG_INFO(g_logger) << "cached clock lag " << lag << "ms after a 200ms task, tick=" << tick << "ms";
+        SYLAR_ASSERT(lag <= tick);
+        iom.addTimer(100, [add, tick]() {
+            uint64_t used = sylar::GetElapsedMS() - add;
+            SYLAR_LOG_INFO(g_logger) << "100ms timer fired after " << used << "ms";
+            SYLAR_ASSERT(used + tick >= 100);
+        });
+    });
+}
+
+/**
+ * @brief use_caller的调度器停止之后，主线程的缓存时钟不再停在调度器退出的时刻
+ */
+void test_clock_after_stop() 
+{
+    uint64_t begin = sylar::GetCachedElapsedMS();
+    uint64_t start = sylar::GetElapsedMS();
+    while(sylar::GetElapsedMS() - start < 20);
+    uint64_t used = sylar::GetCachedElapsedMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "cached clock advanced " << used << "ms";
+    SYLAR_ASSERT(used >= 20);
+}
+
 int main(int argc, char *argv[]) 
 {
     sylar::EnvMgr::GetInstance()->init(argc, argv);
@@ -55,6 +95,8 @@ int main(int argc, char *argv[])
     SYLAR_LOG_INFO(g_logger) << "test begin!";
     
     test_timer();
+    test_clock_after_stop();
+    test_deadline();
 
     SYLAR_LOG_INFO(g_logger) << "test end!";
 
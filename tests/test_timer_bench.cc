@@ -0,0 +1,88 @@
+/**
+ * @file test_timer_bench.cc
+ * @brief 定时器管理器性能测试
+ * @details 先放入100万个分布在1分钟内的定时器，再在此基础上测试添加+取消（hook中带超时的读写就是这种用法）、
+ *          refresh、取消和到期收集的耗时
+ */
+
+#include "sylar/sylar.h"
+#include <stdlib.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/// 定时器数量
+static int s_count = 1000000;
+
+/**
+ * @brief 不依赖IOManager的定时器管理器
+ */
+class BenchTimerManager : public sylar::TimerManager {
+protected:
+    void onTimerInsertedAtFront(size_t wheel) override {}
+};
+
+static void report(const char *name, uint64_t begin_us, uint64_t ops)
+{
+    uint64_t used = sylar::GetCurrentUS() - begin_us;
+    SYLAR_LOG_INFO(g_logger) << name << " ops=" << ops << " used=" << used / 1000 << "ms"
+                             << " ns/op=" << (ops ? used * 1000 / ops : 0);
+}
+
+int main(int argc, char *argv[])
+{
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    if (argc > 1)
+    {
+        s_count = atoi(argv[1]);
+    }
+
+    BenchTimerManager mgr;
+    std::vector<sylar::Timer::ptr> timers;
+    timers.reserve(s_count);
+    srand(1);
+
+    uint64_t begin = sylar::GetCurrentUS();
+    for (int i = 0; i < s_count; ++i)
+    {
+        timers.push_back(mgr.addTimer(1000 + rand() % 60000, []() {}));
+    }
+    report("add", begin, s_count);
+
+    std::shared_ptr<int> cond(new int(0));
+    begin = sylar::GetCurrentUS();
+    for (int i = 0; i < s_count; ++i)
+    {
+        sylar::Timer::ptr timer = mgr.addConditionTimer(3000, []() {}, cond);
+        timer->cancel();
+    }
+    report("add+cancel", begin, s_count);
+
+    begin = sylar::GetCurrentUS();
+    for (auto &i : timers)
+    {
+        i->refresh();
+    }
+    report("refresh", begin, s_count);
+
+    begin = sylar::GetCurrentUS();
+    for (auto &i : timers)
+    {
+        i->cancel();
+    }
+    report("cancel", begin, s_count);
+    timers.clear();
+
+    // 到期：100万个定时器分布在100ms内，等它们全部到期后一次收集
+    for (int i = 0; i < s_count; ++i)
+    {
+        mgr.addTimer(i % 100, []() {});
+    }
+    usleep(150 * 1000);
+    std::vector<std::function<void()> > cbs;
+    begin = sylar::GetCurrentUS();
+    mgr.listExpiredCb(cbs);
+    report("expire", begin, cbs.size());
+    SYLAR_ASSERT((int)cbs.size() == s_count);
+    SYLAR_ASSERT(!mgr.hasTimer());
+    return 0;
+}
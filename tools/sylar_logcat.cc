@@ -0,0 +1,100 @@
+/**
+ * @file sylar_logcat.cc
+ * @brief 二进制日志解码工具
+ * @details 读取BinaryLogAppender写的文件，按条件过滤后用LogFormatter格式化输出
+ * 
+ * 用法：sylar-logcat [-l 级别] [-c 日志器名称] [-t 线程id] [-g 消息包含的字符串] [-p 输出格式] 文件...
+ */
+
+#include "sylar/log.h"
+#include <unistd.h>
+#include <stdlib.h>
+
+static void usage(const char *prog)
+{
+    std::cerr << "usage: " << prog << " [-l level] [-c logger] [-t thread_id] [-g text] [-p pattern] file..." << std::endl
+              << "  -l level     only show records at this level or more severe, e.g. warn" << std::endl
+              << "  -c logger    only show records of this logger" << std::endl
+              << "  -t thread_id only show records of this thread" << std::endl
+              << "  -g text      only show records whose message contains text" << std::endl
+              << "  -p pattern   output pattern, same as LogFormatter" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    sylar::LogLevel::Level level = sylar::LogLevel::NOTSET;
+    std::string logger;
+    std::string text;
+    std::string pattern = "%d{%Y-%m-%d %H:%M:%S} [%rms]%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+    int64_t thread_id = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:c:t:g:p:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            level = sylar::LogLevel::FromString(optarg);
+            break;
+        case 'c':
+            logger = optarg;
+            break;
+        case 't':
+            thread_id = atoll(optarg);
+            break;
+        case 'g':
+            text = optarg;
+            break;
+        case 'p':
+            pattern = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    sylar::LogFormatter formatter(pattern);
+    if (formatter.isError())
+    {
+        return 1;
+    }
+
+    int rt = 0;
+    sylar::BinaryLogRecord rec;
+    for (int i = optind; i < argc; ++i)
+    {
+        sylar::BinaryLogReader reader(argv[i]);
+        if (!reader.isOpen())
+        {
+            std::cerr << argv[i] << ": not a binary log file" << std::endl;
+            rt = 1;
+            continue;
+        }
+        while (reader.next(rec))
+        {
+            if (rec.level > level || (!logger.empty() && rec.loggerName != logger)
+                    || (thread_id >= 0 && rec.threadId != (uint64_t)thread_id)
+                    || (!text.empty() && rec.message.find(text) == std::string::npos))
+            {
+                continue;
+            }
+            sylar::LogEvent::ptr event(new sylar::LogEvent(rec.loggerName, rec.level, rec.file.c_str(), rec.line,
+                                                           rec.elapse, rec.threadId, rec.fiberId, rec.timeMs / 1000,
+                                                           rec.threadName));
+            event->getSS().write(rec.message.data(), rec.message.size());
+            formatter.format(std::cout, event);
+        }
+        if (reader.isError())
+        {
+            std::cerr << argv[i] << ": truncated or corrupt record" << std::endl;
+            rt = 1;
+        }
+    }
+    return rt;
+}